@@ -1,6 +1,9 @@
 #ifndef __CAMERADEVICE_H__
 #define __CAMERADEVICE_H__
 
+#include <stdio.h>
+#include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -20,7 +23,22 @@
 #include <CoreFoundation/CFNumber.h>
 #endif
 
+#ifdef __APPLE__
 #include "MacFrameCapture.h"
+#endif
+#ifdef __linux__
+#include "V4L2Capture.h"
+#endif
+#include "SyntheticCapture.h"
+#include "ConvertCapture.h"
+#ifdef PANACAST_MJPEG_DECODE
+#include "DecodeCapture.h"
+#endif
+#include "FrameBroadcaster.h"
+#include "FrameTensor.h"
+#ifndef _WIN32
+#include "ReplayCapture.h"
+#endif
 
 //#include "Logger.h" // FIXME
 
@@ -73,6 +91,14 @@ class CameraDeviceInterface {
         virtual bool getProperty(PropertyType t, Property& prop) = 0;
         virtual bool setProperty(PropertyType p, int value) = 0; 
         virtual bool sendCommand(CommandInfo& info) = 0;
+        // current values of several properties, backends that can read them in one request override this
+        virtual bool getProperties(const std::vector<PropertyType>& types, std::vector<Property>& props) {
+            props.resize(types.size());
+            for (size_t k = 0; k < types.size(); k++) {
+                if (!getProperty(types[k], props[k])) return false;
+            }
+            return true;
+        }
         virtual ~CameraDeviceInterface() = default;
 };
 
@@ -89,10 +115,39 @@ class WindowsCameraDevice : public CameraDeviceInterface {
 class LinuxCameraDevice : public CameraDeviceInterface {
     public:
         LinuxCameraDevice(const std::string& prop);
+        // takes ownership of transport, tests pass a fake control endpoint
+        LinuxCameraDevice(V4L2Device * transport, const std::string& devicePath);
+        virtual ~LinuxCameraDevice();
         bool getProperty(PropertyType t, Property& prop);
+        bool getProperties(const std::vector<PropertyType>& types, std::vector<Property>& props);
         bool setProperty(PropertyType p, int value);
         bool sendCommand(CommandInfo& info);
         static bool getJabraDevices(std::vector<std::string>&);
+    private:
+        // static per control, read once with VIDIOC_QUERYCTRL
+        struct ControlRange {
+            bool supported;
+            int min;
+            int max;
+            int step;
+            int def;
+            bool readOnly;
+        };
+        // extension unit control, GET_LEN/GET_INFO and the static GET_* answers
+        struct XUControl {
+            uint16_t length;
+            uint8_t info;
+            std::map<uint8_t, std::vector<unsigned char> > statics;
+        };
+        bool loadRanges();
+        XUControl * getXUControl(uint8_t unit, uint8_t selector);
+        bool xuQuery(uint8_t unit, uint8_t selector, uint8_t query, std::vector<unsigned char>& data);
+
+        std::unique_ptr<V4L2Device> transport;
+        std::string mDeviceName;
+        bool rangesLoaded;
+        ControlRange ranges[WhiteBalance + 1];
+        std::map<uint16_t, XUControl> xuControls;
 };
 #elif __APPLE__
 class MacCameraDevice : public CameraDeviceInterface {
@@ -154,7 +209,61 @@ class CameraStreamInterface {
             height = _height;
             format = _format;
             fps = _fps;
+            ringDepth = FRAME_RING_DEFAULT_DEPTH;
+            outputWidth = 0;
+            outputHeight = 0;
+            convertThreads = 0;
+            decodeThreads = 0;
             cameraOpened = false;
+            device = NULL;
+        }
+
+        // Hand frames out in another format than the device is opened with, e.g. "BGR" for
+        // a "YUYV" stream or "NV12" from a camera that only has YUYV (see FrameConvert.h for
+        // the pairs). If the device cannot deliver the stream's format either, openStream
+        // converts from one it can. Call before openStream; "" delivers frames as the device
+        // sends them.
+        void setOutputFormat(std::string _outputFormat) {
+            outputFormat = _outputFormat;
+        }
+
+        // Hand frames out scaled down to width x height, e.g. 640x360 out of a 4K stream for
+        // a preview, so small consumers never touch full resolution frames. Scaled in the
+        // device's format before any conversion. Call before openStream; 0 x 0 keeps the size.
+        void setOutputSize(unsigned _width, unsigned _height) {
+            outputWidth = _width;
+            outputHeight = _height;
+        }
+
+        // threads that convert each frame to the output format, 0 for one per core up to
+        // FRAME_WORKERS_MAX. Takes effect at the next openStream.
+        void setConvertThreads(unsigned threads) {
+            convertThreads = threads;
+        }
+
+        // Decode an MJPEG stream natively for every consumer on this many threads, with the
+        // output format and size of setOutputFormat and setOutputSize; a small output size
+        // decodes with the 1/2, 1/4 or 1/8 scaled IDCT. 0, the default, leaves MJPEG frames
+        // as they are, and a stream asked for another format is opened in one the device
+        // sends uncompressed. Needs a build with PANACAST_MJPEG_DECODE (libjpeg). Takes
+        // effect at the next openStream.
+        void setDecodeThreads(unsigned threads) {
+            decodeThreads = threads;
+        }
+
+        // Measure how much each frame moved against the one before (see MotionGate.h) and leave
+        // out the still ones, or only mark them in RawFrame::motion. Uncompressed streams are
+        // gated as the device delivers them, so still frames are never converted; MJPEG
+        // streams once they are decoded to a YUV format. Before or after openStream; false if
+        // the settings are not a gate or the backend cannot gate.
+        bool setMotionGate(const MotionGateSettings& settings) {
+           if (settings.enabled && !MotionGate::valid(settings)) {
+              printf("CameraStreamInterface: setMotionGate: %ux%u tiles every %u rows, threshold %g is not a gate\n",
+                     settings.tilesX, settings.tilesY, settings.rowStep, settings.threshold);
+              return false;
+           }
+           motionGate = settings;
+           return !cameraOpened || applyMotionGate();
         }
 
         void updateParams(unsigned _width, unsigned _height, std::string _format, unsigned _fps) {
@@ -168,49 +277,258 @@ class CameraStreamInterface {
 
            if (cameraOpened) return true;
 
-           if (!m) {
-               m.reset(new MacCameraCapture);
+           RawFrameFormat rawFormat;
+           if (!rawFrameFormatFromString(format, rawFormat)) {
+              printf("CameraStreamInterface: openStream: unknown format %s\n", format.c_str());
+              return false;
+           }
+
+           RawFrameFormat outFormat = rawFormat;
+           if (!outputFormat.empty() && !rawFrameFormatFromString(outputFormat, outFormat)) {
+              printf("CameraStreamInterface: openStream: unknown output format %s\n", outputFormat.c_str());
+              return false;
            }
-           
-           if (!m->init(width, height, (format == "MJPG" || format == "mjpg") ? PANACAST_FRAME_FORMAT_MJPEG : PANACAST_FRAME_FORMAT_YUYV, NULL)){
+
+           bool decode = rawFormat == PANACAST_FRAME_FORMAT_MJPEG && outFormat != rawFormat && decodeThreads;
+#ifdef PANACAST_MJPEG_DECODE
+           // every frame queued to a decoder pins a slot of the device's ring
+           CaptureInterface * capture = createCapture(decode ? ringDepth + DecodeCapture::inFlight(decodeThreads) : ringDepth);
+#else
+           if (decode) printf("CameraStreamInterface: openStream: built without MJPEG decoding\n");
+           CaptureInterface * capture = createCapture(ringDepth);
+#endif
+           if (!capture) {
+              printf("CameraStreamInterface: openStream: no capture backend for %s\n", deviceName.c_str());
+              return false;
+           }
+#ifdef PANACAST_MJPEG_DECODE
+           if (decode) {
+              m.reset(DecodeCapture::open(capture, width, height, outFormat, outputWidth, outputHeight, fps, ringDepth,
+                                          decodeThreads));
+           } else
+#endif
+           // converts only if the device cannot deliver outFormat itself; fps 0 leaves
+           // the device at its default rate
+           m.reset(ConvertCapture::open(capture, width, height, rawFormat, outFormat, outputWidth, outputHeight, fps,
+                                          ringDepth, convertThreads));
+           if (!m) {
               printf("CameraStreamInterface: openStream: could not initialize camera\n");
               cameraOpened = false;
               return false;
            }
-           
+           device = capture;
+           if (motionGate.enabled) applyMotionGate();
+           if (frameHandler) m->setFrameHandler(frameHandler);
+
            cameraOpened = true;
            return true;
         }
 
-        bool getFrame(unsigned char * & ptrFrame, unsigned& length) {
+        // Push mode: handler is called on the capture thread for every frame, see FrameHandler
+        // in PCCameraInterface.h for what it may do. Can be set before or after openStream,
+        // getFrame and subscribers keep working. false if the backend cannot push.
+        bool setFrameHandler(FrameHandler handler) {
+           frameHandler = handler;
+           if (m) return m->setFrameHandler(handler);
+           return true;
+        }
+
+        // takes effect at the next openStream. Every frame a consumer queues or holds pins
+        // a ring slot, so streams with several subscribers need a deeper ring.
+        void setRingDepth(unsigned depth) {
+            ringDepth = depth;
+        }
+
+        // Share the stream: each subscriber gets every frame through its own queue, see
+        // FrameBroadcaster.h. Once there is a subscriber, getFrame is served by one too.
+        std::shared_ptr<FrameSubscriber> subscribe(unsigned depth = 1, FrameDropPolicy policy = FRAME_DROP_OLDEST) {
+
+           // openStream should have been called at this point
+           if (!cameraOpened) return std::shared_ptr<FrameSubscriber>();
+
+           if (!broadcaster) broadcaster.reset(new FrameBroadcaster(m.get()));
+           return broadcaster->subscribe(depth, policy);
+        }
+
+        void unsubscribe(const std::shared_ptr<FrameSubscriber>& subscriber) {
+           if (broadcaster && subscriber) broadcaster->unsubscribe(subscriber);
+        }
+
+        // the frame stays valid for as long as any copy of the FrameRef is alive
+        bool getFrame(FrameRef& frame) {
+
+           // openStream should have been called at this point
+           if (!cameraOpened) return false;
+
+           if (broadcaster) {
+              // the broadcaster owns the capture now, take the latest frame like everyone else
+              if (!ownSubscriber) ownSubscriber = broadcaster->subscribe(1, FRAME_DROP_OLDEST);
+              frame = ownSubscriber->next();
+           } else {
+              frame = m->nextFrame();
+           }
+           return (bool)frame;
+        }
+
+        // rate frames are actually delivered at, fps unless the device cannot keep up
+        double achievedFrameRate() {
+           return cameraOpened ? m->achievedFrameRate() : 0;
+        }
+
+        // delivered, dropped and late frames, rate and jitter; false before openStream
+        bool getStats(StreamStats& stats) {
+           return cameraOpened && m->getStats(stats);
+        }
+
+        // Time from capture to stage for the frames delivered so far (see FrameLatency.h);
+        // FRAME_STAGE_ACQUIRE is capture to consumer. false if the backend does not trace frames.
+        bool getLatency(FrameStage stage, LatencySummary& summary) {
+           FrameLatencyTrace * trace = cameraOpened ? m->latencyTrace() : NULL;
+           if (trace == NULL) return false;
+           summary = trace->summary(stage);
+           return true;
+        }
+
+        void resetLatency() {
+           FrameLatencyTrace * trace = cameraOpened ? m->latencyTrace() : NULL;
+           if (trace) trace->reset();
+        }
+
+        // nsec per frame spent converting to the output format, or decoding MJPEG on a
+        // decoder thread; false if the stream is neither converted nor decoded
+        bool getConversionTime(LatencySummary& summary) {
+           ConvertCapture * convert = cameraOpened ? dynamic_cast<ConvertCapture *>(m.get()) : NULL;
+           if (convert != NULL) {
+              summary = convert->conversionTime().summary();
+              return true;
+           }
+#ifdef PANACAST_MJPEG_DECODE
+           DecodeCapture * decode = cameraOpened ? dynamic_cast<DecodeCapture *>(m.get()) : NULL;
+           if (decode != NULL) {
+              summary = decode->decodeTime().summary();
+              return true;
+           }
+#endif
+           return false;
+        }
+
+        // Readable when getFrame has a new frame, so one thread can poll many streams (and
+        // sockets) instead of blocking in getFrame per camera. Once the stream is shared the
+        // fd moves to getFrame's own subscriber, fetch it again after subscribe.
+        int frameReadyFd() {
+
+           // openStream should have been called at this point
+           if (!cameraOpened) return -1;
+
+           if (broadcaster) {
+              if (!ownSubscriber) ownSubscriber = broadcaster->subscribe(1, FRAME_DROP_OLDEST);
+              return ownSubscriber->frameReadyFd();
+           }
+           return m->frameReadyFd();
+        }
+
+        // getFrame without waiting, for use once frameReadyFd is readable
+        bool tryGetFrame(FrameRef& frame) {
 
            // openStream should have been called at this point
            if (!cameraOpened) return false;
 
-           RawFrame * frame = m->getNextFrame();
-           if (frame != NULL) {
-              ptrFrame = frame->buf;
-              unsigned yuyvSize = width * height * 2;
-              length = format == "MJPG" ? frame->size : yuyvSize;
+           if (broadcaster) {
+              if (!ownSubscriber) ownSubscriber = broadcaster->subscribe(1, FRAME_DROP_OLDEST);
+              frame = ownSubscriber->next(0);
+           } else {
+              frame = m->tryNextFrame();
+           }
+           return (bool)frame;
+        }
+
+        unsigned frameLength(const RawFrame * frame) {
+           if (frame->format == PANACAST_FRAME_FORMAT_MJPEG) return frame->size;
+           return rawFrameSize(frame->format, frame->width, frame->height);
+        }
+
+        // ptrFrame stays valid until freeFrame or the next getFrame call
+        bool getFrame(unsigned char * & ptrFrame, unsigned& length) {
+
+           // a frame still held from the previous call goes back to the ring
+           currentFrame.reset();
+
+           if (getFrame(currentFrame)) {
+              ptrFrame = currentFrame->buf;
+              length = frameLength(currentFrame.get());
               return true;
            }
            return false;
         }
 
         void freeFrame() {
-           m->freeFrame();
+           currentFrame.reset();
+        }
+
+        // The next frame as an inference tensor in dst, layout.bytes() long, see FrameTensor.h:
+        // scaled to layout.width x height, planar and normalized, without a full size RGB frame
+        // in between. Takes the frame as getFrame does. MJPEG has to be decoded first, see
+        // setDecodeThreads.
+        bool getTensor(const TensorLayout& layout, void * dst) {
+           FrameRef frame;
+           if (!getFrame(frame)) return false;
+           if (!tensorizer.configuredFor(frame->format, frame->width, frame->height, layout) &&
+               !tensorizer.configure(frame->format, frame->width, frame->height, layout)) {
+              printf("CameraStreamInterface: getTensor: cannot make a %ux%u tensor out of format %d at %ux%u\n",
+                     layout.width, layout.height, frame->format, frame->width, frame->height);
+              return false;
+           }
+           return tensorizer.convert(frame->buf, 0, dst);
         }
 
     private:
+        // on the device and on the stage handing frames out; a frame measured at the device
+        // is not measured again after conversion
+        bool applyMotionGate() {
+           bool ok = device->setMotionGate(motionGate);
+           if (m.get() != device) ok = m->setMotionGate(motionGate) || ok;
+           return ok;
+        }
+
+        CaptureInterface * createCapture(unsigned depth) {
+           if (SyntheticCapture::isSyntheticDevice(deviceName)) {
+              return new SyntheticCapture(fps, depth);
+           }
+#ifndef _WIN32
+           if (ReplayCapture::isReplayDevice(deviceName)) {
+              return ReplayCapture::fromDeviceName(deviceName, depth);
+           }
+#endif
+#ifdef __APPLE__
+           return new MacCameraCapture(depth);
+#elif __linux__
+           return new V4L2Capture(deviceName, depth);
+#else
+           return NULL;
+#endif
+        }
+
         std::string deviceName;
         unsigned width;
         unsigned height;
         std::string format;
+        std::string outputFormat;
+        unsigned outputWidth;
+        unsigned outputHeight;
         unsigned fps;
+        unsigned ringDepth;
+        unsigned convertThreads;
+        unsigned decodeThreads;
         bool cameraOpened;
-#ifdef __APPLE__
-        std::unique_ptr<MacCameraCapture> m;   
-#endif
+        FrameHandler frameHandler;
+        MotionGateSettings motionGate;
+        std::unique_ptr<CaptureInterface> m;
+        CaptureInterface * device; // what createCapture made, m itself or the source m reads from
+        // declared after m so they are torn down before the capture they read from
+        std::unique_ptr<FrameBroadcaster> broadcaster;
+        std::shared_ptr<FrameSubscriber> ownSubscriber;
+        FrameRef currentFrame;
+        FrameTensorizer tensorizer;
 };
 
 
@@ -0,0 +1,197 @@
+#include "ConvertCapture.h"
+#include <stdio.h>
+
+ConvertCapture::ConvertCapture(CaptureInterface * _source, RawFrameFormat outputFormat, unsigned ringDepth, unsigned threads)
+    : FrameRingCapture(ringDepth), source(_source), workers(new FrameWorkers(threads))
+{
+    input = outputFormat;
+    output = outputFormat;
+    width = 0;
+    height = 0;
+    requestedWidth = 0;
+    requestedHeight = 0;
+    outWidth = 0;
+    outHeight = 0;
+    running = false;
+    scaling = false;
+}
+
+ConvertCapture::~ConvertCapture()
+{
+    stopCapture();
+    releaseBuffers();
+}
+
+CaptureInterface * ConvertCapture::open(CaptureInterface * _source, unsigned width, unsigned height, RawFrameFormat format,
+                                        RawFrameFormat outputFormat, unsigned outputWidth, unsigned outputHeight,
+                                        unsigned fps, unsigned ringDepth, unsigned threads)
+{
+    std::unique_ptr<CaptureInterface> capture(_source);
+    bool scaled = (outputWidth && outputWidth != width) || (outputHeight && outputHeight != height);
+    if (format == outputFormat && !scaled) {
+        capture->setFrameRate(fps);
+        if (capture->init(width, height, format, NULL)) return capture.release();
+        if (!convertSupported(format, format)) return NULL;
+    }
+
+    // formats most devices have first, the cheapest to convert from among equals
+    static const RawFrameFormat fallbacks[] = {
+        PANACAST_FRAME_FORMAT_YUYV, PANACAST_FRAME_FORMAT_UYVY, PANACAST_FRAME_FORMAT_NV12,
+        PANACAST_FRAME_FORMAT_I420, PANACAST_FRAME_FORMAT_YV12,
+    };
+    std::unique_ptr<ConvertCapture> convert(new ConvertCapture(capture.release(), outputFormat, ringDepth, threads));
+    convert->setOutputSize(outputWidth, outputHeight);
+    convert->setFrameRate(fps);
+    for (int k = -1; k < (int)(sizeof(fallbacks) / sizeof(fallbacks[0])); k++) {
+        RawFrameFormat from = k < 0 ? format : fallbacks[k];
+        if ((from == outputFormat && !scaled) || (k >= 0 && from == format) || !convertSupported(from, outputFormat)) continue;
+        if (convert->init(width, height, from, NULL)) {
+            if (from != format) {
+                printf("ConvertCapture: the device has no format %d at %ux%u, converting format %d to %d\n",
+                       format, width, height, from, outputFormat);
+            }
+            return convert.release();
+        }
+    }
+    printf("ConvertCapture: no format the device offers at %ux%u converts to format %d\n", width, height, outputFormat);
+    return NULL;
+}
+
+void ConvertCapture::setOutputSize(unsigned _width, unsigned _height)
+{
+    requestedWidth = _width;
+    requestedHeight = _height;
+}
+
+void ConvertCapture::releaseBuffers()
+{
+    for (unsigned k = 0; k < ring.depth(); k++) {
+        RawFrame * slot = ring.slot(k);
+        if (pool) pool->release(slot->buf);
+        slot->buf = NULL;
+    }
+}
+
+bool ConvertCapture::init(unsigned _width, unsigned _height, RawFrameFormat format, void * captureDevice)
+{
+    if (running) return false;
+    unsigned w = requestedWidth ? requestedWidth : _width, h = requestedHeight ? requestedHeight : _height;
+    scaling = w != _width || h != _height;
+    if (!convertSupported(format, output) || (_width & 1) || (w & 1) ||
+        (scaling && !scaler.configure(format, _width, _height, w, h))) {
+        printf("ConvertCapture: cannot convert format %d at %ux%u to format %d at %ux%u\n", format, _width, _height,
+               output, w, h);
+        return false;
+    }
+
+    width = _width;
+    height = _height;
+    outWidth = w;
+    outHeight = h;
+    if (scaling && format != output) scaled.resize(rawFrameSize(format, outWidth, outHeight));
+    size_t bufferSize = rawFrameSize(output, outWidth, outHeight);
+    releaseBuffers();
+    if (!pool || pool->bufferSize() < bufferSize) {
+        unsigned flags = bufferSize >= FRAME_POOL_HUGE_PAGE_SIZE ? FRAME_POOL_HUGE_PAGES : 0;
+        pool.reset(new FrameBufferPool(bufferSize, ring.depth(), flags));
+        if (!pool->valid()) {
+            pool.reset();
+            return false;
+        }
+    }
+
+    if (!source->setFrameHandler([this](const FrameRef& frame) { convert(frame); })) {
+        printf("ConvertCapture: the capture backend cannot push frames\n");
+        return false;
+    }
+    pacer.reset();
+    convertTime.reset();
+    input = format;
+    if (!source->init(width, height, format, captureDevice)) {
+        source->setFrameHandler(FrameHandler());
+        return false;
+    }
+    running = true;
+    return true;
+}
+
+void ConvertCapture::setFrameRate(unsigned fps)
+{
+    source->setFrameRate(fps);
+    FrameRingCapture::setFrameRate(fps);
+    pacer.setTarget(0);
+}
+
+void ConvertCapture::stopCapture()
+{
+    if (!running) return;
+    running = false;
+    // once this returns convert is not running and will not be called again
+    source->setFrameHandler(FrameHandler());
+    source->stopCapture();
+    frameAvail->Reset();
+}
+
+uint64_t ConvertCapture::sourceDrops() const
+{
+    StreamStats stats;
+    return source->getStats(stats) ? stats.dropped : 0;
+}
+
+uint64_t ConvertCapture::sourceCorrupt() const
+{
+    StreamStats stats;
+    return source->getStats(stats) ? stats.corrupt : 0;
+}
+
+uint64_t ConvertCapture::sourceStill() const
+{
+    StreamStats stats;
+    return source->getStats(stats) ? stats.still : 0;
+}
+
+void ConvertCapture::convert(const FrameRef& in)
+{
+    uint64_t timestamp = in->timestamp;
+    if (!paceFrame(timestamp)) return;
+
+    RawFrame * frame = ring.claim();
+    if (frame == NULL) return;
+
+    if (frame->buf == NULL) {
+        frame->buf = pool->acquire();
+        if (frame->buf == NULL) {
+            printf("ConvertCapture: frame buffer pool is empty\n");
+            ring.abandon(frame);
+            return;
+        }
+    }
+    uint64_t start = frameClockNsec();
+    unsigned w = scaling ? outWidth : in->width, h = scaling ? outHeight : in->height;
+    bool ok;
+    if (scaling) {
+        // the scaler is set up for one input size, anything else is dropped
+        uint8_t * small = input == output ? frame->buf : &scaled[0];
+        ok = in->format == input && in->width == width && in->height == height &&
+             scaler.scale(in->buf, 0, small, 0, workers.get());
+        if (ok && input != output) ok = convertFrameParallel(*workers, small, 0, input, frame->buf, 0, output, w, h);
+    } else {
+        // a source that changed resolution under us must not overrun the pool
+        ok = rawFrameSize(output, w, h) <= pool->bufferSize() &&
+             convertFrameParallel(*workers, in->buf, 0, in->format, frame->buf, 0, output, w, h);
+    }
+    if (!ok) {
+        ring.abandon(frame);
+        return;
+    }
+    convertTime.record(frameClockNsec() - start);
+    frame->format = output;
+    frame->width = w;
+    frame->height = h;
+    frame->size = rawFrameSize(output, w, h);
+    frame->timestamp = timestamp;
+    // capture stages carry over, the conversion counts as the backend's own work
+    for (unsigned s = 0; s < FRAME_STAGE_CALLBACK; s++) frame->stageTime[s] = in->stageTime[s];
+    frame->stageTime[FRAME_STAGE_CALLBACK] = frameClockNsec();
+    publishFrame(frame, &in->motion);
+}
@@ -0,0 +1,94 @@
+//
+//  ConvertCapture.h
+//
+//  Capture stage that hands out frames in another format or at a smaller
+//  size than the camera delivers, e.g. packed BGR straight from a YUYV
+//  device, or a 640x360 preview of a 4K stream. Frames are scaled first,
+//  in the camera's format (FrameScale.h), and then converted, so neither
+//  step touches more memory than it must. It sits on top of
+//  another backend as that backend's frame handler, converts every frame on
+//  the capture thread into a pooled buffer of its own and publishes it into
+//  its own ring. Consumers see an ordinary CaptureInterface, and however many
+//  there are, each frame is converted once, in row bands spread over a few
+//  worker threads of its own for frames big enough to need it.
+//
+//  open() is how streams use it: it asks the device for the format the
+//  consumer wants and only converts when the device cannot deliver it, from
+//  whichever format the device does offer.
+//
+
+#ifndef CONVERTCAPTURE_H
+#define CONVERTCAPTURE_H
+
+#include "FrameBufferPool.h"
+#include "FrameConvert.h"
+#include "FrameLatency.h"
+#include "FrameRing.h"
+#include "FrameScale.h"
+#include <memory>
+#include <vector>
+
+class ConvertCapture : public FrameRingCapture {
+public:
+    // takes ownership of source; threads convert each frame, see FrameWorkers
+    ConvertCapture(CaptureInterface * source, RawFrameFormat outputFormat, unsigned ringDepth = FRAME_RING_DEFAULT_DEPTH,
+                   unsigned threads = 0);
+    virtual ~ConvertCapture();
+
+    // Start source at width x height delivering outputFormat at outputWidth x outputHeight
+    // (0 for the capture size): in format straight from the device if it can, else converted
+    // from format or from the first camera format that works. Returns the running capture,
+    // source itself or a ConvertCapture owning it; NULL, with source deleted, if nothing works.
+    static CaptureInterface * open(CaptureInterface * source, unsigned width, unsigned height, RawFrameFormat format,
+                                   RawFrameFormat outputFormat, unsigned outputWidth, unsigned outputHeight,
+                                   unsigned fps, unsigned ringDepth = FRAME_RING_DEFAULT_DEPTH, unsigned threads = 0);
+
+    // Hand frames out scaled down to width x height, before init; 0 keeps the capture size.
+    void setOutputSize(unsigned width, unsigned height);
+
+    // format is what the source is opened with, frames come out in outputFormat
+    bool init(unsigned width, unsigned height, RawFrameFormat format, void * captureDevice);
+    void stopCapture();
+    // the source paces, this stage only measures
+    void setFrameRate(unsigned fps);
+
+    RawFrameFormat outputFormat() const { return output; }
+    CaptureInterface * sourceCapture() { return source.get(); }
+    // the format the source was opened with
+    RawFrameFormat inputFormat() const { return input; }
+    // nsec per frame spent scaling and converting, for the input to output pair of this stream
+    const LatencyHistogram& conversionTime() const { return convertTime; }
+    unsigned threads() const { return workers->threads(); }
+
+protected:
+    uint64_t sourceDrops() const;
+    uint64_t sourceCorrupt() const;
+    uint64_t sourceStill() const;
+
+private:
+    void convert(const FrameRef& frame);
+    void releaseBuffers();
+
+    std::unique_ptr<CaptureInterface> source;
+    RawFrameFormat input;
+    RawFrameFormat output;
+    unsigned width;
+    unsigned height;
+    unsigned requestedWidth;  // setOutputSize
+    unsigned requestedHeight;
+    unsigned outWidth;        // what frames come out at
+    unsigned outHeight;
+    bool running;
+    std::unique_ptr<FrameBufferPool> pool;
+    LatencyHistogram convertTime;
+    std::unique_ptr<FrameWorkers> workers;
+    FrameScaler scaler;
+    bool scaling;
+    std::vector<uint8_t> scaled; // scaled frames on their way to conversion
+
+    //disable copy constructor and assignment operator
+    ConvertCapture(const ConvertCapture&);
+    void operator=(const ConvertCapture&);
+};
+
+#endif
@@ -0,0 +1,295 @@
+#include "DecodeCapture.h"
+#include "FrameConvert.h"
+#include "JpegHeader.h"
+#include <stdio.h>
+
+DecodeCapture::DecodeCapture(CaptureInterface * _source, RawFrameFormat outputFormat, unsigned ringDepth, unsigned threads)
+    : FrameRingCapture(ringDepth), source(_source), corrupt(0), busy(0)
+{
+    output = outputFormat;
+    decoded = outputFormat;
+    width = 0;
+    height = 0;
+    requestedWidth = 0;
+    requestedHeight = 0;
+    outWidth = 0;
+    outHeight = 0;
+    decodedWidth = 0;
+    decodedHeight = 0;
+    scale = 1;
+    scaling = false;
+    running = false;
+    submitted = 0;
+    taken = 0;
+    published = 0;
+    stopping = false;
+
+    if (threads == 0) threads = std::thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+    if (threads > FRAME_WORKERS_MAX) threads = FRAME_WORKERS_MAX;
+    jobs.resize(inFlight(threads));
+    for (unsigned k = 0; k < threads; k++) workers.push_back(std::unique_ptr<Worker>(new Worker));
+    for (unsigned k = 0; k < threads; k++) workers[k]->thread = std::thread(&DecodeCapture::work, this, std::ref(*workers[k]));
+}
+
+DecodeCapture::~DecodeCapture()
+{
+    stopCapture();
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (size_t k = 0; k < workers.size(); k++) workers[k]->thread.join();
+    releaseBuffers();
+}
+
+unsigned DecodeCapture::inFlight(unsigned threads)
+{
+    return threads + DECODE_QUEUED_FRAMES;
+}
+
+bool DecodeCapture::decodeSupported(RawFrameFormat format)
+{
+    return MjpegDecoder::decodeSupported(format) || convertSupported(PANACAST_FRAME_FORMAT_YUYV, format);
+}
+
+CaptureInterface * DecodeCapture::open(CaptureInterface * _source, unsigned width, unsigned height, RawFrameFormat outputFormat,
+                                       unsigned outputWidth, unsigned outputHeight, unsigned fps, unsigned ringDepth,
+                                       unsigned threads)
+{
+    std::unique_ptr<DecodeCapture> decode(new DecodeCapture(_source, outputFormat, ringDepth, threads));
+    decode->setOutputSize(outputWidth, outputHeight);
+    decode->setFrameRate(fps);
+    if (!decode->init(width, height, PANACAST_FRAME_FORMAT_MJPEG, NULL)) return NULL;
+    return decode.release();
+}
+
+void DecodeCapture::setOutputSize(unsigned _width, unsigned _height)
+{
+    requestedWidth = _width;
+    requestedHeight = _height;
+}
+
+void DecodeCapture::releaseBuffers()
+{
+    for (unsigned k = 0; k < ring.depth(); k++) {
+        RawFrame * slot = ring.slot(k);
+        if (pool) pool->release(slot->buf);
+        slot->buf = NULL;
+    }
+}
+
+bool DecodeCapture::init(unsigned _width, unsigned _height, RawFrameFormat format, void * captureDevice)
+{
+    if (running) return false;
+    unsigned w = requestedWidth ? requestedWidth : _width, h = requestedHeight ? requestedHeight : _height;
+    bool packedRGB = output == PANACAST_FRAME_FORMAT_BGR24 || output == PANACAST_FRAME_FORMAT_RGB24 ||
+                     output == PANACAST_FRAME_FORMAT_BGRA32;
+    decoded = MjpegDecoder::decodeSupported(output) ? output : PANACAST_FRAME_FORMAT_YUYV;
+
+    // the smallest IDCT that still covers the output
+    scale = 1;
+    for (unsigned s = 8; s > 1 && scale == 1; s /= 2) {
+        if (MjpegDecoder::scaledSize(_width, s) >= w && MjpegDecoder::scaledSize(_height, s) >= h) scale = s;
+    }
+    decodedWidth = MjpegDecoder::scaledSize(_width, scale);
+    decodedHeight = MjpegDecoder::scaledSize(_height, scale);
+    if (!packedRGB) decodedWidth &= ~1u;
+    scaling = decodedWidth != w || decodedHeight != h;
+
+    bool ok = format == PANACAST_FRAME_FORMAT_MJPEG && decodeSupported(output) && w <= _width && h <= _height &&
+              (packedRGB || !(w & 1)) && (decoded == output || convertSupported(decoded, output));
+    for (size_t k = 0; ok && scaling && k < workers.size(); k++) {
+        ok = workers[k]->scaler.configure(decoded, decodedWidth, decodedHeight, w, h);
+    }
+    // the 4:2:0 outputs, the only ones converted from YUYV, need whole row pairs
+    if (ok && decoded != output) ok = !(h & 1);
+    if (!ok) {
+        printf("DecodeCapture: cannot decode format %d at %ux%u to format %d at %ux%u\n", format, _width, _height,
+               output, w, h);
+        return false;
+    }
+
+    width = _width;
+    height = _height;
+    outWidth = w;
+    outHeight = h;
+    for (size_t k = 0; k < workers.size(); k++) {
+        Worker& worker = *workers[k];
+        bool direct = !scaling && decoded == output;
+        worker.decoded.resize(direct ? 0 : rawFrameSize(decoded, decodedWidth, decodedHeight));
+        worker.scaled.resize(scaling && decoded != output ? rawFrameSize(decoded, outWidth, outHeight) : 0);
+    }
+
+    // a buffer for every ring slot and every frame in flight
+    size_t bufferSize = rawFrameSize(output, outWidth, outHeight);
+    unsigned count = ring.depth() + (unsigned)jobs.size();
+    releaseBuffers();
+    if (!pool || pool->bufferSize() < bufferSize || pool->count() < count) {
+        unsigned flags = bufferSize >= FRAME_POOL_HUGE_PAGE_SIZE ? FRAME_POOL_HUGE_PAGES : 0;
+        pool.reset(new FrameBufferPool(bufferSize, count, flags));
+        if (!pool->valid()) {
+            pool.reset();
+            return false;
+        }
+    }
+
+    if (!source->setFrameHandler([this](const FrameRef& frame) { submit(frame); })) {
+        printf("DecodeCapture: the capture backend cannot push frames\n");
+        return false;
+    }
+    pacer.reset();
+    decodeTimes.reset();
+    if (!source->init(width, height, format, captureDevice)) {
+        source->setFrameHandler(FrameHandler());
+        return false;
+    }
+    running = true;
+    return true;
+}
+
+void DecodeCapture::setFrameRate(unsigned fps)
+{
+    source->setFrameRate(fps);
+    FrameRingCapture::setFrameRate(fps);
+    pacer.setTarget(0);
+}
+
+void DecodeCapture::stopCapture()
+{
+    if (!running) return;
+    running = false;
+    // once this returns submit is not running and will not be called again
+    source->setFrameHandler(FrameHandler());
+    source->stopCapture();
+    // let the decoders finish what was queued, the source frames they hold go back before it is gone
+    std::unique_lock<std::mutex> guard(lock);
+    drained.wait(guard, [this] { return published == submitted; });
+    guard.unlock();
+    frameAvail->Reset();
+}
+
+uint64_t DecodeCapture::sourceDrops() const
+{
+    StreamStats stats;
+    uint64_t drops = source->getStats(stats) ? stats.dropped : 0;
+    return drops + corrupt.load(std::memory_order_relaxed) + busy.load(std::memory_order_relaxed);
+}
+
+uint64_t DecodeCapture::sourceCorrupt() const
+{
+    StreamStats stats;
+    uint64_t damaged = source->getStats(stats) ? stats.corrupt : 0;
+    return damaged + corrupt.load(std::memory_order_relaxed);
+}
+
+uint64_t DecodeCapture::sourceStill() const
+{
+    StreamStats stats;
+    return source->getStats(stats) ? stats.still : 0;
+}
+
+void DecodeCapture::submit(const FrameRef& in)
+{
+    uint64_t timestamp = in->timestamp;
+    if (!paceFrame(timestamp)) return;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (submitted - published >= jobs.size()) {
+            busy++;
+            return;
+        }
+        Job& job = jobs[submitted % jobs.size()];
+        job.in = in;
+        job.timestamp = timestamp;
+        job.buf = NULL;
+        job.ok = false;
+        job.done = false;
+        submitted++;
+    }
+    wake.notify_one();
+}
+
+void DecodeCapture::work(Worker& worker)
+{
+    std::unique_lock<std::mutex> guard(lock);
+    for (;;) {
+        wake.wait(guard, [this] { return stopping || taken < submitted; });
+        if (stopping) return;
+        // nobody else touches the job until it is done
+        Job& job = jobs[taken++ % jobs.size()];
+        guard.unlock();
+
+        uint64_t start = frameClockNsec();
+        unsigned char * buf = pool->acquire();
+        bool ok = buf != NULL && decodeFrame(worker, job.in.get(), buf);
+        if (ok) decodeTimes.record(frameClockNsec() - start);
+        else if (buf != NULL) corrupt++;
+
+        guard.lock();
+        job.buf = buf;
+        job.ok = ok;
+        job.done = true;
+        guard.unlock();
+        publishReady();
+        guard.lock();
+    }
+}
+
+bool DecodeCapture::decodeFrame(Worker& worker, const RawFrame * in, unsigned char * dst)
+{
+    if (in->format != PANACAST_FRAME_FORMAT_MJPEG || in->size <= 0) return false;
+    // the source checked the header as it published the frame, anything else is checked here
+    JpegHeader header = in->jpeg;
+    if (!header.valid && !parseJpegHeader(in->buf, in->size, header)) return false;
+    if (header.width != width || header.height != height) return false;
+    uint8_t * frame = worker.decoded.empty() ? dst : &worker.decoded[0];
+    if (!worker.decoder.decode(in->buf, header.size, scale, frame, 0, decoded, decodedWidth, decodedHeight)) return false;
+    if (scaling) {
+        uint8_t * small = decoded == output ? dst : &worker.scaled[0];
+        worker.scaler.scale(frame, 0, small, 0);
+        frame = small;
+    }
+    if (decoded != output) return convertFrame(frame, 0, decoded, dst, 0, output, outWidth, outHeight);
+    return true;
+}
+
+void DecodeCapture::publishReady()
+{
+    // whoever finishes a frame publishes everything in order up to the first still decoding
+    std::lock_guard<std::mutex> publisher(publishLock);
+    for (;;) {
+        Job * job;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (published == submitted || !jobs[published % jobs.size()].done) return;
+            job = &jobs[published % jobs.size()];
+        }
+
+        RawFrame * frame = job->ok ? ring.claim() : NULL;
+        if (frame == NULL) {
+            if (job->buf != NULL) pool->release(job->buf);
+        } else {
+            // the decoded buffer takes the slot's place, the slot's goes back to the pool
+            if (frame->buf != NULL) pool->release(frame->buf);
+            frame->buf = job->buf;
+            frame->format = output;
+            frame->width = outWidth;
+            frame->height = outHeight;
+            frame->size = rawFrameSize(output, outWidth, outHeight);
+            frame->timestamp = job->timestamp;
+            // capture stages carry over, the decoding counts as the backend's own work
+            for (unsigned s = 0; s < FRAME_STAGE_CALLBACK; s++) frame->stageTime[s] = job->in->stageTime[s];
+            frame->stageTime[FRAME_STAGE_CALLBACK] = frameClockNsec();
+            publishFrame(frame, &job->in->motion);
+        }
+        job->in.reset();
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            published++;
+        }
+        drained.notify_all();
+    }
+}
@@ -0,0 +1,142 @@
+//
+//  DecodeCapture.h
+//
+//  Capture stage that decodes an MJPEG stream once, natively, for every
+//  consumer, instead of each of them running cv2.imdecode on every frame.
+//  It sits on top of another backend as that backend's frame handler and
+//  queues each JPEG to a pool of decoder threads of its own, each with a
+//  reusable decompressor (MjpegDecoder.h). Decoded frames go into pooled
+//  buffers and are published into its own ring in capture order, however
+//  the threads finish. The capture thread never waits: with every decoder
+//  busy and the queue full, the frame is dropped.
+//
+//  Frames can come out in any format FrameConvert.h turns YUYV into, and
+//  smaller than the camera sends them: the largest 1/2, 1/4 or 1/8 scaled
+//  IDCT that still covers the output size is used, and FrameScale.h takes
+//  it the rest of the way if that is not exact, so a preview of a 4K
+//  stream costs a fraction of a full decode.
+//
+
+#ifndef DECODECAPTURE_H
+#define DECODECAPTURE_H
+
+#include "FrameBufferPool.h"
+#include "FrameLatency.h"
+#include "FrameRing.h"
+#include "FrameScale.h"
+#include "MjpegDecoder.h"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// frames queued beyond one per decoder thread
+#define DECODE_QUEUED_FRAMES 2
+
+class DecodeCapture : public FrameRingCapture {
+public:
+    // takes ownership of source; threads 0 for one per core, up to FRAME_WORKERS_MAX
+    DecodeCapture(CaptureInterface * source, RawFrameFormat outputFormat, unsigned ringDepth = FRAME_RING_DEFAULT_DEPTH,
+                  unsigned threads = 0);
+    virtual ~DecodeCapture();
+
+    // Start source at width x height in MJPEG, decoding to outputFormat at outputWidth x
+    // outputHeight (0 for the capture size). NULL, with source deleted, if that fails.
+    static CaptureInterface * open(CaptureInterface * source, unsigned width, unsigned height, RawFrameFormat outputFormat,
+                                   unsigned outputWidth, unsigned outputHeight, unsigned fps,
+                                   unsigned ringDepth = FRAME_RING_DEFAULT_DEPTH, unsigned threads = 0);
+    // true if MJPEG can be decoded to format
+    static bool decodeSupported(RawFrameFormat format);
+    // frames in flight for that many decoder threads; each pins a frame of the source
+    static unsigned inFlight(unsigned threads);
+
+    // Hand frames out scaled down to width x height, before init; 0 keeps the capture size.
+    void setOutputSize(unsigned width, unsigned height);
+
+    // format must be MJPEG, frames come out in outputFormat
+    bool init(unsigned width, unsigned height, RawFrameFormat format, void * captureDevice);
+    void stopCapture();
+    // the source paces, this stage only measures
+    void setFrameRate(unsigned fps);
+
+    RawFrameFormat outputFormat() const { return output; }
+    CaptureInterface * sourceCapture() { return source.get(); }
+    unsigned threads() const { return (unsigned)workers.size(); }
+    // the IDCT scales frames down by 1 over this
+    unsigned decodeScale() const { return scale; }
+    // nsec per frame a decoder thread spends on it, scaling and converting included
+    const LatencyHistogram& decodeTime() const { return decodeTimes; }
+    // frames libjpeg could not decode, and frames dropped with every decoder busy
+    uint64_t corruptFrames() const { return corrupt.load(std::memory_order_relaxed); }
+    uint64_t busyDrops() const { return busy.load(std::memory_order_relaxed); }
+
+protected:
+    uint64_t sourceDrops() const;
+    uint64_t sourceCorrupt() const;
+    uint64_t sourceStill() const;
+
+private:
+    struct Job {
+        FrameRef in;
+        uint64_t timestamp;
+        unsigned char * buf;
+        bool ok;
+        bool done;
+    };
+
+    // what each decoder thread keeps from frame to frame
+    struct Worker {
+        MjpegDecoder decoder;
+        FrameScaler scaler;
+        std::vector<uint8_t> decoded; // frames libjpeg cannot write straight to the output
+        std::vector<uint8_t> scaled;
+        std::thread thread;
+    };
+
+    void submit(const FrameRef& frame);
+    void work(Worker& worker);
+    bool decodeFrame(Worker& worker, const RawFrame * in, unsigned char * dst);
+    void publishReady();
+    void releaseBuffers();
+
+    std::unique_ptr<CaptureInterface> source;
+    RawFrameFormat output;
+    RawFrameFormat decoded;   // what libjpeg writes, the output format if it can
+    unsigned width;
+    unsigned height;
+    unsigned requestedWidth;  // setOutputSize
+    unsigned requestedHeight;
+    unsigned outWidth;        // what frames come out at
+    unsigned outHeight;
+    unsigned decodedWidth;    // what the scaled IDCT gives
+    unsigned decodedHeight;
+    unsigned scale;
+    bool scaling;
+    bool running;
+    std::unique_ptr<FrameBufferPool> pool;
+    LatencyHistogram decodeTimes;
+    std::atomic<uint64_t> corrupt;
+    std::atomic<uint64_t> busy;
+
+    // jobs[n % size] is the n-th frame submitted; frames are taken by the decoders in
+    // that order and published in it too
+    std::mutex lock;
+    std::condition_variable wake;    // a job was submitted, or stopping
+    std::condition_variable drained; // a job was published
+    std::vector<Job> jobs;
+    uint64_t submitted;
+    uint64_t taken;
+    uint64_t published;
+    bool stopping;
+    // one thread publishes at a time, the ring has a single producer
+    std::mutex publishLock;
+    std::vector<std::unique_ptr<Worker> > workers;
+
+    //disable copy constructor and assignment operator
+    DecodeCapture(const DecodeCapture&);
+    void operator=(const DecodeCapture&);
+};
+
+#endif
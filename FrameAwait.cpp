@@ -0,0 +1,261 @@
+#include "FrameAwait.h"
+
+#if defined(__linux__) && __cplusplus >= 202002L
+
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <algorithm>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+FrameTask::promise_type::~promise_type()
+{
+    if (executor) executor->live--;
+}
+
+bool AsyncFrameStream::Awaiter::await_ready()
+{
+    AsyncFrameStream * s = stream;
+    s->result.frame.reset();
+    if (s->cancelled()) {
+        s->result.status = FRAME_WAIT_CANCELLED;
+        return true;
+    }
+    if (s->fd < 0) {
+        s->result.status = FRAME_WAIT_ERROR;
+        return true;
+    }
+    // a frame may already be waiting, then there is no need to suspend at all
+    s->result.frame = s->take();
+    s->result.status = s->result.frame ? FRAME_WAIT_OK : FRAME_WAIT_TIMEOUT;
+    return s->result.frame || timeoutMsec == 0;
+}
+
+void AsyncFrameStream::Awaiter::await_suspend(std::coroutine_handle<> h)
+{
+    AsyncFrameStream * s = stream;
+    s->waiter = h;
+    s->deadline = timeoutMsec == FRAME_WAIT_FOREVER ? 0 : frameClockNsec() + timeoutMsec * 1000000ULL;
+
+    // one shot: the fd is only watched while someone waits on it, a frame published
+    // since await_ready leaves it readable and fires straight away
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLONESHOT;
+    ev.data.ptr = s;
+    epoll_ctl(s->executor.epollFd, EPOLL_CTL_MOD, s->fd, &ev);
+}
+
+AwaitedFrame AsyncFrameStream::Awaiter::await_resume()
+{
+    return std::move(stream->result);
+}
+
+AsyncFrameStream::AsyncFrameStream(FrameExecutor& _executor, CaptureInterface * source)
+    : executor(_executor), fd(source->frameReadyFd())
+{
+    take = [source] { return source->tryNextFrame(); };
+    attach();
+}
+
+AsyncFrameStream::AsyncFrameStream(FrameExecutor& _executor, FrameSubscriber * subscriber)
+    : executor(_executor), fd(subscriber->frameReadyFd())
+{
+    take = [subscriber] { return subscriber->next(0); };
+    attach();
+}
+
+void AsyncFrameStream::attach()
+{
+    isCancelled = false;
+    self = std::make_shared<AsyncFrameStream *>(this);
+    deadline = 0;
+    result.status = FRAME_WAIT_OK;
+    if (fd < 0) {
+        printf("AsyncFrameStream: the source has no frame-ready fd, it cannot be awaited\n");
+        return;
+    }
+
+    struct epoll_event ev;
+    ev.events = 0; // armed by each nextFrame
+    ev.data.ptr = this;
+    if (epoll_ctl(executor.epollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        printf("AsyncFrameStream: cannot watch fd %d: %d\n", fd, errno);
+        fd = -1;
+        return;
+    }
+    executor.streams.push_back(this);
+}
+
+AsyncFrameStream::~AsyncFrameStream()
+{
+    if (fd < 0) return;
+    epoll_ctl(executor.epollFd, EPOLL_CTL_DEL, fd, NULL);
+    std::vector<AsyncFrameStream *>& s = executor.streams;
+    s.erase(std::remove(s.begin(), s.end(), this), s.end());
+}
+
+void AsyncFrameStream::cancel()
+{
+    isCancelled = true;
+    std::weak_ptr<AsyncFrameStream *> handle = self;
+    executor.post([handle] {
+        // the stream may be gone by the time this runs; it is destroyed on this thread, so it
+        // cannot go while this holds the handle
+        std::shared_ptr<AsyncFrameStream *> s = handle.lock();
+        if (s && (*s)->waiter) (*s)->complete(FRAME_WAIT_CANCELLED);
+    });
+}
+
+void AsyncFrameStream::onReady()
+{
+    if (!waiter) return;
+    result.frame = take();
+    if (result.frame) {
+        complete(FRAME_WAIT_OK);
+        return;
+    }
+
+    // someone else took the frame, keep waiting
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLONESHOT;
+    ev.data.ptr = this;
+    epoll_ctl(executor.epollFd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+void AsyncFrameStream::complete(FrameWaitStatus status)
+{
+    if (status != FRAME_WAIT_OK) {
+        struct epoll_event ev;
+        ev.events = 0;
+        ev.data.ptr = this;
+        epoll_ctl(executor.epollFd, EPOLL_CTL_MOD, fd, &ev);
+    }
+    result.status = status;
+    deadline = 0;
+    std::coroutine_handle<> h = waiter;
+    waiter = NULL;
+    // resumed from the loop, not from here, so completions never nest
+    executor.schedule(h);
+}
+
+FrameExecutor::FrameExecutor()
+{
+    live = 0;
+    wakes = 0;
+    stopping = false;
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = this;
+    if (epollFd < 0 || wakeFd < 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev) < 0) {
+        printf("FrameExecutor: cannot set up epoll\n");
+    }
+}
+
+FrameExecutor::~FrameExecutor()
+{
+    // tasks that have not finished are destroyed where they stand, which releases their frames
+    std::vector<std::coroutine_handle<> > pending(ready.begin(), ready.end());
+    ready.clear();
+    for (size_t k = 0; k < streams.size(); k++) {
+        if (streams[k]->waiter) pending.push_back(streams[k]->waiter);
+        streams[k]->waiter = NULL;
+    }
+    for (size_t k = 0; k < pending.size(); k++) pending[k].destroy();
+
+    if (epollFd >= 0) close(epollFd);
+    if (wakeFd >= 0) close(wakeFd);
+}
+
+void FrameExecutor::spawn(FrameTask task)
+{
+    std::coroutine_handle<FrameTask::promise_type> h = task.handle;
+    task.handle = NULL;
+    h.promise().executor = this;
+    live++;
+    schedule(h);
+}
+
+void FrameExecutor::post(std::function<void()> fn)
+{
+    {
+        std::lock_guard<std::mutex> guard(postLock);
+        posted.push_back(fn);
+    }
+    uint64_t one = 1;
+    ssize_t r = write(wakeFd, &one, sizeof(one));
+    (void)r;
+}
+
+void FrameExecutor::stop()
+{
+    stopping = true;
+    uint64_t one = 1;
+    ssize_t r = write(wakeFd, &one, sizeof(one));
+    (void)r;
+}
+
+int FrameExecutor::nextTimeoutMsec()
+{
+    uint64_t nearest = 0;
+    for (size_t k = 0; k < streams.size(); k++) {
+        AsyncFrameStream * s = streams[k];
+        if (s->waiter && s->deadline && (nearest == 0 || s->deadline < nearest)) nearest = s->deadline;
+    }
+    if (nearest == 0) return -1;
+    uint64_t now = frameClockNsec();
+    // rounded up, waking a little late beats spinning until the deadline
+    return nearest <= now ? 0 : (int)((nearest - now + 999999) / 1000000);
+}
+
+void FrameExecutor::expireTimeouts()
+{
+    uint64_t now = frameClockNsec();
+    for (size_t k = 0; k < streams.size(); k++) {
+        AsyncFrameStream * s = streams[k];
+        if (s->waiter && s->deadline && s->deadline <= now) s->complete(FRAME_WAIT_TIMEOUT);
+    }
+}
+
+void FrameExecutor::run()
+{
+    stopping = false;
+    while (!stopping) {
+        std::vector<std::function<void()> > work;
+        {
+            std::lock_guard<std::mutex> guard(postLock);
+            work.swap(posted);
+        }
+        for (size_t k = 0; k < work.size(); k++) work[k]();
+
+        while (!ready.empty()) {
+            std::coroutine_handle<> h = ready.front();
+            ready.pop_front();
+            h.resume();
+        }
+        if (live == 0) break;
+
+        struct epoll_event events[64];
+        int n = epoll_wait(epollFd, events, 64, nextTimeoutMsec());
+        wakes++;
+        if (n < 0 && errno != EINTR) {
+            printf("FrameExecutor: epoll_wait failed: %d\n", errno);
+            break;
+        }
+        for (int k = 0; k < n; k++) {
+            if (events[k].data.ptr == this) {
+                uint64_t count;
+                ssize_t r = read(wakeFd, &count, sizeof(count));
+                (void)r;
+            } else {
+                ((AsyncFrameStream *)events[k].data.ptr)->onReady();
+            }
+        }
+        expireTimeouts();
+    }
+}
+
+#endif
@@ -0,0 +1,180 @@
+//
+//  FrameAwait.h
+//
+//  C++20 coroutine front end for the capture backends, so an ingest service
+//  can write
+//
+//      FrameTask ingest(AsyncFrameStream& stream) {
+//          while (true) {
+//              AwaitedFrame f = co_await stream.nextFrame(500);
+//              if (!f) break; // timed out or cancelled
+//              ...
+//          }
+//      }
+//
+//  and service dozens of cameras from one thread instead of parking a thread
+//  in getNextFrame per camera. FrameExecutor is a single-threaded loop that
+//  epolls the streams' frame-ready fds (CaptureInterface::frameReadyFd) and
+//  resumes a coroutine when its frame arrives, its timeout expires or its
+//  stream is cancelled.
+//
+//  Everything but AsyncFrameStream::cancel, FrameExecutor::post and
+//  FrameExecutor::stop must be used on the executor's thread. Linux only
+//  (epoll), and only when built as C++20; the rest of the library stays C++11.
+//
+
+#ifndef FRAMEAWAIT_H
+#define FRAMEAWAIT_H
+
+#if defined(__linux__) && __cplusplus >= 202002L
+
+#include "FrameBroadcaster.h"
+#include <atomic>
+#include <coroutine>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#define FRAME_WAIT_FOREVER 0xFFFFFFFF
+
+enum FrameWaitStatus {
+    FRAME_WAIT_OK,
+    FRAME_WAIT_TIMEOUT,
+    FRAME_WAIT_CANCELLED,
+    FRAME_WAIT_ERROR, // the source cannot be polled
+};
+
+struct AwaitedFrame {
+    FrameRef frame;
+    FrameWaitStatus status;
+    explicit operator bool() const { return status == FRAME_WAIT_OK; }
+};
+
+class FrameExecutor;
+
+// fire-and-forget coroutine, started by FrameExecutor::spawn and freed when it returns
+class FrameTask {
+public:
+    struct promise_type {
+        FrameExecutor * executor = NULL;
+        ~promise_type();
+        FrameTask get_return_object() { return FrameTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    FrameTask(FrameTask&& other) : handle(other.handle) { other.handle = NULL; }
+    // a task that was never spawned is simply dropped
+    ~FrameTask() { if (handle) handle.destroy(); }
+
+private:
+    friend class FrameExecutor;
+    explicit FrameTask(std::coroutine_handle<promise_type> h) : handle(h) {}
+    std::coroutine_handle<promise_type> handle;
+
+    //disable copy constructor and assignment operator
+    FrameTask(const FrameTask&);
+    void operator=(const FrameTask&);
+};
+
+class AsyncFrameStream {
+public:
+    class Awaiter {
+    public:
+        bool await_ready();
+        void await_suspend(std::coroutine_handle<> h);
+        AwaitedFrame await_resume();
+
+    private:
+        friend class AsyncFrameStream;
+        Awaiter(AsyncFrameStream * s, unsigned t) : stream(s), timeoutMsec(t) {}
+        AsyncFrameStream * stream;
+        unsigned timeoutMsec;
+    };
+
+    // the source must outlive the stream and provide a frameReadyFd
+    AsyncFrameStream(FrameExecutor& executor, CaptureInterface * source);
+    AsyncFrameStream(FrameExecutor& executor, FrameSubscriber * subscriber);
+    // must not be destroyed while a coroutine is suspended on it
+    ~AsyncFrameStream();
+
+    // one nextFrame pending per stream at a time
+    Awaiter nextFrame(unsigned timeoutMsec = FRAME_WAIT_FOREVER) { return Awaiter(this, timeoutMsec); }
+
+    // Any thread. The pending nextFrame and every later one complete with FRAME_WAIT_CANCELLED.
+    void cancel();
+    bool cancelled() const { return isCancelled.load(std::memory_order_acquire); }
+
+private:
+    friend class FrameExecutor;
+    void attach();
+    void onReady();
+    void complete(FrameWaitStatus status);
+
+    FrameExecutor& executor;
+    int fd;
+    std::function<FrameRef()> take;
+    std::atomic<bool> isCancelled;
+    // what cancel hands the executor: expired once the stream is destroyed, even if another
+    // stream has taken its address since
+    std::shared_ptr<AsyncFrameStream *> self;
+
+    std::coroutine_handle<> waiter;
+    uint64_t deadline; // frameClockNsec, 0 for none
+    AwaitedFrame result;
+
+    //disable copy constructor and assignment operator
+    AsyncFrameStream(const AsyncFrameStream&);
+    void operator=(const AsyncFrameStream&);
+};
+
+class FrameExecutor {
+public:
+    FrameExecutor();
+    // destroys the tasks that have not returned yet
+    ~FrameExecutor();
+
+    // the task starts running inside run
+    void spawn(FrameTask task);
+    // Any thread: fn runs on the executor thread at the next turn of the loop.
+    void post(std::function<void()> fn);
+    // until every spawned task has returned, or stop
+    void run();
+    // any thread
+    void stop();
+
+    unsigned tasks() const { return live; }
+    // times epoll_wait returned, to see how idle the loop was
+    uint64_t wakeups() const { return wakes; }
+
+private:
+    friend class AsyncFrameStream;
+    friend struct FrameTask::promise_type;
+
+    void schedule(std::coroutine_handle<> h) { ready.push_back(h); }
+    int nextTimeoutMsec();
+    void expireTimeouts();
+
+    int epollFd;
+    int wakeFd;
+    std::deque<std::coroutine_handle<> > ready;
+    std::vector<AsyncFrameStream *> streams;
+    unsigned live;
+    uint64_t wakes;
+    std::atomic<bool> stopping;
+
+    std::mutex postLock;
+    std::vector<std::function<void()> > posted;
+
+    //disable copy constructor and assignment operator
+    FrameExecutor(const FrameExecutor&);
+    void operator=(const FrameExecutor&);
+};
+
+#endif
+
+#endif
@@ -0,0 +1,166 @@
+#include "FrameBroadcaster.h"
+#include <stdio.h>
+#include <algorithm>
+
+FrameSubscriber::FrameSubscriber(unsigned depth, FrameDropPolicy policy)
+    : dropPolicy(policy), queue(depth ? depth : 1)
+{
+    int sts;
+    frameAvail.reset(new OSEvent(sts, false, false));
+    head = 0;
+    count = 0;
+    isClosed = false;
+    delivered = 0;
+    dropped = 0;
+    cursor = 0;
+}
+
+void FrameSubscriber::push(const FrameRef& frame)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (isClosed) return;
+
+        unsigned depth = (unsigned)queue.size();
+        if (count == depth) {
+            dropped++;
+            if (dropPolicy == FRAME_DROP_NEWEST) return;
+            // overwrite the oldest, which releases its slot
+            queue[head] = frame;
+            head = (head + 1) % depth;
+        } else {
+            queue[(head + count) % depth] = frame;
+            count++;
+        }
+    }
+    frameAvail->Signal();
+#ifndef _WIN32
+    frameReady.Signal();
+#endif
+}
+
+FrameRef FrameSubscriber::next(unsigned timeoutMsec)
+{
+    std::unique_lock<std::mutex> guard(lock);
+    uint64_t deadline = frameClockNsec() + timeoutMsec * 1000000ULL;
+    while (count == 0 && !isClosed) {
+        // frameAvail can still be signalled for frames a next(0) took, wait again until the deadline
+        uint64_t now = frameClockNsec();
+        if (now >= deadline) break;
+        guard.unlock();
+        frameAvail->TimedWait((unsigned)((deadline - now + 999999) / 1000000));
+        guard.lock();
+    }
+    if (count == 0) return FrameRef();
+
+    FrameRef frame(std::move(queue[head]));
+    head = (head + 1) % queue.size();
+    count--;
+    delivered++;
+    cursor = frame->sequence;
+#ifndef _WIN32
+    // push signals after it queued under the lock, so a frame queued after this still shows up
+    if (count == 0 && !isClosed) frameReady.Reset();
+#endif
+    return frame;
+}
+
+int FrameSubscriber::frameReadyFd()
+{
+#ifndef _WIN32
+    std::lock_guard<std::mutex> guard(lock);
+    int fd = frameReady.GetFd();
+    if (fd >= 0 && (count || isClosed)) frameReady.Signal();
+    return fd;
+#else
+    return -1;
+#endif
+}
+
+unsigned FrameSubscriber::queued()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return count;
+}
+
+bool FrameSubscriber::closed()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return isClosed;
+}
+
+void FrameSubscriber::close()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        isClosed = true;
+        for (size_t k = 0; k < queue.size(); k++) queue[k].reset();
+        count = 0;
+    }
+    frameAvail->Signal();
+#ifndef _WIN32
+    frameReady.Signal();
+#endif
+}
+
+FrameBroadcaster::FrameBroadcaster(CaptureInterface * _source) : source(_source)
+{
+    running = false;
+    broadcast = 0;
+}
+
+FrameBroadcaster::~FrameBroadcaster()
+{
+    stop();
+}
+
+std::shared_ptr<FrameSubscriber> FrameBroadcaster::subscribe(unsigned depth, FrameDropPolicy policy)
+{
+    std::shared_ptr<FrameSubscriber> subscriber(new FrameSubscriber(depth, policy));
+
+    std::lock_guard<std::mutex> guard(lock);
+    subs.push_back(subscriber);
+    if (!pumpThread.joinable()) {
+        running = true;
+        pumpThread = std::thread(&FrameBroadcaster::pump, this);
+    }
+    return subscriber;
+}
+
+void FrameBroadcaster::unsubscribe(const std::shared_ptr<FrameSubscriber>& subscriber)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        subs.erase(std::remove(subs.begin(), subs.end(), subscriber), subs.end());
+    }
+    subscriber->close();
+}
+
+unsigned FrameBroadcaster::subscribers()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return (unsigned)subs.size();
+}
+
+void FrameBroadcaster::stop()
+{
+    running = false;
+    if (pumpThread.joinable()) pumpThread.join();
+
+    std::lock_guard<std::mutex> guard(lock);
+    for (size_t k = 0; k < subs.size(); k++) subs[k]->close();
+    subs.clear();
+}
+
+void FrameBroadcaster::pump()
+{
+    while (running) {
+        // waits up to FRAME_AVAILABLE_TIMEOUT_MSEC, so stop is noticed promptly
+        FrameRef frame = source->nextFrame();
+        if (!frame) continue;
+
+        std::lock_guard<std::mutex> guard(lock);
+        for (size_t k = 0; k < subs.size(); k++) subs[k]->push(frame);
+        broadcast++;
+    }
+}
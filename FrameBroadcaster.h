@@ -0,0 +1,108 @@
+//
+//  FrameBroadcaster.h
+//
+//  Fans one capture stream out to several consumers, e.g. a recorder, a
+//  preview and an analytics job on the same camera. A pump thread pulls
+//  frames from the CaptureInterface and gives every subscriber a FrameRef to
+//  the same buffer, so there are no per-consumer copies. Each subscriber has
+//  its own bounded queue and its own policy for what to lose when it falls
+//  behind, so a slow consumer never holds up the others.
+//
+//  Every frame queued for or held by a subscriber pins a slot of the
+//  backend's frame ring: the ring has to be deeper than the frames all
+//  subscribers may hold at once (see CameraStreamInterface::setRingDepth),
+//  or the backend starts dropping frames for everyone.
+//
+
+#ifndef FRAMEBROADCASTER_H
+#define FRAMEBROADCASTER_H
+
+#include "FrameRing.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+enum FrameDropPolicy {
+    FRAME_DROP_OLDEST, // queue full: make room by dropping the oldest queued frame, for previews
+    FRAME_DROP_NEWEST, // queue full: drop the incoming frame, keeps runs of consecutive frames
+};
+
+class FrameSubscriber {
+public:
+    // next frame in this subscriber's queue, empty after timeoutMsec or once the broadcaster stopped
+    FrameRef next(unsigned timeoutMsec = FRAME_AVAILABLE_TIMEOUT_MSEC);
+
+    // readable while frames are queued or once closed, see CaptureInterface::frameReadyFd;
+    // next(0) takes a frame without blocking
+    int frameReadyFd();
+
+    unsigned depth() const { return (unsigned)queue.size(); }
+    FrameDropPolicy policy() const { return dropPolicy; }
+    unsigned queued();
+    bool closed();
+
+    uint64_t framesDelivered() const { return delivered.load(std::memory_order_relaxed); }
+    // frames this subscriber lost to its drop policy
+    uint64_t framesDropped() const { return dropped.load(std::memory_order_relaxed); }
+    // sequence of the last frame handed out by next, the subscriber's cursor into the stream
+    uint64_t lastSequence() const { return cursor.load(std::memory_order_relaxed); }
+
+private:
+    friend class FrameBroadcaster;
+    FrameSubscriber(unsigned depth, FrameDropPolicy policy);
+    void push(const FrameRef& frame);
+    void close();
+
+    FrameDropPolicy dropPolicy;
+    std::mutex lock;
+    std::unique_ptr<OSEvent> frameAvail;
+#ifndef _WIN32
+    OSPollableEvent frameReady;
+#endif
+    std::vector<FrameRef> queue;
+    unsigned head;
+    unsigned count;
+    bool isClosed;
+
+    std::atomic<uint64_t> delivered;
+    std::atomic<uint64_t> dropped;
+    std::atomic<uint64_t> cursor;
+
+    //disable copy constructor and assignment operator
+    FrameSubscriber(const FrameSubscriber&);
+    void operator=(const FrameSubscriber&);
+};
+
+class FrameBroadcaster {
+public:
+    // source must outlive the broadcaster and must not be read by anyone else meanwhile
+    FrameBroadcaster(CaptureInterface * source);
+    ~FrameBroadcaster();
+
+    // the pump starts with the first subscriber
+    std::shared_ptr<FrameSubscriber> subscribe(unsigned depth = 1, FrameDropPolicy policy = FRAME_DROP_OLDEST);
+    void unsubscribe(const std::shared_ptr<FrameSubscriber>& subscriber);
+    // stops the pump and closes every subscriber, their queued frames are released
+    void stop();
+
+    unsigned subscribers();
+    uint64_t framesBroadcast() const { return broadcast.load(std::memory_order_relaxed); }
+
+private:
+    void pump();
+
+    CaptureInterface * source;
+    std::mutex lock;
+    std::vector<std::shared_ptr<FrameSubscriber> > subs;
+    std::thread pumpThread;
+    std::atomic<bool> running;
+    std::atomic<uint64_t> broadcast;
+
+    //disable copy constructor and assignment operator
+    FrameBroadcaster(const FrameBroadcaster&);
+    void operator=(const FrameBroadcaster&);
+};
+
+#endif
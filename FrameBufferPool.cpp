@@ -0,0 +1,132 @@
+#include "FrameBufferPool.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+# include <windows.h>
+#else
+# include <sys/mman.h>
+#endif
+
+static size_t roundUp(size_t n, size_t to)
+{
+    return (n + to - 1) / to * to;
+}
+
+static unsigned char * mapPool(size_t& length, unsigned flags, bool& huge)
+{
+    huge = false;
+#ifdef _WIN32
+    if (flags & FRAME_POOL_HUGE_PAGES) {
+        // needs SeLockMemoryPrivilege, fall back to normal pages without it
+        size_t large = roundUp(length, GetLargePageMinimum() ? GetLargePageMinimum() : FRAME_POOL_HUGE_PAGE_SIZE);
+        void * p = VirtualAlloc(NULL, large, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (p != NULL) {
+            length = large;
+            huge = true;
+            return (unsigned char *)p;
+        }
+    }
+    return (unsigned char *)VirtualAlloc(NULL, length, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+# ifdef MAP_HUGETLB
+    if (flags & FRAME_POOL_HUGE_PAGES) {
+        // only succeeds when huge pages have been reserved (vm.nr_hugepages)
+        size_t large = roundUp(length, FRAME_POOL_HUGE_PAGE_SIZE);
+        void * p = mmap(NULL, large, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            length = large;
+            huge = true;
+            return (unsigned char *)p;
+        }
+    }
+# endif
+    void * p = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return NULL;
+# ifdef MADV_HUGEPAGE
+    // transparent huge pages: the kernel backs the 2 MB aligned parts when it can
+    if ((flags & FRAME_POOL_HUGE_PAGES) && madvise(p, length, MADV_HUGEPAGE) == 0) huge = true;
+# endif
+    return (unsigned char *)p;
+#endif
+}
+
+static void unmapPool(unsigned char * p, size_t length)
+{
+#ifdef _WIN32
+    VirtualFree(p, 0, MEM_RELEASE);
+#else
+    munmap(p, length);
+#endif
+}
+
+FrameBufferPool::FrameBufferPool(size_t bufferSize, unsigned count, unsigned flags)
+    : base(NULL), size(bufferSize), stride(roundUp(bufferSize ? bufferSize : 1, FRAME_POOL_ALIGNMENT)),
+      mapSize(0), numBuffers(count), huge(false), next(new std::atomic<uint32_t>[count ? count : 1])
+{
+    head = 0;
+    freeCount = 0;
+    if (count == 0) return;
+
+    mapSize = stride * count;
+    base = mapPool(mapSize, flags, huge);
+    if (base == NULL) {
+        printf("FrameBufferPool: cannot map %u buffers of %u bytes\n", count, (unsigned)bufferSize);
+        return;
+    }
+    // fault every page in now rather than in the middle of a frame
+    memset(base, 0, mapSize);
+
+    for (unsigned k = count; k > 0; k--) release(base + (k - 1) * stride);
+}
+
+FrameBufferPool::~FrameBufferPool()
+{
+    if (base != NULL) unmapPool(base, mapSize);
+}
+
+size_t FrameBufferPool::bufferSizeFor(RawFrameFormat format, unsigned width, unsigned height)
+{
+    if (format == PANACAST_FRAME_FORMAT_MJPEG) return (size_t)width * height * 2;
+    return rawFrameSize(format, width, height);
+}
+
+bool FrameBufferPool::owns(const void * p) const
+{
+    const unsigned char * c = (const unsigned char *)p;
+    return base != NULL && c >= base && c < base + stride * numBuffers && (size_t)(c - base) % stride == 0;
+}
+
+unsigned char * FrameBufferPool::acquire()
+{
+    uint64_t h = head.load(std::memory_order_acquire);
+    while (true) {
+        uint32_t top = (uint32_t)h;
+        if (top == 0) return NULL;
+        uint32_t below = next[top - 1].load(std::memory_order_relaxed);
+        // the tag changes on every update, so a top that was popped and pushed back meanwhile fails the CAS
+        uint64_t popped = ((h >> 32) + 1) << 32 | below;
+        if (head.compare_exchange_weak(h, popped, std::memory_order_acquire, std::memory_order_acquire)) {
+            freeCount.fetch_sub(1, std::memory_order_relaxed);
+            return base + (size_t)(top - 1) * stride;
+        }
+    }
+}
+
+void FrameBufferPool::release(unsigned char * buf)
+{
+    if (buf == NULL) return;
+    if (!owns(buf)) {
+        printf("FrameBufferPool: %p is not one of our buffers\n", (void *)buf);
+        return;
+    }
+    uint32_t idx = (uint32_t)((buf - base) / stride);
+
+    freeCount.fetch_add(1, std::memory_order_relaxed);
+    uint64_t h = head.load(std::memory_order_relaxed);
+    uint64_t pushed;
+    do {
+        next[idx].store((uint32_t)h, std::memory_order_relaxed);
+        pushed = ((h >> 32) + 1) << 32 | (idx + 1);
+    } while (!head.compare_exchange_weak(h, pushed, std::memory_order_release, std::memory_order_relaxed));
+}
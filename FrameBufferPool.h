@@ -0,0 +1,69 @@
+//
+//  FrameBufferPool.h
+//
+//  Fixed set of equally sized frame buffers, allocated once when the format
+//  is known and then recycled, so steady-state capture does no heap
+//  allocation at all. Buffers are page aligned (so also cache line and SIMD
+//  aligned), prefaulted, and the whole pool can be put on 2 MB huge pages to
+//  cut TLB misses when 4K frames are walked by converters and encoders.
+//  acquire and release are lock-free and can be called from any thread.
+//
+
+#ifndef FRAMEBUFFERPOOL_H
+#define FRAMEBUFFERPOOL_H
+
+#include "PCCameraInterface.h"
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+
+#define FRAME_POOL_ALIGNMENT 4096
+#define FRAME_POOL_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+enum FrameBufferPoolFlags {
+    FRAME_POOL_HUGE_PAGES = 1, // explicit huge pages if reserved, else ask for transparent ones
+};
+
+class FrameBufferPool {
+public:
+    FrameBufferPool(size_t bufferSize, unsigned count, unsigned flags = 0);
+    ~FrameBufferPool();
+
+    // largest frame of this format, MJPEG is bounded by the uncompressed YUYV size
+    static size_t bufferSizeFor(RawFrameFormat format, unsigned width, unsigned height);
+
+    // false if the memory could not be mapped
+    bool valid() const { return base != NULL; }
+
+    // NULL when every buffer is out; never allocates
+    unsigned char * acquire();
+    void release(unsigned char * buf);
+
+    bool owns(const void * p) const;
+    size_t bufferSize() const { return size; }
+    unsigned count() const { return numBuffers; }
+    unsigned available() const { return freeCount.load(std::memory_order_relaxed); }
+    // the pool sits on huge pages, or the kernel was asked to use them
+    bool hugePages() const { return huge; }
+
+private:
+    unsigned char * base;
+    size_t size;
+    size_t stride;
+    size_t mapSize;
+    unsigned numBuffers;
+    bool huge;
+
+    // Treiber stack of buffer indices: head holds an ABA tag in the upper 32 bits and
+    // index + 1 of the top buffer in the lower, next[k] the index + 1 below buffer k
+    std::atomic<uint64_t> head;
+    std::unique_ptr<std::atomic<uint32_t>[]> next;
+    std::atomic<unsigned> freeCount;
+
+    //disable copy constructor and assignment operator
+    FrameBufferPool(const FrameBufferPool&);
+    void operator=(const FrameBufferPool&);
+};
+
+#endif
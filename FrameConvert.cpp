@@ -0,0 +1,302 @@
+#include "FrameConvertKernels.h"
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+
+#if defined(CONVERT_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+static ConvertIsa detectIsa()
+{
+#if defined(CONVERT_X86) && defined(__GNUC__)
+    // libgcc also checks that the OS saves the AVX and AVX-512 registers
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) return CONVERT_ISA_AVX512;
+    if (__builtin_cpu_supports("avx2")) return CONVERT_ISA_AVX2;
+    if (__builtin_cpu_supports("sse4.1")) return CONVERT_ISA_SSE41;
+#elif defined(CONVERT_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    bool sse41 = (info[2] & (1 << 19)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    // XCR0: the OS saves the YMM registers (bits 1-2), and the AVX-512 state (bits 5-7)
+    unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+    __cpuidex(info, 7, 0);
+    bool avx2 = (info[1] & (1 << 5)) != 0 && (xcr0 & 0x6) == 0x6;
+    bool avx512 = (info[1] & (1 << 16)) != 0 && (info[1] & (1 << 30)) != 0 && (xcr0 & 0xe6) == 0xe6;
+    if (avx512) return CONVERT_ISA_AVX512;
+    if (avx2) return CONVERT_ISA_AVX2;
+    if (sse41) return CONVERT_ISA_SSE41;
+#endif
+    return CONVERT_ISA_SCALAR;
+}
+
+ConvertIsa convertCpuIsa()
+{
+    static const ConvertIsa isa = detectIsa();
+    return isa;
+}
+
+static ConvertIsa limitFromEnvironment()
+{
+    const char * env = getenv("PANACAST_CONVERT_ISA");
+    if (env != NULL) {
+        for (unsigned k = 0; k < CONVERT_ISAS; k++) {
+            if (strcmp(env, convertIsaName((ConvertIsa)k)) == 0) return (ConvertIsa)k;
+        }
+    }
+    return CONVERT_ISA_AVX512;
+}
+
+static std::atomic<int> isaLimit(limitFromEnvironment());
+
+ConvertIsa convertIsa()
+{
+    ConvertIsa cpu = convertCpuIsa();
+    int limit = isaLimit.load(std::memory_order_relaxed);
+    return limit < cpu ? (ConvertIsa)limit : cpu;
+}
+
+void convertLimitIsa(ConvertIsa isa)
+{
+    isaLimit = isa >= CONVERT_ISAS ? CONVERT_ISA_AVX512 : isa;
+}
+
+const char * convertIsaName(ConvertIsa isa)
+{
+    switch (isa) {
+        case CONVERT_ISA_SCALAR: return "scalar";
+        case CONVERT_ISA_SSE41: return "sse4.1";
+        case CONVERT_ISA_AVX2: return "avx2";
+        case CONVERT_ISA_AVX512: return "avx512";
+        default: return "unknown";
+    }
+}
+
+// table[isa] is table[isa - 1] with whatever that instruction set does better
+struct KernelTables {
+    ConvertKernels table[CONVERT_ISAS];
+
+    KernelTables()
+    {
+        convertKernelsScalar(table[CONVERT_ISA_SCALAR]);
+#ifdef CONVERT_X86
+        table[CONVERT_ISA_SSE41] = table[CONVERT_ISA_SCALAR];
+        convertKernelsSSE41(table[CONVERT_ISA_SSE41]);
+        table[CONVERT_ISA_AVX2] = table[CONVERT_ISA_SSE41];
+        convertKernelsAVX2(table[CONVERT_ISA_AVX2]);
+        table[CONVERT_ISA_AVX512] = table[CONVERT_ISA_AVX2];
+        convertKernelsAVX512(table[CONVERT_ISA_AVX512]);
+#else
+        // non-x86 builds leave the x86 kernel files out, every table is the scalar one
+        table[CONVERT_ISA_SSE41] = table[CONVERT_ISA_AVX2] = table[CONVERT_ISA_AVX512] = table[CONVERT_ISA_SCALAR];
+#endif
+    }
+};
+
+static const ConvertKernels& kernelsFor(ConvertIsa isa)
+{
+    static const KernelTables tables;
+    return tables.table[isa];
+}
+
+const ConvertKernels& convertKernels(ConvertIsa isa)
+{
+    if (isa == CONVERT_ISA_AUTO) isa = convertIsa();
+    else if (isa > convertCpuIsa()) isa = convertCpuIsa();
+    return kernelsFor(isa);
+}
+
+static unsigned rgbIndex(RawFrameFormat format)
+{
+    return format == PANACAST_FRAME_FORMAT_BGR24 ? 0 : format == PANACAST_FRAME_FORMAT_RGB24 ? 1 : 2;
+}
+
+static void copyRows(const uint8_t * src, unsigned srcStride, uint8_t * dst, unsigned dstStride, unsigned bytes, unsigned rows)
+{
+    for (unsigned y = 0; y < rows; y++, src += srcStride, dst += dstStride) memcpy(dst, src, bytes);
+}
+
+// The row kernels with the scalar ones finishing what the vector ones leave over. x is
+// always a whole number of vector blocks, so even, and x / 2 is where the chroma planes are.
+
+static void toRGB(const ConvertKernels& k, bool uyvy, unsigned to, const uint8_t * src, uint8_t * dst, unsigned width)
+{
+    const unsigned bpp = to == 2 ? 4 : 3;
+    unsigned x = k.toRGB[uyvy][to](src, dst, width);
+    if (x < width) kernelsFor(CONVERT_ISA_SCALAR).toRGB[uyvy][to](src + x * 2, dst + x * bpp, width - x);
+}
+
+static void swap(const ConvertKernels& k, const uint8_t * src, uint8_t * dst, unsigned width)
+{
+    unsigned x = k.swap(src, dst, width);
+    if (x < width) kernelsFor(CONVERT_ISA_SCALAR).swap(src + x * 2, dst + x * 2, width - x);
+}
+
+static void interleave(const ConvertKernels& k, bool nv12, bool uyvy, const uint8_t * y, const uint8_t * u, const uint8_t * v,
+                       uint8_t * dst, unsigned width)
+{
+    unsigned x = k.interleave[nv12][uyvy](y, u, v, dst, width);
+    if (x < width) {
+        kernelsFor(CONVERT_ISA_SCALAR).interleave[nv12][uyvy](y + x, nv12 ? u + x : u + x / 2, nv12 ? NULL : v + x / 2,
+                                                              dst + x * 2, width - x);
+    }
+}
+
+static void deinterleave(const ConvertKernels& k, bool uyvy, bool nv12, const uint8_t * src0, const uint8_t * src1,
+                         uint8_t * y0, uint8_t * y1, uint8_t * u, uint8_t * v, unsigned width)
+{
+    unsigned x = k.deinterleave[uyvy][nv12](src0, src1, y0, y1, u, v, width);
+    if (x < width) {
+        kernelsFor(CONVERT_ISA_SCALAR).deinterleave[uyvy][nv12](src0 + x * 2, src1 + x * 2, y0 + x, y1 + x,
+                                                               nv12 ? u + x : u + x / 2, nv12 ? NULL : v + x / 2, width - x);
+    }
+}
+
+static void splitUV(const ConvertKernels& k, const uint8_t * uv, uint8_t * u, uint8_t * v, unsigned width)
+{
+    unsigned x = k.splitUV(uv, u, v, width);
+    if (x < width) kernelsFor(CONVERT_ISA_SCALAR).splitUV(uv + x, u + x / 2, v + x / 2, width - x);
+}
+
+static void mergeUV(const ConvertKernels& k, const uint8_t * u, const uint8_t * v, uint8_t * uv, unsigned width)
+{
+    unsigned x = k.mergeUV(u, v, uv, width);
+    if (x < width) kernelsFor(CONVERT_ISA_SCALAR).mergeUV(u + x / 2, v + x / 2, uv + x, width - x);
+}
+
+// 4:2:0 to RGB goes through packed 4:2:2 a piece of a row at a time, small enough to stay
+// in L1 and a multiple of every vector block
+static const unsigned CHUNK_PIXELS = 1024;
+
+bool convertSupported(RawFrameFormat from, RawFrameFormat to)
+{
+    if (!isPacked422(from) && !is420(from)) return false;
+    return isPacked422(to) || is420(to) || isPackedRGB(to);
+}
+
+// rows [y0, y1) of a frame, y0 and y1 even wherever 4:2:0 is involved
+static void convertRows(const ConvertKernels& k, const Planes& in, RawFrameFormat from, const Planes& out, RawFrameFormat to,
+                        unsigned width, unsigned y0, unsigned y1)
+{
+    bool uyvyIn = from == PANACAST_FRAME_FORMAT_UYVY, uyvyOut = to == PANACAST_FRAME_FORMAT_UYVY;
+    bool nv12In = from == PANACAST_FRAME_FORMAT_NV12, nv12Out = to == PANACAST_FRAME_FORMAT_NV12;
+    unsigned rows = y1 - y0, c0 = y0 / 2, chromaRows = rows / 2;
+
+    if (from == to) {
+        copyRows(in.y + (size_t)y0 * in.stride, in.stride, out.y + (size_t)y0 * out.stride, out.stride,
+                 rowBytes(from, width), rows);
+        if (nv12In) {
+            copyRows(in.u + (size_t)c0 * in.stride, in.stride, out.u + (size_t)c0 * out.stride, out.stride, width, chromaRows);
+        }
+        if (is420(from) && !nv12In) {
+            copyRows(in.u + (size_t)c0 * in.chromaStride, in.chromaStride, out.u + (size_t)c0 * out.chromaStride,
+                     out.chromaStride, width / 2, chromaRows);
+            copyRows(in.v + (size_t)c0 * in.chromaStride, in.chromaStride, out.v + (size_t)c0 * out.chromaStride,
+                     out.chromaStride, width / 2, chromaRows);
+        }
+    } else if (isPacked422(from)) {
+        if (isPackedRGB(to)) {
+            for (unsigned y = y0; y < y1; y++) {
+                toRGB(k, uyvyIn, rgbIndex(to), in.y + (size_t)y * in.stride, out.y + (size_t)y * out.stride, width);
+            }
+        } else if (isPacked422(to)) {
+            for (unsigned y = y0; y < y1; y++) {
+                swap(k, in.y + (size_t)y * in.stride, out.y + (size_t)y * out.stride, width);
+            }
+        } else {
+            for (unsigned y = y0; y < y1; y += 2) {
+                const uint8_t * row = in.y + (size_t)y * in.stride;
+                uint8_t * luma = out.y + (size_t)y * out.stride;
+                size_t c = (size_t)(y / 2) * out.chromaStride;
+                deinterleave(k, uyvyIn, nv12Out, row, row + in.stride, luma, luma + out.stride,
+                             out.u + c, nv12Out ? NULL : out.v + c, width);
+            }
+        }
+    } else if (isPacked422(to) || isPackedRGB(to)) {
+        uint8_t scratch[CHUNK_PIXELS * 2];
+        for (unsigned y = y0; y < y1; y++) {
+            const uint8_t * luma = in.y + (size_t)y * in.stride;
+            size_t c = (size_t)(y / 2) * in.chromaStride;
+            const uint8_t * u = in.u + c;
+            const uint8_t * v = nv12In ? NULL : in.v + c;
+            uint8_t * row = out.y + (size_t)y * out.stride;
+            if (isPacked422(to)) {
+                interleave(k, nv12In, uyvyOut, luma, u, v, row, width);
+                continue;
+            }
+            const unsigned bpp = to == PANACAST_FRAME_FORMAT_BGRA32 ? 4 : 3;
+            for (unsigned x = 0; x < width; x += CHUNK_PIXELS) {
+                unsigned n = width - x < CHUNK_PIXELS ? width - x : CHUNK_PIXELS;
+                interleave(k, nv12In, false, luma + x, nv12In ? u + x : u + x / 2, nv12In ? NULL : v + x / 2, scratch, n);
+                toRGB(k, false, rgbIndex(to), scratch, row + x * bpp, n);
+            }
+        }
+    } else {
+        // 4:2:0 to 4:2:0: the luma plane as it is, the chroma reshuffled
+        copyRows(in.y + (size_t)y0 * in.stride, in.stride, out.y + (size_t)y0 * out.stride, out.stride, width, rows);
+        for (unsigned y = c0; y < c0 + chromaRows; y++) {
+            if (nv12In) {
+                splitUV(k, in.u + (size_t)y * in.stride, out.u + (size_t)y * out.chromaStride,
+                        out.v + (size_t)y * out.chromaStride, width);
+            } else if (nv12Out) {
+                mergeUV(k, in.u + (size_t)y * in.chromaStride, in.v + (size_t)y * in.chromaStride,
+                        out.u + (size_t)y * out.stride, width);
+            } else {
+                memcpy(out.u + (size_t)y * out.chromaStride, in.u + (size_t)y * in.chromaStride, width / 2);
+                memcpy(out.v + (size_t)y * out.chromaStride, in.v + (size_t)y * in.chromaStride, width / 2);
+            }
+        }
+    }
+}
+
+static bool convertFrameOn(FrameWorkers * workers, const uint8_t * src, unsigned srcStride, RawFrameFormat from,
+                           uint8_t * dst, unsigned dstStride, RawFrameFormat to,
+                           unsigned width, unsigned height, ConvertIsa isa)
+{
+    if (!convertSupported(from, to) || (width & 1)) return false;
+    if ((is420(from) || is420(to)) && (height & 1)) return false;
+
+    const ConvertKernels& k = convertKernels(isa);
+
+    if (srcStride == 0) srcStride = rowBytes(from, width);
+    if (dstStride == 0) dstStride = rowBytes(to, width);
+    Planes in(src, srcStride, from, height), out(dst, dstStride, to, height);
+
+    if (workers == NULL || workers->threads() == 1) {
+        convertRows(k, in, from, out, to, width, 0, height);
+        return true;
+    }
+    // bands of whole 4:2:0 row pairs, the odd row of an odd height goes with the last band
+    unsigned rows = FrameWorkers::bandRows(rowBytes(from, width) + rowBytes(to, width), 2);
+    unsigned bands = height / rows + (height % rows >= 2 ? 1 : 0);
+    if (bands == 0) bands = 1;
+    // one reference is all the job captures, small enough for std::function not to allocate
+    struct Job {
+        const ConvertKernels& k;
+        const Planes& in;
+        const Planes& out;
+        RawFrameFormat from, to;
+        unsigned width, height, rows, bands;
+    } job = { k, in, out, from, to, width, height, rows, bands };
+    workers->run(bands, [&job](unsigned band) {
+        unsigned y0 = band * job.rows, y1 = band == job.bands - 1 ? job.height : y0 + job.rows;
+        convertRows(job.k, job.in, job.from, job.out, job.to, job.width, y0, y1);
+    });
+    return true;
+}
+
+bool convertFrame(const uint8_t * src, unsigned srcStride, RawFrameFormat from,
+                  uint8_t * dst, unsigned dstStride, RawFrameFormat to,
+                  unsigned width, unsigned height, ConvertIsa isa)
+{
+    return convertFrameOn(NULL, src, srcStride, from, dst, dstStride, to, width, height, isa);
+}
+
+bool convertFrameParallel(FrameWorkers& workers, const uint8_t * src, unsigned srcStride, RawFrameFormat from,
+                          uint8_t * dst, unsigned dstStride, RawFrameFormat to,
+                          unsigned width, unsigned height, ConvertIsa isa)
+{
+    return convertFrameOn(&workers, src, srcStride, from, dst, dstStride, to, width, height, isa);
+}
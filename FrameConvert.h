@@ -0,0 +1,58 @@
+//
+//  FrameConvert.h
+//
+//  Conversion between the YUV layouts cameras deliver (YUYV, UYVY, NV12, YV12
+//  and I420), and from them to packed RGB for consumers that want pixels
+//  rather than YUV. 4:2:0 is turned into 4:2:2 by using each chroma row for
+//  two luma rows, and back by averaging two. Every kernel has a scalar version and,
+//  on x86, SSE4.1, AVX2 and AVX-512 versions; the widest one the CPU and OS
+//  support is picked at run time, so one binary runs everywhere. All of them
+//  produce bit-identical output (BT.601 limited range in 8 bit fixed point,
+//  the coefficients OpenCV uses), which makes the scalar kernel the reference
+//  the vector ones are tested against.
+//
+
+#ifndef FRAMECONVERT_H
+#define FRAMECONVERT_H
+
+#include "FrameWorkers.h"
+#include "PCCameraInterface.h"
+#include <stdint.h>
+
+enum ConvertIsa {
+    CONVERT_ISA_SCALAR,
+    CONVERT_ISA_SSE41,
+    CONVERT_ISA_AVX2,
+    CONVERT_ISA_AVX512, // AVX-512 F and BW
+    CONVERT_ISAS,
+    CONVERT_ISA_AUTO = CONVERT_ISAS, // whatever convertIsa returns
+};
+
+// widest instruction set this CPU and OS support, detected once
+ConvertIsa convertCpuIsa();
+// What the converters use: convertCpuIsa, capped by convertLimitIsa or by the
+// PANACAST_CONVERT_ISA environment variable ("scalar", "sse4.1", "avx2", "avx512").
+ConvertIsa convertIsa();
+void convertLimitIsa(ConvertIsa isa);
+const char * convertIsaName(ConvertIsa isa);
+
+// true if convertFrame can turn frames in format from into format to; MJPEG has to be
+// decoded first, and packed RGB is only ever an output
+bool convertSupported(RawFrameFormat from, RawFrameFormat to);
+
+// Convert width x height pixels from src to dst. Strides are bytes per row of the first
+// plane, 0 for rows packed back to back; the other planes follow it in the same buffer
+// as in rawFrameSize, NV12's UV plane with the same stride, YV12's and I420's chroma
+// planes with half of it. isa picks the kernels for tests and benchmarks, it is lowered
+// to what the CPU has. false if the pair is unsupported, the width is odd, or the height
+// is odd and either side is 4:2:0.
+bool convertFrame(const uint8_t * src, unsigned srcStride, RawFrameFormat from,
+                  uint8_t * dst, unsigned dstStride, RawFrameFormat to,
+                  unsigned width, unsigned height, ConvertIsa isa = CONVERT_ISA_AUTO);
+
+// convertFrame in cache sized bands of rows spread over workers, same result
+bool convertFrameParallel(FrameWorkers& workers, const uint8_t * src, unsigned srcStride, RawFrameFormat from,
+                          uint8_t * dst, unsigned dstStride, RawFrameFormat to,
+                          unsigned width, unsigned height, ConvertIsa isa = CONVERT_ISA_AUTO);
+
+#endif
@@ -0,0 +1,265 @@
+#include "FrameConvertKernels.h"
+
+#ifdef CONVERT_X86
+
+#include <immintrin.h>
+
+#define TARGET CONVERT_TARGET("avx2")
+
+// The arithmetic is FrameConvertSSE41.cpp's twice over: every instruction works within
+// 128 bit lanes, so only putting the pixels back in order at the end is new.
+
+static inline TARGET __m256i pair16(int a, int b)
+{
+    return _mm256_set1_epi32((int)(((uint32_t)(uint16_t)b << 16) | (uint16_t)a));
+}
+
+// 16 pixels of YUYV or UYVY to 16 bit R, G and B, pixels 0-7 in the low lane
+template <bool UYVY>
+static inline TARGET void yuv16(__m256i v, __m256i& r, __m256i& g, __m256i& b)
+{
+    const __m256i low = _mm256_set1_epi16(0xff);
+    __m256i y = UYVY ? _mm256_srli_epi16(v, 8) : _mm256_and_si256(v, low);
+    __m256i uv = UYVY ? _mm256_and_si256(v, low) : _mm256_srli_epi16(v, 8);
+    y = _mm256_sub_epi16(y, _mm256_set1_epi16(16));
+    uv = _mm256_sub_epi16(uv, _mm256_set1_epi16(128));
+
+    const __m256i yk = pair16(CONVERT_YG, 1), round = _mm256_set1_epi16(128);
+    __m256i y0 = _mm256_madd_epi16(_mm256_unpacklo_epi16(y, round), yk);
+    __m256i y1 = _mm256_madd_epi16(_mm256_unpackhi_epi16(y, round), yk);
+
+    __m256i cr = _mm256_madd_epi16(uv, pair16(0, CONVERT_VR));
+    __m256i cg = _mm256_madd_epi16(uv, pair16(CONVERT_UG, CONVERT_VG));
+    __m256i cb = _mm256_madd_epi16(uv, pair16(CONVERT_UB, 0));
+
+    r = _mm256_packs_epi32(_mm256_srai_epi32(_mm256_add_epi32(y0, _mm256_unpacklo_epi32(cr, cr)), 8),
+                           _mm256_srai_epi32(_mm256_add_epi32(y1, _mm256_unpackhi_epi32(cr, cr)), 8));
+    g = _mm256_packs_epi32(_mm256_srai_epi32(_mm256_add_epi32(y0, _mm256_unpacklo_epi32(cg, cg)), 8),
+                           _mm256_srai_epi32(_mm256_add_epi32(y1, _mm256_unpackhi_epi32(cg, cg)), 8));
+    b = _mm256_packs_epi32(_mm256_srai_epi32(_mm256_add_epi32(y0, _mm256_unpacklo_epi32(cb, cb)), 8),
+                           _mm256_srai_epi32(_mm256_add_epi32(y1, _mm256_unpackhi_epi32(cb, cb)), 8));
+}
+
+// 8 pixels of BGRA (4 per lane) down to 24 contiguous bytes of BGR
+static inline TARGET void store8x3(uint8_t * dst, __m256i p, bool last)
+{
+    const __m256i pack = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                          0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    p = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(p, pack), _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+    if (!last) {
+        // the 8 spare bytes are overwritten by the next store
+        _mm256_storeu_si256((__m256i *)dst, p);
+        return;
+    }
+    _mm_storeu_si128((__m128i *)dst, _mm256_castsi256_si128(p));
+    _mm_storel_epi64((__m128i *)(dst + 16), _mm256_extracti128_si256(p, 1));
+}
+
+// 32 pixels of 8 bit R, G and B, lanes as _mm256_packus_epi16 left them:
+// pixels 0-7 and 16-23 in the low lane, 8-15 and 24-31 in the high one
+template <RawFrameFormat TO>
+static inline TARGET void store32(uint8_t * dst, __m256i r, __m256i g, __m256i b)
+{
+    __m256i first = TO == PANACAST_FRAME_FORMAT_RGB24 ? r : b;
+    __m256i third = TO == PANACAST_FRAME_FORMAT_RGB24 ? b : r;
+    const __m256i alpha = _mm256_set1_epi8(-1);
+
+    // pixels 0-7 | 8-15 and 16-23 | 24-31
+    __m256i lo = _mm256_unpacklo_epi8(first, g), hi = _mm256_unpackhi_epi8(first, g);
+    __m256i lo2 = _mm256_unpacklo_epi8(third, alpha), hi2 = _mm256_unpackhi_epi8(third, alpha);
+    // 0-3 | 8-11, 4-7 | 12-15, 16-19 | 24-27, 20-23 | 28-31
+    __m256i p0 = _mm256_unpacklo_epi16(lo, lo2), p1 = _mm256_unpackhi_epi16(lo, lo2);
+    __m256i p2 = _mm256_unpacklo_epi16(hi, hi2), p3 = _mm256_unpackhi_epi16(hi, hi2);
+
+    __m256i o0 = _mm256_permute2x128_si256(p0, p1, 0x20);
+    __m256i o1 = _mm256_permute2x128_si256(p0, p1, 0x31);
+    __m256i o2 = _mm256_permute2x128_si256(p2, p3, 0x20);
+    __m256i o3 = _mm256_permute2x128_si256(p2, p3, 0x31);
+
+    if (TO == PANACAST_FRAME_FORMAT_BGRA32) {
+        _mm256_storeu_si256((__m256i *)dst, o0);
+        _mm256_storeu_si256((__m256i *)(dst + 32), o1);
+        _mm256_storeu_si256((__m256i *)(dst + 64), o2);
+        _mm256_storeu_si256((__m256i *)(dst + 96), o3);
+        return;
+    }
+    store8x3(dst, o0, false);
+    store8x3(dst + 24, o1, false);
+    store8x3(dst + 48, o2, false);
+    store8x3(dst + 72, o3, true);
+}
+
+template <bool UYVY, RawFrameFormat TO>
+static TARGET unsigned toRGBRow(const uint8_t * src, uint8_t * dst, unsigned width)
+{
+    const unsigned bpp = TO == PANACAST_FRAME_FORMAT_BGRA32 ? 4 : 3;
+    unsigned x = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m256i r0, g0, b0, r1, g1, b1;
+        yuv16<UYVY>(_mm256_loadu_si256((const __m256i *)(src + x * 2)), r0, g0, b0);
+        yuv16<UYVY>(_mm256_loadu_si256((const __m256i *)(src + x * 2 + 32)), r1, g1, b1);
+        store32<TO>(dst + x * bpp, _mm256_packus_epi16(r0, r1), _mm256_packus_epi16(g0, g1), _mm256_packus_epi16(b0, b1));
+    }
+    return x;
+}
+
+static TARGET unsigned swapRow(const uint8_t * src, uint8_t * dst, unsigned width)
+{
+    unsigned x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + x * 2));
+        _mm256_storeu_si256((__m256i *)(dst + x * 2), _mm256_or_si256(_mm256_slli_epi16(v, 8), _mm256_srli_epi16(v, 8)));
+    }
+    return x;
+}
+
+// widening each byte to 16 bits keeps the pixels in order across lanes, unlike unpacklo/hi
+template <bool NV12, bool UYVY>
+static TARGET unsigned interleaveRow(const uint8_t * y, const uint8_t * u, const uint8_t * v, uint8_t * dst, unsigned width)
+{
+    unsigned x = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m128i uv0, uv1;
+        if (NV12) {
+            uv0 = _mm_loadu_si128((const __m128i *)(u + x));
+            uv1 = _mm_loadu_si128((const __m128i *)(u + x + 16));
+        } else {
+            __m128i cu = _mm_loadu_si128((const __m128i *)(u + x / 2)), cv = _mm_loadu_si128((const __m128i *)(v + x / 2));
+            uv0 = _mm_unpacklo_epi8(cu, cv);
+            uv1 = _mm_unpackhi_epi8(cu, cv);
+        }
+        __m256i l0 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(y + x)));
+        __m256i l1 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(y + x + 16)));
+        __m256i c0 = _mm256_cvtepu8_epi16(uv0), c1 = _mm256_cvtepu8_epi16(uv1);
+        __m256i o0 = UYVY ? _mm256_or_si256(c0, _mm256_slli_epi16(l0, 8)) : _mm256_or_si256(l0, _mm256_slli_epi16(c0, 8));
+        __m256i o1 = UYVY ? _mm256_or_si256(c1, _mm256_slli_epi16(l1, 8)) : _mm256_or_si256(l1, _mm256_slli_epi16(c1, 8));
+        _mm256_storeu_si256((__m256i *)(dst + x * 2), o0);
+        _mm256_storeu_si256((__m256i *)(dst + x * 2 + 32), o1);
+    }
+    return x;
+}
+
+// the even and odd bytes of 64, in order
+static inline TARGET void evensOdds(const uint8_t * src, __m256i& evens, __m256i& odds)
+{
+    const __m256i low = _mm256_set1_epi16(0xff);
+    __m256i a = _mm256_loadu_si256((const __m256i *)src), b = _mm256_loadu_si256((const __m256i *)(src + 32));
+    evens = _mm256_permute4x64_epi64(_mm256_packus_epi16(_mm256_and_si256(a, low), _mm256_and_si256(b, low)), 0xd8);
+    odds = _mm256_permute4x64_epi64(_mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8)), 0xd8);
+}
+
+// 16 U bytes in the low lane, 16 V bytes in the high one
+static inline TARGET __m256i splitUV(__m256i uv)
+{
+    const __m256i low = _mm256_set1_epi16(0xff);
+    return _mm256_permute4x64_epi64(_mm256_packus_epi16(_mm256_and_si256(uv, low), _mm256_srli_epi16(uv, 8)), 0xd8);
+}
+
+template <bool UYVY, bool NV12>
+static TARGET unsigned deinterleaveRows(const uint8_t * src0, const uint8_t * src1, uint8_t * y0, uint8_t * y1,
+                                        uint8_t * u, uint8_t * v, unsigned width)
+{
+    unsigned x = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m256i e0, o0, e1, o1;
+        evensOdds(src0 + x * 2, e0, o0);
+        evensOdds(src1 + x * 2, e1, o1);
+        _mm256_storeu_si256((__m256i *)(y0 + x), UYVY ? o0 : e0);
+        _mm256_storeu_si256((__m256i *)(y1 + x), UYVY ? o1 : e1);
+        __m256i uv = UYVY ? _mm256_avg_epu8(e0, e1) : _mm256_avg_epu8(o0, o1);
+        if (NV12) {
+            _mm256_storeu_si256((__m256i *)(u + x), uv);
+        } else {
+            __m256i planes = splitUV(uv);
+            _mm_storeu_si128((__m128i *)(u + x / 2), _mm256_castsi256_si128(planes));
+            _mm_storeu_si128((__m128i *)(v + x / 2), _mm256_extracti128_si256(planes, 1));
+        }
+    }
+    return x;
+}
+
+static TARGET unsigned splitUVRow(const uint8_t * uv, uint8_t * u, uint8_t * v, unsigned width)
+{
+    unsigned x = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m256i planes = splitUV(_mm256_loadu_si256((const __m256i *)(uv + x)));
+        _mm_storeu_si128((__m128i *)(u + x / 2), _mm256_castsi256_si128(planes));
+        _mm_storeu_si128((__m128i *)(v + x / 2), _mm256_extracti128_si256(planes, 1));
+    }
+    return x;
+}
+
+static TARGET unsigned mergeUVRow(const uint8_t * u, const uint8_t * v, uint8_t * uv, unsigned width)
+{
+    unsigned x = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m256i cu = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(u + x / 2)));
+        __m256i cv = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(v + x / 2)));
+        _mm256_storeu_si256((__m256i *)(uv + x), _mm256_or_si256(cu, _mm256_slli_epi16(cv, 8)));
+    }
+    return x;
+}
+
+static TARGET unsigned accumulateRow(const uint8_t * src, uint16_t * acc, unsigned n, unsigned weight)
+{
+    const __m256i w = _mm256_set1_epi16((short)weight);
+    unsigned x = 0;
+    for (; x + 32 <= n; x += 32) {
+        __m128i s0 = _mm_loadu_si128((const __m128i *)(src + x)), s1 = _mm_loadu_si128((const __m128i *)(src + x + 16));
+        __m256i lo = _mm256_mullo_epi16(_mm256_cvtepu8_epi16(s0), w), hi = _mm256_mullo_epi16(_mm256_cvtepu8_epi16(s1), w);
+        _mm256_storeu_si256((__m256i *)(acc + x), _mm256_add_epi16(_mm256_loadu_si256((const __m256i *)(acc + x)), lo));
+        _mm256_storeu_si256((__m256i *)(acc + x + 16), _mm256_add_epi16(_mm256_loadu_si256((const __m256i *)(acc + x + 16)), hi));
+    }
+    return x;
+}
+
+static TARGET unsigned differenceRow(const uint8_t * src, uint8_t * ref, unsigned n, unsigned mask, uint32_t * sum)
+{
+    const __m256i keep = _mm256_set1_epi16((short)mask);
+    __m256i total = _mm256_setzero_si256();
+    unsigned x = 0;
+    for (; x + 32 <= n; x += 32) {
+        __m256i s = _mm256_loadu_si256((const __m256i *)(src + x)), r = _mm256_loadu_si256((const __m256i *)(ref + x));
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(_mm256_and_si256(s, keep), _mm256_and_si256(r, keep)));
+        _mm256_storeu_si256((__m256i *)(ref + x), s);
+    }
+    __m128i half = _mm_add_epi64(_mm256_castsi256_si128(total), _mm256_extracti128_si256(total, 1));
+    half = _mm_add_epi32(half, _mm_srli_si128(half, 8));
+    *sum += (uint32_t)_mm_cvtsi128_si32(half);
+    return x;
+}
+
+template <bool UYVY>
+static void fillToRGB(ConvertKernels& k)
+{
+    k.toRGB[UYVY][0] = toRGBRow<UYVY, PANACAST_FRAME_FORMAT_BGR24>;
+    k.toRGB[UYVY][1] = toRGBRow<UYVY, PANACAST_FRAME_FORMAT_RGB24>;
+    k.toRGB[UYVY][2] = toRGBRow<UYVY, PANACAST_FRAME_FORMAT_BGRA32>;
+}
+
+void convertKernelsAVX2(ConvertKernels& k)
+{
+    fillToRGB<false>(k);
+    fillToRGB<true>(k);
+    k.swap = swapRow;
+    k.interleave[0][0] = interleaveRow<false, false>;
+    k.interleave[0][1] = interleaveRow<false, true>;
+    k.interleave[1][0] = interleaveRow<true, false>;
+    k.interleave[1][1] = interleaveRow<true, true>;
+    k.deinterleave[0][0] = deinterleaveRows<false, false>;
+    k.deinterleave[0][1] = deinterleaveRows<false, true>;
+    k.deinterleave[1][0] = deinterleaveRows<true, false>;
+    k.deinterleave[1][1] = deinterleaveRows<true, true>;
+    k.splitUV = splitUVRow;
+    k.mergeUV = mergeUVRow;
+    k.accumulate = accumulateRow;
+    k.difference = differenceRow;
+}
+
+#else
+
+void convertKernelsAVX2(ConvertKernels& k)
+{
+}
+
+#endif
@@ -0,0 +1,126 @@
+#include "FrameConvertKernels.h"
+
+#ifdef CONVERT_X86
+
+#include <immintrin.h>
+
+// GCC 12's own _mm512_set1 and broadcast intrinsics trip this over their undefined source operand
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+#define TARGET CONVERT_TARGET("avx512f,avx512bw")
+
+// FrameConvertAVX2.cpp with four 128 bit lanes instead of two
+
+static inline TARGET __m512i pair16(int a, int b)
+{
+    return _mm512_set1_epi32((int)(((uint32_t)(uint16_t)b << 16) | (uint16_t)a));
+}
+
+// 32 pixels of YUYV or UYVY to 16 bit R, G and B, 8 pixels per lane
+template <bool UYVY>
+static inline TARGET void yuv32(__m512i v, __m512i& r, __m512i& g, __m512i& b)
+{
+    const __m512i low = _mm512_set1_epi16(0xff);
+    __m512i y = UYVY ? _mm512_srli_epi16(v, 8) : _mm512_and_si512(v, low);
+    __m512i uv = UYVY ? _mm512_and_si512(v, low) : _mm512_srli_epi16(v, 8);
+    y = _mm512_sub_epi16(y, _mm512_set1_epi16(16));
+    uv = _mm512_sub_epi16(uv, _mm512_set1_epi16(128));
+
+    const __m512i yk = pair16(CONVERT_YG, 1), round = _mm512_set1_epi16(128);
+    __m512i y0 = _mm512_madd_epi16(_mm512_unpacklo_epi16(y, round), yk);
+    __m512i y1 = _mm512_madd_epi16(_mm512_unpackhi_epi16(y, round), yk);
+
+    __m512i cr = _mm512_madd_epi16(uv, pair16(0, CONVERT_VR));
+    __m512i cg = _mm512_madd_epi16(uv, pair16(CONVERT_UG, CONVERT_VG));
+    __m512i cb = _mm512_madd_epi16(uv, pair16(CONVERT_UB, 0));
+
+    r = _mm512_packs_epi32(_mm512_srai_epi32(_mm512_add_epi32(y0, _mm512_unpacklo_epi32(cr, cr)), 8),
+                           _mm512_srai_epi32(_mm512_add_epi32(y1, _mm512_unpackhi_epi32(cr, cr)), 8));
+    g = _mm512_packs_epi32(_mm512_srai_epi32(_mm512_add_epi32(y0, _mm512_unpacklo_epi32(cg, cg)), 8),
+                           _mm512_srai_epi32(_mm512_add_epi32(y1, _mm512_unpackhi_epi32(cg, cg)), 8));
+    b = _mm512_packs_epi32(_mm512_srai_epi32(_mm512_add_epi32(y0, _mm512_unpacklo_epi32(cb, cb)), 8),
+                           _mm512_srai_epi32(_mm512_add_epi32(y1, _mm512_unpackhi_epi32(cb, cb)), 8));
+}
+
+// 16 pixels of BGRA (4 per lane) down to 48 contiguous bytes of BGR
+static inline TARGET void store16x3(uint8_t * dst, __m512i p)
+{
+    const __m512i pack = _mm512_broadcast_i32x4(_mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1));
+    const __m512i compact = _mm512_setr_epi32(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, 15, 15, 15, 15);
+    p = _mm512_permutexvar_epi32(compact, _mm512_shuffle_epi8(p, pack));
+    _mm512_mask_storeu_epi8(dst, 0xffffffffffffULL, p);
+}
+
+// 64 pixels of 8 bit R, G and B; lane k has pixels 8k to 8k+7 and 32+8k to 32+8k+7
+template <RawFrameFormat TO>
+static inline TARGET void store64(uint8_t * dst, __m512i r, __m512i g, __m512i b)
+{
+    __m512i first = TO == PANACAST_FRAME_FORMAT_RGB24 ? r : b;
+    __m512i third = TO == PANACAST_FRAME_FORMAT_RGB24 ? b : r;
+    const __m512i alpha = _mm512_set1_epi8(-1);
+
+    __m512i lo = _mm512_unpacklo_epi8(first, g), hi = _mm512_unpackhi_epi8(first, g);
+    __m512i lo2 = _mm512_unpacklo_epi8(third, alpha), hi2 = _mm512_unpackhi_epi8(third, alpha);
+    // lane k of p0 has pixels 8k to 8k+3, of p1 8k+4 to 8k+7, p2 and p3 the same 32 further on
+    __m512i p0 = _mm512_unpacklo_epi16(lo, lo2), p1 = _mm512_unpackhi_epi16(lo, lo2);
+    __m512i p2 = _mm512_unpacklo_epi16(hi, hi2), p3 = _mm512_unpackhi_epi16(hi, hi2);
+
+    const __m512i firstHalf = _mm512_setr_epi64(0, 1, 8, 9, 2, 3, 10, 11);
+    const __m512i secondHalf = _mm512_setr_epi64(4, 5, 12, 13, 6, 7, 14, 15);
+    __m512i o0 = _mm512_permutex2var_epi64(p0, firstHalf, p1);
+    __m512i o1 = _mm512_permutex2var_epi64(p0, secondHalf, p1);
+    __m512i o2 = _mm512_permutex2var_epi64(p2, firstHalf, p3);
+    __m512i o3 = _mm512_permutex2var_epi64(p2, secondHalf, p3);
+
+    if (TO == PANACAST_FRAME_FORMAT_BGRA32) {
+        _mm512_storeu_si512(dst, o0);
+        _mm512_storeu_si512(dst + 64, o1);
+        _mm512_storeu_si512(dst + 128, o2);
+        _mm512_storeu_si512(dst + 192, o3);
+        return;
+    }
+    store16x3(dst, o0);
+    store16x3(dst + 48, o1);
+    store16x3(dst + 96, o2);
+    store16x3(dst + 144, o3);
+}
+
+template <bool UYVY, RawFrameFormat TO>
+static TARGET unsigned toRGBRow(const uint8_t * src, uint8_t * dst, unsigned width)
+{
+    const unsigned bpp = TO == PANACAST_FRAME_FORMAT_BGRA32 ? 4 : 3;
+    unsigned x = 0;
+    for (; x + 64 <= width; x += 64) {
+        __m512i r0, g0, b0, r1, g1, b1;
+        yuv32<UYVY>(_mm512_loadu_si512(src + x * 2), r0, g0, b0);
+        yuv32<UYVY>(_mm512_loadu_si512(src + x * 2 + 64), r1, g1, b1);
+        store64<TO>(dst + x * bpp, _mm512_packus_epi16(r0, r1), _mm512_packus_epi16(g0, g1), _mm512_packus_epi16(b0, b1));
+    }
+    return x;
+}
+
+template <bool UYVY>
+static void fillToRGB(ConvertKernels& k)
+{
+    k.toRGB[UYVY][0] = toRGBRow<UYVY, PANACAST_FRAME_FORMAT_BGR24>;
+    k.toRGB[UYVY][1] = toRGBRow<UYVY, PANACAST_FRAME_FORMAT_RGB24>;
+    k.toRGB[UYVY][2] = toRGBRow<UYVY, PANACAST_FRAME_FORMAT_BGRA32>;
+}
+
+// only the colour conversion is compute bound enough to gain from 512 bits,
+// the byte shuffling kernels stay AVX2 ones
+void convertKernelsAVX512(ConvertKernels& k)
+{
+    fillToRGB<false>(k);
+    fillToRGB<true>(k);
+}
+
+#else
+
+void convertKernelsAVX512(ConvertKernels& k)
+{
+}
+
+#endif
@@ -0,0 +1,133 @@
+//
+//  FrameConvertKernels.h
+//
+//  What FrameConvert.cpp and the per instruction set kernel files share. Each
+//  FrameConvert<ISA>.cpp is compiled with the same flags as everything else
+//  and marks its functions with CONVERT_TARGET instead, so only the dispatcher
+//  decides whether they ever run. FrameScale.cpp and MotionGate.cpp use the same tables.
+//
+
+#ifndef FRAMECONVERTKERNELS_H
+#define FRAMECONVERTKERNELS_H
+
+#include "FrameConvert.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define CONVERT_X86 1
+#if defined(__GNUC__)
+#define CONVERT_TARGET(isa) __attribute__((target(isa)))
+#else
+// MSVC lets any function use any intrinsic
+#define CONVERT_TARGET(isa)
+#endif
+#endif
+
+// BT.601 limited range, 8 fractional bits:
+//   R = (298 (Y - 16)                 + 409 (V - 128) + 128) >> 8
+//   G = (298 (Y - 16) - 100 (U - 128) - 208 (V - 128) + 128) >> 8
+//   B = (298 (Y - 16) + 516 (U - 128)                 + 128) >> 8
+#define CONVERT_YG 298
+#define CONVERT_VR 409
+#define CONVERT_UG (-100)
+#define CONVERT_VG (-208)
+#define CONVERT_UB 516
+
+inline bool isPacked422(RawFrameFormat format)
+{
+    return format == PANACAST_FRAME_FORMAT_YUYV || format == PANACAST_FRAME_FORMAT_UYVY;
+}
+
+inline bool is420(RawFrameFormat format)
+{
+    return format == PANACAST_FRAME_FORMAT_NV12 || format == PANACAST_FRAME_FORMAT_YV12 ||
+           format == PANACAST_FRAME_FORMAT_I420;
+}
+
+inline bool isPackedRGB(RawFrameFormat format)
+{
+    return format == PANACAST_FRAME_FORMAT_BGR24 || format == PANACAST_FRAME_FORMAT_RGB24 ||
+           format == PANACAST_FRAME_FORMAT_BGRA32;
+}
+
+// bytes per row of the first plane
+inline unsigned rowBytes(RawFrameFormat format, unsigned width)
+{
+    if (is420(format)) return width;
+    if (isPacked422(format)) return width * 2;
+    return format == PANACAST_FRAME_FORMAT_BGRA32 ? width * 4 : width * 3;
+}
+
+// Where the planes of a frame in one buffer are. NV12's UV plane has the luma stride,
+// YV12's and I420's chroma planes half of it; u is NV12's UV plane.
+struct Planes {
+    uint8_t * y;
+    uint8_t * u;
+    uint8_t * v;
+    unsigned stride;
+    unsigned chromaStride;
+
+    Planes(const uint8_t * buf, unsigned stride, RawFrameFormat format, unsigned height)
+        : y((uint8_t *)buf), u(NULL), v(NULL), stride(stride), chromaStride(stride)
+    {
+        if (!is420(format)) return;
+        uint8_t * chroma = y + (size_t)stride * height;
+        if (format == PANACAST_FRAME_FORMAT_NV12) {
+            u = chroma;
+            return;
+        }
+        chromaStride = stride / 2;
+        uint8_t * second = chroma + (size_t)chromaStride * (height / 2);
+        u = format == PANACAST_FRAME_FORMAT_I420 ? chroma : second;
+        v = format == PANACAST_FRAME_FORMAT_I420 ? second : chroma;
+    }
+};
+
+// Row kernels. width is in pixels and even. Each returns how many pixels it did, a whole
+// number of vector blocks for the SIMD ones; the scalar kernel of the same kind is called
+// on the rest. u and v are rows of a planar format's U and V planes; NV12 kernels get the
+// interleaved UV row as u and no v.
+
+// packed 4:2:2 to packed RGB
+typedef unsigned (*ToRGBRow)(const uint8_t * src, uint8_t * dst, unsigned width);
+// YUYV to UYVY, and back with the same byte swap
+typedef unsigned (*SwapRow)(const uint8_t * src, uint8_t * dst, unsigned width);
+// a 4:2:0 luma row and its chroma row to packed 4:2:2, the chroma row serves two luma rows
+typedef unsigned (*InterleaveRow)(const uint8_t * y, const uint8_t * u, const uint8_t * v, uint8_t * dst, unsigned width);
+// two packed 4:2:2 rows to two 4:2:0 luma rows and one chroma row, the average of theirs
+typedef unsigned (*DeinterleaveRows)(const uint8_t * src0, const uint8_t * src1, uint8_t * y0, uint8_t * y1,
+                                     uint8_t * u, uint8_t * v, unsigned width);
+// NV12 chroma to planar and back
+typedef unsigned (*SplitUVRow)(const uint8_t * uv, uint8_t * u, uint8_t * v, unsigned width);
+typedef unsigned (*MergeUVRow)(const uint8_t * u, const uint8_t * v, uint8_t * uv, unsigned width);
+// acc[k] += src[k] * weight over n bytes of any format, the caller keeps the sums within
+// 16 bits; n is in bytes, not pixels, and need not be even
+typedef unsigned (*AccumulateRow)(const uint8_t * src, uint16_t * acc, unsigned n, unsigned weight);
+// *sum += |src[k] - ref[k]| over the bytes of n that mask keeps, then ref = src: mask is
+// two bytes, 0x00 or 0xFF each, repeated along the row (0x00FF keeps YUYV's luma). n is in
+// bytes and even; src and ref start on an even byte of the row
+typedef unsigned (*DifferenceRow)(const uint8_t * src, uint8_t * ref, unsigned n, unsigned mask, uint32_t * sum);
+
+struct ConvertKernels {
+    ToRGBRow toRGB[2][3];                // [source is UYVY][BGR24, RGB24, BGRA32]
+    SwapRow swap;
+    InterleaveRow interleave[2][2];      // [source is NV12][output is UYVY]
+    DeinterleaveRows deinterleave[2][2]; // [source is UYVY][output is NV12]
+    SplitUVRow splitUV;
+    MergeUVRow mergeUV;
+    AccumulateRow accumulate;
+    DifferenceRow difference;
+};
+
+// Each fills in the kernels its instruction set has and leaves the others alone, so a
+// table starts as the scalar one and every wider set overrides what it does better.
+void convertKernelsScalar(ConvertKernels& k);
+void convertKernelsSSE41(ConvertKernels& k);
+void convertKernelsAVX2(ConvertKernels& k);
+void convertKernelsAVX512(ConvertKernels& k);
+
+// the table for isa, CONVERT_ISA_AUTO or capped like convertFrame's
+const ConvertKernels& convertKernels(ConvertIsa isa);
+
+#endif
@@ -0,0 +1,237 @@
+#include "FrameConvertKernels.h"
+
+#ifdef CONVERT_X86
+
+#include <immintrin.h>
+
+#define TARGET CONVERT_TARGET("sse4.1")
+
+// (a, b) in every 32 bit lane, for _mm_madd_epi16 against (U, V) or (Y, 1) pairs
+static inline TARGET __m128i pair16(int a, int b)
+{
+    return _mm_set1_epi32((int)(((uint32_t)(uint16_t)b << 16) | (uint16_t)a));
+}
+
+// 8 pixels of YUYV or UYVY to 16 bit R, G and B
+template <bool UYVY>
+static inline TARGET void yuv8(__m128i v, __m128i& r, __m128i& g, __m128i& b)
+{
+    const __m128i low = _mm_set1_epi16(0xff);
+    __m128i y = UYVY ? _mm_srli_epi16(v, 8) : _mm_and_si128(v, low);
+    __m128i uv = UYVY ? _mm_and_si128(v, low) : _mm_srli_epi16(v, 8);
+    y = _mm_sub_epi16(y, _mm_set1_epi16(16));
+    uv = _mm_sub_epi16(uv, _mm_set1_epi16(128));
+
+    // luma term plus rounding per pixel, 32 bits wide
+    const __m128i yk = pair16(CONVERT_YG, 1), round = _mm_set1_epi16(128);
+    __m128i y0 = _mm_madd_epi16(_mm_unpacklo_epi16(y, round), yk);
+    __m128i y1 = _mm_madd_epi16(_mm_unpackhi_epi16(y, round), yk);
+
+    // chroma terms once per pixel pair, then doubled up for both pixels
+    __m128i cr = _mm_madd_epi16(uv, pair16(0, CONVERT_VR));
+    __m128i cg = _mm_madd_epi16(uv, pair16(CONVERT_UG, CONVERT_VG));
+    __m128i cb = _mm_madd_epi16(uv, pair16(CONVERT_UB, 0));
+
+    r = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(y0, _mm_unpacklo_epi32(cr, cr)), 8),
+                        _mm_srai_epi32(_mm_add_epi32(y1, _mm_unpackhi_epi32(cr, cr)), 8));
+    g = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(y0, _mm_unpacklo_epi32(cg, cg)), 8),
+                        _mm_srai_epi32(_mm_add_epi32(y1, _mm_unpackhi_epi32(cg, cg)), 8));
+    b = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(y0, _mm_unpacklo_epi32(cb, cb)), 8),
+                        _mm_srai_epi32(_mm_add_epi32(y1, _mm_unpackhi_epi32(cb, cb)), 8));
+}
+
+// 16 pixels of 8 bit R, G and B out as BGR24, RGB24 or BGRA32
+template <RawFrameFormat TO>
+static inline TARGET void store16(uint8_t * dst, __m128i r, __m128i g, __m128i b)
+{
+    __m128i first = TO == PANACAST_FRAME_FORMAT_RGB24 ? r : b;
+    __m128i third = TO == PANACAST_FRAME_FORMAT_RGB24 ? b : r;
+    const __m128i alpha = _mm_set1_epi8(-1);
+
+    __m128i lo = _mm_unpacklo_epi8(first, g), hi = _mm_unpackhi_epi8(first, g);
+    __m128i lo2 = _mm_unpacklo_epi8(third, alpha), hi2 = _mm_unpackhi_epi8(third, alpha);
+    __m128i p0 = _mm_unpacklo_epi16(lo, lo2), p1 = _mm_unpackhi_epi16(lo, lo2);
+    __m128i p2 = _mm_unpacklo_epi16(hi, hi2), p3 = _mm_unpackhi_epi16(hi, hi2);
+
+    if (TO == PANACAST_FRAME_FORMAT_BGRA32) {
+        _mm_storeu_si128((__m128i *)dst, p0);
+        _mm_storeu_si128((__m128i *)(dst + 16), p1);
+        _mm_storeu_si128((__m128i *)(dst + 32), p2);
+        _mm_storeu_si128((__m128i *)(dst + 48), p3);
+        return;
+    }
+
+    // drop the fourth byte of each pixel, then stitch 4 x 12 bytes into 3 x 16
+    const __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    p0 = _mm_shuffle_epi8(p0, pack);
+    p1 = _mm_shuffle_epi8(p1, pack);
+    p2 = _mm_shuffle_epi8(p2, pack);
+    p3 = _mm_shuffle_epi8(p3, pack);
+    _mm_storeu_si128((__m128i *)dst, _mm_or_si128(p0, _mm_slli_si128(p1, 12)));
+    _mm_storeu_si128((__m128i *)(dst + 16), _mm_or_si128(_mm_srli_si128(p1, 4), _mm_slli_si128(p2, 8)));
+    _mm_storeu_si128((__m128i *)(dst + 32), _mm_or_si128(_mm_srli_si128(p2, 8), _mm_slli_si128(p3, 4)));
+}
+
+template <bool UYVY, RawFrameFormat TO>
+static TARGET unsigned toRGBRow(const uint8_t * src, uint8_t * dst, unsigned width)
+{
+    const unsigned bpp = TO == PANACAST_FRAME_FORMAT_BGRA32 ? 4 : 3;
+    unsigned x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i r0, g0, b0, r1, g1, b1;
+        yuv8<UYVY>(_mm_loadu_si128((const __m128i *)(src + x * 2)), r0, g0, b0);
+        yuv8<UYVY>(_mm_loadu_si128((const __m128i *)(src + x * 2 + 16)), r1, g1, b1);
+        store16<TO>(dst + x * bpp, _mm_packus_epi16(r0, r1), _mm_packus_epi16(g0, g1), _mm_packus_epi16(b0, b1));
+    }
+    return x;
+}
+
+static TARGET unsigned swapRow(const uint8_t * src, uint8_t * dst, unsigned width)
+{
+    unsigned x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + x * 2));
+        _mm_storeu_si128((__m128i *)(dst + x * 2), _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+    }
+    return x;
+}
+
+template <bool NV12, bool UYVY>
+static TARGET unsigned interleaveRow(const uint8_t * y, const uint8_t * u, const uint8_t * v, uint8_t * dst, unsigned width)
+{
+    unsigned x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i luma = _mm_loadu_si128((const __m128i *)(y + x));
+        __m128i uv = NV12 ? _mm_loadu_si128((const __m128i *)(u + x))
+                          : _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(u + x / 2)),
+                                              _mm_loadl_epi64((const __m128i *)(v + x / 2)));
+        __m128i lo = UYVY ? _mm_unpacklo_epi8(uv, luma) : _mm_unpacklo_epi8(luma, uv);
+        __m128i hi = UYVY ? _mm_unpackhi_epi8(uv, luma) : _mm_unpackhi_epi8(luma, uv);
+        _mm_storeu_si128((__m128i *)(dst + x * 2), lo);
+        _mm_storeu_si128((__m128i *)(dst + x * 2 + 16), hi);
+    }
+    return x;
+}
+
+// 16 pixels of packed 4:2:2 split into 16 luma and 16 interleaved chroma bytes
+template <bool UYVY>
+static inline TARGET void split16(const uint8_t * src, __m128i& luma, __m128i& chroma)
+{
+    const __m128i low = _mm_set1_epi16(0xff);
+    __m128i a = _mm_loadu_si128((const __m128i *)src), b = _mm_loadu_si128((const __m128i *)(src + 16));
+    __m128i evens = _mm_packus_epi16(_mm_and_si128(a, low), _mm_and_si128(b, low));
+    __m128i odds = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+    luma = UYVY ? odds : evens;
+    chroma = UYVY ? evens : odds;
+}
+
+template <bool UYVY, bool NV12>
+static TARGET unsigned deinterleaveRows(const uint8_t * src0, const uint8_t * src1, uint8_t * y0, uint8_t * y1,
+                                        uint8_t * u, uint8_t * v, unsigned width)
+{
+    const __m128i low = _mm_set1_epi16(0xff);
+    unsigned x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i l0, c0, l1, c1;
+        split16<UYVY>(src0 + x * 2, l0, c0);
+        split16<UYVY>(src1 + x * 2, l1, c1);
+        _mm_storeu_si128((__m128i *)(y0 + x), l0);
+        _mm_storeu_si128((__m128i *)(y1 + x), l1);
+        __m128i uv = _mm_avg_epu8(c0, c1);
+        if (NV12) {
+            _mm_storeu_si128((__m128i *)(u + x), uv);
+        } else {
+            __m128i planes = _mm_packus_epi16(_mm_and_si128(uv, low), _mm_srli_epi16(uv, 8));
+            _mm_storel_epi64((__m128i *)(u + x / 2), planes);
+            _mm_storel_epi64((__m128i *)(v + x / 2), _mm_srli_si128(planes, 8));
+        }
+    }
+    return x;
+}
+
+static TARGET unsigned splitUVRow(const uint8_t * uv, uint8_t * u, uint8_t * v, unsigned width)
+{
+    const __m128i low = _mm_set1_epi16(0xff);
+    unsigned x = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(uv + x)), b = _mm_loadu_si128((const __m128i *)(uv + x + 16));
+        _mm_storeu_si128((__m128i *)(u + x / 2), _mm_packus_epi16(_mm_and_si128(a, low), _mm_and_si128(b, low)));
+        _mm_storeu_si128((__m128i *)(v + x / 2), _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+    }
+    return x;
+}
+
+static TARGET unsigned mergeUVRow(const uint8_t * u, const uint8_t * v, uint8_t * uv, unsigned width)
+{
+    unsigned x = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m128i cu = _mm_loadu_si128((const __m128i *)(u + x / 2)), cv = _mm_loadu_si128((const __m128i *)(v + x / 2));
+        _mm_storeu_si128((__m128i *)(uv + x), _mm_unpacklo_epi8(cu, cv));
+        _mm_storeu_si128((__m128i *)(uv + x + 16), _mm_unpackhi_epi8(cu, cv));
+    }
+    return x;
+}
+
+static TARGET unsigned accumulateRow(const uint8_t * src, uint16_t * acc, unsigned n, unsigned weight)
+{
+    const __m128i w = _mm_set1_epi16((short)weight);
+    unsigned x = 0;
+    for (; x + 16 <= n; x += 16) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + x));
+        __m128i lo = _mm_mullo_epi16(_mm_cvtepu8_epi16(s), w), hi = _mm_mullo_epi16(_mm_cvtepu8_epi16(_mm_srli_si128(s, 8)), w);
+        _mm_storeu_si128((__m128i *)(acc + x), _mm_add_epi16(_mm_loadu_si128((const __m128i *)(acc + x)), lo));
+        _mm_storeu_si128((__m128i *)(acc + x + 8), _mm_add_epi16(_mm_loadu_si128((const __m128i *)(acc + x + 8)), hi));
+    }
+    return x;
+}
+
+static TARGET unsigned differenceRow(const uint8_t * src, uint8_t * ref, unsigned n, unsigned mask, uint32_t * sum)
+{
+    const __m128i keep = _mm_set1_epi16((short)mask);
+    __m128i total = _mm_setzero_si128();
+    unsigned x = 0;
+    for (; x + 16 <= n; x += 16) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + x)), r = _mm_loadu_si128((const __m128i *)(ref + x));
+        // masked out bytes are 0 on both sides and add nothing
+        total = _mm_add_epi64(total, _mm_sad_epu8(_mm_and_si128(s, keep), _mm_and_si128(r, keep)));
+        _mm_storeu_si128((__m128i *)(ref + x), s);
+    }
+    total = _mm_add_epi32(total, _mm_srli_si128(total, 8));
+    *sum += (uint32_t)_mm_cvtsi128_si32(total);
+    return x;
+}
+
+template <bool UYVY>
+static void fillToRGB(ConvertKernels& k)
+{
+    k.toRGB[UYVY][0] = toRGBRow<UYVY, PANACAST_FRAME_FORMAT_BGR24>;
+    k.toRGB[UYVY][1] = toRGBRow<UYVY, PANACAST_FRAME_FORMAT_RGB24>;
+    k.toRGB[UYVY][2] = toRGBRow<UYVY, PANACAST_FRAME_FORMAT_BGRA32>;
+}
+
+void convertKernelsSSE41(ConvertKernels& k)
+{
+    fillToRGB<false>(k);
+    fillToRGB<true>(k);
+    k.swap = swapRow;
+    k.interleave[0][0] = interleaveRow<false, false>;
+    k.interleave[0][1] = interleaveRow<false, true>;
+    k.interleave[1][0] = interleaveRow<true, false>;
+    k.interleave[1][1] = interleaveRow<true, true>;
+    k.deinterleave[0][0] = deinterleaveRows<false, false>;
+    k.deinterleave[0][1] = deinterleaveRows<false, true>;
+    k.deinterleave[1][0] = deinterleaveRows<true, false>;
+    k.deinterleave[1][1] = deinterleaveRows<true, true>;
+    k.splitUV = splitUVRow;
+    k.mergeUV = mergeUVRow;
+    k.accumulate = accumulateRow;
+    k.difference = differenceRow;
+}
+
+#else
+
+void convertKernelsSSE41(ConvertKernels& k)
+{
+}
+
+#endif
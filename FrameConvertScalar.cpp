@@ -0,0 +1,143 @@
+#include "FrameConvertKernels.h"
+
+// The reference kernels: every SIMD kernel has to give exactly what these give, and
+// they finish whatever part of a row is too short for a vector block.
+
+static inline uint8_t clamp8(int v)
+{
+    return v < 0 ? 0 : v > 255 ? 255 : (uint8_t)v;
+}
+
+template <bool UYVY, RawFrameFormat TO>
+static unsigned toRGBRow(const uint8_t * src, uint8_t * dst, unsigned width)
+{
+    const unsigned bpp = TO == PANACAST_FRAME_FORMAT_BGRA32 ? 4 : 3;
+    const unsigned ri = TO == PANACAST_FRAME_FORMAT_RGB24 ? 0 : 2, bi = 2 - ri;
+    for (unsigned x = 0; x + 2 <= width; x += 2, src += 4, dst += 2 * bpp) {
+        int y0 = UYVY ? src[1] : src[0], y1 = UYVY ? src[3] : src[2];
+        int u = (UYVY ? src[0] : src[1]) - 128, v = (UYVY ? src[2] : src[3]) - 128;
+        int cr = CONVERT_VR * v + 128, cg = CONVERT_UG * u + CONVERT_VG * v + 128, cb = CONVERT_UB * u + 128;
+        int l0 = CONVERT_YG * (y0 - 16), l1 = CONVERT_YG * (y1 - 16);
+
+        dst[ri] = clamp8((l0 + cr) >> 8);
+        dst[1] = clamp8((l0 + cg) >> 8);
+        dst[bi] = clamp8((l0 + cb) >> 8);
+        dst[bpp + ri] = clamp8((l1 + cr) >> 8);
+        dst[bpp + 1] = clamp8((l1 + cg) >> 8);
+        dst[bpp + bi] = clamp8((l1 + cb) >> 8);
+        if (bpp == 4) dst[3] = dst[7] = 255;
+    }
+    return width;
+}
+
+static unsigned swapRow(const uint8_t * src, uint8_t * dst, unsigned width)
+{
+    for (unsigned x = 0; x < width; x++, src += 2, dst += 2) {
+        uint8_t first = src[0];
+        dst[0] = src[1];
+        dst[1] = first;
+    }
+    return width;
+}
+
+template <bool NV12, bool UYVY>
+static unsigned interleaveRow(const uint8_t * y, const uint8_t * u, const uint8_t * v, uint8_t * dst, unsigned width)
+{
+    for (unsigned x = 0; x < width; x += 2, dst += 4) {
+        uint8_t cu = NV12 ? u[x] : u[x / 2];
+        uint8_t cv = NV12 ? u[x + 1] : v[x / 2];
+        dst[0] = UYVY ? cu : y[x];
+        dst[1] = UYVY ? y[x] : cu;
+        dst[2] = UYVY ? cv : y[x + 1];
+        dst[3] = UYVY ? y[x + 1] : cv;
+    }
+    return width;
+}
+
+template <bool UYVY, bool NV12>
+static unsigned deinterleaveRows(const uint8_t * src0, const uint8_t * src1, uint8_t * y0, uint8_t * y1,
+                                 uint8_t * u, uint8_t * v, unsigned width)
+{
+    const unsigned yi = UYVY ? 1 : 0, ui = UYVY ? 0 : 1;
+    for (unsigned x = 0; x < width; x += 2, src0 += 4, src1 += 4) {
+        y0[x] = src0[yi];
+        y0[x + 1] = src0[yi + 2];
+        y1[x] = src1[yi];
+        y1[x + 1] = src1[yi + 2];
+        // rounded like pavgb
+        uint8_t cu = (uint8_t)((src0[ui] + src1[ui] + 1) >> 1);
+        uint8_t cv = (uint8_t)((src0[ui + 2] + src1[ui + 2] + 1) >> 1);
+        if (NV12) {
+            u[x] = cu;
+            u[x + 1] = cv;
+        } else {
+            u[x / 2] = cu;
+            v[x / 2] = cv;
+        }
+    }
+    return width;
+}
+
+static unsigned splitUVRow(const uint8_t * uv, uint8_t * u, uint8_t * v, unsigned width)
+{
+    for (unsigned k = 0; k < width / 2; k++) {
+        u[k] = uv[2 * k];
+        v[k] = uv[2 * k + 1];
+    }
+    return width;
+}
+
+static unsigned mergeUVRow(const uint8_t * u, const uint8_t * v, uint8_t * uv, unsigned width)
+{
+    for (unsigned k = 0; k < width / 2; k++) {
+        uv[2 * k] = u[k];
+        uv[2 * k + 1] = v[k];
+    }
+    return width;
+}
+
+static unsigned accumulateRow(const uint8_t * src, uint16_t * acc, unsigned n, unsigned weight)
+{
+    for (unsigned k = 0; k < n; k++) acc[k] = (uint16_t)(acc[k] + src[k] * weight);
+    return n;
+}
+
+static unsigned differenceRow(const uint8_t * src, uint8_t * ref, unsigned n, unsigned mask, uint32_t * sum)
+{
+    uint8_t keep[2] = { (uint8_t)mask, (uint8_t)(mask >> 8) };
+    uint32_t total = 0;
+    for (unsigned k = 0; k < n; k++) {
+        int d = (src[k] & keep[k & 1]) - (ref[k] & keep[k & 1]);
+        total += d < 0 ? -d : d;
+        ref[k] = src[k];
+    }
+    *sum += total;
+    return n;
+}
+
+template <bool UYVY>
+static void fillToRGB(ConvertKernels& k)
+{
+    k.toRGB[UYVY][0] = toRGBRow<UYVY, PANACAST_FRAME_FORMAT_BGR24>;
+    k.toRGB[UYVY][1] = toRGBRow<UYVY, PANACAST_FRAME_FORMAT_RGB24>;
+    k.toRGB[UYVY][2] = toRGBRow<UYVY, PANACAST_FRAME_FORMAT_BGRA32>;
+}
+
+void convertKernelsScalar(ConvertKernels& k)
+{
+    fillToRGB<false>(k);
+    fillToRGB<true>(k);
+    k.swap = swapRow;
+    k.interleave[0][0] = interleaveRow<false, false>;
+    k.interleave[0][1] = interleaveRow<false, true>;
+    k.interleave[1][0] = interleaveRow<true, false>;
+    k.interleave[1][1] = interleaveRow<true, true>;
+    k.deinterleave[0][0] = deinterleaveRows<false, false>;
+    k.deinterleave[0][1] = deinterleaveRows<false, true>;
+    k.deinterleave[1][0] = deinterleaveRows<true, false>;
+    k.deinterleave[1][1] = deinterleaveRows<true, true>;
+    k.splitUV = splitUVRow;
+    k.mergeUV = mergeUVRow;
+    k.accumulate = accumulateRow;
+    k.difference = differenceRow;
+}
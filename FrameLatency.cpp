@@ -0,0 +1,140 @@
+#include "FrameLatency.h"
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+unsigned LatencyHistogram::bucketOf(uint64_t nsec)
+{
+    if (nsec >= (1ULL << LATENCY_MAX_BITS)) nsec = (1ULL << LATENCY_MAX_BITS) - 1;
+    if (nsec < LATENCY_SUB_BUCKETS) return (unsigned)nsec;
+
+    unsigned top = 63;
+    while (!(nsec >> top)) top--;
+    // the bits below the leading one pick the sub-bucket within its power of two
+    unsigned shift = top - LATENCY_SUB_BUCKET_BITS;
+    unsigned sub = (unsigned)(nsec >> shift) & (LATENCY_SUB_BUCKETS - 1);
+    return (shift + 1) * LATENCY_SUB_BUCKETS + sub;
+}
+
+uint64_t LatencyHistogram::valueOf(unsigned bucket)
+{
+    if (bucket < LATENCY_SUB_BUCKETS) return bucket;
+
+    unsigned shift = bucket / LATENCY_SUB_BUCKETS - 1;
+    uint64_t low = (uint64_t)(LATENCY_SUB_BUCKETS + bucket % LATENCY_SUB_BUCKETS) << shift;
+    return low + ((1ULL << shift) >> 1);
+}
+
+void LatencyHistogram::record(uint64_t nsec)
+{
+    buckets[bucketOf(nsec)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(nsec, std::memory_order_relaxed);
+
+    uint64_t m = minimum.load(std::memory_order_relaxed);
+    while (nsec < m && !minimum.compare_exchange_weak(m, nsec, std::memory_order_relaxed)) {}
+    m = maximum.load(std::memory_order_relaxed);
+    while (nsec > m && !maximum.compare_exchange_weak(m, nsec, std::memory_order_relaxed)) {}
+}
+
+void LatencyHistogram::reset()
+{
+    for (unsigned k = 0; k < LATENCY_BUCKETS; k++) buckets[k].store(0, std::memory_order_relaxed);
+    total.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+    minimum.store(UINT64_MAX, std::memory_order_relaxed);
+    maximum.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::percentile(double percent) const
+{
+    // recorders may be adding samples while we walk, so rank against what the buckets hold
+    uint64_t n = 0;
+    for (unsigned k = 0; k < LATENCY_BUCKETS; k++) n += buckets[k].load(std::memory_order_relaxed);
+    if (n == 0) return 0;
+
+    uint64_t rank = (uint64_t)(percent / 100.0 * n + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > n) rank = n;
+
+    uint64_t seen = 0;
+    for (unsigned k = 0; k < LATENCY_BUCKETS; k++) {
+        seen += buckets[k].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            // never report past what was actually recorded
+            uint64_t v = valueOf(k);
+            uint64_t lo = minimum.load(std::memory_order_relaxed), hi = maximum.load(std::memory_order_relaxed);
+            if (v > hi) v = hi;
+            if (v < lo) v = lo;
+            return v;
+        }
+    }
+    return maximum.load(std::memory_order_relaxed);
+}
+
+LatencySummary LatencyHistogram::summary() const
+{
+    LatencySummary s;
+    s.count = count();
+    s.minNsec = s.count ? minimum.load(std::memory_order_relaxed) : 0;
+    s.maxNsec = maximum.load(std::memory_order_relaxed);
+    s.meanNsec = s.count ? sum.load(std::memory_order_relaxed) / s.count : 0;
+    s.p50Nsec = percentile(50);
+    s.p99Nsec = percentile(99);
+    s.p999Nsec = percentile(99.9);
+    return s;
+}
+
+uint64_t FrameLatencyTrace::origin(const struct RawFrame * frame)
+{
+    for (unsigned s = 0; s < FRAME_PRODUCER_STAGES; s++) {
+        if (frame->stageTime[s]) return frame->stageTime[s];
+    }
+    return 0;
+}
+
+void FrameLatencyTrace::recordPublished(const struct RawFrame * frame)
+{
+    uint64_t start = origin(frame);
+    if (start == 0) return;
+    bool first = true;
+    for (unsigned s = 0; s < FRAME_PRODUCER_STAGES; s++) {
+        uint64_t t = frame->stageTime[s];
+        if (t == 0) continue;
+        // the origin itself is always 0 and says nothing
+        if (first) {
+            first = false;
+            continue;
+        }
+        // a device clock that runs ahead of ours must not wrap around
+        stages[s].record(t > start ? t - start : 0);
+    }
+}
+
+void FrameLatencyTrace::recordConsumer(const struct RawFrame * frame, FrameStage stage)
+{
+    uint64_t start = origin(frame);
+    if (start == 0) return;
+    uint64_t now = frameClockNsec();
+    stages[stage].record(now > start ? now - start : 0);
+}
+
+void FrameLatencyTrace::reset()
+{
+    for (unsigned s = 0; s < FRAME_STAGES; s++) stages[s].reset();
+}
+
+const char * FrameLatencyTrace::stageName(FrameStage stage)
+{
+    switch (stage) {
+        case FRAME_STAGE_DEVICE: return "device";
+        case FRAME_STAGE_DRIVER: return "driver";
+        case FRAME_STAGE_CALLBACK: return "callback";
+        case FRAME_STAGE_PUBLISH: return "publish";
+        case FRAME_STAGE_ACQUIRE: return "acquire";
+        case FRAME_STAGE_RELEASE: return "release";
+        default: return "unknown";
+    }
+}
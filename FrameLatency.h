@@ -0,0 +1,94 @@
+//
+//  FrameLatency.h
+//
+//  Where the time goes between the sensor and the consumer. Backends stamp
+//  each frame at every producer FrameStage; FrameRingCapture stamps publish
+//  and records acquire and release as consumers take and drop frames. Each
+//  stage feeds a lock-free log-linear (HDR style) histogram of the time since
+//  the frame's first stamp, so p50/p99/p99.9 capture-to-consumer latency can
+//  be read at any time without stopping the stream.
+//
+
+#ifndef FRAMELATENCY_H
+#define FRAMELATENCY_H
+
+#include "PCCameraInterface.h"
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+
+// 32 linear sub-buckets per power of two: percentiles are within 1/32 of the true value
+#define LATENCY_SUB_BUCKET_BITS 5
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BUCKET_BITS)
+// values are clamped to 2^36 nsec, about 68 seconds
+#define LATENCY_MAX_BITS 36
+#define LATENCY_BUCKETS ((LATENCY_MAX_BITS - LATENCY_SUB_BUCKET_BITS + 1) * LATENCY_SUB_BUCKETS)
+
+// the clock frame stamps are taken on: steady_clock, which is CLOCK_MONOTONIC on Linux,
+// mach_absolute_time on macOS and QPC on Windows
+inline uint64_t frameClockNsec()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct LatencySummary {
+    uint64_t count;
+    uint64_t minNsec;
+    uint64_t maxNsec;
+    uint64_t meanNsec;
+    uint64_t p50Nsec;
+    uint64_t p99Nsec;
+    uint64_t p999Nsec;
+};
+
+// record from any number of threads, read from any thread
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+    void record(uint64_t nsec);
+    // not atomic with respect to concurrent record calls, a few samples may survive it
+    void reset();
+
+    uint64_t count() const { return total.load(std::memory_order_relaxed); }
+    // value at or below which percent of the samples are, 0 if there are none
+    uint64_t percentile(double percent) const;
+    LatencySummary summary() const;
+
+private:
+    static unsigned bucketOf(uint64_t nsec);
+    // middle of the range a bucket covers
+    static uint64_t valueOf(unsigned bucket);
+
+    std::atomic<uint64_t> buckets[LATENCY_BUCKETS];
+    std::atomic<uint64_t> total;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> minimum;
+    std::atomic<uint64_t> maximum;
+
+    //disable copy constructor and assignment operator
+    LatencyHistogram(const LatencyHistogram&);
+    void operator=(const LatencyHistogram&);
+};
+
+// one per stream: histogram s holds the nsec from a frame's first stamped stage to stage s
+class FrameLatencyTrace {
+public:
+    // producer stages of a frame about to be published
+    void recordPublished(const struct RawFrame * frame);
+    // a consumer reached FRAME_STAGE_ACQUIRE or FRAME_STAGE_RELEASE on frame, now
+    void recordConsumer(const struct RawFrame * frame, FrameStage stage);
+
+    const LatencyHistogram& histogram(FrameStage stage) const { return stages[stage]; }
+    LatencySummary summary(FrameStage stage) const { return stages[stage].summary(); }
+    void reset();
+
+    static const char * stageName(FrameStage stage);
+
+private:
+    static uint64_t origin(const struct RawFrame * frame);
+
+    LatencyHistogram stages[FRAME_STAGES];
+};
+
+#endif
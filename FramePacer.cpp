@@ -0,0 +1,79 @@
+#include "FramePacer.h"
+
+FrameRateMeter::FrameRateMeter()
+{
+    reset();
+}
+
+void FrameRateMeter::reset()
+{
+    count = 0;
+    next = 0;
+    meanInterval = 0;
+    fps = 0.0;
+}
+
+void FrameRateMeter::add(uint64_t timestampNsec)
+{
+    times[next] = timestampNsec;
+    next = (next + 1) % FRAME_RATE_WINDOW;
+    if (count < FRAME_RATE_WINDOW) count++;
+    if (count < 2) return;
+
+    // oldest entry still in the window
+    uint64_t first = times[(next + FRAME_RATE_WINDOW - count) % FRAME_RATE_WINDOW];
+    if (timestampNsec <= first) return;
+    meanInterval = (timestampNsec - first) / (count - 1);
+    fps = (count - 1) * 1e9 / (double)(timestampNsec - first);
+}
+
+FramePacer::FramePacer()
+{
+    targetFps = 0;
+    period = 0;
+    reset();
+}
+
+void FramePacer::setTarget(double fps)
+{
+    targetFps = fps > 0 ? fps : 0;
+    period = targetFps > 0 ? (uint64_t)(1e9 / targetFps) : 0;
+    reset();
+}
+
+void FramePacer::reset()
+{
+    nextDue = 0;
+    anchored = false;
+    input.reset();
+    output.reset();
+}
+
+bool FramePacer::admit(uint64_t& timestampNsec)
+{
+    uint64_t t = timestampNsec;
+    input.add(t);
+
+    // no target, or a source no faster than the target give or take clock skew: nothing to throw away,
+    // and the device's own timestamps are as even as it gets
+    uint64_t interval = input.interval();
+    if (period == 0 || (interval && interval * 10 >= period * 9)) {
+        anchored = false;
+        output.add(t);
+        return true;
+    }
+
+    // more than half a period late: the source stalled or is slower than the target
+    if (!anchored || t > nextDue + period / 2) {
+        nextDue = t;
+        anchored = true;
+    }
+
+    // let through the input frame nearest to the grid point: one up to half an input interval early still counts
+    if (t + interval / 2 < nextDue) return false;
+
+    timestampNsec = nextDue;
+    nextDue += period;
+    output.add(t);
+    return true;
+}
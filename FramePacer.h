@@ -0,0 +1,66 @@
+//
+//  FramePacer.h
+//
+//  Brings a capture stream down to a requested frame rate. Backends first
+//  ask the device for the rate; whatever it cannot do is decimated here.
+//  Output frames are laid on an even grid of 1/fps: a frame is let through
+//  when it is the one closest to the next grid point and takes that grid
+//  point as its timestamp, so consumers see evenly spaced timestamps no
+//  matter how the device rate divides into the requested one. The grid is
+//  re-anchored when the source stalls; a source that is not faster than the
+//  requested rate is passed through untouched.
+//
+
+#ifndef FRAMEPACER_H
+#define FRAMEPACER_H
+
+#include <atomic>
+#include <stdint.h>
+
+#define FRAME_RATE_WINDOW 32
+
+// frame rate over the last FRAME_RATE_WINDOW timestamps, written by one thread, read by any
+class FrameRateMeter {
+public:
+    FrameRateMeter();
+    void add(uint64_t timestampNsec);
+    void reset();
+    double rate() const { return fps.load(std::memory_order_relaxed); }
+    // mean interval between the last frames, 0 until there are two
+    uint64_t interval() const { return meanInterval; }
+
+private:
+    uint64_t times[FRAME_RATE_WINDOW];
+    unsigned count;
+    unsigned next;
+    uint64_t meanInterval;
+    std::atomic<double> fps;
+};
+
+class FramePacer {
+public:
+    FramePacer();
+
+    // 0 lets every frame through untouched
+    void setTarget(double fps);
+    double target() const { return targetFps; }
+    void reset();
+
+    // producer thread only: false when the frame should be skipped, otherwise
+    // timestampNsec is moved onto the output grid
+    bool admit(uint64_t& timestampNsec);
+
+    // rates of what came in and what went out, any thread
+    double inputRate() const { return input.rate(); }
+    double outputRate() const { return output.rate(); }
+
+private:
+    double targetFps;
+    uint64_t period;
+    uint64_t nextDue;
+    bool anchored;
+    FrameRateMeter input;
+    FrameRateMeter output;
+};
+
+#endif
@@ -0,0 +1,194 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // sync_file_range
+#endif
+#include "FrameRecorder.h"
+#include "FrameLatency.h"
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <atomic>
+
+FrameRecorder::FrameRecorder()
+{
+    segmentBytes = 0;
+    indexCapacity = 0;
+    fd = -1;
+    map = NULL;
+    header = NULL;
+    index = NULL;
+    dataEnd = 0;
+    writebackStart = 0;
+    segmentCount = 0;
+    frames = 0;
+    bytes = 0;
+    drops = 0;
+}
+
+FrameRecorder::~FrameRecorder()
+{
+    close();
+}
+
+bool FrameRecorder::open(const std::string& path, uint64_t _segmentBytes, uint64_t _indexCapacity)
+{
+    if (isOpen()) return false;
+
+    basePath = path;
+    segmentBytes = _segmentBytes;
+    indexCapacity = _indexCapacity;
+    segmentCount = 0;
+    frames = 0;
+    bytes = 0;
+    drops = 0;
+
+    if (streamFileAlign(sizeof(StreamFileHeader) + indexCapacity * sizeof(StreamFileFrame)) >= segmentBytes) {
+        printf("FrameRecorder: segment of %llu bytes cannot hold an index of %llu frames\n",
+               (unsigned long long)segmentBytes, (unsigned long long)indexCapacity);
+        return false;
+    }
+    return openSegment();
+}
+
+bool FrameRecorder::openSegment()
+{
+    char name[4096];
+    if (segmentCount == 0) snprintf(name, sizeof(name), "%s", basePath.c_str());
+    else snprintf(name, sizeof(name), "%s.%u", basePath.c_str(), segmentCount);
+
+    fd = ::open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        printf("FrameRecorder: cannot create %s\n", name);
+        return false;
+    }
+
+    // reserve the blocks now so a full disk fails here and not with SIGBUS mid-frame
+    int err;
+#ifdef __linux__
+    err = posix_fallocate(fd, 0, segmentBytes);
+#else
+    err = ftruncate(fd, segmentBytes);
+#endif
+    if (err != 0) {
+        printf("FrameRecorder: cannot allocate %llu bytes for %s\n", (unsigned long long)segmentBytes, name);
+        ::close(fd);
+        fd = -1;
+        unlink(name);
+        return false;
+    }
+
+    void * p = mmap(NULL, segmentBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        printf("FrameRecorder: mmap of %s failed\n", name);
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+    map = (unsigned char *)p;
+    madvise(map, segmentBytes, MADV_SEQUENTIAL);
+
+    header = (StreamFileHeader *)map;
+    memset(header, 0, sizeof(StreamFileHeader));
+    header->version = STREAM_FILE_VERSION;
+    header->headerSize = sizeof(StreamFileHeader);
+    header->indexOffset = sizeof(StreamFileHeader);
+    header->indexCapacity = indexCapacity;
+    header->dataOffset = streamFileAlign(header->indexOffset + indexCapacity * sizeof(StreamFileFrame));
+    header->dataEnd = header->dataOffset;
+    memcpy(header->magic, STREAM_FILE_MAGIC, sizeof(header->magic));
+
+    index = (StreamFileFrame *)(map + header->indexOffset);
+    dataEnd = header->dataOffset;
+    writebackStart = dataEnd;
+    segmentCount++;
+    return true;
+}
+
+void FrameRecorder::closeSegment()
+{
+    if (map == NULL) return;
+
+    // trim the unused tail so the file is only as large as what was recorded
+    uint64_t used = dataEnd;
+    msync(map, used, MS_ASYNC);
+    munmap(map, segmentBytes);
+    if (ftruncate(fd, used) != 0) printf("FrameRecorder: could not trim segment\n");
+    ::close(fd);
+
+    fd = -1;
+    map = NULL;
+    header = NULL;
+    index = NULL;
+}
+
+void FrameRecorder::close()
+{
+    closeSegment();
+}
+
+void FrameRecorder::prepareAhead(uint64_t offset, uint64_t length)
+{
+    if (offset >= segmentBytes) return;
+    if (offset + length > segmentBytes) length = segmentBytes - offset;
+
+    long pageSize = sysconf(_SC_PAGESIZE);
+    uint64_t start = offset & ~(uint64_t)(pageSize - 1);
+#ifdef MADV_POPULATE_WRITE
+    // fault the next frame's pages in one go instead of one fault per page inside memcpy
+    madvise(map + start, offset + length - start, MADV_POPULATE_WRITE);
+#else
+    madvise(map + start, offset + length - start, MADV_WILLNEED);
+#endif
+}
+
+bool FrameRecorder::append(const struct RawFrame * frame, uint64_t timestampNsec)
+{
+    if (!isOpen() || frame == NULL || frame->buf == NULL) return false;
+
+    uint64_t size = frame->format == PANACAST_FRAME_FORMAT_MJPEG ? (uint64_t)frame->size
+                    : rawFrameSize(frame->format, frame->width, frame->height);
+    if (size == 0) return false;
+
+    if (header->frameCount == indexCapacity || dataEnd + size > segmentBytes) {
+        if (header->dataOffset + size > segmentBytes) {
+            // would not fit even in an empty segment
+            drops++;
+            return false;
+        }
+        closeSegment();
+        if (!openSegment()) {
+            drops++;
+            return false;
+        }
+    }
+
+    memcpy(map + dataEnd, frame->buf, size);
+
+    StreamFileFrame& entry = index[header->frameCount];
+    entry.offset = dataEnd;
+    entry.size = (uint32_t)size;
+    entry.format = frame->format;
+    entry.width = frame->width;
+    entry.height = frame->height;
+    if (timestampNsec == 0) timestampNsec = frame->timestamp ? frame->timestamp : frameClockNsec();
+    entry.timestampNsec = timestampNsec;
+
+    dataEnd = streamFileAlign(dataEnd + size);
+    header->dataEnd = dataEnd;
+    // a reader of the live file must see the data and index entry before the count
+    std::atomic_thread_fence(std::memory_order_release);
+    header->frameCount++;
+
+    frames++;
+    bytes += size;
+
+#ifdef __linux__
+    if (dataEnd - writebackStart >= FRAME_RECORDER_WRITEBACK_BYTES) {
+        sync_file_range(fd, writebackStart, dataEnd - writebackStart, SYNC_FILE_RANGE_WRITE);
+        writebackStart = dataEnd;
+    }
+#endif
+    prepareAhead(dataEnd, size);
+    return true;
+}
@@ -0,0 +1,67 @@
+//
+//  FrameRecorder.h
+//
+//  Recording sink that appends captured frames to a stream file (see
+//  StreamFile.h) through a shared memory mapping. Each segment file is
+//  allocated to its full size when it is opened, so append is a memcpy plus
+//  an index entry with no allocation and no write() per frame. When a segment
+//  fills up the recorder rolls over to <path>.1, <path>.2, ... and every
+//  segment can be replayed on its own with ReplayCapture.
+//
+
+#ifndef FRAMERECORDER_H
+#define FRAMERECORDER_H
+
+#include "PCCameraInterface.h"
+#include "StreamFile.h"
+#include <string>
+
+#define FRAME_RECORDER_DEFAULT_SEGMENT (4ULL << 30)
+#define FRAME_RECORDER_DEFAULT_INDEX   65536
+// start writeback of finished data every this many bytes so dirty pages do not pile up
+#define FRAME_RECORDER_WRITEBACK_BYTES (32ULL << 20)
+
+class FrameRecorder {
+public:
+    FrameRecorder();
+    ~FrameRecorder();
+
+    bool open(const std::string& path, uint64_t segmentBytes = FRAME_RECORDER_DEFAULT_SEGMENT,
+              uint64_t indexCapacity = FRAME_RECORDER_DEFAULT_INDEX);
+    // timestampNsec 0 keeps the frame's own timestamp, or stamps the current frameClockNsec time if it has none
+    bool append(const struct RawFrame * frame, uint64_t timestampNsec = 0);
+    void close();
+
+    bool isOpen() const { return map != NULL; }
+    uint64_t framesWritten() const { return frames; }
+    uint64_t bytesWritten() const { return bytes; }
+    uint64_t dropped() const { return drops; }
+    unsigned segments() const { return segmentCount; }
+
+private:
+    bool openSegment();
+    void closeSegment();
+    void prepareAhead(uint64_t offset, uint64_t length);
+
+    std::string basePath;
+    uint64_t segmentBytes;
+    uint64_t indexCapacity;
+
+    int fd;
+    unsigned char * map;
+    StreamFileHeader * header;
+    StreamFileFrame * index;
+    uint64_t dataEnd;
+    uint64_t writebackStart;
+    unsigned segmentCount;
+
+    uint64_t frames;
+    uint64_t bytes;
+    uint64_t drops;
+
+    //disable copy constructor and assignment operator
+    FrameRecorder(const FrameRecorder&);
+    void operator=(const FrameRecorder&);
+};
+
+#endif
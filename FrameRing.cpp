@@ -0,0 +1,335 @@
+#include "FrameRing.h"
+#include "JpegHeader.h"
+#include <string.h>
+
+FrameRing::FrameRing(unsigned depth)
+{
+    if (depth < FRAME_RING_MIN_DEPTH) depth = FRAME_RING_MIN_DEPTH;
+    if (depth > FRAME_RING_MAX_DEPTH) depth = FRAME_RING_MAX_DEPTH;
+
+    numSlots = depth;
+    slots.reset(new Slot[numSlots]);
+    for (unsigned k = 0; k < numSlots; k++) {
+        memset(&slots[k].frame, 0, sizeof(RawFrame));
+        slots[k].state.store(0, std::memory_order_relaxed);
+    }
+    latest.store(-1, std::memory_order_relaxed);
+    sequence.store(0, std::memory_order_relaxed);
+    drops.store(0, std::memory_order_relaxed);
+    nextClaim = 0;
+}
+
+int FrameRing::indexOf(const struct RawFrame * frame) const
+{
+    // RawFrame is the first member of Slot
+    return (int)((const Slot *)frame - &slots[0]);
+}
+
+struct RawFrame * FrameRing::claim()
+{
+    int current = latest.load(std::memory_order_relaxed);
+
+    // start after the slot we wrote last so writes rotate through the ring
+    for (unsigned n = 0; n < numSlots; n++) {
+        unsigned idx = (nextClaim + n) % numSlots;
+        if ((int)idx == current) continue; // keep the newest frame readable
+
+        int expected = 0;
+        if (slots[idx].state.compare_exchange_strong(expected, WRITING,
+                    std::memory_order_acquire, std::memory_order_relaxed)) {
+            nextClaim = (idx + 1) % numSlots;
+            memset(slots[idx].frame.stageTime, 0, sizeof(slots[idx].frame.stageTime));
+            return &slots[idx].frame;
+        }
+    }
+
+    drops.fetch_add(1, std::memory_order_relaxed);
+    return NULL;
+}
+
+void FrameRing::publish(struct RawFrame * frame)
+{
+    int idx = indexOf(frame);
+    uint64_t seq = sequence.load(std::memory_order_relaxed) + 1;
+    frame->sequence = seq;
+
+    slots[idx].state.store(0, std::memory_order_release);
+    latest.store(idx, std::memory_order_release);
+    sequence.store(seq, std::memory_order_release);
+}
+
+void FrameRing::abandon(struct RawFrame * frame)
+{
+    slots[indexOf(frame)].state.store(0, std::memory_order_release);
+}
+
+struct RawFrame * FrameRing::acquire(uint64_t after)
+{
+    // the producer only ever claims a slot that is neither latest nor pinned,
+    // so this loop can only spin while it keeps publishing underneath us
+    for (unsigned attempt = 0; attempt < numSlots * 2; attempt++) {
+        int idx = latest.load(std::memory_order_acquire);
+        if (idx < 0) return NULL;
+
+        std::atomic<int>& state = slots[idx].state;
+        int s = state.load(std::memory_order_relaxed);
+        bool pinnedSlot = false;
+        while (!(s & WRITING)) {
+            if (state.compare_exchange_weak(s, s + 1,
+                        std::memory_order_acquire, std::memory_order_relaxed)) {
+                pinnedSlot = true;
+                break;
+            }
+        }
+        if (!pinnedSlot) continue; // slot got recycled, look at the new latest
+        if (latest.load(std::memory_order_acquire) != idx) {
+            // published over between the load and the pin: the producer may have claimed,
+            // rewritten and abandoned the slot meanwhile, its frame is not the one sequence says
+            state.fetch_sub(1, std::memory_order_release);
+            continue;
+        }
+
+        RawFrame * frame = &slots[idx].frame;
+        if (frame->sequence <= after) {
+            state.fetch_sub(1, std::memory_order_release);
+            return NULL;
+        }
+        return frame;
+    }
+    return NULL;
+}
+
+void FrameRing::retain(struct RawFrame * frame)
+{
+    slots[indexOf(frame)].state.fetch_add(1, std::memory_order_relaxed);
+}
+
+void FrameRing::release(struct RawFrame * frame)
+{
+    slots[indexOf(frame)].state.fetch_sub(1, std::memory_order_release);
+}
+
+bool FrameRing::pinned(const struct RawFrame * frame) const
+{
+    return (slots[indexOf(frame)].state.load(std::memory_order_acquire) & ~WRITING) != 0;
+}
+
+FrameRingCapture::FrameRingCapture(unsigned ringDepth) : ring(ringDepth)
+{
+    lastDelivered = 0;
+    lastHandled = 0;
+    requestedFps = 0;
+    hasHandler = false;
+    published = 0;
+    consumed = 0;
+    lateFrames = 0;
+    decimatedFrames = 0;
+    corruptFrames = 0;
+    stillFrames = 0;
+    gating = false;
+    firstPublish = 0;
+    lastPublish = 0;
+    jitterNsec = 0;
+    meanInterval = 0;
+    int s;
+    frameAvail.reset(new OSEvent(s, false, false));
+    consumerActivity.reset(new OSEvent(s, false, false));
+}
+
+struct RawFrame * FrameRingCapture::getNextFrame()
+{
+    // a frame newer than the last one we handed out may already be waiting
+    RawFrame * frame = tryGetNextFrame();
+    uint64_t deadline = frameClockNsec() + FRAME_AVAILABLE_TIMEOUT_MSEC * 1000000ULL;
+    while (frame == NULL) {
+        // frameAvail can still be signalled for a frame tryGetNextFrame took, wait again until the deadline
+        uint64_t now = frameClockNsec();
+        if (now >= deadline) break;
+        OSEventError err = frameAvail->TimedWait((unsigned)((deadline - now + 999999) / 1000000));
+        if (err != OSEvent_Error_None) break;
+        frame = tryGetNextFrame();
+    }
+    return frame;
+}
+
+struct RawFrame * FrameRingCapture::tryGetNextFrame()
+{
+#ifndef _WIN32
+    // acquire hands out the newest frame, so once it is taken nothing is left to announce;
+    // a frame published after the reset signals the fd again
+    frameReady.Reset();
+#endif
+    RawFrame * frame = ring.acquire(lastDelivered);
+    if (frame == NULL) return NULL;
+
+    lastDelivered = frame->sequence;
+    consumed.fetch_add(1, std::memory_order_relaxed);
+    latency.recordConsumer(frame, FRAME_STAGE_ACQUIRE);
+    consumerActivity->Signal();
+    // the slot stays pinned (and the producer skips it) until freeFrame
+    return frame;
+}
+
+int FrameRingCapture::frameReadyFd()
+{
+#ifndef _WIN32
+    int fd = frameReady.GetFd();
+    // frames published before the fd existed did not signal it
+    if (fd >= 0 && ring.lastSequence() > lastDelivered) frameReady.Signal();
+    return fd;
+#else
+    return -1;
+#endif
+}
+
+void FrameRingCapture::retainFrame(struct RawFrame * frame)
+{
+    if (frame != NULL) ring.retain(frame);
+}
+
+void FrameRingCapture::freeFrame(struct RawFrame * frame)
+{
+    if (frame == NULL) return;
+    // stamps are read before the slot can be recycled
+    latency.recordConsumer(frame, FRAME_STAGE_RELEASE);
+    ring.release(frame);
+    consumerActivity->Signal();
+}
+
+void FrameRingCapture::setFrameRate(unsigned fps)
+{
+    requestedFps = fps;
+    pacer.setTarget(fps);
+}
+
+bool FrameRingCapture::setFrameHandler(FrameHandler _handler)
+{
+    std::lock_guard<std::mutex> guard(handlerLock);
+    handler = _handler;
+    hasHandler = (bool)handler;
+    return true;
+}
+
+bool FrameRingCapture::paceFrame(uint64_t& timestampNsec)
+{
+    if (pacer.admit(timestampNsec)) return true;
+    decimatedFrames.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void FrameRingCapture::countPublished(uint64_t now)
+{
+    uint64_t last = lastPublish.load(std::memory_order_relaxed);
+    if (last == 0) firstPublish.store(now, std::memory_order_relaxed);
+    else {
+        double interval = (double)(now - last);
+        if (meanInterval == 0) meanInterval = interval;
+        if (interval * 2 > meanInterval * 3) lateFrames.fetch_add(1, std::memory_order_relaxed);
+        // both smoothed over about 16 frames, the jitter estimator of RFC 3550
+        double deviation = interval > meanInterval ? interval - meanInterval : meanInterval - interval;
+        double j = jitterNsec.load(std::memory_order_relaxed);
+        jitterNsec.store(j + (deviation - j) / 16, std::memory_order_relaxed);
+        meanInterval += (interval - meanInterval) / 16;
+    }
+    lastPublish.store(now, std::memory_order_relaxed);
+    deliveredRate.add(now);
+    published.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool FrameRingCapture::getStats(StreamStats& stats)
+{
+    stats.delivered = published.load(std::memory_order_relaxed);
+    uint64_t corrupt = corruptFrames.load(std::memory_order_relaxed);
+    stats.dropped = sourceDrops() + ring.dropped() + corrupt;
+    stats.corrupt = sourceCorrupt() + corrupt;
+    stats.late = lateFrames.load(std::memory_order_relaxed);
+    stats.decimated = decimatedFrames.load(std::memory_order_relaxed);
+    stats.still = sourceStill() + stillFrames.load(std::memory_order_relaxed);
+    stats.consumed = consumed.load(std::memory_order_relaxed);
+    stats.fps = deliveredRate.rate();
+
+    uint64_t first = firstPublish.load(std::memory_order_relaxed), last = lastPublish.load(std::memory_order_relaxed);
+    stats.averageFps = stats.delivered > 1 && last > first ? (stats.delivered - 1) * 1e9 / (last - first) : 0;
+    stats.jitterMsec = jitterNsec.load(std::memory_order_relaxed) / 1e6;
+
+    stats.queueDepth = 0;
+    for (unsigned k = 0; k < ring.depth(); k++) {
+        if (ring.pinned(ring.slot(k))) stats.queueDepth++;
+    }
+    uint64_t newest = ring.lastSequence(), taken = lastDelivered.load(std::memory_order_relaxed);
+    stats.consumerLag = newest > taken ? newest - taken : 0;
+    return true;
+}
+
+bool FrameRingCapture::setMotionGate(const MotionGateSettings& settings)
+{
+    if (settings.enabled && !MotionGate::valid(settings)) {
+        printf("FrameRingCapture: setMotionGate: %ux%u tiles every %u rows, threshold %g is not a gate\n",
+               settings.tilesX, settings.tilesY, settings.rowStep, settings.threshold);
+        return false;
+    }
+    std::lock_guard<std::mutex> guard(gateLock);
+    motionSettings = settings;
+    gating.store(settings.enabled, std::memory_order_release);
+    return true;
+}
+
+bool FrameRingCapture::gateFrame(struct RawFrame * frame)
+{
+    frame->motion.measured = false;
+    if (!gating.load(std::memory_order_acquire) || !MotionGate::supported(frame->format)) return true;
+    std::lock_guard<std::mutex> guard(gateLock);
+    if (!motionSettings.enabled) return true;
+    // settings or frame size changed: start over, the old reference means nothing
+    if (!gate.configuredFor(frame->format, frame->width, frame->height, motionSettings) &&
+        !gate.configure(frame->format, frame->width, frame->height, motionSettings)) {
+        return true;
+    }
+    gate.measure(frame->buf, 0, frame->motion);
+    return !gate.suppress(frame->motion);
+}
+
+bool FrameRingCapture::publishFrame(struct RawFrame * frame, const FrameMotion * upstream)
+{
+    frame->jpeg.valid = false;
+    if (frame->format == PANACAST_FRAME_FORMAT_MJPEG) {
+        bool ok = frame->size > 0 && parseJpegHeader(frame->buf, frame->size, frame->jpeg);
+        // a frame of another size is as useless to the consumers as a broken one
+        if (ok && frame->width) ok = frame->jpeg.width == frame->width && frame->jpeg.height == frame->height;
+        if (!ok) {
+            frame->jpeg.valid = false;
+            corruptFrames.fetch_add(1, std::memory_order_relaxed);
+            ring.abandon(frame);
+            return false;
+        }
+    }
+    if (upstream != NULL && upstream->measured) {
+        frame->motion = *upstream;
+    } else if (!gateFrame(frame)) {
+        stillFrames.fetch_add(1, std::memory_order_relaxed);
+        ring.abandon(frame);
+        return false;
+    }
+    frame->stageTime[FRAME_STAGE_PUBLISH] = frameClockNsec();
+    latency.recordPublished(frame);
+    countPublished(frame->stageTime[FRAME_STAGE_PUBLISH]);
+    ring.publish(frame);
+    if (hasHandler.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> guard(handlerLock);
+        if (handler) {
+            // only this thread claims slots, so the frame cannot be recycled before it is pinned
+            ring.retain(frame);
+            consumed.fetch_add(1, std::memory_order_relaxed);
+            latency.recordConsumer(frame, FRAME_STAGE_ACQUIRE);
+            uint64_t sequence = frame->sequence;
+            handler(FrameRef(this, frame));
+            lastHandled.store(sequence, std::memory_order_release);
+            consumerActivity->Signal();
+        }
+    }
+    frameAvail->Signal(); // tell any waiting threads that we have a frame
+#ifndef _WIN32
+    frameReady.Signal();
+#endif
+    return true;
+}
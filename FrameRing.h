@@ -0,0 +1,172 @@
+//
+//  FrameRing.h
+//
+//  Lock-free N-slot frame ring shared by the capture backends.
+//
+//  One producer (the capture callback) publishes frames into free slots,
+//  any number of consumers pin the newest published slot while they work on
+//  it. Nothing here takes a lock: a pinned slot is simply skipped by the
+//  producer, and when every slot is pinned the incoming frame is dropped
+//  instead of blocking the capture thread.
+//
+
+#ifndef FRAMERING_H
+#define FRAMERING_H
+
+#include "PCCameraInterface.h"
+#include "FrameLatency.h"
+#include "FramePacer.h"
+#include "MotionGate.h"
+#include "utils.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+
+#define FRAME_RING_DEFAULT_DEPTH 4
+#define FRAME_RING_MIN_DEPTH 2
+#define FRAME_RING_MAX_DEPTH 64
+
+#define FRAME_AVAILABLE_TIMEOUT_MSEC 100
+
+class FrameRing {
+public:
+    FrameRing(unsigned depth = FRAME_RING_DEFAULT_DEPTH);
+
+    // producer side, single thread only
+    // claim returns a slot that no consumer holds, or NULL if they are all pinned.
+    // The slot keeps whatever the producer stored in it last time, so the caller
+    // can recycle the old private_data before overwriting it; only stageTime is cleared.
+    struct RawFrame * claim();
+    void publish(struct RawFrame * frame);
+    void abandon(struct RawFrame * frame);
+
+    // consumer side, any thread
+    // acquire pins the newest frame if its sequence is greater than 'after'
+    struct RawFrame * acquire(uint64_t after = 0);
+    void retain(struct RawFrame * frame);
+    void release(struct RawFrame * frame);
+
+    // true while at least one consumer holds the frame
+    bool pinned(const struct RawFrame * frame) const;
+
+    unsigned depth() const { return numSlots; }
+    struct RawFrame * slot(unsigned idx) { return &slots[idx].frame; }
+    uint64_t lastSequence() const { return sequence.load(std::memory_order_acquire); }
+    uint64_t dropped() const { return drops.load(std::memory_order_relaxed); }
+
+private:
+    // state is the reader count, with WRITING set while the producer owns the slot
+    enum { WRITING = 1 << 30 };
+
+    struct Slot {
+        struct RawFrame frame;
+        std::atomic<int> state;
+    };
+
+    int indexOf(const struct RawFrame * frame) const;
+
+    unsigned numSlots;
+    std::unique_ptr<Slot[]> slots;
+    std::atomic<int> latest;
+    std::atomic<uint64_t> sequence;
+    std::atomic<uint64_t> drops;
+    unsigned nextClaim;
+
+    //disable copy constructor and assignment operator
+    FrameRing(const FrameRing&);
+    void operator=(const FrameRing&);
+};
+
+// Consumer half of CaptureInterface for backends that publish into a FrameRing.
+// The backend claims a slot from ring, fills it and hands it to publishFrame.
+class FrameRingCapture : public CaptureInterface {
+public:
+    FrameRingCapture(unsigned ringDepth = FRAME_RING_DEFAULT_DEPTH);
+    struct RawFrame * getNextFrame();
+    struct RawFrame * tryGetNextFrame();
+    void retainFrame(struct RawFrame * frame);
+    void freeFrame(struct RawFrame * frame);
+
+    void setFrameRate(unsigned fps);
+    double achievedFrameRate() { return pacer.outputRate(); }
+    int frameReadyFd();
+    bool setFrameHandler(FrameHandler handler);
+    FrameLatencyTrace * latencyTrace() { return &latency; }
+    bool getStats(StreamStats& stats);
+    bool setMotionGate(const MotionGateSettings& settings);
+
+protected:
+    // false if frame was MJPEG that failed parseJpegHeader or is not the size it claims, or
+    // the motion gate suppressed it; the slot is given up and the frame counted corrupt or
+    // still. Stages that make frames out of another backend's pass that frame's motion as
+    // upstream: if it was measured there it is carried over rather than measured again.
+    bool publishFrame(struct RawFrame * frame, const FrameMotion * upstream = NULL);
+    // Call for every frame the device delivers, before claiming a slot for it.
+    // false: skip the frame to hold the requested rate; otherwise timestampNsec is the paced timestamp.
+    bool paceFrame(uint64_t& timestampNsec);
+    unsigned requestedFrameRate() const { return requestedFps; }
+    // sequence of the newest frame a consumer has taken, through getNextFrame or the frame
+    // handler; a stage on top of this backend (ConvertCapture, DecodeCapture) takes every
+    // frame through the handler
+    uint64_t deliveredSequence() const {
+        uint64_t pulled = lastDelivered.load(std::memory_order_acquire);
+        uint64_t pushed = lastHandled.load(std::memory_order_acquire);
+        return pulled > pushed ? pulled : pushed;
+    }
+    // treat everything published so far as delivered, for backends that recycle their buffers on restart
+    void discardPublished() { lastDelivered = ring.lastSequence(); }
+    // block until a consumer takes or frees a frame, or msec pass; a producer waiting on
+    // consumers signals consumerActivity itself to be let go when it stops
+    void waitForConsumer(unsigned msec) { consumerActivity->TimedWait(msec); }
+    // frames lost before they reach the ring (driver gaps, OS drops, corrupt buffers), for getStats
+    virtual uint64_t sourceDrops() const { return 0; }
+    // of those, frames that arrived damaged
+    virtual uint64_t sourceCorrupt() const { return 0; }
+    // frames the motion gate of the backend this one reads from suppressed
+    virtual uint64_t sourceStill() const { return 0; }
+
+    FrameRing ring;
+    std::unique_ptr<OSEvent> frameAvail;
+    std::unique_ptr<OSEvent> consumerActivity; // a frame was taken, freed or handled
+#ifndef _WIN32
+    OSPollableEvent frameReady;
+#endif
+    FramePacer pacer;
+    FrameLatencyTrace latency;
+
+private:
+    void countPublished(uint64_t publishNsec);
+    // measure frame's motion if there is a gate for its format; false to suppress it
+    bool gateFrame(struct RawFrame * frame);
+
+    unsigned requestedFps;
+    // held while the handler runs, so removing it waits for the call in progress
+    std::mutex handlerLock;
+    FrameHandler handler;
+    std::atomic<bool> hasHandler;
+    std::atomic<uint64_t> lastDelivered;
+    std::atomic<uint64_t> lastHandled; // newest frame the handler has returned from
+
+    // getStats counters, written with relaxed atomics by the capture thread
+    // (consumed by consumers too) and read by anyone
+    std::atomic<uint64_t> published;
+    std::atomic<uint64_t> consumed;
+    std::atomic<uint64_t> lateFrames;
+    std::atomic<uint64_t> decimatedFrames;
+    std::atomic<uint64_t> corruptFrames; // MJPEG publishFrame refused
+    std::atomic<uint64_t> stillFrames;   // suppressed by the motion gate
+    std::atomic<uint64_t> firstPublish;
+    std::atomic<uint64_t> lastPublish;
+    std::atomic<double> jitterNsec;
+    double meanInterval; // capture thread only
+    FrameRateMeter deliveredRate;
+
+    // held by setMotionGate and by the capture thread while it measures a frame
+    std::mutex gateLock;
+    std::atomic<bool> gating;
+    MotionGateSettings motionSettings;
+    MotionGate gate;
+};
+
+#endif
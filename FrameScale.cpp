@@ -0,0 +1,217 @@
+#include "FrameScale.h"
+#include "FrameConvertKernels.h"
+#include <string.h>
+
+// at most this many bands, each with a row of sums of its own
+#define SCALE_MAX_BANDS (4 * FRAME_WORKERS_MAX)
+
+void FrameScaler::Taps::area(unsigned src, unsigned dst, unsigned maxBox)
+{
+    first.resize(dst);
+    count.resize(dst);
+    weight.assign(dst, 0);
+    weights.clear();
+
+    if (src % dst == 0 && src / dst <= maxBox) {
+        unsigned f = src / dst;
+        box = true;
+        divisor = f;
+        for (unsigned i = 0; i < dst; i++) {
+            first[i] = i * f;
+            count[i] = f;
+        }
+        return;
+    }
+
+    // in units of 1/dst source sample: output sample i covers [i src, (i + 1) src), source
+    // sample r covers [r dst, (r + 1) dst)
+    box = false;
+    divisor = 256;
+    for (unsigned i = 0; i < dst; i++) {
+        uint64_t lo = (uint64_t)i * src, hi = lo + src;
+        unsigned r0 = (unsigned)(lo / dst), r1 = (unsigned)((hi - 1) / dst);
+        first[i] = r0;
+        count[i] = r1 - r0 + 1;
+        weight[i] = (unsigned)weights.size();
+        // each weight is the rounded coverage up to the end of its sample less the rounded
+        // coverage up to its start, so none is negative and together they make exactly 256
+        unsigned start = 0;
+        for (unsigned r = r0; r <= r1; r++) {
+            uint64_t to = hi < (uint64_t)(r + 1) * dst ? hi : (uint64_t)(r + 1) * dst;
+            unsigned end = (unsigned)(((to - lo) * 256 + src / 2) / src);
+            weights.push_back((uint16_t)(end - start));
+            start = end;
+        }
+    }
+}
+
+FrameScaler::FrameScaler()
+{
+    fmt = PANACAST_FRAME_FORMAT_YUYV;
+    srcW = srcH = dstW = dstH = 0;
+    planeCount = 0;
+    bandRows = 0;
+    bands = 0;
+}
+
+bool FrameScaler::configure(RawFrameFormat format, unsigned srcWidth, unsigned srcHeight, unsigned dstWidth, unsigned dstHeight)
+{
+    planeCount = 0;
+    if (!isPacked422(format) && !is420(format) && !isPackedRGB(format)) return false;
+    if (dstWidth == 0 || dstHeight == 0 || dstWidth > srcWidth || dstHeight > srcHeight) return false;
+    // weights in 1/256 cannot tell more source samples apart, and the 16 bit row sums hold no more
+    if (srcWidth > 256ULL * dstWidth || srcHeight > 256ULL * dstHeight) return false;
+    if (!isPackedRGB(format) && ((srcWidth | dstWidth) & 1)) return false;
+    if (is420(format) && ((srcHeight | dstHeight) & 1)) return false;
+
+    fmt = format;
+    srcW = srcWidth;
+    srcH = srcHeight;
+    dstW = dstWidth;
+    dstH = dstHeight;
+
+    // 16 bit sums hold 256 rows of 255, and with at most 256 a side, checked above, the
+    // divisor stays within 65536, where dividing by a 40 bit reciprocal is exact
+    horizontal[0].area(srcW, dstW, 256);
+    if (!isPackedRGB(format)) horizontal[1].area(srcW / 2, dstW / 2, 256);
+    vertical[0].area(srcH, dstH, 256);
+    if (is420(format)) vertical[1].area(srcH / 2, dstH / 2, 256);
+
+    Plane& first = plane[0];
+    first.srcRowBytes = rowBytes(format, srcW);
+    first.dstRowBytes = rowBytes(format, dstW);
+    first.vertical = 0;
+    first.rowShift = 0;
+    if (isPacked422(format)) {
+        bool uyvy = format == PANACAST_FRAME_FORMAT_UYVY;
+        Channel y = { uyvy ? 1u : 0u, 2, 0 }, u = { uyvy ? 0u : 1u, 4, 1 }, v = { uyvy ? 2u : 3u, 4, 1 };
+        first.channels = 3;
+        first.channel[0] = y;
+        first.channel[1] = u;
+        first.channel[2] = v;
+        planeCount = 1;
+    } else if (isPackedRGB(format)) {
+        first.channels = format == PANACAST_FRAME_FORMAT_BGRA32 ? 4 : 3;
+        for (unsigned c = 0; c < first.channels; c++) {
+            Channel ch = { c, first.channels, 0 };
+            first.channel[c] = ch;
+        }
+        planeCount = 1;
+    } else {
+        Channel y = { 0, 1, 0 };
+        first.channels = 1;
+        first.channel[0] = y;
+        bool nv12 = format == PANACAST_FRAME_FORMAT_NV12;
+        planeCount = nv12 ? 2 : 3;
+        for (unsigned p = 1; p < planeCount; p++) {
+            Plane& chroma = plane[p];
+            chroma.srcRowBytes = nv12 ? srcW : srcW / 2;
+            chroma.dstRowBytes = nv12 ? dstW : dstW / 2;
+            chroma.vertical = 1;
+            chroma.rowShift = 1;
+            Channel u = { 0, nv12 ? 2u : 1u, 1 }, v = { 1, 2, 1 };
+            chroma.channels = nv12 ? 2 : 1;
+            chroma.channel[0] = u;
+            chroma.channel[1] = v;
+        }
+    }
+
+    // bands of output rows whose source rows fit the cache, whole row pairs for 4:2:0
+    unsigned ratio = (srcH + dstH - 1) / dstH;
+    bandRows = FrameWorkers::bandRows((size_t)first.srcRowBytes * ratio, 2);
+    if ((dstH + bandRows - 1) / bandRows > SCALE_MAX_BANDS) bandRows = ((dstH + SCALE_MAX_BANDS - 1) / SCALE_MAX_BANDS + 1) & ~1u;
+    bands = (dstH + bandRows - 1) / bandRows;
+    accumulators.assign((size_t)bands * first.srcRowBytes, 0);
+    return true;
+}
+
+void FrameScaler::scaleRows(const ConvertKernels& k, const uint8_t * const * src, const unsigned * srcStride,
+                            uint8_t * const * dst, const unsigned * dstStride, uint16_t * acc, unsigned y0, unsigned y1) const
+{
+    const ConvertKernels& scalar = convertKernels(CONVERT_ISA_SCALAR);
+    for (unsigned p = 0; p < planeCount; p++) {
+        const Plane& pl = plane[p];
+        const Taps& v = vertical[pl.vertical];
+        unsigned bytes = pl.srcRowBytes;
+        for (unsigned r = y0 >> pl.rowShift; r < y1 >> pl.rowShift; r++) {
+            // down: sum the source rows of output row r, weighted unless they are a plain box
+            memset(acc, 0, bytes * sizeof(uint16_t));
+            for (unsigned t = 0; t < v.count[r]; t++) {
+                const uint8_t * row = src[p] + (size_t)(v.first[r] + t) * srcStride[p];
+                unsigned w = v.box ? 1 : v.weights[v.weight[r] + t];
+                unsigned n = k.accumulate(row, acc, bytes, w);
+                if (n < bytes) scalar.accumulate(row + n, acc + n, bytes - n, w);
+            }
+
+            // across: every channel of the summed row on its own
+            uint8_t * out = dst[p] + (size_t)r * dstStride[p];
+            for (unsigned c = 0; c < pl.channels; c++) {
+                const Channel& ch = pl.channel[c];
+                const Taps& h = horizontal[ch.taps];
+                uint32_t divisor = h.divisor * v.divisor;
+                uint64_t reciprocal = ((1ULL << 40) + divisor - 1) / divisor;
+                const uint16_t * in = acc + ch.offset;
+                uint8_t * o = out + ch.offset;
+                unsigned samples = (unsigned)h.first.size(), step = ch.step;
+                for (unsigned j = 0; j < samples; j++) {
+                    const uint16_t * q = in + (size_t)h.first[j] * step;
+                    uint32_t sum = divisor / 2;
+                    if (h.box) {
+                        for (unsigned t = 0; t < h.divisor; t++) sum += q[t * step];
+                    } else {
+                        const uint16_t * w = &h.weights[h.weight[j]];
+                        for (unsigned t = 0; t < h.count[j]; t++) sum += w[t] * q[t * step];
+                    }
+                    o[j * step] = (uint8_t)((sum * reciprocal) >> 40);
+                }
+            }
+        }
+    }
+}
+
+bool FrameScaler::scale(const uint8_t * src, unsigned srcStride, uint8_t * dst, unsigned dstStride,
+                        FrameWorkers * workers, ConvertIsa isa)
+{
+    if (!configured()) return false;
+    const ConvertKernels& k = convertKernels(isa);
+    if (srcStride == 0) srcStride = rowBytes(fmt, srcW);
+    if (dstStride == 0) dstStride = rowBytes(fmt, dstW);
+
+    Planes in(src, srcStride, fmt, srcH), out(dst, dstStride, fmt, dstH);
+    bool nv12 = fmt == PANACAST_FRAME_FORMAT_NV12;
+    const uint8_t * srcPlane[3] = { in.y, in.u, in.v };
+    uint8_t * dstPlane[3] = { out.y, out.u, out.v };
+    unsigned srcStrides[3] = { in.stride, nv12 ? in.stride : in.chromaStride, in.chromaStride };
+    unsigned dstStrides[3] = { out.stride, nv12 ? out.stride : out.chromaStride, out.chromaStride };
+
+    if (workers == NULL || workers->threads() == 1 || bands == 1) {
+        scaleRows(k, srcPlane, srcStrides, dstPlane, dstStrides, &accumulators[0], 0, dstH);
+        return true;
+    }
+    // one reference is all the job captures, small enough for std::function not to allocate
+    struct Job {
+        const FrameScaler& scaler;
+        const ConvertKernels& k;
+        const uint8_t * const * src;
+        const unsigned * srcStride;
+        uint8_t * const * dst;
+        const unsigned * dstStride;
+        uint16_t * acc;
+    } job = { *this, k, srcPlane, srcStrides, dstPlane, dstStrides, &accumulators[0] };
+    workers->run(bands, [&job](unsigned band) {
+        const FrameScaler& s = job.scaler;
+        unsigned y0 = band * s.bandRows, y1 = y0 + s.bandRows < s.dstH ? y0 + s.bandRows : s.dstH;
+        s.scaleRows(job.k, job.src, job.srcStride, job.dst, job.dstStride, job.acc + (size_t)band * s.plane[0].srcRowBytes,
+                    y0, y1);
+    });
+    return true;
+}
+
+bool scaleFrame(const uint8_t * src, unsigned srcStride, unsigned srcWidth, unsigned srcHeight,
+                uint8_t * dst, unsigned dstStride, unsigned dstWidth, unsigned dstHeight,
+                RawFrameFormat format, ConvertIsa isa)
+{
+    FrameScaler scaler;
+    if (!scaler.configure(format, srcWidth, srcHeight, dstWidth, dstHeight)) return false;
+    return scaler.scale(src, srcStride, dst, dstStride, NULL, isa);
+}
@@ -0,0 +1,91 @@
+//
+//  FrameScale.h
+//
+//  Area averaging downscaler for preview and analytics streams that only
+//  need a thumbnail of the full frame, e.g. 640x360 or 320x180 out of 4K.
+//  It works on the frame as the camera sends it, YUYV, UYVY, NV12, YV12 or
+//  I420 (and packed RGB), each output sample the average of the source area
+//  it covers. Rows are summed first, with the SIMD kernels of FrameConvert,
+//  so the full frame is read once; only the few summed rows are then
+//  reduced across. Integer ratios average plain boxes; other ratios weigh
+//  the edge samples by how much of them the output sample covers, in 1/256.
+//
+
+#ifndef FRAMESCALE_H
+#define FRAMESCALE_H
+
+#include "FrameConvert.h"
+#include "FrameWorkers.h"
+#include <stdint.h>
+#include <vector>
+
+struct ConvertKernels;
+
+class FrameScaler {
+public:
+    FrameScaler();
+
+    // Set up for frames of format from srcWidth x srcHeight down to dstWidth x dstHeight.
+    // false if the format cannot be scaled, the output is larger than the input or more than
+    // 256 times smaller on either side, or a width, or for 4:2:0 a height, is odd.
+    bool configure(RawFrameFormat format, unsigned srcWidth, unsigned srcHeight, unsigned dstWidth, unsigned dstHeight);
+    bool configured() const { return planeCount != 0; }
+
+    // Scale one frame; one at a time, a scaler keeps its sums in its own buffers. Strides as
+    // in convertFrame, 0 for rows packed back to back. workers, if any, share out row bands.
+    bool scale(const uint8_t * src, unsigned srcStride, uint8_t * dst, unsigned dstStride,
+               FrameWorkers * workers = NULL, ConvertIsa isa = CONVERT_ISA_AUTO);
+
+    RawFrameFormat format() const { return fmt; }
+    unsigned outputWidth() const { return dstW; }
+    unsigned outputHeight() const { return dstH; }
+
+private:
+    // which source samples make up each output sample along one axis
+    struct Taps {
+        std::vector<unsigned> first;    // first source sample
+        std::vector<unsigned> count;    // source samples from there
+        std::vector<unsigned> weight;   // offset of the weights in weights
+        std::vector<uint16_t> weights;  // per source sample, summing to divisor
+        unsigned divisor;
+        bool box;                       // all weights 1, divisor the ratio
+
+        void area(unsigned src, unsigned dst, unsigned maxBox);
+    };
+
+    // samples at offset, offset + step, ... of a row, e.g. the Y, U or V bytes of YUYV
+    struct Channel {
+        unsigned offset;
+        unsigned step;
+        unsigned taps; // index into horizontal
+    };
+
+    struct Plane {
+        unsigned srcRowBytes;
+        unsigned dstRowBytes;
+        unsigned vertical; // index into vertical
+        unsigned rowShift; // plane rows are luma rows >> rowShift
+        unsigned channels;
+        Channel channel[4];
+    };
+
+    void scaleRows(const ConvertKernels& k, const uint8_t * const * src, const unsigned * srcStride,
+                   uint8_t * const * dst, const unsigned * dstStride, uint16_t * acc, unsigned y0, unsigned y1) const;
+
+    RawFrameFormat fmt;
+    unsigned srcW, srcH, dstW, dstH;
+    Taps horizontal[2]; // luma, chroma
+    Taps vertical[2];
+    Plane plane[3];
+    unsigned planeCount;
+    unsigned bandRows;
+    unsigned bands;
+    std::vector<uint16_t> accumulators; // a row per band
+};
+
+// one-off scale, sets up a FrameScaler every call: keep one per stream instead
+bool scaleFrame(const uint8_t * src, unsigned srcStride, unsigned srcWidth, unsigned srcHeight,
+                uint8_t * dst, unsigned dstStride, unsigned dstWidth, unsigned dstHeight,
+                RawFrameFormat format, ConvertIsa isa = CONVERT_ISA_AUTO);
+
+#endif
@@ -0,0 +1,141 @@
+#include "FrameTensor.h"
+#include "FrameConvertKernels.h"
+#include <math.h>
+#include <string.h>
+
+TensorLayout::TensorLayout(unsigned _width, unsigned _height, TensorType _type)
+    : width(_width), height(_height), type(_type), bgr(false), scale(1)
+{
+    for (unsigned c = 0; c < TENSOR_CHANNELS; c++) {
+        mean[c] = 0;
+        stddev[c] = 1;
+    }
+}
+
+bool TensorLayout::operator==(const TensorLayout& other) const
+{
+    if (width != other.width || height != other.height || type != other.type || bgr != other.bgr) return false;
+    if (type == TENSOR_INT8 && scale != other.scale) return false;
+    for (unsigned c = 0; c < TENSOR_CHANNELS; c++) {
+        if (mean[c] != other.mean[c] || stddev[c] != other.stddev[c]) return false;
+    }
+    return true;
+}
+
+size_t TensorLayout::bytes() const
+{
+    size_t elements = (size_t)TENSOR_CHANNELS * width * height;
+    return type == TENSOR_FLOAT32 ? elements * sizeof(float) : elements;
+}
+
+FrameTensorizer::FrameTensorizer() : fmt(PANACAST_FRAME_FORMAT_MJPEG), srcW(0), srcH(0), scaling(false), pixelBytes(0)
+{
+    memset(offset, 0, sizeof(offset));
+}
+
+bool FrameTensorizer::configure(RawFrameFormat format, unsigned srcWidth, unsigned srcHeight, const TensorLayout& layout)
+{
+    pixelBytes = 0;
+    unsigned w = layout.width, h = layout.height;
+    bool packedRGB = isPackedRGB(format);
+    if (!packedRGB && !isPacked422(format) && !is420(format)) return false;
+    if (w == 0 || h == 0 || w > srcWidth || h > srcHeight) return false;
+    if (layout.type == TENSOR_INT8 && !(layout.scale > 0)) return false;
+    for (unsigned c = 0; c < TENSOR_CHANNELS; c++) {
+        if (layout.stddev[c] == 0) return false;
+    }
+
+    scaling = w != srcWidth || h != srcHeight;
+    if (scaling && !scaler.configure(format, srcWidth, srcHeight, w, h)) return false;
+    // what convertFrame needs, when there is no scaler to refuse it
+    if (!packedRGB && ((w & 1) || (is420(format) && (h & 1)))) return false;
+    scaled.resize(scaling ? rawFrameSize(format, w, h) : 0);
+    rgb.resize(packedRGB ? 0 : (size_t)w * h * 3);
+
+    // BGR24, BGRA32 and what convertFrame writes have blue first, RGB24 red
+    static const unsigned bgrOffsets[3] = { 0, 1, 2 }, rgbOffsets[3] = { 2, 1, 0 };
+    const unsigned * blueGreenRed = format == PANACAST_FRAME_FORMAT_RGB24 ? rgbOffsets : bgrOffsets;
+    for (unsigned p = 0; p < TENSOR_CHANNELS; p++) {
+        offset[p] = blueGreenRed[layout.bgr ? p : TENSOR_CHANNELS - 1 - p];
+    }
+
+    // normalizing an 8 bit sample is a lookup
+    for (unsigned p = 0; p < TENSOR_CHANNELS; p++) {
+        for (unsigned v = 0; v < 256; v++) {
+            float value = ((float)v - layout.mean[p]) / layout.stddev[p];
+            floatTable[p][v] = value;
+            float q = layout.type == TENSOR_INT8 ? rintf(value / layout.scale) : 0;
+            int8Table[p][v] = (int8_t)(q < -128 ? -128 : q > 127 ? 127 : q);
+        }
+    }
+
+    fmt = format;
+    srcW = srcWidth;
+    srcH = srcHeight;
+    tensor = layout;
+    pixelBytes = format == PANACAST_FRAME_FORMAT_BGRA32 ? 4 : 3;
+    return true;
+}
+
+bool FrameTensorizer::configuredFor(RawFrameFormat format, unsigned srcWidth, unsigned srcHeight,
+                                    const TensorLayout& layout) const
+{
+    return pixelBytes != 0 && fmt == format && srcW == srcWidth && srcH == srcHeight && tensor == layout;
+}
+
+
+void FrameTensorizer::planarize(const uint8_t * pixels, unsigned stride, void * dst, unsigned y0, unsigned y1) const
+{
+    unsigned w = tensor.width;
+    size_t planeSize = (size_t)w * tensor.height;
+    for (unsigned p = 0; p < TENSOR_CHANNELS; p++) {
+        for (unsigned y = y0; y < y1; y++) {
+            const uint8_t * in = pixels + (size_t)y * stride + offset[p];
+            size_t first = p * planeSize + (size_t)y * w;
+            if (tensor.type == TENSOR_FLOAT32) {
+                const float * table = floatTable[p];
+                float * out = (float *)dst + first;
+                for (unsigned x = 0; x < w; x++) out[x] = table[in[x * pixelBytes]];
+            } else {
+                const int8_t * table = int8Table[p];
+                int8_t * out = (int8_t *)dst + first;
+                for (unsigned x = 0; x < w; x++) out[x] = table[in[x * pixelBytes]];
+            }
+        }
+    }
+}
+
+bool FrameTensorizer::convert(const uint8_t * src, unsigned srcStride, void * dst, FrameWorkers * workers, ConvertIsa isa)
+{
+    if (pixelBytes == 0) return false;
+    unsigned w = tensor.width, h = tensor.height;
+
+    const uint8_t * frame = src;
+    unsigned stride = srcStride;
+    if (scaling) {
+        if (!scaler.scale(src, srcStride, &scaled[0], 0, workers, isa)) return false;
+        frame = &scaled[0];
+        stride = 0;
+    }
+    if (!isPackedRGB(fmt)) {
+        bool ok = workers ? convertFrameParallel(*workers, frame, stride, fmt, &rgb[0], 0, PANACAST_FRAME_FORMAT_BGR24, w, h, isa)
+                          : convertFrame(frame, stride, fmt, &rgb[0], 0, PANACAST_FRAME_FORMAT_BGR24, w, h, isa);
+        if (!ok) return false;
+        frame = &rgb[0];
+        stride = 0;
+    }
+    if (stride == 0) stride = w * pixelBytes;
+
+    if (workers == NULL || workers->threads() == 1) {
+        planarize(frame, stride, dst, 0, h);
+        return true;
+    }
+    size_t elementBytes = tensor.type == TENSOR_FLOAT32 ? sizeof(float) : 1;
+    unsigned rows = FrameWorkers::bandRows((size_t)w * (pixelBytes + TENSOR_CHANNELS * elementBytes), 1);
+    unsigned bands = (h + rows - 1) / rows;
+    workers->run(bands, [&](unsigned band) {
+        unsigned y0 = band * rows, y1 = y0 + rows < h ? y0 + rows : h;
+        planarize(frame, stride, dst, y0, y1);
+    });
+    return true;
+}
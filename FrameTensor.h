@@ -0,0 +1,84 @@
+//
+//  FrameTensor.h
+//
+//  Input tensors for inference, straight from the frame as the camera sends
+//  it: YUYV, UYVY, NV12, YV12, I420, or the packed RGB an MJPEG stream is
+//  decoded to. The frame is scaled to the tensor size with FrameScaler,
+//  still in its own format, so the full frame is read once; the small frame
+//  is then converted to RGB with the SIMD kernels of FrameConvert and
+//  spread into planes through a per channel table that normalizes as it
+//  goes. What comes out is channels x height x width (CHW) float32 or int8,
+//  (pixel - mean) / stddev per channel, in a buffer the caller owns.
+//
+
+#ifndef FRAMETENSOR_H
+#define FRAMETENSOR_H
+
+#include "FrameConvert.h"
+#include "FrameScale.h"
+#include "FrameWorkers.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#define TENSOR_CHANNELS 3
+
+enum TensorType {
+    TENSOR_FLOAT32,
+    TENSOR_INT8,   // round((pixel - mean) / stddev / scale), saturated to -128..127
+};
+
+struct TensorLayout {
+    unsigned width;
+    unsigned height;
+    TensorType type;
+    bool bgr;                       // planes in B, G, R order rather than R, G, B
+    float mean[TENSOR_CHANNELS];    // per plane, in plane order, on the 0..255 scale of the pixels
+    float stddev[TENSOR_CHANNELS];
+    float scale;                    // TENSOR_INT8 only, the quantization step
+
+    // width x height float32 RGB, mean 0 and stddev 1: pixel values as they are
+    TensorLayout(unsigned width = 0, unsigned height = 0, TensorType type = TENSOR_FLOAT32);
+    // bytes of a tensor, TENSOR_CHANNELS x height x width elements
+    size_t bytes() const;
+    bool operator==(const TensorLayout& other) const;
+    bool operator!=(const TensorLayout& other) const { return !(*this == other); }
+};
+
+class FrameTensorizer {
+public:
+    FrameTensorizer();
+
+    // Set up for frames of format at srcWidth x srcHeight. false if the format is MJPEG or
+    // unknown, a stddev is 0, or the tensor is larger than the frame or cannot be scaled to
+    // (see FrameScaler::configure: the width, and for 4:2:0 the height, must be even).
+    bool configure(RawFrameFormat format, unsigned srcWidth, unsigned srcHeight, const TensorLayout& layout);
+    // true if configured for exactly this
+    bool configuredFor(RawFrameFormat format, unsigned srcWidth, unsigned srcHeight, const TensorLayout& layout) const;
+
+    const TensorLayout& layout() const { return tensor; }
+
+    // Write the tensor of one frame to dst, layout().bytes() long. srcStride as in convertFrame,
+    // 0 for rows packed back to back. One frame at a time, the scratch frames are shared;
+    // workers, if any, share out the scaling and the planes.
+    bool convert(const uint8_t * src, unsigned srcStride, void * dst, FrameWorkers * workers = NULL,
+                 ConvertIsa isa = CONVERT_ISA_AUTO);
+
+private:
+    void planarize(const uint8_t * pixels, unsigned stride, void * dst, unsigned y0, unsigned y1) const;
+
+    RawFrameFormat fmt;
+    unsigned srcW;
+    unsigned srcH;
+    TensorLayout tensor;
+    bool scaling;
+    FrameScaler scaler;
+    std::vector<uint8_t> scaled;  // the frame at tensor size, in its own format
+    std::vector<uint8_t> rgb;     // and as BGR24, unless it was packed RGB already
+    unsigned pixelBytes;          // of what planarize reads
+    unsigned offset[TENSOR_CHANNELS]; // byte of each plane's channel in a pixel
+    float floatTable[TENSOR_CHANNELS][256];
+    int8_t int8Table[TENSOR_CHANNELS][256];
+};
+
+#endif
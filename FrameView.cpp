@@ -0,0 +1,85 @@
+#include "FrameView.h"
+#include "FrameConvertKernels.h"
+#include <string.h>
+
+// pixels per sample, across and down alike, in plane p of format
+static unsigned subsample(RawFrameFormat format, unsigned p)
+{
+    return is420(format) && p > 0 ? 2 : 1;
+}
+
+bool FrameView::view(const FrameRef& _frame)
+{
+    planes = 0;
+    if (!_frame) return false;
+    RawFrame * raw = _frame.get();
+    if (!isPacked422(raw->format) && !is420(raw->format) && !isPackedRGB(raw->format)) return false;
+
+    frame = _frame;
+    format = raw->format;
+    x = 0;
+    y = 0;
+    width = raw->width;
+    height = raw->height;
+
+    Planes p(raw->buf, rowBytes(format, width), format, height);
+    PlaneView first = { p.y, p.stride, width, height, isPacked422(format) ? 2u : rawFrameSize(format, 1, 1) };
+    if (is420(format)) first.sampleBytes = 1;
+    plane[0] = first;
+    planes = 1;
+    if (format == PANACAST_FRAME_FORMAT_NV12) {
+        PlaneView uv = { p.u, p.stride, width / 2, height / 2, 2 };
+        plane[1] = uv;
+        planes = 2;
+    } else if (is420(format)) {
+        // planes in memory order, YV12 has V first
+        bool yv12 = format == PANACAST_FRAME_FORMAT_YV12;
+        PlaneView second = { yv12 ? p.v : p.u, p.chromaStride, width / 2, height / 2, 1 };
+        PlaneView third = { yv12 ? p.u : p.v, p.chromaStride, width / 2, height / 2, 1 };
+        plane[1] = second;
+        plane[2] = third;
+        planes = 3;
+    }
+    return true;
+}
+
+bool FrameView::crop(unsigned _x, unsigned _y, unsigned _width, unsigned _height, FrameView& out) const
+{
+    if (planes == 0 || _width == 0 || _height == 0) return false;
+    // grown to whole chroma samples, in 64 bits so nothing wraps
+    uint64_t x0 = _x, y0 = _y, x1 = x0 + _width, y1 = y0 + _height;
+    if (isPacked422(format) || is420(format)) {
+        x0 &= ~1ULL;
+        x1 = (x1 + 1) & ~1ULL;
+    }
+    if (is420(format)) {
+        y0 &= ~1ULL;
+        y1 = (y1 + 1) & ~1ULL;
+    }
+    if (x1 > width || y1 > height) return false;
+
+    if (&out != this) out.frame = frame;
+    out.format = format;
+    out.x = x + (unsigned)x0;
+    out.y = y + (unsigned)y0;
+    out.width = (unsigned)(x1 - x0);
+    out.height = (unsigned)(y1 - y0);
+    for (unsigned p = 0; p < planes; p++) {
+        const PlaneView& from = plane[p];
+        unsigned s = subsample(format, p);
+        PlaneView to = { from.data + (size_t)(y0 / s) * from.stride + (size_t)(x0 / s) * from.sampleBytes, from.stride,
+                         out.width / s, out.height / s, from.sampleBytes };
+        out.plane[p] = to;
+    }
+    out.planes = planes;
+    return true;
+}
+
+void FrameView::copyTo(uint8_t * dst) const
+{
+    for (unsigned p = 0; p < planes; p++) {
+        const PlaneView& from = plane[p];
+        size_t bytes = (size_t)from.width * from.sampleBytes;
+        for (unsigned r = 0; r < from.height; r++, dst += bytes) memcpy(dst, from.data + (size_t)r * from.stride, bytes);
+    }
+}
@@ -0,0 +1,55 @@
+//
+//  FrameView.h
+//
+//  Zero copy views of a rectangle of a captured frame, for consumers that
+//  only look at part of the panorama, e.g. one side of a meeting room. A
+//  view is a base pointer, stride, width and height per plane into the
+//  capture buffer itself, and holds a FrameRef so the buffer stays out of
+//  the ring while it is looked at. Nothing is read until someone reads the
+//  pixels; copyTo packs the rectangle into a frame of its own when a
+//  consumer needs one. Rectangles grow to whole chroma samples: even x and
+//  width for YUYV and UYVY, and even y and height as well for 4:2:0.
+//
+
+#ifndef FRAMEVIEW_H
+#define FRAMEVIEW_H
+
+#include "PCCameraInterface.h"
+#include <stdint.h>
+
+#define FRAME_VIEW_MAX_PLANES 3
+
+struct PlaneView {
+    const uint8_t * data; // first sample of the rectangle
+    unsigned stride;      // bytes from a row to the next
+    unsigned width;       // samples per row
+    unsigned height;      // rows
+    unsigned sampleBytes; // bytes per sample: 2 for a YUYV pixel or an NV12 UV pair, 3 for BGR, 1 for a planar Y, U or V
+};
+
+struct FrameView {
+    FrameRef frame;        // keeps the capture buffer from going back to the ring
+    RawFrameFormat format;
+    unsigned x;            // where the rectangle is in the frame
+    unsigned y;
+    unsigned width;
+    unsigned height;
+    unsigned planes;
+    PlaneView plane[FRAME_VIEW_MAX_PLANES]; // in memory order: Y then UV, U then V, or V then U for YV12
+
+    FrameView() : format(PANACAST_FRAME_FORMAT_YUYV), x(0), y(0), width(0), height(0), planes(0), plane() {}
+
+    // The whole of frame. false if the frame is empty or its format has no planes to
+    // point into, i.e. MJPEG.
+    bool view(const FrameRef& frame);
+
+    // The rectangle at x, y of this view, grown to whole chroma samples, into out. false
+    // if it is empty or, once grown, reaches outside this view.
+    bool crop(unsigned x, unsigned y, unsigned width, unsigned height, FrameView& out) const;
+
+    // Copy the pixels into dst laid out as rawFrameSize(format, width, height) bytes of a
+    // frame of the view's size, ready for convertFrame or FrameScaler.
+    void copyTo(uint8_t * dst) const;
+};
+
+#endif
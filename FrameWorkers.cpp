@@ -0,0 +1,79 @@
+#include "FrameWorkers.h"
+
+FrameWorkers::FrameWorkers(unsigned threads)
+{
+    job = NULL;
+    bands = 0;
+    next = 0;
+    busy = 0;
+    generation = 0;
+    stopping = false;
+
+    if (threads == 0) threads = std::thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+    if (threads > FRAME_WORKERS_MAX) threads = FRAME_WORKERS_MAX;
+    for (unsigned k = 1; k < threads; k++) pool.push_back(std::thread(&FrameWorkers::work, this));
+}
+
+FrameWorkers::~FrameWorkers()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (size_t k = 0; k < pool.size(); k++) pool[k].join();
+}
+
+unsigned FrameWorkers::bandRows(size_t rowBytes, unsigned align)
+{
+    size_t rows = rowBytes ? FRAME_BAND_BYTES / rowBytes : 0;
+    rows -= rows % align;
+    return rows < align ? align : (unsigned)rows;
+}
+
+void FrameWorkers::runBands()
+{
+    for (unsigned band = next.fetch_add(1); band < bands; band = next.fetch_add(1)) (*job)(band);
+}
+
+void FrameWorkers::run(unsigned _bands, const std::function<void(unsigned)>& _job)
+{
+    if (pool.empty() || _bands < 2) {
+        for (unsigned band = 0; band < _bands; band++) _job(band);
+        return;
+    }
+
+    std::lock_guard<std::mutex> serial(runLock);
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        job = &_job;
+        bands = _bands;
+        next = 0;
+        busy = (unsigned)pool.size();
+        generation++;
+    }
+    wake.notify_all();
+    runBands();
+
+    // every pool thread has to check in, the job it points at is gone once this returns
+    std::unique_lock<std::mutex> guard(lock);
+    done.wait(guard, [this] { return busy == 0; });
+    job = NULL;
+}
+
+void FrameWorkers::work()
+{
+    // not generation: a run may have started before this thread got here
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> guard(lock);
+    while (true) {
+        wake.wait(guard, [this, seen] { return stopping || generation != seen; });
+        if (stopping) return;
+        seen = generation;
+        guard.unlock();
+        runBands();
+        guard.lock();
+        if (--busy == 0) done.notify_one();
+    }
+}
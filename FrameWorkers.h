@@ -0,0 +1,67 @@
+//
+//  FrameWorkers.h
+//
+//  Persistent thread pool for splitting per-frame pixel work into row bands,
+//  e.g. converting or scaling a 4K or wide panoramic frame on several cores.
+//  The threads are started once and sleep between frames, so a frame costs a
+//  wake-up rather than a thread creation. Bands are handed out from a shared
+//  counter, a band to whichever thread is free next, and the thread that
+//  calls run works through bands as well instead of just waiting.
+//
+
+#ifndef FRAMEWORKERS_H
+#define FRAMEWORKERS_H
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// beyond this, memory bandwidth rather than cores limits pixel work
+#define FRAME_WORKERS_MAX 8
+
+// rows per band are picked so that a band's input and output fit in this, about
+// what a core's L2 holds
+#define FRAME_BAND_BYTES (256 * 1024)
+
+class FrameWorkers {
+public:
+    // threads counts the one calling run; 0 is one per core, at most FRAME_WORKERS_MAX
+    explicit FrameWorkers(unsigned threads = 0);
+    ~FrameWorkers();
+
+    unsigned threads() const { return (unsigned)pool.size() + 1; }
+
+    // Call job(band) once for every band in [0, bands), spread over the workers and the
+    // calling thread, and return once all are done. Calls from several threads take turns.
+    void run(unsigned bands, const std::function<void(unsigned band)>& job);
+
+    // rows per band for rows of rowBytes bytes (input and output together), a multiple of
+    // align and at least that
+    static unsigned bandRows(size_t rowBytes, unsigned align);
+
+private:
+    void work();
+    void runBands();
+
+    std::vector<std::thread> pool;
+    std::mutex runLock; // one run at a time
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(unsigned)> * job;
+    unsigned bands;
+    std::atomic<unsigned> next;
+    unsigned busy; // pool threads not yet finished with the current run
+    uint64_t generation;
+    bool stopping;
+
+    //disable copy constructor and assignment operator
+    FrameWorkers(const FrameWorkers&);
+    void operator=(const FrameWorkers&);
+};
+
+#endif
@@ -2,13 +2,16 @@
 #define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
 #include <numpy/ndarraytypes.h>
 
+#include <algorithm>
 #include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <memory>
 #include <string>
 #include <map>
 
 #include "CameraDevice.h"
+#include "FrameView.h"
 
 class JabraDriver {
    public:
@@ -38,6 +41,10 @@ class JabraDriver {
       }
 
       bool containsDeviceName(std::string deviceName){
+         if (SyntheticCapture::isSyntheticDevice(deviceName)) return true;
+#ifndef _WIN32
+         if (ReplayCapture::isReplayDevice(deviceName)) return true;
+#endif
          return (std::find(devices.begin(), devices.end(), deviceName) != devices.end());
       }
 
@@ -75,7 +82,8 @@ class JabraDriver {
          return false;
       }
 
-      bool setStreamParams(std::string deviceName, unsigned int width, unsigned int height, std::string format, unsigned int fps) {
+      bool setStreamParams(std::string deviceName, unsigned int width, unsigned int height, std::string format, unsigned int fps, std::string output,
+                           unsigned int outputWidth = 0, unsigned int outputHeight = 0, unsigned int decodeThreads = 0) {
          if (!containsDeviceName(deviceName)) return false;
          std::shared_ptr<CameraStreamInterface> csi;
          if (streamMap.find(deviceName) == streamMap.end()) {
@@ -86,11 +94,13 @@ class JabraDriver {
             csi = streamMap.at(deviceName);
             csi->updateParams(width, height, format, fps);
          }
+         csi->setOutputFormat(output);
+         csi->setOutputSize(outputWidth, outputHeight);
+         csi->setDecodeThreads(decodeThreads);
          return true;
       }
 
-      bool getFrame(std::string deviceName, unsigned char *& ptrFrame, unsigned& length) {
-         if (!containsDeviceName(deviceName)) return false;
+      std::shared_ptr<CameraStreamInterface> getStream(std::string deviceName) {
          std::shared_ptr<CameraStreamInterface> csi;
          if (streamMap.find(deviceName) == streamMap.end()) {
             // not found
@@ -99,6 +109,12 @@ class JabraDriver {
          } else {
             csi = streamMap.at(deviceName);
          }
+         return csi;
+      }
+
+      bool getFrame(std::string deviceName, unsigned char *& ptrFrame, unsigned& length) {
+         if (!containsDeviceName(deviceName)) return false;
+         std::shared_ptr<CameraStreamInterface> csi = getStream(deviceName);
 
          if (csi->openStream()) {
             return csi->getFrame(ptrFrame, length);
@@ -107,6 +123,57 @@ class JabraDriver {
          return false;
       }
 
+      // zero copy: the returned reference pins the capture buffer until it is dropped
+      bool getFrame(std::string deviceName, FrameRef& frame, std::shared_ptr<CameraStreamInterface>& stream) {
+         if (!containsDeviceName(deviceName)) return false;
+         stream = getStream(deviceName);
+
+         if (stream->openStream()) {
+            return stream->getFrame(frame);
+         }
+
+         return false;
+      }
+
+      // see CameraStreamInterface::setMotionGate, before or after the stream is opened
+      bool setMotionGate(std::string deviceName, const MotionGateSettings& settings) {
+         if (!containsDeviceName(deviceName)) return false;
+         return getStream(deviceName)->setMotionGate(settings);
+      }
+
+      // the next frame as an inference tensor, see CameraStreamInterface::getTensor
+      bool getTensor(std::string deviceName, const TensorLayout& layout, void * dst) {
+         if (!containsDeviceName(deviceName)) return false;
+         std::shared_ptr<CameraStreamInterface> csi = getStream(deviceName);
+
+         if (csi->openStream()) {
+            return csi->getTensor(layout, dst);
+         }
+
+         return false;
+      }
+
+      // pollable fd that turns readable when getFrame has a new frame, -1 if there is none
+      int getFrameFd(std::string deviceName) {
+         if (!containsDeviceName(deviceName)) return -1;
+         std::shared_ptr<CameraStreamInterface> csi = getStream(deviceName);
+
+         if (csi->openStream()) {
+            return csi->frameReadyFd();
+         }
+
+         return -1;
+      }
+
+      // counters of a stream that is already open, false otherwise
+      bool getStats(std::string deviceName, StreamStats& stats, LatencySummary& latency) {
+         if (streamMap.find(deviceName) == streamMap.end()) return false;
+         std::shared_ptr<CameraStreamInterface> csi = streamMap.at(deviceName);
+         if (!csi->getStats(stats)) return false;
+         if (!csi->getLatency(FRAME_STAGE_ACQUIRE, latency)) memset(&latency, 0, sizeof(latency));
+         return true;
+      }
+
       void freeFrame(std::string deviceName) {
          if (!containsDeviceName(deviceName)) return;
          std::shared_ptr<CameraStreamInterface> csi;
@@ -132,6 +199,233 @@ typedef struct {
       JabraDriver * ptrObj;
 } PyJabraCamera;
 
+// jabracamera.Frame: read-only buffer over a captured frame, usable with
+// memoryview() and np.frombuffer() without copying the pixels
+struct FrameHolder {
+   std::shared_ptr<CameraStreamInterface> stream; // keeps the capture backend alive
+   FrameRef frame;
+   unsigned length;
+};
+
+typedef struct {
+   PyObject_HEAD
+      FrameHolder * holder;
+      int exports;
+} PyJabraFrame;
+
+static void PyJabraFrame_dealloc(PyJabraFrame * self)
+{
+   delete self->holder;
+   Py_TYPE(self)->tp_free(self);
+}
+
+static int PyJabraFrame_getbuffer(PyJabraFrame * self, Py_buffer * view, int flags)
+{
+   if (self->holder == NULL) {
+      PyErr_SetString(PyExc_BufferError, "Frame has been released");
+      view->obj = NULL;
+      return -1;
+   }
+   RawFrame * raw = self->holder->frame.get();
+   if (PyBuffer_FillInfo(view, (PyObject *)self, raw->buf, self->holder->length, 1, flags) < 0) return -1;
+   self->exports++;
+   return 0;
+}
+
+static void PyJabraFrame_releasebuffer(PyJabraFrame * self, Py_buffer * view)
+{
+   self->exports--;
+}
+
+static PyObject * PyJabraFrame_getattr(PyJabraFrame * self, void * closure)
+{
+   if (self->holder == NULL) Py_RETURN_NONE;
+   RawFrame * raw = self->holder->frame.get();
+   const char * name = (const char *)closure;
+
+   if (!strcmp(name, "width")) return PyLong_FromUnsignedLong(raw->width);
+   if (!strcmp(name, "height")) return PyLong_FromUnsignedLong(raw->height);
+   if (!strcmp(name, "format")) return PyLong_FromLong(raw->format);
+   if (!strcmp(name, "sequence")) return PyLong_FromUnsignedLongLong(raw->sequence);
+   if (!strcmp(name, "jpeg") && raw->jpeg.valid) {
+      const JpegHeader& h = raw->jpeg;
+      PyObject * sampling = PyTuple_New(h.components);
+      if (sampling == NULL) return NULL;
+      for (unsigned c = 0; c < h.components; c++) {
+         PyTuple_SET_ITEM(sampling, c, Py_BuildValue("(ii)", h.sampling[c] >> 4, h.sampling[c] & 15));
+      }
+      return Py_BuildValue("{s:I,s:I,s:I,s:N,s:I,s:I,s:I}",
+            "width", (unsigned)h.width,
+            "height", (unsigned)h.height,
+            "frameType", (unsigned)h.frameType,
+            "sampling", sampling,
+            "restartInterval", (unsigned)h.restartInterval,
+            "scanOffset", (unsigned)h.scanOffset,
+            "size", (unsigned)h.size);
+   }
+   if (!strcmp(name, "motion") && raw->motion.measured) {
+      const FrameMotion& m = raw->motion;
+      PyObject * tiles = PyBytes_FromStringAndSize((const char *)m.tiles, (Py_ssize_t)m.tilesX * m.tilesY);
+      if (tiles == NULL) return NULL;
+      return Py_BuildValue("{s:O,s:I,s:I,s:I,s:N}",
+            "moving", m.moving ? Py_True : Py_False,
+            "level", (unsigned)m.level,
+            "tilesX", (unsigned)m.tilesX,
+            "tilesY", (unsigned)m.tilesY,
+            "tiles", tiles);
+   }
+   Py_RETURN_NONE;
+}
+
+static PyObject * PyJabraFrame_release(PyJabraFrame * self, PyObject * args)
+{
+   if (self->exports > 0) {
+      PyErr_SetString(PyExc_BufferError, "Frame is still referenced by a memoryview or array");
+      return NULL;
+   }
+   delete self->holder;
+   self->holder = NULL;
+   Py_RETURN_NONE;
+}
+
+// jabracamera.Plane: read-only strided buffer over one plane of a rectangle of a
+// Frame, so np.asarray(plane) is a view of the capture buffer and cropping copies
+// nothing. Holds the Frame, which cannot be released while planes are around.
+typedef struct {
+   PyObject_HEAD
+      PyJabraFrame * owner;
+      const uint8_t * data;
+      int ndim;
+      Py_ssize_t shape[3];
+      Py_ssize_t strides[3];
+} PyJabraPlane;
+
+static PyTypeObject PyJabraPlaneType = { PyVarObject_HEAD_INIT(NULL, 0)
+   "jabracamera.Plane"   /* tp_name */
+};
+
+static void PyJabraPlane_dealloc(PyJabraPlane * self)
+{
+   self->owner->exports--;
+   Py_DECREF(self->owner);
+   Py_TYPE(self)->tp_free(self);
+}
+
+static int PyJabraPlane_getbuffer(PyJabraPlane * self, Py_buffer * view, int flags)
+{
+   view->obj = NULL;
+   if ((flags & PyBUF_WRITABLE) == PyBUF_WRITABLE) {
+      PyErr_SetString(PyExc_BufferError, "Plane is read-only");
+      return -1;
+   }
+   Py_ssize_t len = 1;
+   for (int d = 0; d < self->ndim; d++) len *= self->shape[d];
+   bool contiguous = self->strides[0] == len / self->shape[0];
+   if ((flags & PyBUF_STRIDES) != PyBUF_STRIDES && !contiguous) {
+      PyErr_SetString(PyExc_BufferError, "Plane rows are strided, ask for strides as numpy does");
+      return -1;
+   }
+   view->buf = (void *)self->data;
+   view->obj = (PyObject *)self;
+   Py_INCREF(self);
+   view->len = len;
+   view->readonly = 1;
+   view->itemsize = 1;
+   view->format = (flags & PyBUF_FORMAT) ? (char *)"B" : NULL;
+   view->ndim = (flags & PyBUF_ND) ? self->ndim : 1;
+   view->shape = (flags & PyBUF_ND) ? self->shape : NULL;
+   view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? self->strides : NULL;
+   view->suboffsets = NULL;
+   view->internal = NULL;
+   return 0;
+}
+
+static PyBufferProcs PyJabraPlane_as_buffer = {
+   (getbufferproc)PyJabraPlane_getbuffer,
+   NULL
+};
+
+static PyObject * PyJabraFrame_crop(PyJabraFrame * self, PyObject * args, PyObject * keywds)
+{
+   unsigned int x = 0, y = 0, width = 0, height = 0;
+   const char *kwlist [] = {
+      "x",
+      "y",
+      "width",
+      "height",
+      NULL
+   };
+
+   if (!PyArg_ParseTupleAndKeywords(args, keywds, "|IIII", const_cast<char **>(kwlist), &x, &y, &width, &height)) {
+      return NULL;
+   }
+   if (self->holder == NULL) {
+      PyErr_SetString(PyExc_BufferError, "Frame has been released");
+      return NULL;
+   }
+
+   // width and height 0 run to the edge of the frame
+   FrameView whole, view;
+   RawFrame * raw = self->holder->frame.get();
+   if (width == 0 && x < raw->width) width = raw->width - x;
+   if (height == 0 && y < raw->height) height = raw->height - y;
+   if (!whole.view(self->holder->frame) || !whole.crop(x, y, width, height, view)) {
+      PyErr_Format(PyExc_ValueError, "cannot crop %ux%u at %u,%u out of a %ux%u frame of format %d", width, height, x, y,
+                   raw->width, raw->height, raw->format);
+      return NULL;
+   }
+
+   PyObject * planes = PyTuple_New(view.planes);
+   if (planes == NULL) return NULL;
+   for (unsigned p = 0; p < view.planes; p++) {
+      const PlaneView& plane = view.plane[p];
+      PyJabraPlane * result = PyObject_New(PyJabraPlane, &PyJabraPlaneType);
+      if (result == NULL) {
+         Py_DECREF(planes);
+         return NULL;
+      }
+      Py_INCREF(self);
+      self->exports++;
+      result->owner = self;
+      result->data = plane.data;
+      // rows x samples, x bytes per sample when there are several
+      result->ndim = plane.sampleBytes > 1 ? 3 : 2;
+      result->shape[0] = plane.height;
+      result->shape[1] = plane.width;
+      result->shape[2] = plane.sampleBytes;
+      result->strides[0] = plane.stride;
+      result->strides[1] = plane.sampleBytes;
+      result->strides[2] = 1;
+      PyTuple_SET_ITEM(planes, p, (PyObject *)result);
+   }
+   return planes;
+}
+
+static PyBufferProcs PyJabraFrame_as_buffer = {
+   (getbufferproc)PyJabraFrame_getbuffer,
+   (releasebufferproc)PyJabraFrame_releasebuffer
+};
+
+static PyGetSetDef PyJabraFrame_getset[] = {
+   { "width", (getter)PyJabraFrame_getattr, NULL, "frame width", (void *)"width" },
+   { "height", (getter)PyJabraFrame_getattr, NULL, "frame height", (void *)"height" },
+   { "format", (getter)PyJabraFrame_getattr, NULL, "RawFrameFormat value", (void *)"format" },
+   { "sequence", (getter)PyJabraFrame_getattr, NULL, "capture sequence number", (void *)"sequence" },
+   { "jpeg", (getter)PyJabraFrame_getattr, NULL, "MJPEG header checked at capture: width, height, frameType, sampling (h, v) per component, restartInterval, scanOffset, size; None for other formats", (void *)"jpeg" },
+   { "motion", (getter)PyJabraFrame_getattr, NULL, "What the stream's motion gate measured: moving, level (mean absolute luma difference of the most changed tile, 0..255), tilesX, tilesY and tiles, tilesY rows of tilesX levels as bytes; None without a gate", (void *)"motion" },
+   {NULL}  /* Sentinel */
+};
+
+static PyMethodDef PyJabraFrame_methods[] = {
+   { "release", (PyCFunction)PyJabraFrame_release, METH_NOARGS, "Hand the capture buffer back to the camera" },
+   { "crop", (PyCFunction)PyJabraFrame_crop, METH_VARARGS | METH_KEYWORDS, "crop(x, y, width, height): tuple of Planes over that rectangle of the frame, grown to whole chroma samples, without copying; np.asarray(plane) is a strided view of each" },
+   {NULL}  /* Sentinel */
+};
+
+static PyTypeObject PyJabraFrameType = { PyVarObject_HEAD_INIT(NULL, 0)
+   "jabracamera.Frame"   /* tp_name */
+};
+
 static PyModuleDef jabracameramodule = {
    PyModuleDef_HEAD_INIT,
    "jabracamera",
@@ -221,22 +515,33 @@ static PyObject * PyJabraCamera_setStreamParams(PyJabraCamera *self, PyObject *a
    const char * format = "YUYV";
    const char * deviceName = "";
    int fps = 30;
+   const char * output = "";
+   int outputWidth = 0;
+   int outputHeight = 0;
+   int decodeThreads = 0;
    const char *kwlist [] = {
       "deviceName",
       "width",
       "height",
       "format",
       "fps",
+      "output",
+      "outputWidth",
+      "outputHeight",
+      "decodeThreads",
       NULL
    };
 
 
-   if (!PyArg_ParseTupleAndKeywords(args, keywds, "sii|si", const_cast<char **>(kwlist), &deviceName, &width, &height, &format, &fps))
+   if (!PyArg_ParseTupleAndKeywords(args, keywds, "sii|sisiii", const_cast<char **>(kwlist), &deviceName, &width, &height, &format, &fps, &output,
+                                    &outputWidth, &outputHeight, &decodeThreads))
    {
       Py_RETURN_FALSE;
    }
+   if (outputWidth < 0 || outputHeight < 0 || decodeThreads < 0) Py_RETURN_FALSE;
 
-   bool ret = (self->ptrObj)->setStreamParams(deviceName, width, height, format, fps);
+   bool ret = (self->ptrObj)->setStreamParams(deviceName, width, height, format, fps, output, outputWidth, outputHeight,
+                                              decodeThreads);
 
    if (ret) {
       Py_RETURN_TRUE;
@@ -267,11 +572,302 @@ static PyObject *PyJabraCamera_getFrame(PyJabraCamera *self, PyObject *args)
    Py_RETURN_NONE;
 }
 
+static PyObject *PyJabraCamera_getFrameView(PyJabraCamera *self, PyObject *args)
+{
+   const char * deviceName;
+
+   if (!PyArg_ParseTuple(args, "s", &deviceName)) {
+      return NULL;
+   }
+
+   std::unique_ptr<FrameHolder> holder(new FrameHolder);
+   bool ret = (self->ptrObj)->getFrame(deviceName, holder->frame, holder->stream);
+
+   if (ret) {
+      holder->length = holder->stream->frameLength(holder->frame.get());
+      PyJabraFrame * result = PyObject_New(PyJabraFrame, &PyJabraFrameType);
+      if (result == NULL) return NULL;
+      result->holder = holder.release();
+      result->exports = 0;
+      return (PyObject *)result;
+   }
+
+   Py_RETURN_NONE;
+}
+
+static PyObject *PyJabraCamera_getFrameInto(PyJabraCamera *self, PyObject *args)
+{
+   const char * deviceName;
+   Py_buffer out;
+
+   // the caller's buffer is reused frame after frame, nothing is allocated per frame
+   if (!PyArg_ParseTuple(args, "sw*", &deviceName, &out)) {
+      return NULL;
+   }
+
+   FrameRef frame;
+   std::shared_ptr<CameraStreamInterface> stream;
+   bool ret = (self->ptrObj)->getFrame(deviceName, frame, stream);
+
+   if (!ret) {
+      PyBuffer_Release(&out);
+      Py_RETURN_NONE;
+   }
+
+   unsigned length = stream->frameLength(frame.get());
+   if ((Py_ssize_t)length > out.len) {
+      PyBuffer_Release(&out);
+      PyErr_Format(PyExc_ValueError, "frame is %u bytes, buffer holds %zd", length, out.len);
+      return NULL;
+   }
+   memcpy(out.buf, frame->buf, length);
+   PyBuffer_Release(&out);
+   return PyLong_FromUnsignedLong(length);
+}
+
+// jabracamera.Tensor: a channels x height x width float32 or int8 array of its own,
+// np.asarray(tensor) takes it over without a copy
+typedef struct {
+   PyObject_HEAD
+      void * data;
+      Py_ssize_t len;
+      TensorType type;
+      Py_ssize_t shape[3];
+      Py_ssize_t strides[3];
+} PyJabraTensor;
+
+static PyTypeObject PyJabraTensorType = { PyVarObject_HEAD_INIT(NULL, 0)
+   "jabracamera.Tensor"   /* tp_name */
+};
+
+static void PyJabraTensor_dealloc(PyJabraTensor * self)
+{
+   PyMem_Free(self->data);
+   Py_TYPE(self)->tp_free(self);
+}
+
+static int PyJabraTensor_getbuffer(PyJabraTensor * self, Py_buffer * view, int flags)
+{
+   view->buf = self->data;
+   view->obj = (PyObject *)self;
+   Py_INCREF(self);
+   view->len = self->len;
+   view->readonly = 0;
+   view->itemsize = self->type == TENSOR_FLOAT32 ? sizeof(float) : 1;
+   view->format = (flags & PyBUF_FORMAT) ? (char *)(self->type == TENSOR_FLOAT32 ? "f" : "b") : NULL;
+   view->ndim = (flags & PyBUF_ND) ? 3 : 1;
+   view->shape = (flags & PyBUF_ND) ? self->shape : NULL;
+   view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? self->strides : NULL;
+   view->suboffsets = NULL;
+   view->internal = NULL;
+   return 0;
+}
+
+static PyBufferProcs PyJabraTensor_as_buffer = {
+   (getbufferproc)PyJabraTensor_getbuffer,
+   NULL
+};
+
+// a number for all three channels, or a sequence of three
+static bool parseChannels(PyObject * value, const char * name, float * channels)
+{
+   if (value == NULL) return true;
+   if (PyNumber_Check(value)) {
+      double v = PyFloat_AsDouble(value);
+      if (PyErr_Occurred()) return false;
+      for (unsigned c = 0; c < TENSOR_CHANNELS; c++) channels[c] = (float)v;
+      return true;
+   }
+   PyObject * seq = PySequence_Fast(value, name);
+   if (seq == NULL) return false;
+   bool ok = PySequence_Fast_GET_SIZE(seq) == TENSOR_CHANNELS;
+   for (unsigned c = 0; ok && c < TENSOR_CHANNELS; c++) {
+      channels[c] = (float)PyFloat_AsDouble(PySequence_Fast_GET_ITEM(seq, c));
+      ok = !PyErr_Occurred();
+   }
+   Py_DECREF(seq);
+   if (!ok && !PyErr_Occurred()) PyErr_Format(PyExc_ValueError, "%s takes a number or 3 of them", name);
+   return ok;
+}
+
+static PyObject *PyJabraCamera_getTensor(PyJabraCamera *self, PyObject *args, PyObject *keywds)
+{
+   const char * deviceName;
+   unsigned int width, height;
+   const char * dtype = "float32";
+   const char * order = "RGB";
+   PyObject * mean = NULL;
+   PyObject * stddev = NULL;
+   float scale = 1;
+   PyObject * out = NULL;
+   const char *kwlist [] = {
+      "deviceName",
+      "width",
+      "height",
+      "dtype",
+      "mean",
+      "std",
+      "order",
+      "scale",
+      "out",
+      NULL
+   };
+
+   if (!PyArg_ParseTupleAndKeywords(args, keywds, "sII|sOOsfO", const_cast<char **>(kwlist), &deviceName, &width, &height,
+                                    &dtype, &mean, &stddev, &order, &scale, &out)) {
+      return NULL;
+   }
+
+   TensorLayout layout(width, height);
+   if (!strcmp(dtype, "int8")) layout.type = TENSOR_INT8;
+   else if (strcmp(dtype, "float32")) {
+      PyErr_Format(PyExc_ValueError, "dtype is \"float32\" or \"int8\", not \"%s\"", dtype);
+      return NULL;
+   }
+   if (strcmp(order, "RGB") && strcmp(order, "BGR")) {
+      PyErr_Format(PyExc_ValueError, "order is \"RGB\" or \"BGR\", not \"%s\"", order);
+      return NULL;
+   }
+   layout.bgr = !strcmp(order, "BGR");
+   layout.scale = scale;
+   if (!parseChannels(mean, "mean", layout.mean) || !parseChannels(stddev, "std", layout.stddev)) return NULL;
+
+   // into the caller's array, reused frame after frame, or a Tensor of its own
+   if (out != NULL && out != Py_None) {
+      Py_buffer view;
+      if (PyObject_GetBuffer(out, &view, PyBUF_WRITABLE | PyBUF_C_CONTIGUOUS) < 0) return NULL;
+      if ((size_t)view.len != layout.bytes()) {
+         PyErr_Format(PyExc_ValueError, "tensor is %zu bytes, buffer holds %zd", layout.bytes(), view.len);
+         PyBuffer_Release(&view);
+         return NULL;
+      }
+      bool ret = (self->ptrObj)->getTensor(deviceName, layout, view.buf);
+      PyBuffer_Release(&view);
+      if (!ret) Py_RETURN_NONE;
+      Py_INCREF(out);
+      return out;
+   }
+
+   PyJabraTensor * result = PyObject_New(PyJabraTensor, &PyJabraTensorType);
+   if (result == NULL) return NULL;
+   result->len = (Py_ssize_t)layout.bytes();
+   result->data = PyMem_Malloc(result->len);
+   result->type = layout.type;
+   if (result->data == NULL) {
+      Py_DECREF(result);
+      return PyErr_NoMemory();
+   }
+   Py_ssize_t itemsize = layout.type == TENSOR_FLOAT32 ? sizeof(float) : 1;
+   result->shape[0] = TENSOR_CHANNELS;
+   result->shape[1] = height;
+   result->shape[2] = width;
+   result->strides[2] = itemsize;
+   result->strides[1] = itemsize * width;
+   result->strides[0] = itemsize * width * height;
+   if (!(self->ptrObj)->getTensor(deviceName, layout, result->data)) {
+      Py_DECREF(result);
+      Py_RETURN_NONE;
+   }
+   return (PyObject *)result;
+}
+
+static PyObject *PyJabraCamera_getStats(PyJabraCamera *self, PyObject *args)
+{
+   const char * deviceName;
 
+   if (!PyArg_ParseTuple(args, "s", &deviceName)) {
+      return NULL;
+   }
+
+   StreamStats stats;
+   LatencySummary latency;
+   if (!(self->ptrObj)->getStats(deviceName, stats, latency)) {
+      Py_RETURN_NONE;
+   }
+
+   return Py_BuildValue("{s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:d,s:d,s:d,s:I,s:K,s:d,s:d,s:d}",
+         "delivered", (unsigned long long)stats.delivered,
+         "dropped", (unsigned long long)stats.dropped,
+         "corrupt", (unsigned long long)stats.corrupt,
+         "late", (unsigned long long)stats.late,
+         "decimated", (unsigned long long)stats.decimated,
+         "still", (unsigned long long)stats.still,
+         "consumed", (unsigned long long)stats.consumed,
+         "fps", stats.fps,
+         "averageFps", stats.averageFps,
+         "jitterMsec", stats.jitterMsec,
+         "queueDepth", stats.queueDepth,
+         "consumerLag", (unsigned long long)stats.consumerLag,
+         // capture to consumer
+         "latencyP50Msec", latency.p50Nsec / 1e6,
+         "latencyP99Msec", latency.p99Nsec / 1e6,
+         "latencyP999Msec", latency.p999Nsec / 1e6);
+}
+
+static PyObject *PyJabraCamera_setMotionGate(PyJabraCamera *self, PyObject *args, PyObject *keywds)
+{
+   const char * deviceName;
+   MotionGateSettings settings;
+   int suppress = 1;
+   int enabled = 1;
+   int tilesX = settings.tilesX;
+   int tilesY = settings.tilesY;
+   int rowStep = settings.rowStep;
+   int keepAlive = 0;
+   const char *kwlist [] = {
+      "deviceName",
+      "threshold",
+      "suppress",
+      "tilesX",
+      "tilesY",
+      "rowStep",
+      "keepAlive",
+      "enabled",
+      NULL
+   };
+
+   if (!PyArg_ParseTupleAndKeywords(args, keywds, "s|dpiiiip", const_cast<char **>(kwlist), &deviceName, &settings.threshold,
+                                    &suppress, &tilesX, &tilesY, &rowStep, &keepAlive, &enabled))
+   {
+      return NULL;
+   }
+   if (tilesX < 0 || tilesY < 0 || rowStep < 0 || keepAlive < 0) Py_RETURN_FALSE;
+   settings.enabled = enabled != 0;
+   settings.suppress = suppress != 0;
+   settings.tilesX = tilesX;
+   settings.tilesY = tilesY;
+   settings.rowStep = rowStep;
+   settings.keepAlive = keepAlive;
+
+   if ((self->ptrObj)->setMotionGate(deviceName, settings)) {
+      Py_RETURN_TRUE;
+   }
+   Py_RETURN_FALSE;
+}
+
+static PyObject *PyJabraCamera_getFrameFd(PyJabraCamera *self, PyObject *args)
+{
+   const char * deviceName;
+
+   if (!PyArg_ParseTuple(args, "s", &deviceName)) {
+      return NULL;
+   }
+
+   int fd = (self->ptrObj)->getFrameFd(deviceName);
+   if (fd >= 0) return PyLong_FromLong(fd);
+
+   Py_RETURN_NONE;
+}
 
 static PyMethodDef PyJabraCamera_methods[] = {
-   { "setStreamParams", (PyCFunction)PyJabraCamera_setStreamParams, METH_VARARGS | METH_KEYWORDS, "setStreamParams(width, height, format, fps)"},
+   { "setStreamParams", (PyCFunction)PyJabraCamera_setStreamParams, METH_VARARGS | METH_KEYWORDS, "setStreamParams(width, height, format, fps, output, outputWidth, outputHeight, decodeThreads): output \"BGR\", \"RGB\", \"BGRA\", \"YUYV\", \"UYVY\", \"NV12\", \"YV12\" or \"I420\" converts frames before they are handed out, from another format if the camera lacks this one; outputWidth and outputHeight scale them down first, e.g. to 640x360; decodeThreads decodes an \"MJPG\" stream natively on that many threads instead"},
    { "getFrame", (PyCFunction)PyJabraCamera_getFrame, METH_VARARGS, "Get a Frame"},
+   { "getFrameView", (PyCFunction)PyJabraCamera_getFrameView, METH_VARARGS, "Get a Frame without copying it"},
+   { "getFrameInto", (PyCFunction)PyJabraCamera_getFrameInto, METH_VARARGS, "getFrameInto(deviceName, buffer): copy a frame into a writable buffer, returns its length"},
+   { "getTensor", (PyCFunction)PyJabraCamera_getTensor, METH_VARARGS | METH_KEYWORDS, "getTensor(deviceName, width, height, dtype, mean, std, order, scale, out): the next frame scaled to width x height as a 3 x height x width \"float32\" or \"int8\" Tensor, (pixel - mean) / std per channel in \"RGB\" or \"BGR\" order, int8 quantized in steps of scale; np.asarray(tensor) is a view of it. With out, a writable array of that size, writes into it instead and returns it. None if there is no frame"},
+   { "getStats", (PyCFunction)PyJabraCamera_getStats, METH_VARARGS, "Frame counters, rate, jitter and latency of an open stream, as a dict"},
+   { "setMotionGate", (PyCFunction)PyJabraCamera_setMotionGate, METH_VARARGS | METH_KEYWORDS, "setMotionGate(deviceName, threshold, suppress, tilesX, tilesY, rowStep, keepAlive, enabled): compare every rowStep-th luma row with the frame before, per tile of a tilesX x tilesY grid; frames whose most changed tile stays below threshold (mean absolute difference, 0..255) are dropped before conversion, or with suppress False only marked in Frame.motion; keepAlive lets every keepAlive-th still frame through anyway. enabled False removes the gate"},
+   { "getFrameFd", (PyCFunction)PyJabraCamera_getFrameFd, METH_VARARGS, "File descriptor that is readable when a frame is ready, for select/epoll"},
    { "getProperty", (PyCFunction)PyJabraCamera_getProperty,    METH_VARARGS,  "Get property" },
    { "setProperty", (PyCFunction)PyJabraCamera_setProperty,    METH_VARARGS,  "Set property" },
    { "getCameras", (PyCFunction)PyJabraCamera_getCameras,    METH_VARARGS,  "Get list of cameras" },
@@ -299,11 +895,46 @@ PyMODINIT_FUNC PyInit_jabracamera(void)
    if (PyType_Ready(&PyJabraCameraType) < 0)
       return NULL;
 
+   PyJabraFrameType.tp_basicsize=sizeof(PyJabraFrame);
+   PyJabraFrameType.tp_dealloc=(destructor) PyJabraFrame_dealloc;
+   PyJabraFrameType.tp_flags=Py_TPFLAGS_DEFAULT;
+   PyJabraFrameType.tp_doc="Captured frame, supports the buffer protocol";
+   PyJabraFrameType.tp_as_buffer=&PyJabraFrame_as_buffer;
+   PyJabraFrameType.tp_getset=PyJabraFrame_getset;
+   PyJabraFrameType.tp_methods=PyJabraFrame_methods;
+
+   if (PyType_Ready(&PyJabraFrameType) < 0)
+      return NULL;
+
+   PyJabraPlaneType.tp_basicsize=sizeof(PyJabraPlane);
+   PyJabraPlaneType.tp_dealloc=(destructor) PyJabraPlane_dealloc;
+   PyJabraPlaneType.tp_flags=Py_TPFLAGS_DEFAULT;
+   PyJabraPlaneType.tp_doc="Plane of a cropped frame, supports the buffer protocol with strides";
+   PyJabraPlaneType.tp_as_buffer=&PyJabraPlane_as_buffer;
+
+   if (PyType_Ready(&PyJabraPlaneType) < 0)
+      return NULL;
+
+   PyJabraTensorType.tp_basicsize=sizeof(PyJabraTensor);
+   PyJabraTensorType.tp_dealloc=(destructor) PyJabraTensor_dealloc;
+   PyJabraTensorType.tp_flags=Py_TPFLAGS_DEFAULT;
+   PyJabraTensorType.tp_doc="Inference tensor of a frame, supports the buffer protocol";
+   PyJabraTensorType.tp_as_buffer=&PyJabraTensor_as_buffer;
+
+   if (PyType_Ready(&PyJabraTensorType) < 0)
+      return NULL;
+
    m = PyModule_Create(&jabracameramodule);
    if (m == NULL)
       return NULL;
 
    Py_INCREF(&PyJabraCameraType);
    PyModule_AddObject(m, "JabraCamera", (PyObject *)&PyJabraCameraType); // Add JabraCamera object to the module
+   Py_INCREF(&PyJabraFrameType);
+   PyModule_AddObject(m, "Frame", (PyObject *)&PyJabraFrameType);
+   Py_INCREF(&PyJabraPlaneType);
+   PyModule_AddObject(m, "Plane", (PyObject *)&PyJabraPlaneType);
+   Py_INCREF(&PyJabraTensorType);
+   PyModule_AddObject(m, "Tensor", (PyObject *)&PyJabraTensorType);
    return m;
 }
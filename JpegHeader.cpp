@@ -0,0 +1,89 @@
+#include "JpegHeader.h"
+#include <string.h>
+
+#define JPEG_SOI  0xD8
+#define JPEG_EOI  0xD9
+#define JPEG_SOS  0xDA
+#define JPEG_DRI  0xDD
+#define JPEG_TEM  0x01
+
+static unsigned readShort(const uint8_t * p)
+{
+    return (unsigned)p[0] << 8 | p[1];
+}
+
+// SOF0..SOF15 but DHT, JPG and DAC, which share the range
+static bool isFrameHeader(uint8_t marker)
+{
+    return marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+}
+
+static bool parseFrameHeader(const uint8_t * p, unsigned length, uint8_t marker, JpegHeader& header)
+{
+    // precision, height, width, component count, then id, sampling, table per component
+    if (length < 8) return false;
+    unsigned components = p[5];
+    if (components == 0 || components > 4 || length != 6 + 3 * components) return false;
+    header.frameType = marker;
+    header.height = (uint16_t)readShort(p + 1);
+    header.width = (uint16_t)readShort(p + 3);
+    header.components = (uint8_t)components;
+    // a height of 0 is left to a DNL marker after the first scan, no camera sends that
+    if (header.width == 0 || header.height == 0) return false;
+    for (unsigned c = 0; c < components; c++) {
+        uint8_t sampling = p[6 + 3 * c + 1];
+        unsigned h = sampling >> 4, v = sampling & 15;
+        if (h < 1 || h > 4 || v < 1 || v > 4) return false;
+        header.sampling[c] = sampling;
+    }
+    return true;
+}
+
+bool parseJpegHeader(const uint8_t * data, size_t size, JpegHeader& header)
+{
+    memset(&header, 0, sizeof(header));
+    if (data == NULL || size < 4 || data[0] != 0xFF || data[1] != JPEG_SOI) return false;
+
+    size_t end = size;
+    while (end > 4 && data[end - 1] == 0) end--;
+    if (data[end - 2] != 0xFF || data[end - 1] != JPEG_EOI) return false;
+    // EOI is not part of the segments
+    end -= 2;
+
+    bool haveFrame = false;
+    size_t pos = 2;
+    for (;;) {
+        if (pos >= end || data[pos] != 0xFF) return false;
+        // any number of fill bytes may come before a marker
+        while (pos < end && data[pos] == 0xFF) pos++;
+        if (pos + 3 > end) return false;
+        uint8_t marker = data[pos++];
+        // SOI, RSTn, TEM and stuffed zeros have no length and do not belong in the header
+        if (marker == 0 || marker == JPEG_TEM || (marker >= 0xD0 && marker <= JPEG_EOI)) return false;
+
+        unsigned length = readShort(data + pos);
+        if (length < 2 || pos + length > end) return false;
+        const uint8_t * p = data + pos + 2;
+        unsigned bytes = length - 2;
+
+        if (isFrameHeader(marker)) {
+            if (haveFrame || !parseFrameHeader(p, bytes, marker, header)) return false;
+            haveFrame = true;
+        } else if (marker == JPEG_DRI) {
+            if (bytes != 2) return false;
+            header.restartInterval = (uint16_t)readShort(p);
+        } else if (marker == JPEG_SOS) {
+            // component count, selector and tables per component, then the spectral selection
+            if (!haveFrame || bytes < 1) return false;
+            unsigned components = p[0];
+            if (components == 0 || components > header.components || bytes != 4 + 2 * components) return false;
+            // and at least one byte of entropy-coded data before EOI
+            if (pos + length >= end) return false;
+            header.scanOffset = (uint32_t)(pos + length);
+            header.size = (uint32_t)(end + 2);
+            header.valid = true;
+            return true;
+        }
+        pos += length;
+    }
+}
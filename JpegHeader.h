@@ -0,0 +1,26 @@
+//
+//  JpegHeader.h
+//
+//  Cheap check of an MJPEG frame before anyone decodes it. USB hiccups
+//  leave truncated or scrambled frames that otherwise only fail deep in a
+//  consumer's decoder. This walks the marker segments up to the start of
+//  the scan: SOI, the SOF frame header (size, components, sampling
+//  factors), DRI and SOS, then makes sure the frame ends in EOI. That is a
+//  few hundred bytes of every frame; the entropy-coded data is not looked
+//  at. FrameRingCapture runs it on every MJPEG frame it publishes, drops
+//  frames that fail it, and leaves the header in RawFrame::jpeg.
+//
+
+#ifndef JPEGHEADER_H
+#define JPEGHEADER_H
+
+#include "PCCameraInterface.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Fill header from the JPEG in data. false, with header.valid false, if a marker
+// segment runs past the end, SOF or SOS is missing or malformed, or EOI is not the
+// last marker; zero bytes after EOI, which some cameras pad frames with, are allowed.
+bool parseJpegHeader(const uint8_t * data, size_t size, JpegHeader& header);
+
+#endif
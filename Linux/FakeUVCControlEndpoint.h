@@ -0,0 +1,162 @@
+//
+//  FakeUVCControlEndpoint.h
+//
+//  In-process stand-in for the control side of a UVC camera, for testing
+//  LinuxCameraDevice without hardware. It answers the V4L2 control ioctls
+//  for the processing unit and UVCIOC_CTRL_QUERY for one extension unit,
+//  and counts ioctls and the USB control transfers a real camera would have
+//  seen for them.
+//
+
+#ifndef FAKEUVCCONTROLENDPOINT_H
+#define FAKEUVCCONTROLENDPOINT_H
+
+#include "V4L2Capture.h"
+#include <errno.h>
+#include <string.h>
+#include <linux/videodev2.h>
+#include <linux/usb/video.h>
+#include <linux/uvcvideo.h>
+#include <map>
+#include <vector>
+
+#define FAKE_XU_UNIT_ID 0x06
+
+class FakeUVCControlEndpoint : public V4L2Device {
+public:
+    struct Control {
+        int value, min, max, step, def;
+        bool readOnly;
+    };
+
+    FakeUVCControlEndpoint() : ioctls(0), transfers(0) {
+        addControl(V4L2_CID_BRIGHTNESS, 0, -64, 64, 1);
+        addControl(V4L2_CID_CONTRAST, 32, 0, 95, 1);
+        addControl(V4L2_CID_SATURATION, 64, 0, 100, 1);
+        addControl(V4L2_CID_SHARPNESS, 2, 0, 7, 1);
+        addControl(V4L2_CID_WHITE_BALANCE_TEMPERATURE, 4600, 2800, 6500, 10);
+
+        // selector 1: 4 byte read/write, selector 2: 2 byte read only
+        addXU(1, 4, UVC_CONTROL_CAP_GET | UVC_CONTROL_CAP_SET);
+        addXU(2, 2, UVC_CONTROL_CAP_GET);
+    }
+
+    void addControl(uint32_t id, int value, int min, int max, int step, bool readOnly = false) {
+        Control c = { value, min, max, step, value, readOnly };
+        controls[id] = c;
+    }
+    void removeControl(uint32_t id) { controls.erase(id); }
+
+    bool open(const std::string& path) { return true; }
+    void close() {}
+    void * mmap(size_t length, off_t offset) { return NULL; }
+    void munmap(void * addr, size_t length) {}
+    int waitForBuffer(int timeoutMsec) { return -1; }
+
+    int xioctl(unsigned long request, void * arg) {
+        ioctls++;
+        switch (request) {
+            case VIDIOC_QUERYCTRL: {
+                struct v4l2_queryctrl * q = (struct v4l2_queryctrl *)arg;
+                std::map<uint32_t, Control>::iterator it = controls.find(q->id);
+                if (it == controls.end()) return fail(EINVAL);
+                transfers += 5; // GET_MIN, GET_MAX, GET_RES, GET_DEF, GET_INFO
+                q->type = V4L2_CTRL_TYPE_INTEGER;
+                q->minimum = it->second.min;
+                q->maximum = it->second.max;
+                q->step = it->second.step;
+                q->default_value = it->second.def;
+                q->flags = it->second.readOnly ? V4L2_CTRL_FLAG_READ_ONLY : 0;
+                return 0;
+            }
+            case VIDIOC_G_EXT_CTRLS:
+            case VIDIOC_S_EXT_CTRLS: {
+                struct v4l2_ext_controls * ext = (struct v4l2_ext_controls *)arg;
+                for (unsigned k = 0; k < ext->count; k++) {
+                    std::map<uint32_t, Control>::iterator it = controls.find(ext->controls[k].id);
+                    if (it == controls.end()) {
+                        ext->error_idx = k;
+                        return fail(EINVAL);
+                    }
+                    transfers++;
+                    if (request == VIDIOC_G_EXT_CTRLS) {
+                        ext->controls[k].value = it->second.value;
+                    } else {
+                        if (it->second.readOnly) return fail(EACCES);
+                        it->second.value = ext->controls[k].value;
+                    }
+                }
+                return 0;
+            }
+            case UVCIOC_CTRL_QUERY:
+                return xuQuery((struct uvc_xu_control_query *)arg);
+        }
+        return fail(ENOTTY);
+    }
+
+    Control& control(uint32_t id) { return controls[id]; }
+    std::vector<unsigned char>& xuValue(uint8_t selector) { return xu[selector].cur; }
+
+    // ioctls issued, and control transfers the camera would have answered
+    unsigned ioctls;
+    unsigned transfers;
+
+private:
+    struct XU {
+        uint8_t info;
+        std::vector<unsigned char> cur, min, max, res, def;
+    };
+
+    void addXU(uint8_t selector, unsigned length, uint8_t info) {
+        XU& x = xu[selector];
+        x.info = info;
+        x.cur.assign(length, 0x11);
+        x.min.assign(length, 0x00);
+        x.max.assign(length, 0xff);
+        x.res.assign(length, 0x01);
+        x.def.assign(length, 0x11);
+    }
+
+    int xuQuery(struct uvc_xu_control_query * q) {
+        if (q->unit != FAKE_XU_UNIT_ID) return fail(ENOENT);
+        std::map<uint8_t, XU>::iterator it = xu.find(q->selector);
+        if (it == xu.end()) return fail(ENOENT);
+        XU& x = it->second;
+        transfers++;
+
+        const std::vector<unsigned char> * src = NULL;
+        switch (q->query) {
+            case UVC_GET_LEN:
+                if (q->size != 2) return fail(EINVAL);
+                q->data[0] = x.cur.size() & 0xff;
+                q->data[1] = x.cur.size() >> 8;
+                return 0;
+            case UVC_GET_INFO:
+                if (q->size != 1) return fail(EINVAL);
+                q->data[0] = x.info;
+                return 0;
+            case UVC_GET_CUR: src = &x.cur; break;
+            case UVC_GET_MIN: src = &x.min; break;
+            case UVC_GET_MAX: src = &x.max; break;
+            case UVC_GET_RES: src = &x.res; break;
+            case UVC_GET_DEF: src = &x.def; break;
+            case UVC_SET_CUR:
+                if (!(x.info & UVC_CONTROL_CAP_SET)) return fail(EIO);
+                if (q->size != x.cur.size()) return fail(EINVAL);
+                memcpy(&x.cur[0], q->data, q->size);
+                return 0;
+            default:
+                return fail(EINVAL);
+        }
+        if (q->size != src->size()) return fail(EINVAL);
+        memcpy(q->data, &(*src)[0], q->size);
+        return 0;
+    }
+
+    int fail(int err) { errno = err; return -1; }
+
+    std::map<uint32_t, Control> controls;
+    std::map<uint8_t, XU> xu;
+};
+
+#endif
@@ -0,0 +1,290 @@
+//
+//  FakeV4L2Device.h
+//
+//  In-process stand-in for a V4L2 capture node, for testing and benchmarking
+//  V4L2Capture without a camera. A generator thread "captures" into the
+//  queued buffers at the configured rate, stamping the driver sequence number
+//  into the first bytes, and drops the frame when userspace has left it no
+//  buffer, just like uvcvideo. Buffers carry CLOCK_MONOTONIC timestamps, and
+//  a list of discrete frame rates and a single pixel format can be offered
+//  for negotiation.
+//
+
+#ifndef FAKEV4L2DEVICE_H
+#define FAKEV4L2DEVICE_H
+
+#include "V4L2Capture.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/videodev2.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class FakeV4L2Device : public V4L2Device {
+public:
+    FakeV4L2Device(unsigned _fps = 30, unsigned _maxBuffers = 32)
+        : fps(_fps), maxBuffers(_maxBuffers), opened(false), streaming(false),
+          width(0), height(0), pixelFormat(0), onlyFormat(0), sequence(0), errorEvery(0),
+          generated(0), noBufferDrops(0), minQueued(~0u) {}
+    ~FakeV4L2Device() { stop(); }
+
+    bool open(const std::string& path) { opened = true; return true; }
+    void close() { stop(); opened = false; }
+
+    int xioctl(unsigned long request, void * arg) {
+        std::unique_lock<std::mutex> lock(mutex);
+        switch (request) {
+            case VIDIOC_QUERYCAP: {
+                struct v4l2_capability * cap = (struct v4l2_capability *)arg;
+                memset(cap, 0, sizeof(*cap));
+                strcpy((char *)cap->driver, "fake");
+                cap->device_caps = V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_STREAMING;
+                cap->capabilities = cap->device_caps | V4L2_CAP_DEVICE_CAPS;
+                return 0;
+            }
+            case VIDIOC_S_FMT:
+            case VIDIOC_G_FMT: {
+                struct v4l2_format * fmt = (struct v4l2_format *)arg;
+                if (request == VIDIOC_S_FMT) {
+                    width = fmt->fmt.pix.width;
+                    height = fmt->fmt.pix.height;
+                    pixelFormat = onlyFormat ? onlyFormat : fmt->fmt.pix.pixelformat;
+                }
+                fmt->fmt.pix.width = width;
+                fmt->fmt.pix.height = height;
+                fmt->fmt.pix.pixelformat = pixelFormat;
+                bool packed = pixelFormat == V4L2_PIX_FMT_YUYV || pixelFormat == V4L2_PIX_FMT_UYVY;
+                fmt->fmt.pix.bytesperline = pixelFormat == V4L2_PIX_FMT_MJPEG ? 0 : (packed ? width * 2 : width);
+                fmt->fmt.pix.sizeimage = packed || pixelFormat == V4L2_PIX_FMT_MJPEG ? width * height * 2 : width * height * 3 / 2;
+                return 0;
+            }
+            case VIDIOC_S_PARM:
+            case VIDIOC_G_PARM: {
+                struct v4l2_streamparm * parm = (struct v4l2_streamparm *)arg;
+                struct v4l2_fract& tpf = parm->parm.capture.timeperframe;
+                if (request == VIDIOC_S_PARM && tpf.numerator && tpf.denominator) {
+                    fps = nearestRate((double)tpf.denominator / tpf.numerator);
+                }
+                parm->parm.capture.capability = V4L2_CAP_TIMEPERFRAME;
+                tpf.numerator = 1;
+                tpf.denominator = fps;
+                return 0;
+            }
+            case VIDIOC_ENUM_FRAMEINTERVALS: {
+                struct v4l2_frmivalenum * ival = (struct v4l2_frmivalenum *)arg;
+                if (ival->index >= rates.size()) return fail(EINVAL);
+                ival->type = V4L2_FRMIVAL_TYPE_DISCRETE;
+                ival->discrete.numerator = 1;
+                ival->discrete.denominator = rates[ival->index];
+                return 0;
+            }
+            case VIDIOC_REQBUFS: {
+                struct v4l2_requestbuffers * req = (struct v4l2_requestbuffers *)arg;
+                if (streaming) return fail(EBUSY);
+                if (req->count > maxBuffers) req->count = maxBuffers;
+                buffers.assign(req->count, std::vector<unsigned char>());
+                for (unsigned k = 0; k < req->count; k++) buffers[k].resize(imageSize());
+                queued.clear();
+                done.clear();
+                return 0;
+            }
+            case VIDIOC_QUERYBUF: {
+                struct v4l2_buffer * buf = (struct v4l2_buffer *)arg;
+                if (buf->index >= buffers.size()) return fail(EINVAL);
+                buf->length = imageSize();
+                buf->m.offset = buf->index << 12;
+                return 0;
+            }
+            case VIDIOC_EXPBUF: {
+                struct v4l2_exportbuffer * exp = (struct v4l2_exportbuffer *)arg;
+                if (exp->index >= buffers.size()) return fail(EINVAL);
+                exp->fd = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+                return exp->fd < 0 ? -1 : 0;
+            }
+            case VIDIOC_QBUF: {
+                struct v4l2_buffer * buf = (struct v4l2_buffer *)arg;
+                if (buf->index >= buffers.size() || isQueued(buf->index)) return fail(EINVAL);
+                queued.push_back(buf->index);
+                return 0;
+            }
+            case VIDIOC_DQBUF: {
+                struct v4l2_buffer * buf = (struct v4l2_buffer *)arg;
+                if (done.empty()) return fail(EAGAIN);
+                *buf = done.front();
+                done.pop_front();
+                return 0;
+            }
+            case VIDIOC_STREAMON:
+                if (!streaming) {
+                    streaming = true;
+                    generator = std::thread(&FakeV4L2Device::generate, this);
+                }
+                return 0;
+            case VIDIOC_STREAMOFF:
+                lock.unlock();
+                stop();
+                return 0;
+        }
+        return fail(ENOTTY);
+    }
+
+    void * mmap(size_t length, off_t offset) {
+        std::lock_guard<std::mutex> lock(mutex);
+        unsigned idx = (unsigned)(offset >> 12);
+        return idx < buffers.size() ? &buffers[idx][0] : NULL;
+    }
+
+    void munmap(void * addr, size_t length) {}
+
+    int waitForBuffer(int timeoutMsec) {
+        std::unique_lock<std::mutex> lock(mutex);
+        frameDone.wait_for(lock, std::chrono::milliseconds(timeoutMsec), [this] { return !done.empty(); });
+        return done.empty() ? 0 : 1;
+    }
+
+    // discrete rates offered by VIDIOC_ENUM_FRAMEINTERVALS, S_PARM snaps to the nearest one
+    void setFrameRates(const std::vector<unsigned>& _rates) {
+        std::lock_guard<std::mutex> lock(mutex);
+        rates = _rates;
+    }
+    unsigned frameRate() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return fps;
+    }
+
+    // S_FMT settles on pixelFormat whatever is asked for, like a driver does with formats
+    // the camera does not have; 0 accepts anything
+    void supportOnly(uint32_t _pixelFormat) {
+        std::lock_guard<std::mutex> lock(mutex);
+        onlyFormat = _pixelFormat;
+    }
+
+    // flag every n-th frame with V4L2_BUF_FLAG_ERROR
+    void injectErrors(unsigned n) { errorEvery = n; }
+
+    bool ownsAddress(const void * p) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t k = 0; k < buffers.size(); k++) {
+            if (p == &buffers[k][0]) return true;
+        }
+        return false;
+    }
+
+    uint64_t framesGenerated() { return generated; }
+    // frames lost because userspace had not queued any buffer
+    uint64_t framesWithoutBuffer() { return noBufferDrops; }
+    // fewest buffers the driver held at any frame time
+    unsigned lowestQueueDepth() { return minQueued; }
+
+private:
+    int fail(int err) { errno = err; return -1; }
+
+    bool isQueued(unsigned idx) {
+        for (size_t k = 0; k < queued.size(); k++) if (queued[k] == idx) return true;
+        for (size_t k = 0; k < done.size(); k++) if (done[k].index == idx) return true;
+        return false;
+    }
+
+    unsigned nearestRate(double wanted) {
+        if (rates.empty()) return (unsigned)(wanted + 0.5);
+        unsigned best = rates[0];
+        for (size_t k = 1; k < rates.size(); k++) {
+            if (fabs(rates[k] - wanted) < fabs(best - wanted)) best = rates[k];
+        }
+        return best;
+    }
+
+    unsigned imageSize() {
+        if (pixelFormat == V4L2_PIX_FMT_YUYV || pixelFormat == V4L2_PIX_FMT_UYVY || pixelFormat == V4L2_PIX_FMT_MJPEG) {
+            return width * height * 2;
+        }
+        return width * height * 3 / 2;
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!streaming) return;
+            streaming = false;
+        }
+        if (generator.joinable()) generator.join();
+        std::lock_guard<std::mutex> lock(mutex);
+        queued.clear();
+        done.clear();
+    }
+
+    void generate() {
+        std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+        while (true) {
+            if (fps) {
+                next += std::chrono::nanoseconds(1000000000ULL / fps);
+                std::this_thread::sleep_until(next);
+            }
+
+            std::unique_lock<std::mutex> lock(mutex);
+            if (!streaming) break;
+            uint32_t seq = sequence++;
+            generated++;
+            if (queued.size() < minQueued) minQueued = (unsigned)queued.size();
+            if (queued.empty()) {
+                noBufferDrops++;
+                lock.unlock();
+                if (!fps) std::this_thread::yield();
+                continue;
+            }
+
+            unsigned idx = queued.front();
+            queued.pop_front();
+            memcpy(&buffers[idx][0], &seq, sizeof(seq));
+
+            struct v4l2_buffer buf;
+            memset(&buf, 0, sizeof(buf));
+            buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            buf.memory = V4L2_MEMORY_MMAP;
+            buf.index = idx;
+            buf.sequence = seq;
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            buf.timestamp.tv_sec = now.tv_sec;
+            buf.timestamp.tv_usec = now.tv_nsec / 1000;
+            buf.bytesused = pixelFormat == V4L2_PIX_FMT_MJPEG ? imageSize() / 4 + seq % 4096 : imageSize();
+            buf.flags = V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+            if (errorEvery && seq % errorEvery == errorEvery - 1) buf.flags |= V4L2_BUF_FLAG_ERROR;
+            done.push_back(buf);
+            lock.unlock();
+            frameDone.notify_all();
+        }
+    }
+
+    unsigned fps;
+    std::vector<unsigned> rates;
+    unsigned maxBuffers;
+    bool opened;
+    bool streaming;
+    unsigned width;
+    unsigned height;
+    uint32_t pixelFormat;
+    uint32_t onlyFormat;
+    uint32_t sequence;
+    unsigned errorEvery;
+    uint64_t generated;
+    uint64_t noBufferDrops;
+    unsigned minQueued;
+
+    std::vector<std::vector<unsigned char> > buffers;
+    std::deque<unsigned> queued;
+    std::deque<struct v4l2_buffer> done;
+    std::mutex mutex;
+    std::condition_variable frameDone;
+    std::thread generator;
+};
+
+#endif
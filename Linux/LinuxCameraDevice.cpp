@@ -0,0 +1,282 @@
+#ifdef __linux__
+#include "CameraDevice.h"
+#include <errno.h>
+#include <string.h>
+#include <dirent.h>
+#include <fstream>
+#include <stdexcept>
+#include <linux/videodev2.h>
+#include <linux/usb/video.h>
+#include <linux/uvcvideo.h>
+
+#define ALTIA_VENDOR_ID 0x2b93
+#define GN_VENDOR_ID    0x0b0e
+
+// uvcvideo maps the processing unit controls onto these
+static uint32_t convertPropertyTypeToControlId(PropertyType t) {
+    switch (t) {
+        case Brightness:
+            return V4L2_CID_BRIGHTNESS;
+        case Contrast:
+            return V4L2_CID_CONTRAST;
+        case Saturation:
+            return V4L2_CID_SATURATION;
+        case Sharpness:
+            return V4L2_CID_SHARPNESS;
+        case WhiteBalance:
+            return V4L2_CID_WHITE_BALANCE_TEMPERATURE;
+    }
+    return 0;
+}
+
+LinuxCameraDevice::LinuxCameraDevice(const std::string& prop)
+    : transport(new SystemV4L2Device), mDeviceName(prop), rangesLoaded(false)
+{
+    std::string path = V4L2Capture::findDevicePath(prop);
+    if (path.empty() || !transport->open(path)) {
+        printf("LinuxCameraDevice::LinuxCameraDevice: no capture node for %s\n", prop.c_str());
+        throw std::runtime_error("Unable to get Jabra devices");
+    }
+}
+
+LinuxCameraDevice::LinuxCameraDevice(V4L2Device * _transport, const std::string& devicePath)
+    : transport(_transport), mDeviceName(devicePath), rangesLoaded(false)
+{
+    if (!transport->open(devicePath)) {
+        printf("LinuxCameraDevice::LinuxCameraDevice: cannot open %s\n", devicePath.c_str());
+        throw std::runtime_error("Unable to get Jabra devices");
+    }
+}
+
+LinuxCameraDevice::~LinuxCameraDevice()
+{
+    transport->close();
+}
+
+bool LinuxCameraDevice::loadRanges()
+{
+    if (rangesLoaded) return true;
+
+    for (int t = Brightness; t <= WhiteBalance; t++) {
+        ControlRange& range = ranges[t];
+        memset(&range, 0, sizeof(range));
+
+        struct v4l2_queryctrl query;
+        memset(&query, 0, sizeof(query));
+        query.id = convertPropertyTypeToControlId((PropertyType)t);
+        if (transport->xioctl(VIDIOC_QUERYCTRL, &query) < 0) {
+            if (errno != EINVAL) {
+                printf("LinuxCameraDevice::loadRanges: VIDIOC_QUERYCTRL failed: %s\n", strerror(errno));
+                return false;
+            }
+            continue; // the camera does not have this control
+        }
+        if (query.flags & V4L2_CTRL_FLAG_DISABLED) continue;
+
+        range.supported = true;
+        range.min = query.minimum;
+        range.max = query.maximum;
+        range.step = query.step;
+        range.def = query.default_value;
+        range.readOnly = (query.flags & V4L2_CTRL_FLAG_READ_ONLY) != 0;
+    }
+    rangesLoaded = true;
+    return true;
+}
+
+bool LinuxCameraDevice::getProperty(PropertyType t, Property& prop)
+{
+    std::vector<PropertyType> types(1, t);
+    std::vector<Property> props;
+    if (!getProperties(types, props)) return false;
+    prop = props[0];
+    return true;
+}
+
+bool LinuxCameraDevice::getProperties(const std::vector<PropertyType>& types, std::vector<Property>& props)
+{
+    props.assign(types.size(), Property());
+    if (types.empty()) return true;
+    if (!loadRanges()) return false;
+
+    std::vector<struct v4l2_ext_control> ctrls(types.size());
+    for (size_t k = 0; k < types.size(); k++) {
+        if (!ranges[types[k]].supported) {
+            printf("LinuxCameraDevice::getProperties: property %d is not supported\n", types[k]);
+            return false;
+        }
+        memset(&ctrls[k], 0, sizeof(ctrls[k]));
+        ctrls[k].id = convertPropertyTypeToControlId(types[k]);
+    }
+
+    // one ioctl for all the current values, the ranges come from the cache
+    struct v4l2_ext_controls ext;
+    memset(&ext, 0, sizeof(ext));
+    ext.which = V4L2_CTRL_WHICH_CUR_VAL;
+    ext.count = (uint32_t)ctrls.size();
+    ext.controls = &ctrls[0];
+    if (transport->xioctl(VIDIOC_G_EXT_CTRLS, &ext) < 0) {
+        printf("LinuxCameraDevice::getProperties: VIDIOC_G_EXT_CTRLS failed at %u: %s\n", ext.error_idx, strerror(errno));
+        return false;
+    }
+
+    for (size_t k = 0; k < types.size(); k++) {
+        const ControlRange& range = ranges[types[k]];
+        props[k] = Property(ctrls[k].value, range.min, range.max);
+        props[k].returnValue = true;
+    }
+    return true;
+}
+
+bool LinuxCameraDevice::setProperty(PropertyType p, int value)
+{
+    if (!loadRanges()) return false;
+
+    const ControlRange& range = ranges[p];
+    if (!range.supported || range.readOnly) {
+        printf("LinuxCameraDevice::setProperty: property %d cannot be set\n", p);
+        return false;
+    }
+    if (value < range.min || value > range.max) {
+        printf("LinuxCameraDevice::setProperty: %d is outside [%d, %d]\n", value, range.min, range.max);
+        return false;
+    }
+
+    struct v4l2_ext_control ctrl;
+    memset(&ctrl, 0, sizeof(ctrl));
+    ctrl.id = convertPropertyTypeToControlId(p);
+    ctrl.value = value;
+
+    struct v4l2_ext_controls ext;
+    memset(&ext, 0, sizeof(ext));
+    ext.which = V4L2_CTRL_WHICH_CUR_VAL;
+    ext.count = 1;
+    ext.controls = &ctrl;
+    if (transport->xioctl(VIDIOC_S_EXT_CTRLS, &ext) < 0) {
+        // EBUSY/EACCES when an auto mode owns the control, e.g. white balance temperature
+        printf("LinuxCameraDevice::setProperty: VIDIOC_S_EXT_CTRLS failed: %s\n", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool LinuxCameraDevice::xuQuery(uint8_t unit, uint8_t selector, uint8_t query, std::vector<unsigned char>& data)
+{
+    struct uvc_xu_control_query q;
+    memset(&q, 0, sizeof(q));
+    q.unit = unit;
+    q.selector = selector;
+    q.query = query;
+    q.size = (uint16_t)data.size();
+    q.data = data.empty() ? NULL : &data[0];
+    if (transport->xioctl(UVCIOC_CTRL_QUERY, &q) < 0) {
+        printf("LinuxCameraDevice::xuQuery: unit %u selector %u query 0x%02x failed: %s\n",
+               unit, selector, query, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+LinuxCameraDevice::XUControl * LinuxCameraDevice::getXUControl(uint8_t unit, uint8_t selector)
+{
+    uint16_t key = (unit << 8) | selector;
+    std::map<uint16_t, XUControl>::iterator it = xuControls.find(key);
+    if (it != xuControls.end()) return &it->second;
+
+    std::vector<unsigned char> len(2, 0);
+    std::vector<unsigned char> info(1, 0);
+    if (!xuQuery(unit, selector, UVC_GET_LEN, len)) return NULL;
+    if (!xuQuery(unit, selector, UVC_GET_INFO, info)) return NULL;
+
+    XUControl& ctrl = xuControls[key];
+    ctrl.length = len[0] | (len[1] << 8);
+    ctrl.info = info[0];
+    return &ctrl;
+}
+
+// CommandInfo carries a raw class request to an extension unit:
+// request is the UVC request code, value holds the selector and index the unit id in their high bytes
+bool LinuxCameraDevice::sendCommand(CommandInfo& info)
+{
+    uint8_t unit = info.index >> 8;
+    uint8_t selector = info.value >> 8;
+
+    XUControl * ctrl = getXUControl(unit, selector);
+    if (ctrl == NULL) return false;
+
+    switch (info.request) {
+        case UVC_GET_LEN:
+            info.data.resize(2);
+            info.data[0] = ctrl->length & 0xff;
+            info.data[1] = ctrl->length >> 8;
+            return true;
+        case UVC_GET_INFO:
+            info.data.assign(1, ctrl->info);
+            return true;
+        case UVC_GET_MIN:
+        case UVC_GET_MAX:
+        case UVC_GET_RES:
+        case UVC_GET_DEF: {
+            std::map<uint8_t, std::vector<unsigned char> >::iterator it = ctrl->statics.find(info.request);
+            if (it == ctrl->statics.end()) {
+                std::vector<unsigned char> data(ctrl->length, 0);
+                if (!xuQuery(unit, selector, info.request, data)) return false;
+                it = ctrl->statics.insert(std::make_pair((uint8_t)info.request, data)).first;
+            }
+            info.data = it->second;
+            return true;
+        }
+        case UVC_GET_CUR:
+            if (!(ctrl->info & UVC_CONTROL_CAP_GET)) return false;
+            info.data.assign(ctrl->length, 0);
+            return xuQuery(unit, selector, UVC_GET_CUR, info.data);
+        case UVC_SET_CUR:
+            if (!(ctrl->info & UVC_CONTROL_CAP_SET)) return false;
+            if (info.data.size() != ctrl->length) {
+                printf("LinuxCameraDevice::sendCommand: SET_CUR needs %u bytes, got %u\n",
+                       ctrl->length, (unsigned)info.data.size());
+                return false;
+            }
+            return xuQuery(unit, selector, UVC_SET_CUR, info.data);
+    }
+    printf("LinuxCameraDevice::sendCommand: unsupported request 0x%02x\n", info.request);
+    return false;
+}
+
+static std::string readSysfs(const std::string& path)
+{
+    std::ifstream f(path.c_str());
+    std::string value;
+    std::getline(f, value);
+    return value;
+}
+
+bool LinuxCameraDevice::getJabraDevices(std::vector<std::string>& devPaths)
+{
+    devPaths.clear();
+
+    DIR * dir = opendir("/sys/bus/usb/devices");
+    if (dir == NULL) {
+        printf("LinuxCameraDevice::getJabraDevices: no usb devices in sysfs\n");
+        return false;
+    }
+
+    struct dirent * entry;
+    while ((entry = readdir(dir)) != NULL) {
+        std::string node = std::string("/sys/bus/usb/devices/") + entry->d_name;
+        std::string vid = readSysfs(node + "/idVendor");
+        if (vid.empty()) continue; // interfaces and hubs' ports have no idVendor
+
+        long usbVendor = strtol(vid.c_str(), NULL, 16);
+        if (usbVendor != ALTIA_VENDOR_ID && usbVendor != GN_VENDOR_ID) continue;
+
+        std::string sn = readSysfs(node + "/serial");
+        if (!sn.empty()) devPaths.push_back(sn);
+    }
+    closedir(dir);
+
+    printf("getAllDevices: found %d devices\n", (int)devPaths.size());
+    return !devPaths.empty();
+}
+
+#endif
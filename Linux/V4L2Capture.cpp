@@ -0,0 +1,489 @@
+#include "V4L2Capture.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/videodev2.h>
+#include <time.h>
+#include <fstream>
+
+bool SystemV4L2Device::open(const std::string& path)
+{
+    close();
+    fd = ::open(path.c_str(), O_RDWR | O_NONBLOCK);
+    return fd >= 0;
+}
+
+void SystemV4L2Device::close()
+{
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+}
+
+int SystemV4L2Device::xioctl(unsigned long request, void * arg)
+{
+    int r;
+    do {
+        r = ioctl(fd, request, arg);
+    } while (r == -1 && errno == EINTR);
+    return r;
+}
+
+void * SystemV4L2Device::mmap(size_t length, off_t offset)
+{
+    void * p = ::mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+void SystemV4L2Device::munmap(void * addr, size_t length)
+{
+    ::munmap(addr, length);
+}
+
+int SystemV4L2Device::waitForBuffer(int timeoutMsec)
+{
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    int r = poll(&pfd, 1, timeoutMsec);
+    if (r > 0 && (pfd.revents & (POLLERR | POLLHUP | POLLNVAL))) return -1;
+    return r;
+}
+
+V4L2Capture::V4L2Capture(const std::string& _devicePath, unsigned ringDepth)
+    : FrameRingCapture(ringDepth), device(new SystemV4L2Device), devicePath(_devicePath)
+{
+    format = PANACAST_FRAME_FORMAT_YUYV;
+    width = 0;
+    height = 0;
+    exportDmabuf = false;
+    streaming = false;
+    running = false;
+    captured = 0;
+    dropped = 0;
+    driverDropped = 0;
+    corrupt = 0;
+    decimated = 0;
+    deviceFps = 0;
+    lastDriverSequence = 0;
+    haveDriverSequence = false;
+}
+
+V4L2Capture::V4L2Capture(V4L2Device * _device, const std::string& _devicePath, unsigned ringDepth)
+    : FrameRingCapture(ringDepth), device(_device), devicePath(_devicePath)
+{
+    format = PANACAST_FRAME_FORMAT_YUYV;
+    width = 0;
+    height = 0;
+    exportDmabuf = false;
+    streaming = false;
+    running = false;
+    captured = 0;
+    dropped = 0;
+    driverDropped = 0;
+    corrupt = 0;
+    decimated = 0;
+    deviceFps = 0;
+    lastDriverSequence = 0;
+    haveDriverSequence = false;
+}
+
+V4L2Capture::~V4L2Capture()
+{
+    stopCapture();
+    releaseBuffers();
+    device->close();
+    delete device;
+}
+
+uint32_t V4L2Capture::toPixelFormat(RawFrameFormat format)
+{
+    switch (format) {
+        case PANACAST_FRAME_FORMAT_YUYV: return V4L2_PIX_FMT_YUYV;
+        case PANACAST_FRAME_FORMAT_UYVY: return V4L2_PIX_FMT_UYVY;
+        case PANACAST_FRAME_FORMAT_MJPEG: return V4L2_PIX_FMT_MJPEG;
+        case PANACAST_FRAME_FORMAT_YV12: return V4L2_PIX_FMT_YVU420;
+        case PANACAST_FRAME_FORMAT_NV12: return V4L2_PIX_FMT_NV12;
+        case PANACAST_FRAME_FORMAT_I420: return V4L2_PIX_FMT_YUV420;
+        default: break;
+    }
+    return 0;
+}
+
+static std::string readSysfs(const std::string& path)
+{
+    std::ifstream f(path.c_str());
+    std::string value;
+    std::getline(f, value);
+    return value;
+}
+
+std::string V4L2Capture::findDevicePath(const std::string& serialOrPath)
+{
+    if (serialOrPath.compare(0, 5, "/dev/") == 0) return serialOrPath;
+
+    DIR * dir = opendir("/sys/class/video4linux");
+    if (dir == NULL) return "";
+
+    std::string found;
+    struct dirent * entry;
+    while ((entry = readdir(dir)) != NULL) {
+        std::string name = entry->d_name;
+        if (name.compare(0, 5, "video") != 0) continue;
+
+        // uvcvideo registers a metadata node next to the capture node, the capture node is index 0
+        std::string node = "/sys/class/video4linux/" + name;
+        if (readSysfs(node + "/index") != "0") continue;
+        if (readSysfs(node + "/device/../serial") != serialOrPath) continue;
+
+        found = "/dev/" + name;
+        break;
+    }
+    closedir(dir);
+    return found;
+}
+
+bool V4L2Capture::queueBuffer(unsigned idx)
+{
+    struct v4l2_buffer buf;
+    memset(&buf, 0, sizeof(buf));
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = idx;
+    if (device->xioctl(VIDIOC_QBUF, &buf) < 0) {
+        printf("V4L2Capture: VIDIOC_QBUF %u failed: %s\n", idx, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+// the slowest rate the device offers at or above fps, so the pacer has the least to throw away;
+// the fastest one if none is high enough
+bool V4L2Capture::negotiateFrameRate(unsigned fps)
+{
+    struct v4l2_frmivalenum ival;
+    memset(&ival, 0, sizeof(ival));
+    ival.pixel_format = toPixelFormat(format);
+    ival.width = width;
+    ival.height = height;
+
+    double best = 0, fastest = 0;
+    struct v4l2_fract bestInterval = { 0, 0 }, fastestInterval = { 0, 0 };
+    for (ival.index = 0; device->xioctl(VIDIOC_ENUM_FRAMEINTERVALS, &ival) == 0; ival.index++) {
+        struct v4l2_fract interval;
+        if (ival.type == V4L2_FRMIVAL_TYPE_DISCRETE) {
+            interval = ival.discrete;
+        } else {
+            // continuous or stepwise: ask for exactly fps, clamped to the range
+            const struct v4l2_frmival_stepwise& sw = ival.stepwise;
+            interval.numerator = 1;
+            interval.denominator = fps;
+            if ((double)sw.min.numerator / sw.min.denominator > 1.0 / fps) interval = sw.min;
+            if ((double)sw.max.numerator / sw.max.denominator < 1.0 / fps) interval = sw.max;
+        }
+        if (interval.numerator == 0) continue;
+
+        double rate = (double)interval.denominator / interval.numerator;
+        if (rate > fastest) {
+            fastest = rate;
+            fastestInterval = interval;
+        }
+        if (rate >= fps && (best == 0 || rate < best)) {
+            best = rate;
+            bestInterval = interval;
+        }
+        if (ival.type != V4L2_FRMIVAL_TYPE_DISCRETE) break;
+    }
+
+    struct v4l2_streamparm parm;
+    memset(&parm, 0, sizeof(parm));
+    parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (best > 0) {
+        parm.parm.capture.timeperframe = bestInterval;
+    } else if (fastest > 0) {
+        parm.parm.capture.timeperframe = fastestInterval;
+    } else {
+        // no list to pick from, ask for the rate and see what the driver makes of it
+        parm.parm.capture.timeperframe.numerator = 1;
+        parm.parm.capture.timeperframe.denominator = fps;
+    }
+    if (device->xioctl(VIDIOC_S_PARM, &parm) < 0) {
+        printf("V4L2Capture: VIDIOC_S_PARM failed: %s\n", strerror(errno));
+        return false;
+    }
+
+    const struct v4l2_fract& set = parm.parm.capture.timeperframe;
+    deviceFps = set.numerator ? (double)set.denominator / set.numerator : 0;
+    return true;
+}
+
+bool V4L2Capture::setupBuffers(unsigned count)
+{
+    struct v4l2_requestbuffers req;
+    memset(&req, 0, sizeof(req));
+    req.count = count;
+    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+    if (device->xioctl(VIDIOC_REQBUFS, &req) < 0) {
+        printf("V4L2Capture: VIDIOC_REQBUFS failed: %s\n", strerror(errno));
+        return false;
+    }
+    if (req.count < 2) {
+        printf("V4L2Capture: driver only gave us %u buffers\n", req.count);
+        return false;
+    }
+
+    for (unsigned k = 0; k < req.count; k++) {
+        struct v4l2_buffer buf;
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = k;
+        if (device->xioctl(VIDIOC_QUERYBUF, &buf) < 0) {
+            printf("V4L2Capture: VIDIOC_QUERYBUF %u failed: %s\n", k, strerror(errno));
+            return false;
+        }
+
+        Buffer b;
+        b.length = buf.length;
+        b.start = device->mmap(buf.length, buf.m.offset);
+        b.dmabufFd = -1;
+        if (b.start == NULL) {
+            printf("V4L2Capture: mmap of buffer %u failed\n", k);
+            return false;
+        }
+        buffers.push_back(b);
+
+        if (exportDmabuf) {
+            struct v4l2_exportbuffer exp;
+            memset(&exp, 0, sizeof(exp));
+            exp.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            exp.index = k;
+            exp.flags = O_RDONLY | O_CLOEXEC;
+            if (device->xioctl(VIDIOC_EXPBUF, &exp) == 0) {
+                buffers.back().dmabufFd = exp.fd;
+            } else {
+                printf("V4L2Capture: VIDIOC_EXPBUF %u failed, buffer stays mmap only\n", k);
+            }
+        }
+    }
+    return true;
+}
+
+void V4L2Capture::releaseBuffers()
+{
+    for (size_t k = 0; k < buffers.size(); k++) {
+        if (buffers[k].dmabufFd >= 0) ::close(buffers[k].dmabufFd);
+        device->munmap(buffers[k].start, buffers[k].length);
+    }
+    buffers.clear();
+
+    if (!streaming) {
+        struct v4l2_requestbuffers req;
+        memset(&req, 0, sizeof(req));
+        req.count = 0;
+        req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        req.memory = V4L2_MEMORY_MMAP;
+        device->xioctl(VIDIOC_REQBUFS, &req);
+    }
+
+    // slots may still reference the old mappings, make sure they are never handed out
+    discardPublished();
+    for (unsigned k = 0; k < ring.depth(); k++) {
+        ring.slot(k)->buf = NULL;
+        ring.slot(k)->private_data = NULL;
+    }
+}
+
+bool V4L2Capture::init(unsigned _width, unsigned _height, RawFrameFormat _format, void * captureDevice)
+{
+    if (captureThread.joinable()) return false;
+    if (!buffers.empty()) {
+        // restarted after stopCapture: nothing published is handed out any more, but frames
+        // consumers took before still point into the buffers releaseBuffers unmaps
+        discardPublished();
+        for (unsigned k = 0; k < ring.depth(); k++) {
+            if (ring.pinned(ring.slot(k))) {
+                printf("V4L2Capture: init: frames of the previous stream are still held, release them first\n");
+                return false;
+            }
+        }
+        releaseBuffers();
+    }
+
+    std::string path = findDevicePath(devicePath);
+    if (path.empty()) path = devicePath; // let the device shim make sense of it
+    if (!device->open(path)) {
+        printf("V4L2Capture: cannot open %s\n", path.c_str());
+        return false;
+    }
+
+    struct v4l2_capability cap;
+    memset(&cap, 0, sizeof(cap));
+    if (device->xioctl(VIDIOC_QUERYCAP, &cap) < 0) {
+        printf("V4L2Capture: %s is not a V4L2 device\n", path.c_str());
+        return false;
+    }
+    uint32_t caps = (cap.capabilities & V4L2_CAP_DEVICE_CAPS) ? cap.device_caps : cap.capabilities;
+    if (!(caps & V4L2_CAP_VIDEO_CAPTURE) || !(caps & V4L2_CAP_STREAMING)) {
+        printf("V4L2Capture: %s cannot stream video\n", path.c_str());
+        return false;
+    }
+
+    struct v4l2_format fmt;
+    memset(&fmt, 0, sizeof(fmt));
+    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    fmt.fmt.pix.width = _width;
+    fmt.fmt.pix.height = _height;
+    fmt.fmt.pix.pixelformat = toPixelFormat(_format);
+    fmt.fmt.pix.field = V4L2_FIELD_NONE;
+    if (device->xioctl(VIDIOC_S_FMT, &fmt) < 0) {
+        printf("V4L2Capture: VIDIOC_S_FMT failed: %s\n", strerror(errno));
+        return false;
+    }
+    if (fmt.fmt.pix.width != _width || fmt.fmt.pix.height != _height ||
+        fmt.fmt.pix.pixelformat != toPixelFormat(_format)) {
+        printf("V4L2Capture: %s does not support %ux%u in format %d\n", path.c_str(), _width, _height, _format);
+        return false;
+    }
+    // RawFrame has no stride, so padded lines cannot be passed through without a copy
+    bool packed = _format == PANACAST_FRAME_FORMAT_YUYV || _format == PANACAST_FRAME_FORMAT_UYVY;
+    unsigned lineBytes = packed ? _width * 2 : _width;
+    if (_format != PANACAST_FRAME_FORMAT_MJPEG && fmt.fmt.pix.bytesperline != 0 && fmt.fmt.pix.bytesperline != lineBytes) {
+        printf("V4L2Capture: padded lines (%u bytes) are not supported\n", fmt.fmt.pix.bytesperline);
+        return false;
+    }
+
+    width = _width;
+    height = _height;
+    format = _format;
+
+    // whatever the device cannot do is left to the pacer
+    deviceFps = 0;
+    if (requestedFrameRate() && !negotiateFrameRate(requestedFrameRate())) {
+        printf("V4L2Capture: cannot set %u fps, decimating from the device rate\n", requestedFrameRate());
+    }
+    pacer.reset();
+
+    if (!setupBuffers(ring.depth() + V4L2_EXTRA_BUFFERS)) {
+        releaseBuffers();
+        return false;
+    }
+    for (unsigned k = 0; k < buffers.size(); k++) {
+        if (!queueBuffer(k)) {
+            releaseBuffers();
+            return false;
+        }
+    }
+
+    int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (device->xioctl(VIDIOC_STREAMON, &type) < 0) {
+        printf("V4L2Capture: VIDIOC_STREAMON failed: %s\n", strerror(errno));
+        releaseBuffers();
+        return false;
+    }
+    streaming = true;
+    haveDriverSequence = false;
+
+    running = true;
+    captureThread = std::thread(&V4L2Capture::captureLoop, this);
+    return true;
+}
+
+void V4L2Capture::stopCapture()
+{
+    running = false;
+    if (captureThread.joinable()) captureThread.join();
+
+    if (streaming) {
+        int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        device->xioctl(VIDIOC_STREAMOFF, &type);
+        streaming = false;
+        frameAvail->Reset();
+    }
+}
+
+int V4L2Capture::dmabufFd(const struct RawFrame * frame) const
+{
+    uintptr_t idx = (uintptr_t)frame->private_data;
+    if (idx == 0 || idx > buffers.size()) return -1;
+    return buffers[idx - 1].dmabufFd;
+}
+
+void V4L2Capture::captureLoop()
+{
+    while (running) {
+        int r = device->waitForBuffer(V4L2_POLL_TIMEOUT_MSEC);
+        if (r == 0) continue;
+        if (r < 0) {
+            printf("V4L2Capture: device error, stopping capture\n");
+            break;
+        }
+
+        struct v4l2_buffer buf;
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        if (device->xioctl(VIDIOC_DQBUF, &buf) < 0) {
+            if (errno == EAGAIN) continue;
+            printf("V4L2Capture: VIDIOC_DQBUF failed: %s\n", strerror(errno));
+            break;
+        }
+        uint64_t driverTime = frameClockNsec();
+
+        if (haveDriverSequence && buf.sequence > lastDriverSequence + 1) {
+            driverDropped += buf.sequence - lastDriverSequence - 1;
+        }
+        lastDriverSequence = buf.sequence;
+        haveDriverSequence = true;
+
+        if (buf.flags & V4L2_BUF_FLAG_ERROR) {
+            corrupt++;
+            queueBuffer(buf.index);
+            continue;
+        }
+
+        uint64_t deviceTime = 0;
+        if ((buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) {
+            deviceTime = buf.timestamp.tv_sec * 1000000000ULL + buf.timestamp.tv_usec * 1000ULL;
+        }
+        uint64_t timestamp = deviceTime ? deviceTime : driverTime;
+        if (!paceFrame(timestamp)) {
+            decimated++;
+            queueBuffer(buf.index);
+            continue;
+        }
+
+        RawFrame * frame = ring.claim();
+        if (frame == NULL) {
+            // every slot is pinned, give the buffer straight back so the driver never starves
+            dropped++;
+            queueBuffer(buf.index);
+            continue;
+        }
+
+        // the buffer parked in this slot last time is free again
+        uintptr_t previous = (uintptr_t)frame->private_data;
+        if (previous) queueBuffer(previous - 1);
+
+        frame->buf = (unsigned char *)buffers[buf.index].start;
+        frame->size = buf.bytesused;
+        frame->format = format;
+        frame->width = width;
+        frame->height = height;
+        frame->timestamp = timestamp;
+        frame->private_data = (void *)(uintptr_t)(buf.index + 1);
+        frame->stageTime[FRAME_STAGE_DEVICE] = deviceTime;
+        frame->stageTime[FRAME_STAGE_DRIVER] = driverTime;
+        frame->stageTime[FRAME_STAGE_CALLBACK] = frameClockNsec();
+        // counted first, so a consumer that has the frame also sees it in framesCaptured
+        captured++;
+        if (!publishFrame(frame)) captured--; // broken MJPEG or a still frame, the buffer goes back when the slot is next claimed
+    }
+}
@@ -0,0 +1,132 @@
+//
+//  V4L2Capture.h
+//
+//  Linux capture backend on V4L2 streaming I/O. Driver buffers are mmap'd
+//  once, and a dequeued buffer is published into the frame ring as is, so a
+//  frame reaches the consumer without a memcpy. A buffer goes back to the
+//  driver when its ring slot is reused, or straight away when the frame is
+//  dropped. Buffers can also be exported as DMABUF fds for consumers that
+//  import them into a GPU or encoder.
+//
+//  All device access goes through V4L2Device so tests can run the backend
+//  against an in-process fake (see FakeV4L2Device.h).
+//
+
+#ifndef V4L2CAPTURE_H
+#define V4L2CAPTURE_H
+
+#include "FrameRing.h"
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/types.h>
+
+// buffers on top of the ring depth, so the driver always has some to fill
+#define V4L2_EXTRA_BUFFERS 2
+#define V4L2_POLL_TIMEOUT_MSEC 100
+
+// the handful of system calls V4L2Capture needs
+class V4L2Device {
+public:
+    virtual ~V4L2Device() {}
+    virtual bool open(const std::string& path) = 0;
+    virtual void close() = 0;
+    // same contract as ioctl(2): -1 and errno on failure
+    virtual int xioctl(unsigned long request, void * arg) = 0;
+    virtual void * mmap(size_t length, off_t offset) = 0;
+    virtual void munmap(void * addr, size_t length) = 0;
+    // > 0 when a buffer can be dequeued, 0 on timeout, < 0 on error
+    virtual int waitForBuffer(int timeoutMsec) = 0;
+};
+
+class SystemV4L2Device : public V4L2Device {
+public:
+    SystemV4L2Device() : fd(-1) {}
+    ~SystemV4L2Device() { close(); }
+    bool open(const std::string& path);
+    void close();
+    int xioctl(unsigned long request, void * arg);
+    void * mmap(size_t length, off_t offset);
+    void munmap(void * addr, size_t length);
+    int waitForBuffer(int timeoutMsec);
+    int getFd() const { return fd; }
+
+private:
+    int fd;
+};
+
+class V4L2Capture : public FrameRingCapture {
+public:
+    // devicePath is /dev/videoN or a camera serial number, see findDevicePath
+    V4L2Capture(const std::string& devicePath, unsigned ringDepth = FRAME_RING_DEFAULT_DEPTH);
+    // takes ownership of device
+    V4L2Capture(V4L2Device * device, const std::string& devicePath, unsigned ringDepth = FRAME_RING_DEFAULT_DEPTH);
+    virtual ~V4L2Capture();
+
+    // Can be called again after stopCapture, but fails while a consumer still holds a frame
+    // of the previous stream: the buffers behind those frames are unmapped on restart.
+    bool init(unsigned width, unsigned height, RawFrameFormat format, void * captureDevice);
+    void stopCapture();
+
+    // export every buffer with VIDIOC_EXPBUF, call before init
+    void enableDmabufExport(bool enable) { exportDmabuf = enable; }
+    // DMABUF fd of the buffer behind a frame from this backend, -1 if not exported
+    int dmabufFd(const struct RawFrame * frame) const;
+
+    unsigned bufferCount() const { return (unsigned)buffers.size(); }
+    uint64_t framesCaptured() const { return captured.load(std::memory_order_relaxed); }
+    // every slot was pinned, the buffer went straight back to the driver
+    uint64_t framesDropped() const { return dropped.load(std::memory_order_relaxed); }
+    // gaps in the driver sequence numbers, frames the driver had no buffer for
+    uint64_t driverDrops() const { return driverDropped.load(std::memory_order_relaxed); }
+    // buffers flagged V4L2_BUF_FLAG_ERROR; MJPEG that fails parseJpegHeader is in getStats
+    uint64_t corruptFrames() const { return corrupt.load(std::memory_order_relaxed); }
+    // skipped by the pacer to bring the device rate down to the requested one
+    uint64_t framesDecimated() const { return decimated.load(std::memory_order_relaxed); }
+    // rate the device was set to, 0 when it did not say
+    double deviceFrameRate() const { return deviceFps; }
+
+    static uint32_t toPixelFormat(RawFrameFormat format);
+    // resolve a /dev/videoN path, or the capture node of the camera with this serial number
+    static std::string findDevicePath(const std::string& serialOrPath);
+
+protected:
+    uint64_t sourceDrops() const { return driverDrops() + corruptFrames(); }
+    uint64_t sourceCorrupt() const { return corruptFrames(); }
+
+private:
+    struct Buffer {
+        void * start;
+        size_t length;
+        int dmabufFd;
+    };
+
+    bool negotiateFrameRate(unsigned fps);
+    bool setupBuffers(unsigned count);
+    void releaseBuffers();
+    bool queueBuffer(unsigned idx);
+    void captureLoop();
+
+    V4L2Device * device;
+    std::string devicePath;
+    RawFrameFormat format;
+    unsigned width;
+    unsigned height;
+    bool exportDmabuf;
+    bool streaming;
+    std::vector<Buffer> buffers;
+
+    std::thread captureThread;
+    std::atomic<bool> running;
+    std::atomic<uint64_t> captured;
+    std::atomic<uint64_t> dropped;
+    std::atomic<uint64_t> driverDropped;
+    std::atomic<uint64_t> corrupt;
+    std::atomic<uint64_t> decimated;
+    double deviceFps;
+    uint32_t lastDriverSequence;
+    bool haveDriverSequence;
+};
+
+#endif
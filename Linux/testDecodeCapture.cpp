@@ -0,0 +1,310 @@
+//
+//  testDecodeCapture.cpp
+//
+//  MjpegDecoder must give exactly what plain libjpeg gives for packed RGB at
+//  every IDCT scale, the YUYV the synthetic camera renders for its own MJPEG
+//  frames, and refuse corrupt or truncated frames and keep working after
+//  them. MJPEG streams decoded on several threads must hand out frames of
+//  the asked for format and size in capture order, picking the scaled IDCT
+//  that covers the output size. Then full and scaled decodes of 1080p and
+//  4K JPEGs are timed.
+//
+//  usage: testDecodeCapture [iterations]
+//
+
+#include "CameraDevice.h"
+#include "DecodeCapture.h"
+#include "MjpegDecoder.h"
+#include "SyntheticCapture.h"
+#include "testUtil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <mutex>
+#include <random>
+#include <vector>
+#include <jpeglib.h>
+
+// a camera-like picture: gradients, edges and noise, in 4:2:2 or 4:2:0 at quality 90
+static std::vector<uint8_t> encodeJpeg(unsigned width, unsigned height, bool yuv420)
+{
+    std::vector<uint8_t> rgb((size_t)width * height * 3);
+    std::mt19937 rng(width);
+    for (unsigned y = 0; y < height; y++) {
+        for (unsigned x = 0; x < width; x++) {
+            uint8_t * p = &rgb[((size_t)y * width + x) * 3];
+            unsigned noise = rng() & 31;
+            p[0] = (uint8_t)(x * 255 / width);
+            p[1] = (uint8_t)((y * 255 / height + noise) & 255);
+            p[2] = ((x / 64 + y / 64) & 1) ? 220 : 30;
+        }
+    }
+
+    jpeg_compress_struct cinfo;
+    jpeg_error_mgr err;
+    cinfo.err = jpeg_std_error(&err);
+    jpeg_create_compress(&cinfo);
+    unsigned char * out = NULL;
+    unsigned long size = 0;
+    jpeg_mem_dest(&cinfo, &out, &size);
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, 90, TRUE);
+    cinfo.comp_info[0].h_samp_factor = 2;
+    cinfo.comp_info[0].v_samp_factor = yuv420 ? 2 : 1;
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < height) {
+        JSAMPROW row = &rgb[(size_t)cinfo.next_scanline * width * 3];
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    std::vector<uint8_t> jpeg(out, out + size);
+    free(out);
+    jpeg_destroy_compress(&cinfo);
+    return jpeg;
+}
+
+// what libjpeg gives with nothing but the colour space and scale set
+static std::vector<uint8_t> referenceDecode(const std::vector<uint8_t>& jpeg, J_COLOR_SPACE space, unsigned scale,
+                                            unsigned& width, unsigned& height)
+{
+    jpeg_decompress_struct cinfo;
+    jpeg_error_mgr err;
+    cinfo.err = jpeg_std_error(&err);
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, (unsigned char *)&jpeg[0], jpeg.size());
+    jpeg_read_header(&cinfo, TRUE);
+    cinfo.out_color_space = space;
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = scale;
+    jpeg_start_decompress(&cinfo);
+    width = cinfo.output_width;
+    height = cinfo.output_height;
+    size_t row = (size_t)width * cinfo.output_components;
+    std::vector<uint8_t> out(row * height);
+    while (cinfo.output_scanline < height) {
+        JSAMPROW p = &out[cinfo.output_scanline * row];
+        jpeg_read_scanlines(&cinfo, &p, 1);
+    }
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return out;
+}
+
+static bool matchesReference(MjpegDecoder& decoder, const std::vector<uint8_t>& jpeg, RawFrameFormat format, unsigned scale)
+{
+    J_COLOR_SPACE space = format == PANACAST_FRAME_FORMAT_BGR24 ? JCS_EXT_BGR :
+                          format == PANACAST_FRAME_FORMAT_RGB24 ? JCS_EXT_RGB : JCS_EXT_BGRA;
+    unsigned width, height;
+    std::vector<uint8_t> want = referenceDecode(jpeg, space, scale, width, height);
+    // padded rows, the pad must stay untouched
+    unsigned stride = rawFrameSize(format, width, 1) + 16;
+    std::vector<uint8_t> got((size_t)stride * height, 0x55);
+    if (!decoder.decode(&jpeg[0], jpeg.size(), scale, &got[0], stride, format, width, height)) return false;
+    size_t row = rawFrameSize(format, width, 1);
+    for (unsigned y = 0; y < height; y++) {
+        if (memcmp(&got[(size_t)y * stride], &want[y * row], row)) return false;
+        for (unsigned k = 0; k < 16; k++) {
+            if (got[(size_t)y * stride + row + k] != 0x55) return false;
+        }
+    }
+    return true;
+}
+
+// the raw frame of a synthetic stream, copied so it outlives the stream
+static std::vector<uint8_t> syntheticFrame(const char * format, unsigned width, unsigned height)
+{
+    CameraStreamInterface stream("synthetic", width, height, format, 30);
+    FrameRef frame;
+    if (!stream.openStream() || !stream.getFrame(frame)) return std::vector<uint8_t>();
+    unsigned length = stream.frameLength(frame.get());
+    return std::vector<uint8_t>(frame->buf, frame->buf + length);
+}
+
+static double msecPerDecode(MjpegDecoder& decoder, const std::vector<uint8_t>& jpeg, unsigned width, unsigned height,
+                            unsigned scale, unsigned iterations)
+{
+    unsigned w = MjpegDecoder::scaledSize(width, scale), h = MjpegDecoder::scaledSize(height, scale);
+    std::vector<uint8_t> out((size_t)w * h * 3);
+    std::vector<uint64_t> times;
+    for (unsigned k = 0; k < iterations; k++) {
+        uint64_t t0 = now_nsec();
+        decoder.decode(&jpeg[0], jpeg.size(), scale, &out[0], 0, PANACAST_FRAME_FORMAT_BGR24, w, h);
+        times.push_back(now_nsec() - t0);
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2] / 1e6;
+}
+
+int main(int argc, char * argv[])
+{
+    unsigned iterations = argc > 1 ? atoi(argv[1]) : 20;
+    MjpegDecoder decoder;
+
+    {
+        std::vector<uint8_t> jpeg422 = encodeJpeg(1280, 720, false), jpeg420 = encodeJpeg(1000, 562, true);
+        static const RawFrameFormat rgb[] = {
+            PANACAST_FRAME_FORMAT_BGR24, PANACAST_FRAME_FORMAT_RGB24, PANACAST_FRAME_FORMAT_BGRA32,
+        };
+        bool ok = true;
+        for (unsigned scale = 1; scale <= 8; scale *= 2) {
+            for (unsigned f = 0; f < 3; f++) {
+                ok = matchesReference(decoder, jpeg422, rgb[f], scale) && matchesReference(decoder, jpeg420, rgb[f], scale) && ok;
+            }
+        }
+        check(ok, "packed RGB is what libjpeg gives at every scale");
+
+        // luma of the YUYV decode is libjpeg's Y, for 4:2:0 with an odd scaled width too
+        unsigned width, height;
+        std::vector<uint8_t> ycc = referenceDecode(jpeg420, JCS_YCbCr, 8, width, height);
+        unsigned even = width & ~1u;
+        std::vector<uint8_t> yuyv((size_t)even * height * 2);
+        ok = width == 125 && decoder.decode(&jpeg420[0], jpeg420.size(), 8, &yuyv[0], 0, PANACAST_FRAME_FORMAT_YUYV, even, height);
+        for (unsigned y = 0; ok && y < height; y++) {
+            for (unsigned x = 0; x < even; x++) ok = ok && yuyv[((size_t)y * even + x) * 2] == ycc[((size_t)y * width + x) * 3];
+        }
+        check(ok, "YUYV luma is libjpeg's");
+
+        // truncated, scribbled over and plain wrong frames are refused, and the next good one decodes
+        std::vector<uint8_t> out((size_t)1280 * 720 * 4);
+        std::vector<uint8_t> truncated(jpeg422.begin(), jpeg422.begin() + jpeg422.size() / 2);
+        std::vector<uint8_t> scribbled(jpeg422);
+        for (size_t k = 1000; k < scribbled.size() - 2; k += 97) scribbled[k] = 0xff;
+        std::vector<uint8_t> garbage(5000, 0x42);
+        check(!decoder.decode(&truncated[0], truncated.size(), 1, &out[0], 0, PANACAST_FRAME_FORMAT_BGR24, 1280, 720),
+              "truncated frame refused");
+        check(!decoder.decode(&scribbled[0], scribbled.size(), 1, &out[0], 0, PANACAST_FRAME_FORMAT_BGR24, 1280, 720),
+              "corrupt frame refused");
+        check(!decoder.decode(&garbage[0], garbage.size(), 1, &out[0], 0, PANACAST_FRAME_FORMAT_BGR24, 1280, 720),
+              "garbage refused");
+        check(!decoder.decode(&jpeg422[0], jpeg422.size(), 2, &out[0], 0, PANACAST_FRAME_FORMAT_BGR24, 1280, 720) &&
+              !decoder.decode(&jpeg422[0], jpeg422.size(), 3, &out[0], 0, PANACAST_FRAME_FORMAT_BGR24, 427, 240),
+              "wrong size or scale refused");
+        check(matchesReference(decoder, jpeg422, PANACAST_FRAME_FORMAT_BGR24, 1), "decoder works after errors");
+    }
+
+    {
+        // the synthetic camera's MJPEG decodes to its YUYV, below the stamp that differs per frame
+        std::vector<uint8_t> mjpeg = syntheticFrame("MJPG", 1280, 720), yuyv = syntheticFrame("YUYV", 1280, 720);
+        std::vector<uint8_t> decoded(yuyv.size());
+        bool ok = !mjpeg.empty() && !yuyv.empty() &&
+                  decoder.decode(&mjpeg[0], mjpeg.size(), 1, &decoded[0], 0, PANACAST_FRAME_FORMAT_YUYV, 1280, 720);
+        size_t stamp = (size_t)64 * 1280 * 2;
+        check(ok && memcmp(&decoded[stamp], &yuyv[stamp], yuyv.size() - stamp) == 0, "MJPEG decodes to the YUYV frame");
+    }
+
+    {
+        // decoded on three threads, handed out in capture order
+        CameraStreamInterface stream("synthetic", 1280, 720, "MJPG", 60);
+        stream.setOutputFormat("YUYV");
+        stream.setDecodeThreads(3);
+        std::mutex lock;
+        std::vector<uint64_t> counts, timestamps;
+        stream.setFrameHandler([&](const FrameRef& frame) {
+            uint64_t count, stamped;
+            if (!SyntheticCapture::readStamp(frame.get(), count, stamped)) return;
+            std::lock_guard<std::mutex> guard(lock);
+            counts.push_back(count);
+            timestamps.push_back(frame->timestamp);
+        });
+        check(stream.openStream(), "decoded stream opens");
+        unsigned frames = 0;
+        bool ok = true;
+        for (unsigned k = 0; k < 60; k++) {
+            FrameRef frame;
+            if (!stream.getFrame(frame)) continue;
+            frames++;
+            ok = ok && frame->format == PANACAST_FRAME_FORMAT_YUYV && frame->width == 1280 && frame->height == 720;
+        }
+        stream.setFrameHandler(FrameHandler());
+        bool ordered = counts.size() > 30;
+        for (size_t k = 1; k < counts.size(); k++) ordered = ordered && counts[k] > counts[k - 1] && timestamps[k] > timestamps[k - 1];
+        StreamStats s;
+        stream.getStats(s);
+        LatencySummary t;
+        stream.getConversionTime(t);
+        printf("MJPEG to YUYV on 3 threads: %u frames, %zu in order, delivered %llu dropped %llu, decode p50 %.2f ms\n",
+               frames, counts.size(), (unsigned long long)s.delivered, (unsigned long long)s.dropped, t.p50Nsec / 1e6);
+        check(frames >= 40 && ok, "stream hands out decoded frames");
+        check(ordered, "frames come out in capture order");
+    }
+
+    {
+        // BGR colour bars, white bottom left and black bottom right
+        CameraStreamInterface stream("synthetic", 1920, 1080, "MJPG", 30);
+        stream.setOutputFormat("BGR");
+        stream.setDecodeThreads(2);
+        FrameRef frame;
+        bool ok = stream.openStream() && stream.getFrame(frame) && frame->format == PANACAST_FRAME_FORMAT_BGR24 &&
+                  stream.frameLength(frame.get()) == 1920 * 1080 * 3;
+        const uint8_t * last = ok ? frame->buf + (size_t)1079 * 1920 * 3 : NULL;
+        ok = ok && last[0] > 200 && last[1] > 200 && last[2] > 200 && last[1919 * 3] < 40 && last[1919 * 3 + 2] < 40;
+        check(ok, "decoded to BGR");
+    }
+
+    static const struct {
+        RawFrameFormat format;
+        unsigned width, height, scale;
+    } sizes[] = {
+        { PANACAST_FRAME_FORMAT_BGR24, 320, 180, 4 },
+        { PANACAST_FRAME_FORMAT_BGR24, 160, 90, 8 },
+        { PANACAST_FRAME_FORMAT_YUYV, 960, 540, 2 },
+        { PANACAST_FRAME_FORMAT_NV12, 640, 360, 2 },
+        { PANACAST_FRAME_FORMAT_I420, 1920, 1080, 1 },
+    };
+    for (unsigned k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++) {
+        unsigned depth = FRAME_RING_DEFAULT_DEPTH + DecodeCapture::inFlight(2);
+        CaptureInterface * capture = DecodeCapture::open(new SyntheticCapture(30, depth), 1920, 1080, sizes[k].format,
+                                                         sizes[k].width, sizes[k].height, 30, FRAME_RING_DEFAULT_DEPTH, 2);
+        DecodeCapture * decode = dynamic_cast<DecodeCapture *>(capture);
+        check(decode != NULL && decode->decodeScale() == sizes[k].scale, "scaled IDCT covering the output");
+        unsigned frames = 0;
+        bool ok = true;
+        for (unsigned n = 0; decode && n < 8; n++) {
+            FrameRef frame = capture->nextFrame();
+            if (!frame) continue;
+            frames++;
+            ok = ok && frame->format == sizes[k].format && frame->width == sizes[k].width && frame->height == sizes[k].height &&
+                 frame->size == (int)rawFrameSize(sizes[k].format, sizes[k].width, sizes[k].height);
+        }
+        printf("MJPEG 1920x1080 to %ux%u format %d: IDCT 1/%u, %u frames\n", sizes[k].width, sizes[k].height,
+               sizes[k].format, decode ? decode->decodeScale() : 0, frames);
+        check(frames >= 5 && ok, "decoded frames of the output size");
+        delete capture;
+    }
+
+    {
+        CaptureInterface * capture = DecodeCapture::open(new SyntheticCapture(30), 640, 360, PANACAST_FRAME_FORMAT_BGR24,
+                                                         1280, 720, 30);
+        check(capture == NULL, "larger output size refused");
+        capture = DecodeCapture::open(new SyntheticCapture(30), 640, 360, PANACAST_FRAME_FORMAT_MJPEG, 0, 0, 30);
+        check(capture == NULL, "MJPEG to MJPEG refused");
+    }
+
+    static const unsigned bench[2][2] = { {1920, 1080}, {3840, 2160} };
+    for (unsigned b = 0; b < 2; b++) {
+        unsigned width = bench[b][0], height = bench[b][1];
+        std::vector<uint8_t> jpeg = encodeJpeg(width, height, false);
+        printf("%ux%u JPEG (%zu KB) to BGR, median ms:", width, height, jpeg.size() / 1024);
+        double full = 0;
+        for (unsigned scale = 1; scale <= 8; scale *= 2) {
+            double t = msecPerDecode(decoder, jpeg, width, height, scale, iterations);
+            if (scale == 1) full = t;
+            printf("  1/%u %.2f (%.1fx)", scale, t, full / t);
+            if (scale == 8) check(t < full, "scaled IDCT is cheaper");
+        }
+        printf("\n");
+    }
+
+    if (errors) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+    return 0;
+}
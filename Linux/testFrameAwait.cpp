@@ -0,0 +1,168 @@
+//
+//  testFrameAwait.cpp
+//
+//  Dozens of synthetic cameras, each read by its own coroutine, all on one
+//  FrameExecutor thread. Every coroutine must get its camera's frames in
+//  order at close to the camera's rate while the executor thread stays
+//  mostly idle. Then a wait on a camera that never delivers must time out
+//  on time, one with no timeout must end when another thread cancels it, and
+//  a shared stream must be awaitable through its subscriber. A cancellation
+//  that arrives after its stream is gone must not end another stream's wait.
+//
+//  usage: testFrameAwait [streams] [fps] [seconds]
+//
+
+#include "FrameAwait.h"
+#include "SyntheticCapture.h"
+#include "testUtil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <memory>
+#include <thread>
+#include <vector>
+
+struct StreamResult {
+    unsigned frames = 0;
+    unsigned timeouts = 0;
+    bool ordered = true;
+};
+
+static FrameTask ingest(AsyncFrameStream& stream, uint64_t end, StreamResult& r)
+{
+    uint64_t last = 0;
+    while (now_nsec() < end) {
+        AwaitedFrame f = co_await stream.nextFrame(500);
+        if (!f) {
+            r.timeouts++;
+            continue;
+        }
+        if (r.frames && f.frame->sequence <= last) r.ordered = false;
+        last = f.frame->sequence;
+        r.frames++;
+    }
+}
+
+static FrameTask waitOnce(AsyncFrameStream& stream, unsigned timeoutMsec, FrameWaitStatus& status, uint64_t& waitedMsec)
+{
+    uint64_t start = now_nsec();
+    AwaitedFrame f = co_await stream.nextFrame(timeoutMsec);
+    status = f.status;
+    waitedMsec = (now_nsec() - start) / 1000000;
+}
+
+int main(int argc, char * argv[])
+{
+    unsigned numStreams = argc > 1 ? atoi(argv[1]) : 32;
+    unsigned fps = argc > 2 ? atoi(argv[2]) : 30;
+    unsigned seconds = argc > 3 ? atoi(argv[3]) : 2;
+
+    // many cameras, one thread
+    {
+        std::vector<std::unique_ptr<SyntheticCapture> > cams;
+        for (unsigned k = 0; k < numStreams; k++) {
+            cams.push_back(std::unique_ptr<SyntheticCapture>(new SyntheticCapture(fps)));
+            if (!cams.back()->init(320, 180, PANACAST_FRAME_FORMAT_YUYV, NULL)) return -1;
+        }
+
+        FrameExecutor executor;
+        std::vector<std::unique_ptr<AsyncFrameStream> > streams;
+        std::vector<StreamResult> results(numStreams);
+        uint64_t start = now_nsec(), cpuStart = now_nsec(CLOCK_THREAD_CPUTIME_ID);
+        uint64_t end = start + seconds * 1000000000ULL;
+        for (unsigned k = 0; k < numStreams; k++) {
+            streams.push_back(std::unique_ptr<AsyncFrameStream>(new AsyncFrameStream(executor, cams[k].get())));
+            executor.spawn(ingest(*streams[k], end, results[k]));
+        }
+        executor.run();
+        double cpu = (now_nsec(CLOCK_THREAD_CPUTIME_ID) - cpuStart) / 1e9;
+        double wall = (now_nsec() - start) / 1e9;
+
+        unsigned total = 0, fewest = ~0u, timeouts = 0;
+        bool ordered = true;
+        for (unsigned k = 0; k < numStreams; k++) {
+            total += results[k].frames;
+            if (results[k].frames < fewest) fewest = results[k].frames;
+            timeouts += results[k].timeouts;
+            ordered = ordered && results[k].ordered;
+        }
+        printf("%u streams at %u fps on one thread: %u frames in %.2f s, fewest per stream %u, %u timeouts\n",
+               numStreams, fps, total, wall, fewest, timeouts);
+        printf("executor: %llu wake-ups, %.1f ms cpu (%.1f%% of one core)\n", (unsigned long long)executor.wakeups(),
+               cpu * 1000, cpu / wall * 100);
+        check(executor.tasks() == 0, "every task returned");
+        check(ordered, "frames in order");
+        check(fewest >= fps * seconds * 85 / 100 && timeouts == 0, "every stream kept up");
+        // frames arrive close together, one wake-up usually serves several streams
+        check(executor.wakeups() <= total, "wake-ups batch");
+    }
+
+    // timeout, cancellation and a shared stream
+    {
+        SyntheticCapture idle(30), silent(30);
+        SyntheticCapture shared(fps);
+        if (!shared.init(320, 180, PANACAST_FRAME_FORMAT_YUYV, NULL)) return -1;
+        FrameBroadcaster broadcaster(&shared);
+        std::shared_ptr<FrameSubscriber> sub = broadcaster.subscribe(2, FRAME_DROP_OLDEST);
+
+        FrameExecutor executor;
+        // idle and silent are never started, so they never deliver
+        AsyncFrameStream timed(executor, &idle);
+        AsyncFrameStream forever(executor, &silent);
+        AsyncFrameStream subscribed(executor, sub.get());
+
+        FrameWaitStatus timedStatus, cancelStatus, subStatus;
+        uint64_t timedMsec, cancelMsec, subMsec;
+        executor.spawn(waitOnce(timed, 50, timedStatus, timedMsec));
+        executor.spawn(waitOnce(forever, FRAME_WAIT_FOREVER, cancelStatus, cancelMsec));
+        executor.spawn(waitOnce(subscribed, 1000, subStatus, subMsec));
+
+        std::thread canceller([&] {
+            usleep(150000);
+            forever.cancel();
+        });
+        executor.run();
+        canceller.join();
+
+        printf("timeout after %llu ms, cancelled after %llu ms, subscriber frame after %llu ms\n",
+               (unsigned long long)timedMsec, (unsigned long long)cancelMsec, (unsigned long long)subMsec);
+        check(timedStatus == FRAME_WAIT_TIMEOUT && timedMsec >= 50 && timedMsec < 150, "timeout");
+        check(cancelStatus == FRAME_WAIT_CANCELLED && cancelMsec >= 150, "cancel");
+        check(subStatus == FRAME_WAIT_OK, "subscriber");
+
+        // cancellation sticks, later waits end at once
+        FrameWaitStatus again;
+        uint64_t againMsec;
+        executor.spawn(waitOnce(forever, FRAME_WAIT_FOREVER, again, againMsec));
+        executor.run();
+        check(again == FRAME_WAIT_CANCELLED, "cancel sticks");
+        broadcaster.unsubscribe(sub);
+    }
+
+    // a stream destroyed before its cancellation reaches the loop, and a new one most likely
+    // at its address waiting by then: the cancellation must not land on the new one
+    {
+        SyntheticCapture never(30);
+        FrameExecutor executor;
+        AsyncFrameStream * gone = new AsyncFrameStream(executor, &never);
+        std::unique_ptr<AsyncFrameStream> reused;
+        FrameWaitStatus status = FRAME_WAIT_ERROR;
+        uint64_t waitedMsec = 0;
+        executor.post([&] {
+            gone->cancel();
+            delete gone;
+            reused.reset(new AsyncFrameStream(executor, &never));
+            executor.spawn(waitOnce(*reused, 100, status, waitedMsec));
+        });
+        executor.run();
+        check(status == FRAME_WAIT_TIMEOUT && !reused->cancelled(), "cancel of a destroyed stream");
+    }
+
+    if (errors) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+    return 0;
+}
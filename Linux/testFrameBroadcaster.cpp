@@ -0,0 +1,177 @@
+//
+//  testFrameBroadcaster.cpp
+//
+//  Shares one synthetic stream between a fast recorder, a slow preview, a
+//  very slow analytics job and a plain getFrame caller. The recorder must
+//  see every frame even while the others fall behind, each subscriber must
+//  get its frames in order and lose them according to its own policy, and
+//  all of them must be handed the same buffers rather than copies. Then two
+//  stalled subscribers check what each drop policy keeps, and that a
+//  waiting next is not woken empty by the frames they took without waiting.
+//
+//  usage: testFrameBroadcaster [fps] [seconds]
+//
+
+#include "CameraDevice.h"
+#include "testUtil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <atomic>
+#include <map>
+#include <thread>
+#include <vector>
+
+struct Seen {
+    uint64_t sequence;
+    const unsigned char * buf;
+};
+
+static std::atomic<bool> done(false);
+
+static void consume(std::shared_ptr<FrameSubscriber> sub, unsigned holdUsec, std::vector<Seen> * seen)
+{
+    while (!done) {
+        FrameRef frame = sub->next();
+        if (!frame) continue;
+        Seen s = { frame->sequence, frame->buf };
+        seen->push_back(s);
+        if (holdUsec) usleep(holdUsec);
+    }
+}
+
+static bool inOrder(const std::vector<Seen>& seen)
+{
+    for (size_t k = 1; k < seen.size(); k++) {
+        if (seen[k].sequence <= seen[k - 1].sequence) return false;
+    }
+    return true;
+}
+
+int main(int argc, char * argv[])
+{
+    unsigned fps = argc > 1 ? atoi(argv[1]) : 60;
+    unsigned seconds = argc > 2 ? atoi(argv[2]) : 2;
+
+    std::vector<Seen> recorded, previewed, analysed;
+    std::shared_ptr<FrameSubscriber> recorder, preview, analytics;
+    unsigned legacy = 0;
+    {
+        CameraStreamInterface stream("synthetic", 1280, 720, "YUYV", fps);
+        // recorder 4 + preview 1 + analytics 2 + getFrame 1 queued, one held by each, one being written
+        stream.setRingDepth(14);
+        if (!stream.openStream()) return -1;
+
+        recorder = stream.subscribe(4, FRAME_DROP_OLDEST);
+        preview = stream.subscribe(1, FRAME_DROP_OLDEST);
+        analytics = stream.subscribe(2, FRAME_DROP_NEWEST);
+        if (!recorder || !preview || !analytics) return -1;
+
+        std::thread r(consume, recorder, 0, &recorded);
+        std::thread p(consume, preview, 40000, &previewed);
+        std::thread a(consume, analytics, 150000, &analysed);
+
+        // the single-consumer API keeps working next to the subscribers
+        for (unsigned k = 0; k < seconds * 50; k++) {
+            FrameRef frame;
+            if (stream.getFrame(frame)) legacy++;
+            usleep(20000);
+        }
+
+        // frames must be let go before the stream they came from is destroyed
+        done = true;
+        // the recorder stops reading first, its queue would overflow while the slow ones finish
+        r.join();
+        stream.unsubscribe(recorder);
+        p.join();
+        a.join();
+        stream.unsubscribe(preview);
+        stream.unsubscribe(analytics);
+
+        // two stalled subscribers: drop oldest keeps the latest run of frames, drop newest the first
+        std::shared_ptr<FrameSubscriber> latest = stream.subscribe(3, FRAME_DROP_OLDEST);
+        std::shared_ptr<FrameSubscriber> earliest = stream.subscribe(3, FRAME_DROP_NEWEST);
+        usleep(20 * 1000000 / fps);
+        std::vector<Seen> kept[2];
+        std::shared_ptr<FrameSubscriber> stalled[2] = { latest, earliest };
+        for (unsigned k = 0; k < 2; k++) {
+            if (stalled[k]->queued() != 3) errors++;
+            for (unsigned n = 0; n < 3; n++) {
+                FrameRef frame = stalled[k]->next(0);
+                if (!frame) break;
+                Seen s = { frame->sequence, frame->buf };
+                kept[k].push_back(s);
+            }
+            stalled[k]->next(0); // let go of the slot
+        }
+        // next(0) with frames queued does not wait, so frameAvail stays signalled for the frames
+        // it took: a waiting next must sleep through that until a new frame comes
+        {
+            usleep(2 * 1000000 / fps);
+            while (latest->queued()) latest->next(0);
+            FrameRef fresh = latest->next(1000);
+            if (!fresh) {
+                printf("next returned on a stale signal\n");
+                errors++;
+            }
+        }
+
+        bool runs = kept[0].size() == 3 && kept[1].size() == 3 &&
+                    kept[0][2].sequence == kept[0][0].sequence + 2 && kept[1][2].sequence == kept[1][0].sequence + 2;
+        if (!runs || kept[1][2].sequence >= kept[0][0].sequence) {
+            printf("stalled subscribers kept the wrong frames\n");
+            errors++;
+        } else {
+            printf("stalled: drop oldest kept %llu-%llu, drop newest kept %llu-%llu\n",
+                   (unsigned long long)kept[0][0].sequence, (unsigned long long)kept[0][2].sequence,
+                   (unsigned long long)kept[1][0].sequence, (unsigned long long)kept[1][2].sequence);
+        }
+    }
+
+    printf("recorder: %u frames, %llu dropped\n", (unsigned)recorded.size(), (unsigned long long)recorder->framesDropped());
+    printf("preview: %u frames, %llu dropped\n", (unsigned)previewed.size(), (unsigned long long)preview->framesDropped());
+    printf("analytics: %u frames, %llu dropped\n", (unsigned)analysed.size(), (unsigned long long)analytics->framesDropped());
+    printf("getFrame: %u frames\n", legacy);
+
+    // unsubscribing closed them
+    if (!recorder->closed() || !preview->closed() || !analytics->closed() || recorder->next(0)) errors++;
+    if (!inOrder(recorded) || !inOrder(previewed) || !inOrder(analysed)) {
+        printf("frames out of order\n");
+        errors++;
+    }
+
+    // the fast consumer gets a gap-free stream, whatever the slow ones do
+    if (recorder->framesDropped() != 0 || recorded.size() < fps * seconds * 9 / 10) errors++;
+    for (size_t k = 1; k < recorded.size(); k++) {
+        if (recorded[k].sequence != recorded[k - 1].sequence + 1) {
+            printf("recorder missed frames after %llu\n", (unsigned long long)recorded[k - 1].sequence);
+            errors++;
+            break;
+        }
+    }
+
+    // slow consumers drop instead of slowing anyone down
+    if (preview->framesDropped() == 0 || analytics->framesDropped() == 0) errors++;
+    // same buffer for the same frame: shared, not copied
+    std::map<uint64_t, const unsigned char *> byRecorder;
+    for (size_t k = 0; k < recorded.size(); k++) byRecorder[recorded[k].sequence] = recorded[k].buf;
+    unsigned shared = 0, compared = 0;
+    for (size_t k = 0; k < previewed.size(); k++) {
+        std::map<uint64_t, const unsigned char *>::iterator it = byRecorder.find(previewed[k].sequence);
+        if (it == byRecorder.end()) continue;
+        compared++;
+        if (it->second == previewed[k].buf) shared++;
+    }
+    if (compared == 0 || shared != compared) {
+        printf("preview shared %u of %u buffers with the recorder\n", shared, compared);
+        errors++;
+    }
+    if (legacy < seconds * 25) errors++;
+
+    if (errors) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,177 @@
+//
+//  testFrameBufferPool.cpp
+//
+//  Buffers must be aligned, distinct and usable over their full size, the
+//  pool must run dry rather than allocate, and threads hammering acquire and
+//  release must never be handed the same buffer. Then a synthetic stream is
+//  run to steady state and every malloc in the process is counted: there
+//  must be none while frames are flowing.
+//
+//  usage: testFrameBufferPool [threads] [iterations]
+//
+
+#include "FrameBufferPool.h"
+#include "SyntheticCapture.h"
+#include "testUtil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+extern "C" void * __libc_malloc(size_t size);
+extern "C" void * __libc_calloc(size_t n, size_t size);
+extern "C" void * __libc_realloc(void * p, size_t size);
+
+static std::atomic<bool> counting(false);
+static std::atomic<unsigned> allocations(0);
+
+// every heap allocation in the process, operator new included, goes through these
+extern "C" void * malloc(size_t size)
+{
+    if (counting.load(std::memory_order_relaxed)) allocations++;
+    return __libc_malloc(size);
+}
+
+extern "C" void * calloc(size_t n, size_t size)
+{
+    if (counting.load(std::memory_order_relaxed)) allocations++;
+    return __libc_calloc(n, size);
+}
+
+extern "C" void * realloc(void * p, size_t size)
+{
+    if (counting.load(std::memory_order_relaxed)) allocations++;
+    return __libc_realloc(p, size);
+}
+
+int main(int argc, char * argv[])
+{
+    unsigned numThreads = argc > 1 ? atoi(argv[1]) : 4;
+    unsigned iterations = argc > 2 ? atoi(argv[2]) : 200000;
+
+    // layout and exhaustion
+    {
+        size_t size = FrameBufferPool::bufferSizeFor(PANACAST_FRAME_FORMAT_YUYV, 1920, 1080);
+        FrameBufferPool pool(size, 8);
+        check(pool.valid() && pool.available() == 8, "pool mapped");
+
+        std::vector<unsigned char *> bufs;
+        bool aligned = true, disjoint = true;
+        for (unsigned k = 0; k < 8; k++) {
+            unsigned char * b = pool.acquire();
+            if (b == NULL) break;
+            if ((uintptr_t)b % FRAME_POOL_ALIGNMENT) aligned = false;
+            for (size_t j = 0; j < bufs.size(); j++) {
+                if (b < bufs[j] + size && bufs[j] < b + size) disjoint = false;
+            }
+            memset(b, k, size);
+            bufs.push_back(b);
+        }
+        bool intact = bufs.size() == 8;
+        for (size_t k = 0; intact && k < bufs.size(); k++) {
+            intact = bufs[k][0] == k && bufs[k][size - 1] == k;
+        }
+        check(bufs.size() == 8 && aligned && disjoint, "buffers aligned and disjoint");
+        check(intact, "buffers usable over their full size");
+        check(pool.acquire() == NULL && pool.available() == 0, "empty pool returns NULL");
+
+        pool.release(bufs[3]);
+        check(pool.acquire() == bufs[3], "released buffer comes back");
+        unsigned char outside[16];
+        pool.release(outside);
+        check(pool.available() == 0 && !pool.owns(outside) && !pool.owns(bufs[0] + 1), "foreign pointers are refused");
+        for (size_t k = 0; k < bufs.size(); k++) pool.release(bufs[k]);
+        check(pool.available() == 8, "all buffers back");
+    }
+
+    {
+        size_t size = FrameBufferPool::bufferSizeFor(PANACAST_FRAME_FORMAT_NV12, 3840, 2160);
+        FrameBufferPool pool(size, 4, FRAME_POOL_HUGE_PAGES);
+        printf("4K NV12 pool of 4: %s\n", !pool.valid() ? "not mapped" : pool.hugePages() ? "huge pages" : "4 KB pages");
+        check(pool.valid(), "huge page pool mapped, or fell back to normal pages");
+    }
+
+    // contention: each buffer may only ever have one owner
+    {
+        const unsigned count = numThreads + 1;
+        FrameBufferPool pool(4096, count);
+        std::vector<std::atomic<unsigned> > owner(count);
+        std::atomic<unsigned> doubles(0), empties(0);
+        // buffers of exactly one page sit back to back from the lowest one
+        std::vector<unsigned char *> all;
+        unsigned char * base = NULL;
+        while (unsigned char * b = pool.acquire()) {
+            all.push_back(b);
+            if (base == NULL || b < base) base = b;
+        }
+        for (size_t k = 0; k < all.size(); k++) pool.release(all[k]);
+        uint64_t start = now_nsec();
+        std::vector<std::thread> threads;
+        for (unsigned t = 0; t < numThreads; t++) {
+            threads.push_back(std::thread([&, t] {
+                for (unsigned i = 0; i < iterations; i++) {
+                    unsigned char * b = pool.acquire();
+                    if (b == NULL) {
+                        empties++;
+                        continue;
+                    }
+                    unsigned idx = (unsigned)((b - base) / 4096);
+                    if (owner[idx].exchange(t + 1) != 0) doubles++;
+                    b[0] = (unsigned char)t;
+                    if (b[0] != (unsigned char)t) doubles++;
+                    owner[idx] = 0;
+                    pool.release(b);
+                }
+            }));
+        }
+        for (size_t t = 0; t < threads.size(); t++) threads[t].join();
+        double ns = (double)(now_nsec() - start) / ((double)numThreads * iterations);
+        printf("%u threads: %.1f ns per acquire + release, %u double owners, %u empty\n",
+               numThreads, ns, (unsigned)doubles, (unsigned)empties);
+        check(doubles == 0, "no buffer handed out twice");
+        check(empties == 0, "pool never ran dry with one buffer per thread spare");
+        check(pool.available() == count, "all buffers back after contention");
+    }
+
+    // steady-state capture allocates nothing
+    {
+        // the counter has to see operator new, or the zero below means nothing
+        counting = true;
+        delete new std::vector<unsigned>(16);
+        counting = false;
+        check(allocations == 2, "allocations are counted");
+        allocations = 0;
+
+        SyntheticCapture capture(0);
+        if (!capture.init(1280, 720, PANACAST_FRAME_FORMAT_YUYV, NULL)) return -1;
+        FrameBufferPool pool(4096, 2);
+        for (unsigned k = 0; k < 64; k++) {
+            FrameRef frame = capture.nextFrame();
+            pool.release(pool.acquire());
+        }
+
+        counting = true;
+        unsigned frames = 0;
+        for (unsigned k = 0; k < 1000; k++) {
+            FrameRef frame = capture.nextFrame();
+            if (frame) frames++;
+            pool.release(pool.acquire());
+        }
+        counting = false;
+        capture.stopCapture();
+
+        printf("steady state: %u frames, %u heap allocations\n", frames, (unsigned)allocations);
+        check(frames >= 990, "frames delivered");
+        check(allocations == 0, "no heap allocation in steady state");
+    }
+
+    if (errors) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+    return 0;
+}
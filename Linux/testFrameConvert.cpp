@@ -0,0 +1,318 @@
+//
+//  testFrameConvert.cpp
+//
+//  For every pair of formats, every vector kernel the CPU can run must match
+//  the scalar one byte for byte, on random pixels, on widths that leave a
+//  tail for the scalar code and on padded rows; the scalar one must get the
+//  colour bars right, and layout changes must round trip exactly. Synthetic
+//  streams asked for BGR must hand out BGR frames, and a device that only
+//  has YUYV must still deliver the NV12 asked for. Then every pair is timed
+//  at 1080p, and YUYV to RGB at 4K, against the scalar reference.
+//
+//  usage: testFrameConvert [iterations]
+//
+
+#include "CameraDevice.h"
+#include "ConvertCapture.h"
+#include "FakeV4L2Device.h"
+#include "FrameConvert.h"
+#include "testUtil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <random>
+#include <vector>
+
+static const RawFrameFormat inputs[] = {
+    PANACAST_FRAME_FORMAT_YUYV, PANACAST_FRAME_FORMAT_UYVY, PANACAST_FRAME_FORMAT_NV12,
+    PANACAST_FRAME_FORMAT_YV12, PANACAST_FRAME_FORMAT_I420,
+};
+static const RawFrameFormat outputs[] = {
+    PANACAST_FRAME_FORMAT_YUYV, PANACAST_FRAME_FORMAT_UYVY, PANACAST_FRAME_FORMAT_NV12,
+    PANACAST_FRAME_FORMAT_YV12, PANACAST_FRAME_FORMAT_I420,
+    PANACAST_FRAME_FORMAT_BGR24, PANACAST_FRAME_FORMAT_RGB24, PANACAST_FRAME_FORMAT_BGRA32,
+};
+static const unsigned INPUTS = sizeof(inputs) / sizeof(inputs[0]);
+static const unsigned OUTPUTS = sizeof(outputs) / sizeof(outputs[0]);
+
+static const char * formatName(RawFrameFormat format)
+{
+    switch (format) {
+        case PANACAST_FRAME_FORMAT_YUYV: return "YUYV";
+        case PANACAST_FRAME_FORMAT_UYVY: return "UYVY";
+        case PANACAST_FRAME_FORMAT_NV12: return "NV12";
+        case PANACAST_FRAME_FORMAT_YV12: return "YV12";
+        case PANACAST_FRAME_FORMAT_I420: return "I420";
+        case PANACAST_FRAME_FORMAT_BGR24: return "BGR24";
+        case PANACAST_FRAME_FORMAT_RGB24: return "RGB24";
+        case PANACAST_FRAME_FORMAT_BGRA32: return "BGRA32";
+        default: return "?";
+    }
+}
+
+static bool is420(RawFrameFormat format)
+{
+    return format == PANACAST_FRAME_FORMAT_NV12 || format == PANACAST_FRAME_FORMAT_YV12 ||
+           format == PANACAST_FRAME_FORMAT_I420;
+}
+
+static bool isRGB(RawFrameFormat format)
+{
+    return format == PANACAST_FRAME_FORMAT_BGR24 || format == PANACAST_FRAME_FORMAT_RGB24 ||
+           format == PANACAST_FRAME_FORMAT_BGRA32;
+}
+
+// bytes per row of the first plane, and of all planes of a frame with that stride
+static unsigned rowBytes(RawFrameFormat format, unsigned width)
+{
+    if (is420(format)) return width;
+    return format == PANACAST_FRAME_FORMAT_YUYV || format == PANACAST_FRAME_FORMAT_UYVY ? width * 2 :
+           rawFrameSize(format, width, 1);
+}
+
+static size_t frameBytes(RawFrameFormat format, unsigned stride, unsigned height)
+{
+    return is420(format) ? (size_t)stride * height * 3 / 2 : (size_t)stride * height;
+}
+
+static bool matchesScalar(ConvertIsa isa, RawFrameFormat from, RawFrameFormat to, unsigned width, unsigned height, unsigned pad)
+{
+    std::mt19937 rng(width * 31 + height);
+    unsigned srcStride = rowBytes(from, width) + pad, dstStride = rowBytes(to, width) + pad;
+    std::vector<uint8_t> src(frameBytes(from, srcStride, height));
+    for (size_t k = 0; k < src.size(); k++) src[k] = (uint8_t)rng();
+    // the first row walks the corners of the YUV cube, where clamping happens
+    static const uint8_t corner[] = { 0, 16, 235, 255 };
+    for (unsigned x = 0; !is420(from) && x + 2 <= width && x / 2 < 64; x += 2) {
+        unsigned c = x / 2;
+        memset(&src[x * 2], corner[c & 3], 2);
+        src[x * 2 + 2] = corner[(c >> 2) & 3];
+        src[x * 2 + 3] = corner[(c >> 4) & 3];
+    }
+
+    std::vector<uint8_t> want(frameBytes(to, dstStride, height), 0x55), got(want.size(), 0x55);
+    convertFrame(&src[0], srcStride, from, &want[0], dstStride, to, width, height, CONVERT_ISA_SCALAR);
+    convertFrame(&src[0], srcStride, from, &got[0], dstStride, to, width, height, isa);
+    for (size_t k = 0; k < want.size(); k++) {
+        if (want[k] != got[k]) {
+            printf("%s %ux%u %s to %s: byte %zu (row %zu) is %u, scalar %u\n", convertIsaName(isa), width, height,
+                   formatName(from), formatName(to), k, k / dstStride, got[k], want[k]);
+            return false;
+        }
+    }
+    return true;
+}
+
+// from through each of via and back to from must give the frame back unchanged
+static bool roundTrips(RawFrameFormat from, const std::vector<RawFrameFormat>& via, unsigned width, unsigned height)
+{
+    std::mt19937 rng(width + via.size());
+    std::vector<uint8_t> start(frameBytes(from, rowBytes(from, width), height));
+    for (size_t k = 0; k < start.size(); k++) start[k] = (uint8_t)rng();
+    std::vector<uint8_t> cur = start;
+    RawFrameFormat at = from;
+    for (size_t k = 0; k <= via.size(); k++) {
+        RawFrameFormat next = k < via.size() ? via[k] : from;
+        std::vector<uint8_t> out(frameBytes(next, rowBytes(next, width), height));
+        if (!convertFrame(&cur[0], 0, at, &out[0], 0, next, width, height)) return false;
+        cur.swap(out);
+        at = next;
+    }
+    return cur == start;
+}
+
+static bool near(const uint8_t * px, int r, int g, int b)
+{
+    return abs(px[2] - r) <= 2 && abs(px[1] - g) <= 2 && abs(px[0] - b) <= 2;
+}
+
+static double msecPerFrame(ConvertIsa isa, RawFrameFormat from, RawFrameFormat to, unsigned width, unsigned height,
+                           unsigned iterations, std::vector<uint8_t>& src, std::vector<uint8_t>& dst)
+{
+    uint64_t best = UINT64_MAX;
+    for (unsigned k = 0; k < iterations; k++) {
+        uint64_t t0 = now_nsec();
+        convertFrame(&src[0], 0, from, &dst[0], 0, to, width, height, isa);
+        uint64_t t = now_nsec() - t0;
+        if (t < best) best = t;
+    }
+    return best / 1e6;
+}
+
+int main(int argc, char * argv[])
+{
+    unsigned iterations = argc > 1 ? atoi(argv[1]) : 20;
+    ConvertIsa cpu = convertCpuIsa();
+    printf("cpu: %s, converting with %s\n", convertIsaName(cpu), convertIsaName(convertIsa()));
+
+    check(!convertSupported(PANACAST_FRAME_FORMAT_MJPEG, PANACAST_FRAME_FORMAT_BGR24), "no MJPEG");
+    check(!convertSupported(PANACAST_FRAME_FORMAT_BGR24, PANACAST_FRAME_FORMAT_YUYV), "RGB is output only");
+    uint8_t dummy[64];
+    check(!convertFrame(dummy, 0, PANACAST_FRAME_FORMAT_YUYV, dummy, 0, PANACAST_FRAME_FORMAT_BGR24, 3, 1), "odd width");
+    check(!convertFrame(dummy, 0, PANACAST_FRAME_FORMAT_YUYV, dummy, 0, PANACAST_FRAME_FORMAT_NV12, 4, 3), "odd 4:2:0 height");
+
+    for (unsigned isa = CONVERT_ISA_SSE41; isa <= (unsigned)cpu; isa++) {
+        bool ok = true;
+        for (unsigned i = 0; i < INPUTS; i++) {
+            for (unsigned o = 0; o < OUTPUTS; o++) {
+                if (!convertSupported(inputs[i], outputs[o])) continue;
+                ok = matchesScalar((ConvertIsa)isa, inputs[i], outputs[o], 1920, 4, 0) && ok;
+                ok = matchesScalar((ConvertIsa)isa, inputs[i], outputs[o], 2100, 2, 0) && ok;
+                ok = matchesScalar((ConvertIsa)isa, inputs[i], outputs[o], 718, 6, 0) && ok;
+                ok = matchesScalar((ConvertIsa)isa, inputs[i], outputs[o], 130, 4, 36) && ok;
+                ok = matchesScalar((ConvertIsa)isa, inputs[i], outputs[o], 14, 2, 4) && ok;
+            }
+        }
+        printf("%s matches scalar: %s\n", convertIsaName((ConvertIsa)isa), ok ? "yes" : "no");
+        check(ok, "vector kernels match scalar");
+    }
+
+    {
+        std::vector<RawFrameFormat> uyvy(1, PANACAST_FRAME_FORMAT_UYVY), yuyv(1, PANACAST_FRAME_FORMAT_YUYV);
+        std::vector<RawFrameFormat> planar;
+        planar.push_back(PANACAST_FRAME_FORMAT_I420);
+        planar.push_back(PANACAST_FRAME_FORMAT_YV12);
+        check(roundTrips(PANACAST_FRAME_FORMAT_YUYV, uyvy, 718, 4), "YUYV to UYVY and back");
+        check(roundTrips(PANACAST_FRAME_FORMAT_NV12, planar, 718, 4), "NV12 to I420 to YV12 and back");
+        // 4:2:2 repeats each chroma row, so averaging the pair gives it back
+        check(roundTrips(PANACAST_FRAME_FORMAT_NV12, yuyv, 718, 4), "NV12 to YUYV and back");
+        check(roundTrips(PANACAST_FRAME_FORMAT_I420, uyvy, 2100, 2), "I420 to UYVY and back");
+
+        // 4:2:0 to RGB in pieces must equal going through a whole packed frame
+        unsigned width = 2100, height = 4;
+        std::vector<uint8_t> nv12(width * height * 3 / 2), yuyvFrame(width * height * 2);
+        std::vector<uint8_t> direct(width * height * 3), twoStep(width * height * 3);
+        std::mt19937 rng(7);
+        for (size_t k = 0; k < nv12.size(); k++) nv12[k] = (uint8_t)rng();
+        convertFrame(&nv12[0], 0, PANACAST_FRAME_FORMAT_NV12, &direct[0], 0, PANACAST_FRAME_FORMAT_BGR24, width, height);
+        convertFrame(&nv12[0], 0, PANACAST_FRAME_FORMAT_NV12, &yuyvFrame[0], 0, PANACAST_FRAME_FORMAT_YUYV, width, height);
+        convertFrame(&yuyvFrame[0], 0, PANACAST_FRAME_FORMAT_YUYV, &twoStep[0], 0, PANACAST_FRAME_FORMAT_BGR24, width, height);
+        check(direct == twoStep, "NV12 to BGR goes through YUYV");
+    }
+
+    {
+        // white, yellow, cyan, green, magenta, red, blue, black as SyntheticCapture draws them
+        static const uint8_t yuv[8][3] = {
+            {235, 128, 128}, {210, 16, 146}, {170, 166, 16}, {145, 54, 34},
+            {106, 202, 222}, {81, 90, 240}, {41, 240, 110}, {16, 128, 128},
+        };
+        static const int rgb[8][3] = {
+            {255, 255, 255}, {255, 255, 0}, {0, 255, 255}, {0, 255, 0},
+            {255, 0, 255}, {255, 0, 0}, {0, 0, 255}, {0, 0, 0},
+        };
+        bool ok = true;
+        for (unsigned c = 0; c < 8; c++) {
+            uint8_t src[4] = { yuv[c][0], yuv[c][1], yuv[c][0], yuv[c][2] }, dst[6];
+            convertFrame(src, 0, PANACAST_FRAME_FORMAT_YUYV, dst, 0, PANACAST_FRAME_FORMAT_BGR24, 2, 1, CONVERT_ISA_SCALAR);
+            ok = ok && near(dst, rgb[c][0], rgb[c][1], rgb[c][2]) && memcmp(dst, dst + 3, 3) == 0;
+        }
+        check(ok, "colour bars");
+    }
+
+    static const char * streamFormats[] = { "YUYV", "UYVY", "NV12", "I420" };
+    for (unsigned f = 0; f < 4; f++) {
+        CameraStreamInterface stream("synthetic", 1280, 720, streamFormats[f], 30);
+        stream.setOutputFormat("BGR");
+        if (!stream.openStream()) return -1;
+        unsigned frames = 0, want = f ? 10 : 30;
+        bool ok = true;
+        for (unsigned k = 0; k < want; k++) {
+            FrameRef frame;
+            if (!stream.getFrame(frame)) continue;
+            frames++;
+            // bottom left is in the white bar, bottom right in the black one
+            const uint8_t * last = frame->buf + (frame->height - 1) * frame->width * 3;
+            ok = ok && frame->format == PANACAST_FRAME_FORMAT_BGR24 && stream.frameLength(frame.get()) == 1280 * 720 * 3 &&
+                 near(last, 255, 255, 255) && near(last + (frame->width - 1) * 3, 0, 0, 0);
+        }
+        StreamStats s;
+        stream.getStats(s);
+        LatencySummary t;
+        bool timed = stream.getConversionTime(t);
+        printf("%s to BGR stream: %u frames, delivered %llu dropped %llu, conversion p50 %.2f ms\n", streamFormats[f],
+               frames, (unsigned long long)s.delivered, (unsigned long long)s.dropped, t.p50Nsec / 1e6);
+        check(frames >= want * 2 / 3 && ok, "stream hands out BGR");
+        check(timed && t.count > 0, "conversion time is measured");
+    }
+
+    {
+        // nothing converts to MJPEG, but an MJPEG stream asked for BGR is opened as YUYV
+        CameraStreamInterface bad("synthetic", 1280, 720, "YUYV", 30);
+        bad.setOutputFormat("MJPG");
+        check(!bad.openStream(), "unsupported output format refused");
+        CameraStreamInterface mjpeg("synthetic", 1280, 720, "MJPG", 30);
+        mjpeg.setOutputFormat("BGR");
+        FrameRef frame;
+        check(mjpeg.openStream() && mjpeg.getFrame(frame) && frame->format == PANACAST_FRAME_FORMAT_BGR24,
+              "MJPEG stream converted from YUYV");
+
+        // a camera without NV12 still gives NV12 to whoever asks for it
+        FakeV4L2Device * fake = new FakeV4L2Device(30);
+        fake->supportOnly(V4L2_PIX_FMT_YUYV);
+        CaptureInterface * capture = ConvertCapture::open(new V4L2Capture(fake, "/dev/video-fake"), 640, 480,
+                                                          PANACAST_FRAME_FORMAT_NV12, PANACAST_FRAME_FORMAT_NV12, 0, 0, 30);
+        ConvertCapture * convert = dynamic_cast<ConvertCapture *>(capture);
+        check(convert != NULL && convert->inputFormat() == PANACAST_FRAME_FORMAT_YUYV, "falls back to YUYV");
+        unsigned frames = 0;
+        bool ok = true;
+        for (unsigned k = 0; capture && k < 10; k++) {
+            FrameRef frame = capture->nextFrame();
+            if (!frame) continue;
+            frames++;
+            ok = ok && frame->format == PANACAST_FRAME_FORMAT_NV12 && frame->size == 640 * 480 * 3 / 2;
+        }
+        printf("NV12 from a YUYV only device: %u frames\n", frames);
+        check(frames >= 5 && ok, "fallback hands out NV12");
+        delete capture;
+    }
+
+    {
+        // what each pair costs per 1080p frame
+        unsigned width = 1920, height = 1080, scalarRuns = iterations < 5 ? iterations : 5;
+        std::vector<uint8_t> src(width * height * 2), dst(width * height * 4);
+        std::mt19937 rng(1);
+        for (size_t k = 0; k < src.size(); k++) src[k] = (uint8_t)rng();
+        printf("1080p ms per frame, scalar / %s:\n%6s", convertIsaName(cpu), "");
+        for (unsigned o = 0; o < OUTPUTS; o++) printf("%14s", formatName(outputs[o]));
+        printf("\n");
+        for (unsigned i = 0; i < INPUTS; i++) {
+            printf("%6s", formatName(inputs[i]));
+            for (unsigned o = 0; o < OUTPUTS; o++) {
+                double scalar = msecPerFrame(CONVERT_ISA_SCALAR, inputs[i], outputs[o], width, height, scalarRuns, src, dst);
+                double best = msecPerFrame(cpu, inputs[i], outputs[o], width, height, iterations, src, dst);
+                printf("   %5.2f/%5.2f", scalar, best);
+                if (cpu != CONVERT_ISA_SCALAR && isRGB(outputs[o])) check(best * 1.5 < scalar, "vector kernels are faster");
+            }
+            printf("\n");
+        }
+    }
+
+    static const unsigned sizes[2][2] = { {1920, 1080}, {3840, 2160} };
+    for (unsigned s = 0; s < 2; s++) {
+        unsigned width = sizes[s][0], height = sizes[s][1];
+        std::vector<uint8_t> src(width * height * 2), dst(width * height * 4);
+        std::mt19937 rng(1);
+        for (size_t k = 0; k < src.size(); k++) src[k] = (uint8_t)rng();
+
+        for (unsigned o = 5; o < OUTPUTS; o += 2) {
+            double scalar = msecPerFrame(CONVERT_ISA_SCALAR, PANACAST_FRAME_FORMAT_YUYV, outputs[o], width, height, iterations, src, dst);
+            printf("%ux%u YUYV to %s: scalar %.2f ms", width, height, formatName(outputs[o]), scalar);
+            double best = scalar;
+            for (unsigned isa = CONVERT_ISA_SSE41; isa <= (unsigned)cpu; isa++) {
+                double t = msecPerFrame((ConvertIsa)isa, PANACAST_FRAME_FORMAT_YUYV, outputs[o], width, height, iterations, src, dst);
+                printf(", %s %.2f ms (%.1fx)", convertIsaName((ConvertIsa)isa), t, scalar / t);
+                if (t < best) best = t;
+            }
+            printf("\n");
+            if (cpu != CONVERT_ISA_SCALAR) check(best * 1.5 < scalar, "vector kernels are faster");
+        }
+    }
+
+    if (errors) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,122 @@
+//
+//  testFrameHandler.cpp
+//
+//  Push mode next to pull mode on the same synthetic stream: the handler
+//  must see every published frame, on the capture thread, sooner after
+//  capture than a getFrame caller does, while getFrame keeps working. A
+//  FrameRef copied out of the handler must keep its buffer pinned, and no
+//  call may arrive once the handler is removed. Then the same on a V4L2
+//  stream from the fake device, where the handler must get the driver's
+//  buffers themselves.
+//
+//  usage: testFrameHandler [fps] [seconds]
+//
+
+#include "CameraDevice.h"
+#include "FakeV4L2Device.h"
+#include "testUtil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+static double percentile(std::vector<double>& v, unsigned p)
+{
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    return v[v.size() * p / 100];
+}
+
+int main(int argc, char * argv[])
+{
+    unsigned fps = argc > 1 ? atoi(argv[1]) : 60;
+    unsigned seconds = argc > 2 ? atoi(argv[2]) : 2;
+
+    {
+        CameraStreamInterface stream("synthetic", 1280, 720, "YUYV", fps);
+
+        // only touched by the capture thread while the handler is installed
+        std::vector<double> pushLatency;
+        std::vector<uint64_t> pushed;
+        std::thread::id handlerThread;
+        bool oneThread = true;
+        FrameRef kept;
+        std::atomic<unsigned> calls(0);
+        stream.setFrameHandler([&](const FrameRef& frame) {
+            pushLatency.push_back((now_nsec() - frame->timestamp) / 1000.0);
+            pushed.push_back(frame->sequence);
+            if (calls == 0) handlerThread = std::this_thread::get_id();
+            else if (handlerThread != std::this_thread::get_id()) oneThread = false;
+            // keep one frame for the rest of the run
+            if (pushed.size() == 10) kept = frame;
+            calls++;
+        });
+        if (!stream.openStream()) return -1;
+
+        std::vector<double> pullLatency;
+        unsigned pulled = 0;
+        uint64_t end = now_nsec() + seconds * 1000000000ULL;
+        while (now_nsec() < end) {
+            FrameRef frame;
+            if (!stream.getFrame(frame)) continue;
+            pullLatency.push_back((now_nsec() - frame->timestamp) / 1000.0);
+            pulled++;
+        }
+
+        // a frame kept from the handler still holds its own content
+        bool keptIntact = kept && kept->sequence == pushed[9];
+        unsigned char first[64];
+        if (kept) memcpy(first, kept->buf, sizeof(first));
+        usleep(100000);
+        keptIntact = keptIntact && memcmp(first, kept->buf, sizeof(first)) == 0;
+        kept.reset();
+
+        stream.setFrameHandler(FrameHandler());
+        unsigned afterRemoval = calls;
+        usleep(200000);
+
+        bool gapless = true;
+        for (size_t k = 1; k < pushed.size(); k++) {
+            if (pushed[k] != pushed[k - 1] + 1) gapless = false;
+        }
+        unsigned n = (unsigned)pushLatency.size();
+        double push50 = percentile(pushLatency, 50), push99 = percentile(pushLatency, 99);
+        double pull50 = percentile(pullLatency, 50), pull99 = percentile(pullLatency, 99);
+        printf("synthetic: handler %u frames, capture to handler usec p50 %.1f p99 %.1f\n", n, push50, push99);
+        printf("synthetic: getFrame %u frames, capture to getFrame usec p50 %.1f p99 %.1f\n", pulled, pull50, pull99);
+        check(n >= fps * seconds * 9 / 10 && gapless, "handler sees every frame");
+        check(oneThread && handlerThread != std::this_thread::get_id(), "handler runs on the capture thread");
+        check(pulled >= fps * seconds * 8 / 10, "getFrame keeps working");
+        check(push50 <= pull50, "handler is not slower than getFrame");
+        check(keptIntact, "kept frame stays pinned");
+        check(calls == afterRemoval, "no calls after removal");
+    }
+
+    {
+        FakeV4L2Device * fake = new FakeV4L2Device(fps);
+        V4L2Capture capture(fake, "/dev/fake");
+        std::atomic<unsigned> calls(0), foreign(0);
+        capture.setFrameHandler([&](const FrameRef& frame) {
+            if (!fake->ownsAddress(frame->buf)) foreign++;
+            calls++;
+        });
+        if (!capture.init(640, 480, PANACAST_FRAME_FORMAT_YUYV, NULL)) return -1;
+        usleep(seconds * 500000);
+        capture.stopCapture();
+        printf("v4l2: handler %u frames, %u not in a driver buffer\n", (unsigned)calls, (unsigned)foreign);
+        check(calls >= fps * seconds / 2 * 8 / 10 && foreign == 0, "v4l2 handler gets the driver buffers");
+    }
+
+    if (errors) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+    return 0;
+}
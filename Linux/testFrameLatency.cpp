@@ -0,0 +1,162 @@
+//
+//  testFrameLatency.cpp
+//
+//  The histogram first: percentiles of known distributions must come out
+//  within its 1/32 precision, and samples recorded from several threads at
+//  once must all be counted. Then a synthetic stream whose consumer holds
+//  each frame for a while, and a V4L2 stream from the fake device, must
+//  report every stage in order, with the hold time showing up between
+//  acquire and release.
+//
+//  usage: testFrameLatency [fps] [seconds]
+//
+
+#include "CameraDevice.h"
+#include "FakeV4L2Device.h"
+#include "testUtil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <vector>
+
+static bool near(uint64_t got, uint64_t want)
+{
+    uint64_t diff = got > want ? got - want : want - got;
+    return diff * LATENCY_SUB_BUCKETS <= want + LATENCY_SUB_BUCKETS;
+}
+
+static void checkPercentiles(std::vector<uint64_t>& values, const char * what)
+{
+    LatencyHistogram h;
+    for (size_t k = 0; k < values.size(); k++) h.record(values[k]);
+    std::sort(values.begin(), values.end());
+
+    double percents[] = { 50, 90, 99, 99.9 };
+    bool ok = h.count() == values.size();
+    for (unsigned k = 0; k < 4; k++) {
+        size_t rank = (size_t)(percents[k] / 100.0 * values.size() + 0.5);
+        uint64_t want = values[rank ? rank - 1 : 0];
+        uint64_t got = h.percentile(percents[k]);
+        if (!near(got, want)) {
+            printf("%s p%g: histogram %llu, exact %llu\n", what, percents[k], (unsigned long long)got, (unsigned long long)want);
+            ok = false;
+        }
+    }
+    LatencySummary s = h.summary();
+    ok = ok && s.minNsec == values.front() && s.maxNsec == values.back();
+    check(ok, what);
+}
+
+static void printStages(const char * name, CameraStreamInterface& stream)
+{
+    for (unsigned s = FRAME_STAGE_DRIVER; s < FRAME_STAGES; s++) {
+        LatencySummary l;
+        if (!stream.getLatency((FrameStage)s, l) || l.count == 0) continue;
+        printf("%s %-8s %5llu frames, usec p50 %8.1f p99 %8.1f p99.9 %8.1f max %8.1f\n", name,
+               FrameLatencyTrace::stageName((FrameStage)s), (unsigned long long)l.count,
+               l.p50Nsec / 1000.0, l.p99Nsec / 1000.0, l.p999Nsec / 1000.0, l.maxNsec / 1000.0);
+    }
+}
+
+int main(int argc, char * argv[])
+{
+    unsigned fps = argc > 1 ? atoi(argv[1]) : 60;
+    unsigned seconds = argc > 2 ? atoi(argv[2]) : 2;
+
+    {
+        std::mt19937_64 rng(7);
+        std::vector<uint64_t> uniform, exponential;
+        std::uniform_int_distribution<uint64_t> u(1, 50000000);
+        std::exponential_distribution<double> e(1.0 / 2000000);
+        for (unsigned k = 0; k < 200000; k++) {
+            uniform.push_back(u(rng));
+            exponential.push_back((uint64_t)e(rng) + 1);
+        }
+        checkPercentiles(uniform, "uniform percentiles");
+        checkPercentiles(exponential, "exponential percentiles");
+
+        std::vector<uint64_t> small;
+        for (unsigned k = 0; k < 1000; k++) small.push_back(k % 40);
+        checkPercentiles(small, "exact below 32 nsec");
+    }
+
+    {
+        LatencyHistogram h;
+        const unsigned perThread = 500000, numThreads = 4;
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        std::vector<std::thread> threads;
+        for (unsigned t = 0; t < numThreads; t++) {
+            threads.push_back(std::thread([&h, t] {
+                for (unsigned k = 0; k < perThread; k++) h.record(1000 + t * 1000 + k % 1000);
+            }));
+        }
+        for (size_t t = 0; t < threads.size(); t++) threads[t].join();
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        double ns = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / ((double)perThread * numThreads);
+        printf("%u threads: %.1f ns per record\n", numThreads, ns);
+        LatencySummary s = h.summary();
+        check(s.count == perThread * numThreads && s.minNsec == 1000 && s.maxNsec == numThreads * 1000 + 999,
+              "concurrent records all counted");
+        h.reset();
+        check(h.count() == 0 && h.percentile(50) == 0, "reset");
+    }
+
+    const unsigned holdUsec = 3000;
+    {
+        CameraStreamInterface stream("synthetic", 1280, 720, "YUYV", fps);
+        if (!stream.openStream()) return -1;
+        struct timespec start, now;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        do {
+            FrameRef frame;
+            if (stream.getFrame(frame)) usleep(holdUsec);
+            clock_gettime(CLOCK_MONOTONIC, &now);
+        } while (now.tv_sec - start.tv_sec < (time_t)seconds);
+
+        printStages("synthetic", stream);
+        LatencySummary callback, publish, acquire, release;
+        stream.getLatency(FRAME_STAGE_CALLBACK, callback);
+        stream.getLatency(FRAME_STAGE_PUBLISH, publish);
+        stream.getLatency(FRAME_STAGE_ACQUIRE, acquire);
+        stream.getLatency(FRAME_STAGE_RELEASE, release);
+        // a consumer that holds frames and sleeps coarsely misses some, those taken must all be traced
+        check(acquire.count >= fps * seconds / 2 && release.count == acquire.count, "every frame traced");
+        check(callback.p50Nsec <= publish.p50Nsec && publish.p50Nsec <= acquire.p50Nsec, "stages in order");
+        check(acquire.p50Nsec <= acquire.p99Nsec && acquire.p99Nsec <= acquire.p999Nsec && acquire.p999Nsec <= acquire.maxNsec,
+              "percentiles in order");
+        check(release.p50Nsec >= acquire.p50Nsec + holdUsec * 1000, "hold time between acquire and release");
+
+        stream.resetLatency();
+        stream.getLatency(FRAME_STAGE_ACQUIRE, acquire);
+        check(acquire.count <= 1, "reset clears the stream's histograms");
+    }
+
+    {
+        FakeV4L2Device * fake = new FakeV4L2Device(fps);
+        V4L2Capture capture(fake, "/dev/fake");
+        if (!capture.init(640, 480, PANACAST_FRAME_FORMAT_YUYV, NULL)) return -1;
+        for (unsigned k = 0; k < fps * seconds / 2; k++) {
+            FrameRef frame = capture.nextFrame();
+        }
+        capture.stopCapture();
+
+        const FrameLatencyTrace * trace = capture.latencyTrace();
+        LatencySummary driver = trace->summary(FRAME_STAGE_DRIVER), acquire = trace->summary(FRAME_STAGE_ACQUIRE);
+        printf("v4l2: device to driver usec p50 %.1f, device to acquire usec p50 %.1f p99 %.1f\n",
+               driver.p50Nsec / 1000.0, acquire.p50Nsec / 1000.0, acquire.p99Nsec / 1000.0);
+        // the fake device stamps buffers with CLOCK_MONOTONIC like a UVC driver does
+        check(driver.count > 0 && driver.p50Nsec <= acquire.p50Nsec, "v4l2 device and driver stages");
+    }
+
+    if (errors) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+    return 0;
+}
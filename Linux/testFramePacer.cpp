@@ -0,0 +1,150 @@
+//
+//  testFramePacer.cpp
+//
+//  Feeds the pacer simulated device clocks (30 -> 10, 30 -> 12, 60 -> 25,
+//  a jittery 30 -> 15, a stall) and checks that it keeps the right share of
+//  frames with timestamps exactly 1/fps apart. Then V4L2Capture on the fake
+//  device: when it offers the requested rate it is negotiated and nothing
+//  is decimated, when it only offers faster ones the rest is done in
+//  software. Last, a synthetic stream opened
+//  at 24 fps through CameraStreamInterface must report about 24 fps.
+//
+//  usage: testFramePacer [seconds]
+//
+
+#include "CameraDevice.h"
+#include "FakeV4L2Device.h"
+#include "testUtil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+
+// jitter in nsec is a deterministic pseudo random offset of up to +-jitter per frame
+static void simulate(unsigned sourceFps, unsigned targetFps, unsigned frames, uint64_t jitter, const char * name)
+{
+    FramePacer pacer;
+    pacer.setTarget(targetFps);
+
+    uint64_t period = 1000000000ULL / targetFps;
+    uint64_t t0 = 5000000000ULL;
+    unsigned admitted = 0, badSpacing = 0;
+    uint64_t last = 0, maxOffset = 0;
+    uint32_t seed = 12345;
+    for (unsigned k = 0; k < frames; k++) {
+        seed = seed * 1103515245 + 12345;
+        int64_t offset = jitter ? (int64_t)(seed >> 8) % (int64_t)(2 * jitter + 1) - (int64_t)jitter : 0;
+        uint64_t t = t0 + k * 1000000000ULL / sourceFps + offset;
+        uint64_t ts = t;
+        if (!pacer.admit(ts)) continue;
+        if (admitted && ts - last != period) badSpacing++;
+        uint64_t off = ts > t ? ts - t : t - ts;
+        if (off > maxOffset) maxOffset = off;
+        last = ts;
+        admitted++;
+    }
+
+    unsigned expected = (unsigned)((uint64_t)frames * targetFps / sourceFps);
+    unsigned wanted = targetFps < sourceFps ? expected : frames;
+    printf("%s: %u of %u frames, %u expected, %u unevenly spaced, output %.2f fps, frames up to %.1f ms off the grid\n",
+           name, admitted, frames, wanted, badSpacing, pacer.outputRate(), maxOffset / 1e6);
+    check(admitted + 1 >= wanted && admitted <= wanted + 1, name);
+    check(targetFps >= sourceFps || badSpacing == 0, name);
+    // the frame sent is the one nearest the grid point
+    check(maxOffset <= 1000000000ULL / sourceFps / 2 + jitter + 1000, name);
+}
+
+static void stall()
+{
+    FramePacer pacer;
+    pacer.setTarget(10);
+    uint64_t t = 1000000000ULL, ts;
+    unsigned admitted = 0;
+    for (unsigned k = 0; k < 30; k++, t += 33333333) {
+        ts = t;
+        if (pacer.admit(ts)) admitted++;
+    }
+    // a second without frames, the grid must restart instead of letting a burst through
+    t += 1000000000ULL;
+    unsigned burst = 0;
+    for (unsigned k = 0; k < 6; k++, t += 33333333) {
+        ts = t;
+        if (pacer.admit(ts)) burst++;
+    }
+    printf("stall: %u frames after a one second gap\n", burst);
+    check(admitted == 10 && burst == 2, "stall");
+}
+
+static void v4l2(const std::vector<unsigned>& rates, unsigned deviceFps, unsigned fps, unsigned seconds, bool expectDecimation)
+{
+    FakeV4L2Device * dev = new FakeV4L2Device(deviceFps);
+    dev->setFrameRates(rates);
+    V4L2Capture cap(dev, "/dev/video-fake");
+    cap.setFrameRate(fps);
+    if (!cap.init(640, 480, PANACAST_FRAME_FORMAT_YUYV, NULL)) {
+        check(false, "v4l2 init");
+        return;
+    }
+
+    unsigned got = 0, uneven = 0;
+    uint64_t last = 0, period = 1000000000ULL / fps;
+    uint64_t end = (uint64_t)seconds * 1000000;
+    for (uint64_t waited = 0; waited < end; ) {
+        FrameRef frame = cap.nextFrame();
+        if (!frame) {
+            waited += FRAME_AVAILABLE_TIMEOUT_MSEC * 1000;
+            continue;
+        }
+        // while decimating the timestamps sit on the grid, otherwise they are the device's own
+        if (expectDecimation && got && frame->timestamp - last != period) uneven++;
+        last = frame->timestamp;
+        got++;
+        waited += 1000000 / fps;
+    }
+    double achieved = cap.achievedFrameRate();
+    cap.stopCapture();
+
+    printf("v4l2 %u fps requested: device at %.0f fps, %u frames, %llu decimated, achieved %.2f fps\n", fps,
+           cap.deviceFrameRate(), got, (unsigned long long)cap.framesDecimated(), achieved);
+    check(expectDecimation == (cap.framesDecimated() > 0), "v4l2 decimation");
+    check(uneven == 0, "v4l2 grid");
+    check(achieved > fps * 0.9 && achieved < fps * 1.1, "v4l2 achieved rate");
+}
+
+int main(int argc, char * argv[])
+{
+    unsigned seconds = argc > 1 ? atoi(argv[1]) : 2;
+
+    simulate(30, 10, 3000, 0, "30 -> 10");
+    simulate(30, 12, 3000, 0, "30 -> 12");
+    simulate(60, 25, 6000, 0, "60 -> 25");
+    simulate(30, 15, 3000, 4000000, "30 -> 15 jittered");
+    simulate(30, 60, 300, 0, "30 -> 60");
+    stall();
+
+    unsigned r1[] = { 5, 10, 15, 30 };
+    unsigned r2[] = { 30, 60 };
+    // the device can do it, nothing to decimate
+    v4l2(std::vector<unsigned>(r1, r1 + 4), 30, 10, seconds, false);
+    // slowest rate above 10 is 30, the rest is decimated
+    v4l2(std::vector<unsigned>(r2, r2 + 2), 60, 10, seconds, true);
+
+    {
+        CameraStreamInterface stream("synthetic", 640, 360, "YUYV", 24);
+        if (!stream.openStream()) return -1;
+        for (unsigned k = 0; k < seconds * 24; k++) {
+            FrameRef frame;
+            stream.getFrame(frame);
+        }
+        double achieved = stream.achievedFrameRate();
+        printf("synthetic 24 fps requested: achieved %.2f fps\n", achieved);
+        check(achieved > 24 * 0.9 && achieved < 24 * 1.1, "synthetic achieved rate");
+    }
+
+    if (errors) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+    return 0;
+}
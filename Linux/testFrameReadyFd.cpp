@@ -0,0 +1,158 @@
+//
+//  testFrameReadyFd.cpp
+//
+//  One thread epolls three synthetic cameras at different rates, a V4L2
+//  camera on the fake device, a subscriber of a shared stream and a socket,
+//  the way a multi-camera host would. Every camera must deliver its frames
+//  in order through its frame-ready fd, with few wake-ups that find no
+//  frame, and the polling thread must stay nearly idle. A stopped stream's
+//  fd must go quiet once its last frame is taken.
+//
+//  usage: testFrameReadyFd [seconds]
+//
+
+#include "CameraDevice.h"
+#include "FakeV4L2Device.h"
+#include "testUtil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+struct Source {
+    const char * name;
+    unsigned fps;
+    int fd;
+    std::function<FrameRef()> take;
+    unsigned frames;
+    unsigned emptyWakes;
+    bool ordered;
+    uint64_t lastSequence;
+};
+
+int main(int argc, char * argv[])
+{
+    unsigned seconds = argc > 1 ? atoi(argv[1]) : 2;
+
+    CameraStreamInterface cam30("synthetic", 640, 360, "YUYV", 30);
+    CameraStreamInterface cam60("synthetic", 640, 360, "NV12", 60);
+    CameraStreamInterface cam15("synthetic", 1280, 720, "YUYV", 15);
+    CameraStreamInterface shared("synthetic", 640, 360, "YUYV", 30);
+    if (!cam30.openStream() || !cam60.openStream() || !cam15.openStream() || !shared.openStream()) return -1;
+    std::shared_ptr<FrameSubscriber> sub = shared.subscribe(2, FRAME_DROP_OLDEST);
+
+    V4L2Capture v4l2(new FakeV4L2Device(30), "/dev/video-fake");
+    if (!v4l2.init(640, 480, PANACAST_FRAME_FORMAT_YUYV, NULL)) return -1;
+
+    int sockets[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) < 0) return -1;
+
+    Source sources[] = {
+        { "synthetic 30", 30, cam30.frameReadyFd(), [&] { FrameRef f; cam30.tryGetFrame(f); return f; } },
+        { "synthetic 60", 60, cam60.frameReadyFd(), [&] { FrameRef f; cam60.tryGetFrame(f); return f; } },
+        { "synthetic 15", 15, cam15.frameReadyFd(), [&] { FrameRef f; cam15.tryGetFrame(f); return f; } },
+        { "subscriber", 30, sub->frameReadyFd(), [&] { return sub->next(0); } },
+        { "v4l2", 30, v4l2.frameReadyFd(), [&] { return v4l2.tryNextFrame(); } },
+    };
+    const unsigned numSources = sizeof(sources) / sizeof(sources[0]);
+
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    for (unsigned k = 0; k <= numSources; k++) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u32 = k;
+        int fd = k < numSources ? sources[k].fd : sockets[0];
+        if (fd < 0 || epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            printf("cannot poll source %u\n", k);
+            return -1;
+        }
+        if (k < numSources) {
+            sources[k].frames = 0;
+            sources[k].emptyWakes = 0;
+            sources[k].ordered = true;
+            sources[k].lastSequence = 0;
+        }
+    }
+
+    // something that is not a camera in the same loop
+    std::atomic<bool> done(false);
+    std::thread ticker([&] {
+        while (!done) {
+            usleep(100000);
+            char c = 't';
+            if (write(sockets[1], &c, 1) != 1) break;
+        }
+    });
+
+    std::vector<double> latency;
+    unsigned ticks = 0, wakes = 0;
+    uint64_t start = now_nsec(), cpuStart = now_nsec(CLOCK_THREAD_CPUTIME_ID);
+    uint64_t end = start + seconds * 1000000000ULL;
+    while (now_nsec() < end) {
+        struct epoll_event events[8];
+        int n = epoll_wait(ep, events, 8, 100);
+        wakes++;
+        for (int e = 0; e < n; e++) {
+            unsigned k = events[e].data.u32;
+            if (k == numSources) {
+                char c;
+                if (read(sockets[0], &c, 1) == 1) ticks++;
+                continue;
+            }
+            Source& s = sources[k];
+            FrameRef frame = s.take();
+            if (!frame) {
+                s.emptyWakes++;
+                continue;
+            }
+            if (frame->timestamp) latency.push_back((now_nsec() - frame->timestamp) / 1000.0);
+            if (s.frames && frame->sequence <= s.lastSequence) s.ordered = false;
+            s.lastSequence = frame->sequence;
+            s.frames++;
+        }
+    }
+    double cpu = (now_nsec(CLOCK_THREAD_CPUTIME_ID) - cpuStart) / 1e9;
+    double wall = (now_nsec() - start) / 1e9;
+    done = true;
+    ticker.join();
+
+    for (unsigned k = 0; k < numSources; k++) {
+        Source& s = sources[k];
+        printf("%s: %u frames, %u wake-ups without a frame\n", s.name, s.frames, s.emptyWakes);
+        check(s.frames >= s.fps * seconds * 85 / 100 && s.ordered, s.name);
+        check(s.emptyWakes <= s.frames / 20 + 1, "wake-ups without a frame");
+    }
+    std::sort(latency.begin(), latency.end());
+    if (!latency.empty()) {
+        printf("publish to epoll consumer usec: p50 %.1f p99 %.1f max %.1f\n", latency[latency.size() / 2],
+               latency[latency.size() * 99 / 100], latency.back());
+    }
+    printf("poll thread: %u wake-ups, %u socket messages, %.1f ms cpu in %.2f s\n", wakes, ticks, cpu * 1000, wall);
+    check(ticks >= seconds * 5, "socket in the same loop");
+    check(cpu < wall * 0.05, "poll thread stays idle between frames");
+
+    // once the last frame is taken a stopped camera's fd stays quiet
+    v4l2.stopCapture();
+    while (v4l2.tryNextFrame()) ;
+    struct pollfd pfd = { sources[4].fd, POLLIN, 0 };
+    check(poll(&pfd, 1, 200) == 0, "stopped stream fd goes quiet");
+
+    shared.unsubscribe(sub);
+    close(ep);
+    close(sockets[0]);
+    close(sockets[1]);
+    if (errors) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+    return 0;
+}
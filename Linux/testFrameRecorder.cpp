@@ -0,0 +1,111 @@
+//
+//  testFrameRecorder.cpp
+//
+//  Appends 4K YUYV frames to a segmented recording as fast as one core
+//  allows, which must be at least MIN_RECORD_FPS (or minFps when given),
+//  then replays every segment to check the data and the index.
+//
+//  usage: testFrameRecorder [file] [frames] [segmentMB] [minFps]
+//
+
+#include "FrameRecorder.h"
+#include "ReplayCapture.h"
+#include "SyntheticCapture.h"
+#include "testUtil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+#define WIDTH  3840
+#define HEIGHT 2160
+// the camera's 4K rate: recording must keep up with the device
+#define MIN_RECORD_FPS 30
+
+int main(int argc, char * argv[])
+{
+    std::string path = argc > 1 ? argv[1] : "testFrameRecorder.pcs";
+    unsigned count = argc > 2 ? atoi(argv[2]) : 120;
+    uint64_t segmentBytes = (argc > 3 ? atoi(argv[3]) : 512) * (1ULL << 20);
+    unsigned minFps = argc > 4 ? atoi(argv[4]) : MIN_RECORD_FPS;
+
+    // grab one real synthetic frame to record
+    SyntheticCapture source(0);
+    if (!source.init(WIDTH, HEIGHT, PANACAST_FRAME_FORMAT_YUYV, NULL)) return -1;
+    FrameRef captured;
+    while (!(captured = source.nextFrame())) ;
+    unsigned size = rawFrameSize(PANACAST_FRAME_FORMAT_YUYV, WIDTH, HEIGHT);
+    std::vector<unsigned char> pixels(captured->buf, captured->buf + size);
+    captured.reset();
+    source.stopCapture();
+
+    RawFrame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.buf = &pixels[0];
+    frame.format = PANACAST_FRAME_FORMAT_YUYV;
+    frame.width = WIDTH;
+    frame.height = HEIGHT;
+
+    FrameRecorder recorder;
+    if (!recorder.open(path, segmentBytes, 1024)) return -1;
+
+    uint64_t worst = 0;
+    uint64_t start = now_nsec();
+    for (unsigned k = 0; k < count; k++) {
+        memcpy(&pixels[0], &k, sizeof(k));
+        uint64_t t = now_nsec();
+        if (!recorder.append(&frame, 1000 + k)) errors++;
+        t = now_nsec() - t;
+        if (t > worst) worst = t;
+    }
+    recorder.close();
+    double elapsed = (now_nsec() - start) / 1e9;
+
+    printf("recorded %llu %ux%u YUYV frames into %u segments in %.2f s: %.1f fps, %.0f MB/s, worst append %.1f ms\n",
+           (unsigned long long)recorder.framesWritten(), WIDTH, HEIGHT, recorder.segments(), elapsed,
+           count / elapsed, recorder.bytesWritten() / elapsed / 1e6, worst / 1e6);
+    if (count / elapsed < minFps) {
+        printf("below the %u fps floor\n", minFps);
+        errors++;
+    }
+
+    // read every segment back
+    unsigned expected = 0;
+    for (unsigned s = 0; s < recorder.segments(); s++) {
+        char name[4096];
+        if (s == 0) snprintf(name, sizeof(name), "%s", path.c_str());
+        else snprintf(name, sizeof(name), "%s.%u", path.c_str(), s);
+
+        {
+            ReplayCapture replay(name, REPLAY_FAST, false);
+            if (!replay.init(WIDTH, HEIGHT, PANACAST_FRAME_FORMAT_YUYV, NULL)) {
+                errors++;
+            } else {
+                for (uint64_t n = 0; n < replay.frameCount(); n++) {
+                    FrameRef f;
+                    while (!(f = replay.nextFrame())) ;
+                    unsigned k;
+                    memcpy(&k, f->buf, sizeof(k));
+                    if (k != expected || memcmp(f->buf + 64, &pixels[64], size - 64) != 0) {
+                        printf("segment %u frame %llu: expected frame %u\n", s, (unsigned long long)n, expected);
+                        errors++;
+                    }
+                    expected++;
+                }
+            }
+        }
+        remove(name);
+    }
+    if (expected != count) {
+        printf("replayed %u of %u frames\n", expected, count);
+        errors++;
+    }
+
+    if (errors) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,189 @@
+//
+//  testFrameRing.cpp
+//
+//  Stress test and benchmark for FrameRing. A synthetic producer thread
+//  publishes stamped frames at a fixed rate (or as fast as it can with fps 0)
+//  while several consumers pin, verify and release them. With abandonEvery
+//  the producer also fills every abandonEvery-th slot it claims with a
+//  rejected frame and abandons it, as backends do with broken or still
+//  frames: no consumer may ever see one.
+//
+//  usage: testFrameRing [depth] [consumers] [fps] [seconds] [holdUsec] [abandonEvery]
+//
+
+#include "FrameRing.h"
+#include "utils.h"
+#include "testUtil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#define FRAME_WIDTH  1920
+#define FRAME_HEIGHT 1080
+#define FRAME_SIZE   (FRAME_WIDTH * FRAME_HEIGHT * 2)
+
+struct FrameStamp {
+    uint64_t sequence;
+    uint64_t publishNsec;
+};
+
+struct Consumer {
+    std::unique_ptr<OSEvent> frameAvail;
+    std::vector<uint64_t> latencies;
+    uint64_t frames;
+    uint64_t skipped;
+    uint64_t errors;
+};
+
+static std::atomic<bool> running(true);
+
+// what an abandoned slot is stamped with
+#define REJECTED_SEQUENCE (~0ULL)
+
+static void producer(FrameRing * ring, std::vector<Consumer> * consumers, unsigned fps, unsigned abandonEvery,
+                     uint64_t * published, uint64_t * abandoned)
+{
+    uint64_t interval = fps ? 1000000000ULL / fps : 0;
+    uint64_t next = now_nsec();
+    uint64_t claimed = 0;
+
+    while (running) {
+        RawFrame * frame = ring->claim();
+        if (frame != NULL) {
+            if (frame->buf == NULL) {
+                frame->buf = (unsigned char *)malloc(FRAME_SIZE);
+                frame->size = FRAME_SIZE;
+                frame->format = PANACAST_FRAME_FORMAT_YUYV;
+                frame->width = FRAME_WIDTH;
+                frame->height = FRAME_HEIGHT;
+            }
+            // stamp both ends of the buffer so a consumer can spot a torn frame
+            FrameStamp stamp;
+            bool reject = abandonEvery && ++claimed % abandonEvery == 0;
+            stamp.sequence = reject ? REJECTED_SEQUENCE : ring->lastSequence() + 1;
+            stamp.publishNsec = now_nsec();
+            memcpy(frame->buf, &stamp, sizeof(stamp));
+            memcpy(frame->buf + FRAME_SIZE - sizeof(stamp), &stamp, sizeof(stamp));
+            if (reject) {
+                ring->abandon(frame);
+                (*abandoned)++;
+                continue;
+            }
+            ring->publish(frame);
+            (*published)++;
+
+            for (size_t k = 0; k < consumers->size(); k++) {
+                (*consumers)[k].frameAvail->Signal();
+            }
+        }
+
+        if (interval) {
+            next += interval;
+            uint64_t t = now_nsec();
+            if (next > t) usleep((next - t) / 1000);
+        }
+    }
+}
+
+// poll: spin on acquire instead of waiting to be told, the harder on slots the producer recycles
+static void consumer(FrameRing * ring, Consumer * c, unsigned holdUsec, bool poll)
+{
+    uint64_t last = 0;
+
+    while (running) {
+        if (!poll && c->frameAvail->TimedWait(100) != OSEvent_Error_None) continue;
+
+        RawFrame * frame = ring->acquire(last);
+        if (frame == NULL) continue;
+
+        uint64_t t = now_nsec();
+        FrameStamp head, tail;
+        memcpy(&head, frame->buf, sizeof(head));
+        memcpy(&tail, frame->buf + FRAME_SIZE - sizeof(tail), sizeof(tail));
+        if (head.sequence != frame->sequence || tail.sequence != frame->sequence) c->errors++;
+
+        if (last && frame->sequence > last + 1) c->skipped += frame->sequence - last - 1;
+        last = frame->sequence;
+        c->latencies.push_back(t - head.publishNsec);
+
+        // pretend to convert the frame, then make sure the producer left it alone
+        if (holdUsec) usleep(holdUsec);
+        memcpy(&head, frame->buf, sizeof(head));
+        if (head.sequence != frame->sequence) c->errors++;
+
+        ring->release(frame);
+        c->frames++;
+    }
+}
+
+static double percentile(std::vector<uint64_t>& v, double p)
+{
+    if (v.empty()) return 0;
+    size_t idx = (size_t)(p * (v.size() - 1));
+    return v[idx] / 1000.0;
+}
+
+int main(int argc, char * argv[])
+{
+    unsigned depth = argc > 1 ? atoi(argv[1]) : FRAME_RING_DEFAULT_DEPTH;
+    unsigned numConsumers = argc > 2 ? atoi(argv[2]) : 3;
+    unsigned fps = argc > 3 ? atoi(argv[3]) : 60;
+    unsigned seconds = argc > 4 ? atoi(argv[4]) : 3;
+    unsigned holdUsec = argc > 5 ? atoi(argv[5]) : 2000;
+    unsigned abandonEvery = argc > 6 ? atoi(argv[6]) : 0;
+
+    FrameRing ring(depth);
+    printf("depth %u, consumers %u, fps %u%s, %u s, hold %u usec, abandon every %u\n", ring.depth(), numConsumers,
+           fps, fps ? "" : " (unthrottled)", seconds, holdUsec, abandonEvery);
+
+    std::vector<Consumer> consumers(numConsumers);
+    for (unsigned k = 0; k < numConsumers; k++) {
+        int sts;
+        consumers[k].frameAvail.reset(new OSEvent(sts, false, false));
+        consumers[k].frames = consumers[k].skipped = consumers[k].errors = 0;
+    }
+
+    uint64_t published = 0, abandoned = 0;
+    uint64_t start = now_nsec();
+    std::vector<std::thread> threads;
+    for (unsigned k = 0; k < numConsumers; k++) {
+        threads.push_back(std::thread(consumer, &ring, &consumers[k], holdUsec, abandonEvery != 0));
+    }
+    std::thread p(producer, &ring, &consumers, fps, abandonEvery, &published, &abandoned);
+
+    sleep(seconds);
+    running = false;
+    p.join();
+    for (size_t k = 0; k < threads.size(); k++) threads[k].join();
+    double elapsed = (now_nsec() - start) / 1e9;
+
+    printf("published %llu frames (%.1f fps), abandoned %llu, dropped %llu (all slots pinned)\n",
+           (unsigned long long)published, published / elapsed, (unsigned long long)abandoned,
+           (unsigned long long)ring.dropped());
+
+    uint64_t bad = 0;
+    for (unsigned k = 0; k < numConsumers; k++) {
+        Consumer& c = consumers[k];
+        std::sort(c.latencies.begin(), c.latencies.end());
+        printf("consumer %u: %llu frames (%.1f fps), skipped %llu, latency usec p50 %.1f p99 %.1f max %.1f\n",
+               k, (unsigned long long)c.frames, c.frames / elapsed, (unsigned long long)c.skipped,
+               percentile(c.latencies, 0.5), percentile(c.latencies, 0.99), percentile(c.latencies, 1.0));
+        bad += c.errors;
+    }
+
+    for (unsigned k = 0; k < ring.depth(); k++) free(ring.slot(k)->buf);
+
+    if (bad) {
+        printf("FAILED: %llu torn, overwritten or abandoned frames\n", (unsigned long long)bad);
+        return -1;
+    }
+    printf("OK\n");
+    return 0;
+}
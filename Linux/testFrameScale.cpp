@@ -0,0 +1,300 @@
+//
+//  testFrameScale.cpp
+//
+//  Every vector kernel must scale exactly like the scalar one, integer
+//  ratios must give the plain box average of a naive reference, other
+//  ratios the area average to within one level, and bands on workers what
+//  a single thread gives. A gradient must keep its shape where a source row
+//  weighs only a 256th or two of an output row, and more than 256 to 1 is
+//  refused. Streams asked for a smaller size must hand out frames of that
+//  size, converted after scaling when asked for RGB. Then 4K and 1080p
+//  frames are timed down to preview sizes.
+//
+//  usage: testFrameScale [iterations]
+//
+
+#include "CameraDevice.h"
+#include "FrameScale.h"
+#include "testUtil.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+
+// one channel of a frame: width x height samples at offset + x step + y stride
+struct Channel {
+    const uint8_t * base;
+    unsigned step;
+    unsigned stride;
+    unsigned width;
+    unsigned height;
+
+    double at(unsigned x, unsigned y) const { return base[(size_t)y * stride + (size_t)x * step]; }
+};
+
+// the channels of a packed frame, Y U V for YUYV and Y UV-interleaved for NV12
+static unsigned channels(const uint8_t * buf, RawFrameFormat format, unsigned width, unsigned height, Channel * c)
+{
+    if (format == PANACAST_FRAME_FORMAT_YUYV) {
+        Channel y = { buf, 2, width * 2, width, height }, u = { buf + 1, 4, width * 2, width / 2, height },
+                v = { buf + 3, 4, width * 2, width / 2, height };
+        c[0] = y;
+        c[1] = u;
+        c[2] = v;
+        return 3;
+    }
+    const uint8_t * uv = buf + (size_t)width * height;
+    Channel y = { buf, 1, width, width, height }, u = { uv, 2, width, width / 2, height / 2 },
+            v = { uv + 1, 2, width, width / 2, height / 2 };
+    c[0] = y;
+    c[1] = u;
+    c[2] = v;
+    return 3;
+}
+
+// area average of output sample (x, y), in floating point
+static double areaAverage(const Channel& in, unsigned dstW, unsigned dstH, unsigned x, unsigned y)
+{
+    double sx = (double)in.width / dstW, sy = (double)in.height / dstH;
+    double x0 = x * sx, x1 = x0 + sx, y0 = y * sy, y1 = y0 + sy;
+    double sum = 0;
+    for (unsigned r = (unsigned)y0; r < y1 && r < in.height; r++) {
+        double h = std::min(y1, r + 1.0) - std::max(y0, (double)r);
+        for (unsigned c = (unsigned)x0; c < x1 && c < in.width; c++) {
+            double w = std::min(x1, c + 1.0) - std::max(x0, (double)c);
+            sum += w * h * in.at(c, r);
+        }
+    }
+    return sum / (sx * sy);
+}
+
+// largest difference to the area average, with integer ratios rounded like the scaler
+static double worstError(RawFrameFormat format, unsigned srcW, unsigned srcH, unsigned dstW, unsigned dstH)
+{
+    std::vector<uint8_t> src = randomFrame(rawFrameSize(format, srcW, srcH), srcW + dstW);
+    std::vector<uint8_t> dst(rawFrameSize(format, dstW, dstH));
+    if (!scaleFrame(&src[0], 0, srcW, srcH, &dst[0], 0, dstW, dstH, format)) return 1e9;
+    Channel in[3], out[3];
+    unsigned n = channels(&src[0], format, srcW, srcH, in);
+    channels(&dst[0], format, dstW, dstH, out);
+    double worst = 0;
+    for (unsigned c = 0; c < n; c++) {
+        for (unsigned y = 0; y < out[c].height; y++) {
+            for (unsigned x = 0; x < out[c].width; x++) {
+                double want = areaAverage(in[c], out[c].width, out[c].height, x, y);
+                worst = std::max(worst, fabs(out[c].at(x, y) - floor(want + 0.5)));
+            }
+        }
+    }
+    return worst;
+}
+
+static bool matchesScalar(ConvertIsa isa, RawFrameFormat format, unsigned srcW, unsigned srcH, unsigned dstW, unsigned dstH,
+                          unsigned pad)
+{
+    unsigned srcStride = (format == PANACAST_FRAME_FORMAT_NV12 ? srcW : srcW * 2) + pad;
+    unsigned dstStride = (format == PANACAST_FRAME_FORMAT_NV12 ? dstW : dstW * 2) + pad;
+    bool nv12 = format == PANACAST_FRAME_FORMAT_NV12;
+    std::vector<uint8_t> src = randomFrame(nv12 ? (size_t)srcStride * srcH * 3 / 2 : (size_t)srcStride * srcH, srcW);
+    // all white rows, the largest sums there are
+    memset(&src[0], 255, srcStride * 2);
+    std::vector<uint8_t> want(nv12 ? (size_t)dstStride * dstH * 3 / 2 : (size_t)dstStride * dstH, 0x55), got(want);
+    FrameScaler scaler;
+    if (!scaler.configure(format, srcW, srcH, dstW, dstH)) return false;
+    scaler.scale(&src[0], srcStride, &want[0], dstStride, NULL, CONVERT_ISA_SCALAR);
+    scaler.scale(&src[0], srcStride, &got[0], dstStride, NULL, isa);
+    return want == got;
+}
+
+static bool matchesSerial(FrameWorkers& workers, RawFrameFormat format, unsigned srcW, unsigned srcH, unsigned dstW, unsigned dstH)
+{
+    std::vector<uint8_t> src = randomFrame(rawFrameSize(format, srcW, srcH), dstH);
+    std::vector<uint8_t> want(rawFrameSize(format, dstW, dstH), 0x55), got(want);
+    FrameScaler scaler;
+    if (!scaler.configure(format, srcW, srcH, dstW, dstH)) return false;
+    scaler.scale(&src[0], 0, &want[0], 0);
+    scaler.scale(&src[0], 0, &got[0], 0, &workers);
+    return want == got;
+}
+
+static double msecPerFrame(ConvertIsa isa, RawFrameFormat format, unsigned srcW, unsigned srcH, unsigned dstW, unsigned dstH,
+                           unsigned iterations)
+{
+    std::vector<uint8_t> src = randomFrame(rawFrameSize(format, srcW, srcH), 1);
+    std::vector<uint8_t> dst(rawFrameSize(format, dstW, dstH));
+    FrameScaler scaler;
+    scaler.configure(format, srcW, srcH, dstW, dstH);
+    std::vector<uint64_t> times;
+    for (unsigned k = 0; k < iterations; k++) {
+        uint64_t t0 = now_nsec();
+        scaler.scale(&src[0], 0, &dst[0], 0, NULL, isa);
+        times.push_back(now_nsec() - t0);
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2] / 1e6;
+}
+
+static bool near(const uint8_t * p, int b, int g, int r)
+{
+    return abs(p[0] - b) <= 2 && abs(p[1] - g) <= 2 && abs(p[2] - r) <= 2;
+}
+
+int main(int argc, char * argv[])
+{
+    unsigned iterations = argc > 1 ? atoi(argv[1]) : 20;
+    ConvertIsa cpu = convertIsa();
+    printf("scaling with %s\n", convertIsaName(cpu));
+
+    for (unsigned isa = CONVERT_ISA_SSE41; isa <= (unsigned)cpu; isa++) {
+        bool ok = matchesScalar((ConvertIsa)isa, PANACAST_FRAME_FORMAT_YUYV, 1920, 1080, 640, 360, 0) &&
+                  matchesScalar((ConvertIsa)isa, PANACAST_FRAME_FORMAT_NV12, 1920, 1080, 320, 180, 0) &&
+                  matchesScalar((ConvertIsa)isa, PANACAST_FRAME_FORMAT_YUYV, 1278, 722, 500, 280, 6) &&
+                  matchesScalar((ConvertIsa)isa, PANACAST_FRAME_FORMAT_NV12, 1000, 512, 998, 2, 10) &&
+                  matchesScalar((ConvertIsa)isa, PANACAST_FRAME_FORMAT_UYVY, 38, 512, 2, 2, 2);
+        printf("%s matches scalar: %s\n", convertIsaName((ConvertIsa)isa), ok ? "yes" : "no");
+        check(ok, "vector kernels match scalar");
+    }
+
+    check(worstError(PANACAST_FRAME_FORMAT_YUYV, 1920, 1080, 640, 360) == 0, "YUYV 3:1 is the box average");
+    check(worstError(PANACAST_FRAME_FORMAT_NV12, 1280, 720, 320, 180) == 0, "NV12 4:1 is the box average");
+    check(worstError(PANACAST_FRAME_FORMAT_NV12, 640, 480, 640, 240) == 0, "NV12 rows only");
+    double yuyv = worstError(PANACAST_FRAME_FORMAT_YUYV, 1280, 720, 500, 280);
+    double nv12 = worstError(PANACAST_FRAME_FORMAT_NV12, 1280, 720, 426, 240);
+    printf("area average at other ratios within %.0f (YUYV), %.0f (NV12)\n", yuyv, nv12);
+    check(yuyv <= 1 && nv12 <= 1, "other ratios are the area average");
+
+    {
+        // flat colours stay exactly what they were, whatever the weights
+        std::vector<uint8_t> src(rawFrameSize(PANACAST_FRAME_FORMAT_NV12, 1280, 720)), dst(rawFrameSize(PANACAST_FRAME_FORMAT_NV12, 426, 238));
+        memset(&src[0], 81, 1280 * 720);
+        for (size_t k = 1280 * 720; k < src.size(); k += 2) {
+            src[k] = 90;
+            src[k + 1] = 240;
+        }
+        bool ok = scaleFrame(&src[0], 0, 1280, 720, &dst[0], 0, 426, 238, PANACAST_FRAME_FORMAT_NV12);
+        for (size_t k = 0; k < dst.size(); k++) ok = ok && dst[k] == (k < 426 * 238 ? 81 : (k & 1) ? 240 : 90);
+        check(ok, "flat frame stays flat");
+    }
+
+    {
+        // a vertical gradient at ratios where a source row is worth one or two 256ths of an
+        // output row: every output row must still be the average of its band
+        const unsigned srcW = 3840, srcH = 2160;
+        std::vector<uint8_t> src((size_t)srcW * srcH * 2);
+        for (unsigned y = 0; y < srcH; y++) memset(&src[(size_t)y * srcW * 2], 16 + y * 224 / srcH, srcW * 2);
+        static const unsigned sizes[][2] = { { 16, 10 }, { 26, 14 }, { 40, 24 } };
+        for (unsigned s = 0; s < 3; s++) {
+            unsigned dstW = sizes[s][0], dstH = sizes[s][1];
+            std::vector<uint8_t> dst((size_t)dstW * dstH * 2);
+            bool ok = scaleFrame(&src[0], 0, srcW, srcH, &dst[0], 0, dstW, dstH, PANACAST_FRAME_FORMAT_YUYV);
+            Channel in[3];
+            channels(&src[0], PANACAST_FRAME_FORMAT_YUYV, srcW, srcH, in);
+            for (unsigned y = 0; y < dstH; y++) {
+                double want = areaAverage(in[0], dstW, dstH, 0, y);
+                ok = ok && fabs(dst[(size_t)y * dstW * 2] - want) <= 1.5;
+            }
+            char what[64];
+            snprintf(what, sizeof(what), "gradient down to %ux%u", dstW, dstH);
+            check(ok, what);
+        }
+        FrameScaler scaler;
+        check(!scaler.configure(PANACAST_FRAME_FORMAT_YUYV, srcW, srcH, 8, 8), "more than 256 to 1 refused");
+        check(scaler.configure(PANACAST_FRAME_FORMAT_UYVY, 512, 512, 2, 2), "256 to 1");
+    }
+
+    {
+        FrameScaler scaler;
+        check(!scaler.configure(PANACAST_FRAME_FORMAT_YUYV, 640, 360, 1280, 720), "no upscaling");
+        check(!scaler.configure(PANACAST_FRAME_FORMAT_YUYV, 1280, 720, 641, 360), "odd YUYV width refused");
+        check(!scaler.configure(PANACAST_FRAME_FORMAT_NV12, 1280, 720, 640, 361), "odd NV12 height refused");
+        check(!scaler.configure(PANACAST_FRAME_FORMAT_MJPEG, 1280, 720, 640, 360), "MJPEG refused");
+        check(scaler.configure(PANACAST_FRAME_FORMAT_YUYV, 1280, 720, 640, 361) && scaler.configured(), "odd YUYV height");
+        check(scaleFrame(randomFrame(1280 * 720 * 3, 5).data(), 0, 1280, 720, std::vector<uint8_t>(427 * 241 * 3).data(), 0,
+                         427, 241, PANACAST_FRAME_FORMAT_BGR24), "packed RGB scales to any size");
+    }
+
+    for (unsigned threads = 2; threads <= FRAME_WORKERS_MAX; threads *= 2) {
+        FrameWorkers workers(threads);
+        bool same = matchesSerial(workers, PANACAST_FRAME_FORMAT_YUYV, 3840, 2160, 640, 360) &&
+                    matchesSerial(workers, PANACAST_FRAME_FORMAT_NV12, 3840, 2160, 320, 180) &&
+                    matchesSerial(workers, PANACAST_FRAME_FORMAT_I420, 1920, 1080, 700, 394) &&
+                    matchesSerial(workers, PANACAST_FRAME_FORMAT_UYVY, 1920, 1080, 1918, 1078);
+        check(same, "bands match a single thread");
+    }
+
+    {
+        CameraStreamInterface stream("synthetic", 1920, 1080, "YUYV", 30);
+        stream.setOutputSize(640, 360);
+        check(stream.openStream(), "scaled stream opens");
+        unsigned frames = 0;
+        bool ok = true;
+        for (unsigned k = 0; k < 15; k++) {
+            FrameRef frame;
+            if (!stream.getFrame(frame)) continue;
+            frames++;
+            ok = ok && frame->format == PANACAST_FRAME_FORMAT_YUYV && frame->width == 640 && frame->height == 360 &&
+                 stream.frameLength(frame.get()) == 640 * 360 * 2;
+        }
+        check(frames >= 10 && ok, "stream hands out 640x360 YUYV");
+    }
+
+    static const char * streamFormats[] = { "YUYV", "NV12" };
+    for (unsigned f = 0; f < 2; f++) {
+        CameraStreamInterface stream("synthetic", 1280, 720, streamFormats[f], 30);
+        stream.setOutputFormat("BGR");
+        stream.setOutputSize(320, 180);
+        if (!stream.openStream()) return -1;
+        unsigned frames = 0;
+        bool ok = true;
+        for (unsigned k = 0; k < 10; k++) {
+            FrameRef frame;
+            if (!stream.getFrame(frame)) continue;
+            frames++;
+            // bottom left is in the white bar, bottom right in the black one
+            const uint8_t * last = frame->buf + (frame->height - 1) * frame->width * 3;
+            ok = ok && frame->format == PANACAST_FRAME_FORMAT_BGR24 && frame->width == 320 && frame->height == 180 &&
+                 near(last, 255, 255, 255) && near(last + (frame->width - 1) * 3, 0, 0, 0);
+        }
+        LatencySummary t;
+        stream.getConversionTime(t);
+        printf("%s 1280x720 to 320x180 BGR stream: %u frames, scale and convert p50 %.2f ms\n", streamFormats[f], frames,
+               t.p50Nsec / 1e6);
+        check(frames >= 6 && ok, "stream hands out scaled BGR");
+    }
+
+    {
+        CameraStreamInterface bad("synthetic", 640, 360, "YUYV", 30);
+        bad.setOutputSize(1280, 720);
+        check(!bad.openStream(), "larger output size refused");
+    }
+
+    static const struct {
+        RawFrameFormat format;
+        const char * name;
+        unsigned srcW, srcH, dstW, dstH;
+    } runs[] = {
+        { PANACAST_FRAME_FORMAT_YUYV, "YUYV", 3840, 2160, 640, 360 },
+        { PANACAST_FRAME_FORMAT_NV12, "NV12", 3840, 2160, 320, 180 },
+        { PANACAST_FRAME_FORMAT_YUYV, "YUYV", 1920, 1080, 640, 360 },
+        { PANACAST_FRAME_FORMAT_YUYV, "YUYV", 1920, 1080, 500, 280 },
+        { PANACAST_FRAME_FORMAT_NV12, "NV12", 1920, 1080, 426, 240 },
+    };
+    for (unsigned r = 0; r < sizeof(runs) / sizeof(runs[0]); r++) {
+        double scalar = msecPerFrame(CONVERT_ISA_SCALAR, runs[r].format, runs[r].srcW, runs[r].srcH, runs[r].dstW,
+                                     runs[r].dstH, iterations);
+        double best = msecPerFrame(cpu, runs[r].format, runs[r].srcW, runs[r].srcH, runs[r].dstW, runs[r].dstH, iterations);
+        printf("%s %ux%u to %ux%u: scalar %.2f ms, %s %.2f ms (%.1fx)\n", runs[r].name, runs[r].srcW, runs[r].srcH,
+               runs[r].dstW, runs[r].dstH, scalar, convertIsaName(cpu), best, scalar / best);
+        if (cpu != CONVERT_ISA_SCALAR) check(best < scalar, "vector kernels are faster");
+    }
+
+    if (errors) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,231 @@
+//
+//  testFrameTensor.cpp
+//
+//  A tensor must hold exactly what scaling the frame, converting it to RGB
+//  and normalizing each sample one step at a time gives, for every camera
+//  format and packed RGB, in float32 and int8, RGB and BGR plane order, on
+//  one thread and on several. Streams, MJPEG decoded ones too, must hand
+//  out tensors of colour bars. Then 1080p and 4K YUYV are timed into a
+//  224x224 and a 640x384 tensor, against the convert, resize and normalize
+//  steps done one after the other over the whole frame.
+//
+//  usage: testFrameTensor [iterations]
+//
+
+#include "CameraDevice.h"
+#include "FrameTensor.h"
+#include "testUtil.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+
+// ImageNet's, on the 0..255 scale, in RGB order
+static TensorLayout imagenet(unsigned width, unsigned height, TensorType type, bool bgr)
+{
+    static const float mean[3] = { 123.675f, 116.28f, 103.53f }, stddev[3] = { 58.395f, 57.12f, 57.375f };
+    TensorLayout layout(width, height, type);
+    layout.bgr = bgr;
+    layout.scale = 1.0f / 32;
+    for (unsigned p = 0; p < 3; p++) {
+        layout.mean[p] = mean[bgr ? 2 - p : p];
+        layout.stddev[p] = stddev[bgr ? 2 - p : p];
+    }
+    return layout;
+}
+
+// one step at a time: scale, convert to BGR, then normalize every sample into its plane
+static std::vector<uint8_t> reference(const std::vector<uint8_t>& frame, RawFrameFormat format, unsigned width, unsigned height,
+                                      const TensorLayout& layout)
+{
+    unsigned w = layout.width, h = layout.height;
+    std::vector<uint8_t> small(rawFrameSize(format, w, h));
+    if (w == width && h == height) small = frame;
+    else scaleFrame(&frame[0], 0, width, height, &small[0], 0, w, h, format);
+    std::vector<uint8_t> bgr((size_t)w * h * 4);
+    unsigned bpp = format == PANACAST_FRAME_FORMAT_BGRA32 ? 4 : 3;
+    if (format == PANACAST_FRAME_FORMAT_BGR24 || format == PANACAST_FRAME_FORMAT_RGB24 || format == PANACAST_FRAME_FORMAT_BGRA32) {
+        bgr = small;
+    } else {
+        convertFrame(&small[0], 0, format, &bgr[0], 0, PANACAST_FRAME_FORMAT_BGR24, w, h);
+    }
+    std::vector<uint8_t> tensor(layout.bytes());
+    for (unsigned p = 0; p < 3; p++) {
+        // which of B, G, R plane p holds, and where that is in a pixel
+        unsigned colour = layout.bgr ? p : 2 - p;
+        unsigned offset = format == PANACAST_FRAME_FORMAT_RGB24 ? 2 - colour : colour;
+        for (size_t k = 0; k < (size_t)w * h; k++) {
+            float value = ((float)bgr[k * bpp + offset] - layout.mean[p]) / layout.stddev[p];
+            size_t at = p * (size_t)w * h + k;
+            if (layout.type == TENSOR_FLOAT32) {
+                memcpy(&tensor[at * 4], &value, 4);
+            } else {
+                float q = rintf(value / layout.scale);
+                tensor[at] = (uint8_t)(int8_t)(q < -128 ? -128 : q > 127 ? 127 : q);
+            }
+        }
+    }
+    return tensor;
+}
+
+static bool matches(RawFrameFormat format, unsigned width, unsigned height, const TensorLayout& layout, FrameWorkers * workers)
+{
+    std::vector<uint8_t> frame = randomFrame(rawFrameSize(format, width, height), width + format);
+    FrameTensorizer tensorizer;
+    if (!tensorizer.configure(format, width, height, layout)) return false;
+    std::vector<uint8_t> tensor(layout.bytes() + 16, 0x55);
+    if (!tensorizer.convert(&frame[0], 0, &tensor[0], workers)) return false;
+    for (unsigned k = 0; k < 16; k++) {
+        if (tensor[layout.bytes() + k] != 0x55) return false;
+    }
+    tensor.resize(layout.bytes());
+    return tensor == reference(frame, format, width, height, layout);
+}
+
+// value of plane p at x, y of a float32 tensor
+static float at(const std::vector<float>& tensor, const TensorLayout& layout, unsigned p, unsigned x, unsigned y)
+{
+    return tensor[((size_t)p * layout.height + y) * layout.width + x];
+}
+
+// bottom left of the colour bars is white, bottom right black
+static bool colourBars(const std::vector<float>& tensor, const TensorLayout& layout)
+{
+    bool ok = true;
+    for (unsigned p = 0; p < 3; p++) {
+        ok = ok && at(tensor, layout, p, 0, layout.height - 1) > 200 && at(tensor, layout, p, layout.width - 1, layout.height - 1) < 40;
+    }
+    return ok;
+}
+
+static double msec(uint64_t nsec) { return nsec / 1e6; }
+
+int main(int argc, char * argv[])
+{
+    unsigned iterations = argc > 1 ? atoi(argv[1]) : 20;
+    FrameWorkers workers(4);
+
+    static const RawFrameFormat formats[] = {
+        PANACAST_FRAME_FORMAT_YUYV, PANACAST_FRAME_FORMAT_UYVY, PANACAST_FRAME_FORMAT_NV12, PANACAST_FRAME_FORMAT_YV12,
+        PANACAST_FRAME_FORMAT_I420, PANACAST_FRAME_FORMAT_BGR24, PANACAST_FRAME_FORMAT_RGB24, PANACAST_FRAME_FORMAT_BGRA32,
+    };
+    for (unsigned f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+        bool ok = true;
+        for (unsigned t = 0; t < 2; t++) {
+            TensorType type = t ? TENSOR_INT8 : TENSOR_FLOAT32;
+            for (unsigned bgr = 0; bgr < 2; bgr++) {
+                ok = ok && matches(formats[f], 640, 360, imagenet(224, 224, type, bgr), NULL);
+                ok = ok && matches(formats[f], 640, 360, imagenet(640, 360, type, bgr), NULL);
+                ok = ok && matches(formats[f], 1920, 1080, imagenet(416, 234, type, bgr), &workers);
+            }
+        }
+        char what[64];
+        snprintf(what, sizeof(what), "tensor of format %d", formats[f]);
+        check(ok, what);
+    }
+
+    {
+        // plain pixel values: both orders hold the same planes the other way round
+        std::vector<uint8_t> frame = randomFrame(rawFrameSize(PANACAST_FRAME_FORMAT_NV12, 640, 360), 7);
+        TensorLayout rgb(320, 180), bgr(320, 180);
+        bgr.bgr = true;
+        FrameTensorizer a, b;
+        std::vector<float> ta(rgb.bytes() / 4), tb(bgr.bytes() / 4);
+        bool ok = a.configure(PANACAST_FRAME_FORMAT_NV12, 640, 360, rgb) && b.configure(PANACAST_FRAME_FORMAT_NV12, 640, 360, bgr) &&
+                  a.convert(&frame[0], 0, &ta[0]) && b.convert(&frame[0], 0, &tb[0]);
+        size_t plane = (size_t)320 * 180;
+        ok = ok && std::equal(ta.begin(), ta.begin() + plane, tb.begin() + 2 * plane) &&
+             std::equal(ta.begin() + plane, ta.begin() + 2 * plane, tb.begin() + plane) &&
+             std::equal(ta.begin() + 2 * plane, ta.end(), tb.begin());
+        check(ok, "RGB and BGR plane order");
+    }
+
+    {
+        FrameTensorizer tensorizer;
+        TensorLayout layout(320, 180), zero(320, 180), quantized(320, 180, TENSOR_INT8);
+        zero.stddev[1] = 0;
+        quantized.scale = 0;
+        check(!tensorizer.configure(PANACAST_FRAME_FORMAT_MJPEG, 1280, 720, layout), "MJPEG refused");
+        check(!tensorizer.configure(PANACAST_FRAME_FORMAT_YUYV, 160, 90, layout), "larger tensor refused");
+        check(!tensorizer.configure(PANACAST_FRAME_FORMAT_YUYV, 1280, 720, TensorLayout(223, 224)), "odd width refused");
+        check(!tensorizer.configure(PANACAST_FRAME_FORMAT_YUYV, 1280, 720, zero), "zero stddev refused");
+        check(!tensorizer.configure(PANACAST_FRAME_FORMAT_YUYV, 1280, 720, quantized), "zero int8 scale refused");
+        check(!tensorizer.configuredFor(PANACAST_FRAME_FORMAT_YUYV, 1280, 720, layout), "nothing configured after refusals");
+        check(tensorizer.configure(PANACAST_FRAME_FORMAT_RGB24, 1280, 720, TensorLayout(223, 224)), "odd width of packed RGB");
+    }
+
+    {
+        CameraStreamInterface stream("synthetic", 1280, 720, "YUYV", 30);
+        TensorLayout layout(320, 180);
+        std::vector<float> tensor(layout.bytes() / 4);
+        check(stream.openStream() && stream.getTensor(layout, &tensor[0]) && colourBars(tensor, layout), "tensor of a stream");
+        check(stream.getTensor(imagenet(224, 224, TENSOR_FLOAT32, false), &tensor[0]), "layout changed between frames");
+        check(!stream.getTensor(TensorLayout(1920, 1080), &tensor[0]), "tensor larger than the stream refused");
+    }
+
+#ifdef PANACAST_MJPEG_DECODE
+    {
+        CameraStreamInterface stream("synthetic", 1920, 1080, "MJPG", 30);
+        stream.setOutputFormat("YUYV");
+        stream.setOutputSize(480, 270);
+        stream.setDecodeThreads(2);
+        TensorLayout layout(224, 224);
+        std::vector<float> tensor(layout.bytes() / 4);
+        check(stream.openStream() && stream.getTensor(layout, &tensor[0]) && colourBars(tensor, layout),
+              "tensor of a decoded MJPEG stream");
+    }
+#endif
+
+    static const unsigned sizes[2][4] = { {1920, 1080, 224, 224}, {3840, 2160, 640, 384} };
+    for (unsigned s = 0; s < 2; s++) {
+        unsigned width = sizes[s][0], height = sizes[s][1];
+        TensorLayout layout = imagenet(sizes[s][2], sizes[s][3], TENSOR_FLOAT32, false);
+        std::vector<uint8_t> frame = randomFrame(rawFrameSize(PANACAST_FRAME_FORMAT_YUYV, width, height), s);
+        std::vector<uint8_t> tensor(layout.bytes());
+        FrameTensorizer tensorizer;
+        tensorizer.configure(PANACAST_FRAME_FORMAT_YUYV, width, height, layout);
+
+        // what the Python side did: BGR at full size, resized, then normalized into planes
+        std::vector<uint8_t> bgr((size_t)width * height * 3), small((size_t)layout.width * layout.height * 3);
+        FrameScaler scaler;
+        scaler.configure(PANACAST_FRAME_FORMAT_BGR24, width, height, layout.width, layout.height);
+
+        std::vector<uint64_t> fused, fusedParallel, steps;
+        for (unsigned k = 0; k < iterations; k++) {
+            uint64_t t0 = now_nsec();
+            tensorizer.convert(&frame[0], 0, &tensor[0]);
+            uint64_t t1 = now_nsec();
+            tensorizer.convert(&frame[0], 0, &tensor[0], &workers);
+            uint64_t t2 = now_nsec();
+            convertFrame(&frame[0], 0, PANACAST_FRAME_FORMAT_YUYV, &bgr[0], 0, PANACAST_FRAME_FORMAT_BGR24, width, height);
+            scaler.scale(&bgr[0], 0, &small[0], 0);
+            float * out = (float *)&tensor[0];
+            size_t plane = (size_t)layout.width * layout.height;
+            for (unsigned p = 0; p < 3; p++) {
+                for (size_t i = 0; i < plane; i++) out[p * plane + i] = (small[i * 3 + 2 - p] - layout.mean[p]) / layout.stddev[p];
+            }
+            uint64_t t3 = now_nsec();
+            fused.push_back(t1 - t0);
+            fusedParallel.push_back(t2 - t1);
+            steps.push_back(t3 - t2);
+        }
+        std::sort(fused.begin(), fused.end());
+        std::sort(fusedParallel.begin(), fusedParallel.end());
+        std::sort(steps.begin(), steps.end());
+        unsigned mid = iterations / 2;
+        printf("%ux%u YUYV to %ux%u float32 tensor, median ms: fused %.2f, on %u threads %.2f, step by step %.2f\n",
+               width, height, layout.width, layout.height, msec(fused[mid]), workers.threads(), msec(fusedParallel[mid]),
+               msec(steps[mid]));
+        check(fused[mid] < steps[mid], "fused is faster");
+    }
+
+    if (errors) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+    return 0;
+}
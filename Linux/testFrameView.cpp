@@ -0,0 +1,142 @@
+//
+//  testFrameView.cpp
+//
+//  A crop of a frame in every YUV layout and in BGR, copied out and turned
+//  into BGR, must be exactly that rectangle of the whole frame turned into
+//  BGR; crops of crops must land where one crop would. Rectangles grow to
+//  whole chroma samples and may not leave the frame. A view must keep its
+//  buffer out of the ring while later frames come in. Then cropping is
+//  timed against copying the frame.
+//
+//  usage: testFrameView [iterations]
+//
+
+#include "CameraDevice.h"
+#include "FrameConvert.h"
+#include "FrameView.h"
+#include "testUtil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+static std::vector<uint8_t> toBGR(const uint8_t * buf, RawFrameFormat format, unsigned width, unsigned height)
+{
+    std::vector<uint8_t> bgr((size_t)width * height * 3);
+    if (format == PANACAST_FRAME_FORMAT_BGR24) memcpy(&bgr[0], buf, bgr.size());
+    else convertFrame(buf, 0, format, &bgr[0], 0, PANACAST_FRAME_FORMAT_BGR24, width, height);
+    return bgr;
+}
+
+// the crop, packed and in BGR, against the same rectangle of the whole frame in BGR
+static bool sameAsWhole(const FrameView& crop, const std::vector<uint8_t>& whole, unsigned frameWidth)
+{
+    std::vector<uint8_t> packed(rawFrameSize(crop.format, crop.width, crop.height));
+    crop.copyTo(&packed[0]);
+    std::vector<uint8_t> bgr = toBGR(&packed[0], crop.format, crop.width, crop.height);
+    for (unsigned r = 0; r < crop.height; r++) {
+        if (memcmp(&bgr[(size_t)r * crop.width * 3], &whole[((size_t)(crop.y + r) * frameWidth + crop.x) * 3], crop.width * 3)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char * argv[])
+{
+    unsigned iterations = argc > 1 ? atoi(argv[1]) : 20;
+
+    static const char * outputs[] = { "YUYV", "UYVY", "NV12", "I420", "YV12", "BGR" };
+    for (unsigned f = 0; f < sizeof(outputs) / sizeof(outputs[0]); f++) {
+        CameraStreamInterface stream("synthetic", 1280, 720, "YUYV", 30);
+        stream.setOutputFormat(outputs[f]);
+        if (!stream.openStream()) return -1;
+        FrameRef frame;
+        if (!stream.getFrame(frame)) return -1;
+        bool yuv420 = frame->format == PANACAST_FRAME_FORMAT_NV12 || frame->format == PANACAST_FRAME_FORMAT_I420 ||
+                      frame->format == PANACAST_FRAME_FORMAT_YV12;
+        bool packed422 = frame->format == PANACAST_FRAME_FORMAT_YUYV || frame->format == PANACAST_FRAME_FORMAT_UYVY;
+        std::vector<uint8_t> whole = toBGR(frame->buf, frame->format, 1280, 720);
+
+        FrameView view, crop, inner, direct;
+        check(view.view(frame) && view.width == 1280 && view.height == 720, "view of the whole frame");
+        check(view.planes == (yuv420 ? (frame->format == PANACAST_FRAME_FORMAT_NV12 ? 2u : 3u) : 1u), "plane count");
+        check(sameAsWhole(view, whole, 1280), "whole view is the frame");
+
+        // odd corners grow to whole chroma samples
+        bool ok = view.crop(101, 51, 300, 199, crop);
+        unsigned x = packed422 || yuv420 ? 100 : 101, y = yuv420 ? 50 : 51;
+        unsigned w = packed422 || yuv420 ? 302 : 300, h = yuv420 ? 200 : 199;
+        check(ok && crop.x == x && crop.y == y && crop.width == w && crop.height == h, "crop grows to chroma samples");
+        check(ok && crop.frame.get() == frame.get() && crop.plane[0].data >= frame->buf, "crop points into the frame");
+        check(ok && sameAsWhole(crop, whole, 1280), "crop is that rectangle of the frame");
+
+        // a crop of a crop is the crop of the frame at the added offset
+        ok = crop.crop(20, 10, 64, 32, inner) && view.crop(crop.x + 20, crop.y + 10, 64, 32, direct);
+        check(ok && inner.x == direct.x && inner.y == direct.y && inner.plane[0].data == direct.plane[0].data &&
+              inner.plane[view.planes - 1].data == direct.plane[view.planes - 1].data && sameAsWhole(inner, whole, 1280),
+              "crop of a crop");
+        check(view.crop(1278, 718, 2, 2, inner) && sameAsWhole(inner, whole, 1280), "bottom right corner");
+
+        check(!view.crop(1200, 0, 81, 16, inner) && !view.crop(0, 700, 16, 21, inner) && !view.crop(0, 0, 0, 16, inner) &&
+              !view.crop(~0u, 0, 16, 16, inner) && !view.crop(0, 0, 1281, 720, inner), "crops outside the frame refused");
+        if (yuv420) check(view.crop(0, 719, 16, 1, inner) && inner.y == 718 && inner.height == 2, "last row grows upwards");
+    }
+
+    {
+        // the view pins its buffer: later frames go to other slots
+        CameraStreamInterface stream("synthetic", 640, 360, "YUYV", 120);
+        if (!stream.openStream()) return -1;
+        FrameView view, crop;
+        {
+            FrameRef frame;
+            check(stream.getFrame(frame) && view.view(frame) && view.crop(64, 64, 128, 128, crop), "view a frame");
+        }
+        view = FrameView();
+        std::vector<uint8_t> before(rawFrameSize(crop.format, crop.width, crop.height)), after(before.size());
+        crop.copyTo(&before[0]);
+        uint64_t sequence = crop.frame->sequence;
+        for (unsigned k = 0; k < 10; k++) {
+            FrameRef frame;
+            stream.getFrame(frame);
+        }
+        crop.copyTo(&after[0]);
+        check(crop.frame->sequence == sequence && before == after, "view keeps its frame");
+
+        FrameRef none;
+        check(!view.view(none), "no view of no frame");
+    }
+
+    {
+        CameraStreamInterface stream("synthetic", 1280, 720, "MJPG", 30);
+        FrameRef frame;
+        FrameView view;
+        check(stream.openStream() && stream.getFrame(frame) && !view.view(frame), "MJPEG frames have no view");
+    }
+
+    {
+        CameraStreamInterface stream("synthetic", 3840, 2160, "NV12", 30);
+        FrameRef frame;
+        if (!stream.openStream() || !stream.getFrame(frame)) return -1;
+        FrameView view, crop;
+        view.view(frame);
+        unsigned runs = iterations * 1000;
+        uint64_t t0 = now_nsec();
+        for (unsigned k = 0; k < runs; k++) view.crop(k & 1023, 100, 1280, 720, crop);
+        double cropNsec = (double)(now_nsec() - t0) / runs;
+        std::vector<uint8_t> copy(rawFrameSize(PANACAST_FRAME_FORMAT_NV12, 3840, 2160));
+        t0 = now_nsec();
+        for (unsigned k = 0; k < iterations; k++) memcpy(&copy[0], frame->buf, copy.size());
+        double copyNsec = (double)(now_nsec() - t0) / iterations;
+        printf("4K NV12: cropping 1280x720 %.0f ns, copying the frame %.2f ms\n", cropNsec, copyNsec / 1e6);
+        check(cropNsec * 100 < copyNsec, "cropping costs nothing next to copying");
+    }
+
+    if (errors) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+    return 0;
+}
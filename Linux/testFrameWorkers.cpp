@@ -0,0 +1,156 @@
+//
+//  testFrameWorkers.cpp
+//
+//  Every band of every run must be done exactly once, also with several
+//  threads calling run at the same time, and the pool must neither start
+//  threads nor allocate per frame. Converting in bands on any number of
+//  workers must give what a single thread gives. Then YUYV and NV12 to BGR
+//  at 3840x1080 and 4K are timed per frame against the worker count.
+//
+//  usage: testFrameWorkers [iterations]
+//
+
+#include "FrameConvert.h"
+#include "FrameWorkers.h"
+#include "testUtil.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+extern "C" void * __libc_malloc(size_t size);
+
+static std::atomic<bool> counting(false);
+static std::atomic<unsigned> allocations(0);
+
+// operator new goes through this too
+extern "C" void * malloc(size_t size)
+{
+    if (counting.load(std::memory_order_relaxed)) allocations++;
+    return __libc_malloc(size);
+}
+
+static unsigned threadsInProcess()
+{
+    unsigned n = 0;
+    DIR * dir = opendir("/proc/self/task");
+    if (dir == NULL) return 0;
+    while (struct dirent * entry = readdir(dir)) {
+        if (entry->d_name[0] != '.') n++;
+    }
+    closedir(dir);
+    return n;
+}
+
+static bool bandsOnce(FrameWorkers& workers, unsigned runs, unsigned bands)
+{
+    std::vector<std::atomic<unsigned> > done(bands);
+    bool ok = true;
+    for (unsigned r = 0; r < runs; r++) {
+        for (unsigned b = 0; b < bands; b++) done[b] = 0;
+        workers.run(bands, [&done](unsigned band) { done[band]++; });
+        for (unsigned b = 0; b < bands; b++) ok = ok && done[b] == 1;
+    }
+    return ok;
+}
+
+static bool matchesSerial(FrameWorkers& workers, RawFrameFormat from, RawFrameFormat to, unsigned width, unsigned height)
+{
+    std::vector<uint8_t> src = randomFrame((size_t)width * height * 2, width);
+    std::vector<uint8_t> want((size_t)width * height * 4, 0x55), got(want.size(), 0x55);
+    convertFrame(&src[0], 0, from, &want[0], 0, to, width, height);
+    convertFrameParallel(workers, &src[0], 0, from, &got[0], 0, to, width, height);
+    return want == got;
+}
+
+static double msecPerFrame(FrameWorkers& workers, RawFrameFormat from, unsigned width, unsigned height, unsigned iterations)
+{
+    std::vector<uint8_t> src = randomFrame((size_t)width * height * 2, width), dst((size_t)width * height * 3);
+    std::vector<uint64_t> times;
+    for (unsigned k = 0; k < iterations; k++) {
+        uint64_t t0 = now_nsec();
+        convertFrameParallel(workers, &src[0], 0, from, &dst[0], 0, PANACAST_FRAME_FORMAT_BGR24, width, height);
+        times.push_back(now_nsec() - t0);
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2] / 1e6;
+}
+
+int main(int argc, char * argv[])
+{
+    unsigned iterations = argc > 1 ? atoi(argv[1]) : 20;
+    unsigned cores = std::thread::hardware_concurrency();
+    printf("%u cores, converting with %s\n", cores, convertIsaName(convertIsa()));
+
+    {
+        FrameWorkers automatic;
+        check(automatic.threads() == std::min(std::max(cores, 1u), (unsigned)FRAME_WORKERS_MAX), "one thread per core");
+        check(FrameWorkers::bandRows(19200, 2) == 12 && FrameWorkers::bandRows(1 << 20, 2) == 2, "band rows");
+    }
+
+    for (unsigned threads = 1; threads <= FRAME_WORKERS_MAX; threads *= 2) {
+        FrameWorkers workers(threads);
+        check(workers.threads() == threads, "thread count");
+        check(bandsOnce(workers, 200, 37) && bandsOnce(workers, 200, 1) && bandsOnce(workers, 10, 0), "every band once");
+
+        // two streams sharing a pool take turns
+        bool ok0 = false, ok1 = false;
+        std::thread other([&] { ok1 = bandsOnce(workers, 300, 13); });
+        ok0 = bandsOnce(workers, 300, 29);
+        other.join();
+        check(ok0 && ok1, "concurrent runs");
+
+        unsigned before = threadsInProcess();
+        std::vector<uint8_t> src = randomFrame(3840 * 1080 * 2, 3840), dst(3840 * 1080 * 3);
+        allocations = 0;
+        counting = true;
+        for (unsigned k = 0; k < 20; k++) {
+            convertFrameParallel(workers, &src[0], 0, PANACAST_FRAME_FORMAT_YUYV, &dst[0], 0, PANACAST_FRAME_FORMAT_BGR24,
+                                 3840, 1080);
+        }
+        counting = false;
+        check(threadsInProcess() == before, "no threads started per frame");
+        check(allocations == 0, "no allocation per frame");
+
+        bool same = matchesSerial(workers, PANACAST_FRAME_FORMAT_YUYV, PANACAST_FRAME_FORMAT_BGR24, 3840, 1080) &&
+                    matchesSerial(workers, PANACAST_FRAME_FORMAT_UYVY, PANACAST_FRAME_FORMAT_BGRA32, 1920, 1081) &&
+                    matchesSerial(workers, PANACAST_FRAME_FORMAT_NV12, PANACAST_FRAME_FORMAT_RGB24, 3840, 1080) &&
+                    matchesSerial(workers, PANACAST_FRAME_FORMAT_YUYV, PANACAST_FRAME_FORMAT_I420, 1920, 1080) &&
+                    matchesSerial(workers, PANACAST_FRAME_FORMAT_NV12, PANACAST_FRAME_FORMAT_YV12, 3840, 2160) &&
+                    matchesSerial(workers, PANACAST_FRAME_FORMAT_YV12, PANACAST_FRAME_FORMAT_YV12, 640, 6) &&
+                    matchesSerial(workers, PANACAST_FRAME_FORMAT_YUYV, PANACAST_FRAME_FORMAT_BGR24, 64, 1);
+        check(same, "bands match a single thread");
+    }
+
+    static const unsigned sizes[2][2] = { {3840, 1080}, {3840, 2160} };
+    static const RawFrameFormat formats[2] = { PANACAST_FRAME_FORMAT_YUYV, PANACAST_FRAME_FORMAT_NV12 };
+    for (unsigned s = 0; s < 2; s++) {
+        for (unsigned f = 0; f < 2; f++) {
+            unsigned width = sizes[s][0], height = sizes[s][1];
+            printf("%ux%u %s to BGR, median ms per frame:", width, height, f ? "NV12" : "YUYV");
+            double single = 0, four = 0;
+            for (unsigned threads = 1; threads <= FRAME_WORKERS_MAX; threads *= 2) {
+                FrameWorkers workers(threads);
+                double t = msecPerFrame(workers, formats[f], width, height, iterations);
+                if (threads == 1) single = t;
+                if (threads == 4) four = t;
+                printf("  %u: %.2f (%.1fx)", threads, t, single / t);
+            }
+            printf("\n");
+            // only meaningful with the cores to run on
+            if (cores >= 4) check(four * 2 < single, "4 workers at least twice as fast");
+        }
+    }
+
+    if (errors) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+    return 0;
+}
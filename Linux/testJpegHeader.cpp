@@ -0,0 +1,225 @@
+//
+//  testJpegHeader.cpp
+//
+//  parseJpegHeader must read size, sampling factors and restart interval
+//  out of the synthetic camera's frames and libjpeg's baseline and
+//  progressive ones, allow zero padding after EOI and refuse truncated and
+//  malformed frames without reading past them. A recording with broken and
+//  mis-sized frames mixed in is replayed: only the good frames may reach
+//  the consumer, with their header attached, and the others must show up
+//  as corrupt in getStats. Then the check is timed on a 4K frame.
+//
+//  usage: testJpegHeader [stream file] [iterations]
+//
+
+#include "CameraDevice.h"
+#include "FrameRecorder.h"
+#include "JpegHeader.h"
+#include "ReplayCapture.h"
+#include "SyntheticCapture.h"
+#include "testUtil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <random>
+#include <string>
+#include <vector>
+#include <jpeglib.h>
+
+static std::vector<uint8_t> encodeJpeg(unsigned width, unsigned height, bool yuv420, unsigned restartInterval, bool progressive)
+{
+    std::vector<uint8_t> rgb((size_t)width * height * 3);
+    for (size_t k = 0; k < rgb.size(); k++) rgb[k] = (uint8_t)(k * 7 / 3);
+
+    jpeg_compress_struct cinfo;
+    jpeg_error_mgr err;
+    cinfo.err = jpeg_std_error(&err);
+    jpeg_create_compress(&cinfo);
+    unsigned char * out = NULL;
+    unsigned long size = 0;
+    jpeg_mem_dest(&cinfo, &out, &size);
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    cinfo.comp_info[0].h_samp_factor = 2;
+    cinfo.comp_info[0].v_samp_factor = yuv420 ? 2 : 1;
+    cinfo.restart_interval = restartInterval;
+    if (progressive) jpeg_simple_progression(&cinfo);
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < height) {
+        JSAMPROW row = &rgb[(size_t)cinfo.next_scanline * width * 3];
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    std::vector<uint8_t> jpeg(out, out + size);
+    free(out);
+    jpeg_destroy_compress(&cinfo);
+    return jpeg;
+}
+
+// a frame of the synthetic camera, with the header publishFrame found
+static std::vector<uint8_t> syntheticFrame(unsigned width, unsigned height, JpegHeader& published)
+{
+    CameraStreamInterface stream("synthetic", width, height, "MJPG", 30);
+    FrameRef frame;
+    if (!stream.openStream() || !stream.getFrame(frame)) return std::vector<uint8_t>();
+    published = frame->jpeg;
+    return std::vector<uint8_t>(frame->buf, frame->buf + frame->size);
+}
+
+static bool parses(const std::vector<uint8_t>& jpeg)
+{
+    JpegHeader header;
+    return parseJpegHeader(jpeg.empty() ? NULL : &jpeg[0], jpeg.size(), header) && header.valid;
+}
+
+// offset of the first byte after marker, 0 if there is none
+static size_t findMarker(const std::vector<uint8_t>& jpeg, uint8_t marker)
+{
+    for (size_t k = 0; k + 1 < jpeg.size(); k++) {
+        if (jpeg[k] == 0xFF && jpeg[k + 1] == marker) return k + 2;
+    }
+    return 0;
+}
+
+int main(int argc, char * argv[])
+{
+    std::string path = argc > 1 ? argv[1] : "testJpegHeader.pcs";
+    unsigned iterations = argc > 2 ? atoi(argv[2]) : 200;
+    JpegHeader header;
+
+    // the synthetic camera: 4:2:2, one restart interval per MCU row
+    JpegHeader published;
+    std::vector<uint8_t> synthetic = syntheticFrame(1280, 720, published);
+    bool ok = parseJpegHeader(&synthetic[0], synthetic.size(), header);
+    check(ok && header.width == 1280 && header.height == 720 && header.frameType == 0xC0 && header.components == 3 &&
+          header.sampling[0] == 0x21 && header.sampling[1] == 0x11 && header.sampling[2] == 0x11 &&
+          header.restartInterval == 1280 / 16 && header.size == synthetic.size() &&
+          header.scanOffset > 0 && header.scanOffset < header.size, "synthetic frame header");
+    check(published.valid && memcmp(&published, &header, sizeof(header)) == 0, "header attached to the published frame");
+
+    std::vector<uint8_t> baseline = encodeJpeg(1000, 562, true, 7, false);
+    ok = parseJpegHeader(&baseline[0], baseline.size(), header);
+    check(ok && header.width == 1000 && header.height == 562 && header.frameType == 0xC0 && header.sampling[0] == 0x22 &&
+          header.restartInterval == 7, "libjpeg 4:2:0 with restart markers");
+    std::vector<uint8_t> progressive = encodeJpeg(640, 480, false, 0, true);
+    ok = parseJpegHeader(&progressive[0], progressive.size(), header);
+    check(ok && header.width == 640 && header.height == 480 && header.frameType == 0xC2 && header.sampling[0] == 0x21 &&
+          header.restartInterval == 0, "progressive");
+
+    // padding after EOI is fine, and not counted in size
+    std::vector<uint8_t> padded(synthetic);
+    padded.resize(padded.size() + 1000, 0);
+    check(parseJpegHeader(&padded[0], padded.size(), header) && header.size == synthetic.size(), "zero padding after EOI");
+
+    // broken frames
+    std::vector<uint8_t> bad(synthetic.begin(), synthetic.begin() + synthetic.size() / 2);
+    check(!parses(bad), "truncated frame refused");
+    bad.assign(synthetic.begin(), synthetic.begin() + 100);
+    check(!parses(bad), "frame cut off in the header refused");
+    bad = synthetic;
+    bad[0] = 0;
+    check(!parses(bad), "missing SOI refused");
+    bad = synthetic;
+    bad[bad.size() - 1] = 0xD0;
+    check(!parses(bad), "missing EOI refused");
+    bad = synthetic;
+    size_t sof = findMarker(bad, 0xC0);
+    bad[sof + 5] = 0;
+    bad[sof + 6] = 0;
+    check(sof && !parses(bad), "zero width refused");
+    bad = synthetic;
+    bad[sof + 9] = 0x51;
+    check(!parses(bad), "sampling factor out of range refused");
+    bad = synthetic;
+    bad[sof] = 0xFF;
+    check(!parses(bad), "segment running past the end refused");
+    bad = synthetic;
+    bad[sof - 1] = 0xFE; // SOF turned into a comment, SOS comes without a frame header
+    check(!parses(bad), "scan without a frame header refused");
+    bad = synthetic;
+    size_t sos = findMarker(bad, 0xDA);
+    bad.erase(bad.begin() + sos + bad[sos + 1], bad.end() - 2);
+    check(sos && !parses(bad), "frame without scan data refused");
+    bad.assign(4096, 0);
+    check(!parses(bad) && !parses(std::vector<uint8_t>()), "empty and zeroed buffers refused");
+
+    // scribbled over headers never read outside the frame or call it valid with nonsense
+    std::mt19937 rng(1);
+    bool sane = true;
+    for (unsigned k = 0; k < iterations * 50; k++) {
+        std::vector<uint8_t> fuzzed(synthetic.begin(), synthetic.begin() + published.scanOffset + 64);
+        fuzzed.push_back(0xFF);
+        fuzzed.push_back(0xD9);
+        for (unsigned n = 0; n < 4; n++) fuzzed[rng() % published.scanOffset] = (uint8_t)rng();
+        if (parseJpegHeader(&fuzzed[0], fuzzed.size(), header)) {
+            sane = sane && header.width && header.height && header.components && header.scanOffset < header.size &&
+                   header.size == fuzzed.size();
+        }
+    }
+    check(sane, "fuzzed headers");
+
+    // replayed: only whole frames of the right size get through
+    {
+        std::vector<uint8_t> small = encodeJpeg(640, 360, false, 0, false);
+        std::vector<uint8_t> truncated(synthetic.begin(), synthetic.end() - 4096);
+        FrameRecorder recorder;
+        check(recorder.open(path, 64ULL << 20, 1024), "recorder opens");
+        RawFrame frame;
+        memset(&frame, 0, sizeof(frame));
+        frame.format = PANACAST_FRAME_FORMAT_MJPEG;
+        frame.width = 1280;
+        frame.height = 720;
+        unsigned good = 0;
+        for (unsigned k = 0; k < 30; k++) {
+            const std::vector<uint8_t>& jpeg = k % 3 == 1 ? truncated : k % 5 == 2 ? small : synthetic;
+            if (&jpeg == &synthetic) good++;
+            frame.buf = (unsigned char *)&jpeg[0];
+            frame.size = (int)jpeg.size();
+            recorder.append(&frame, 1000000 + k * 33333333ULL);
+        }
+        recorder.close();
+
+        ReplayCapture replay(path, REPLAY_FAST, false);
+        check(replay.init(0, 0, PANACAST_FRAME_FORMAT_MJPEG, NULL), "replay opens");
+        unsigned delivered = 0;
+        bool attached = true;
+        for (;;) {
+            // the replay waits for each frame it delivers to be taken, so it is finished once all are
+            FrameRef f = replay.nextFrame();
+            if (!f && replay.finished()) break;
+            if (!f) continue;
+            delivered++;
+            attached = attached && f->jpeg.valid && f->jpeg.width == 1280 && f->jpeg.size == synthetic.size();
+        }
+        StreamStats s;
+        replay.getStats(s);
+        replay.stopCapture();
+        printf("replayed 30 frames, %u whole: delivered %u, dropped %llu, corrupt %llu\n", good, delivered,
+               (unsigned long long)s.dropped, (unsigned long long)s.corrupt);
+        check(delivered == good && s.delivered == good && attached, "only whole frames delivered");
+        check(s.corrupt == 30 - good && s.dropped >= s.corrupt, "broken frames counted");
+        remove(path.c_str());
+    }
+
+    {
+        JpegHeader unused;
+        std::vector<uint8_t> frame4k = syntheticFrame(3840, 2160, unused);
+        uint64_t start = now_nsec();
+        unsigned valid = 0;
+        for (unsigned k = 0; k < iterations * 100; k++) valid += parseJpegHeader(&frame4k[0], frame4k.size(), header);
+        double nsec = (double)(now_nsec() - start) / (iterations * 100);
+        printf("3840x2160 MJPEG (%zu KB): %.0f ns per check\n", frame4k.size() / 1024, nsec);
+        check(valid == iterations * 100, "4K frame");
+    }
+
+    if (errors) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+    return 0;
+}
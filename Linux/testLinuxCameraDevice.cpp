@@ -0,0 +1,124 @@
+//
+//  testLinuxCameraDevice.cpp
+//
+//  Exercises LinuxCameraDevice against FakeUVCControlEndpoint: control
+//  ranges must be read once per device, current values of any number of
+//  properties must take one ioctl, and extension unit GET_LEN/GET_INFO and
+//  static GET_* answers must be served from the cache.
+//
+//  usage: testLinuxCameraDevice [iterations]
+//
+
+#include "CameraDevice.h"
+#include "FakeUVCControlEndpoint.h"
+#include "testUtil.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static CommandInfo xuCommand(uint8_t request, uint8_t selector, const std::vector<unsigned char>& data = std::vector<unsigned char>())
+{
+    CommandInfo info;
+    info.requestType = request & 0x80 ? 0xa1 : 0x21;
+    info.request = request;
+    info.value = selector << 8;
+    info.index = FAKE_XU_UNIT_ID << 8;
+    info.data = data;
+    return info;
+}
+
+int main(int argc, char * argv[])
+{
+    unsigned iterations = argc > 1 ? atoi(argv[1]) : 1000;
+
+    FakeUVCControlEndpoint * fake = new FakeUVCControlEndpoint;
+    LinuxCameraDevice camera(fake, "/dev/fake");
+
+    // first read pays for the ranges of every control, once
+    Property p;
+    if (!camera.getProperty(Contrast, p) || p.value != 32 || p.min != 0 || p.max != 95) {
+        printf("contrast: got %d [%d, %d]\n", p.value, p.min, p.max);
+        errors++;
+    }
+    unsigned rangeIoctls = fake->ioctls;
+
+    fake->ioctls = 0;
+    fake->transfers = 0;
+    for (unsigned k = 0; k < iterations; k++) {
+        if (!camera.getProperty(WhiteBalance, p) || p.value != 4600 || p.min != 2800 || p.max != 6500) errors++;
+    }
+    printf("getProperty: %u ioctls to load ranges, then %.2f ioctls and %.2f transfers per call (3 on the Mac path)\n",
+           rangeIoctls, (double)fake->ioctls / iterations, (double)fake->transfers / iterations);
+    if (fake->ioctls != iterations || fake->transfers != iterations) errors++;
+
+    // all five current values in one ioctl
+    std::vector<PropertyType> all;
+    all.push_back(Brightness);
+    all.push_back(Contrast);
+    all.push_back(Saturation);
+    all.push_back(Sharpness);
+    all.push_back(WhiteBalance);
+    std::vector<Property> props;
+    fake->ioctls = 0;
+    if (!camera.getProperties(all, props) || fake->ioctls != 1) {
+        printf("getProperties took %u ioctls\n", fake->ioctls);
+        errors++;
+    }
+    if (props.size() != 5 || props[0].min != -64 || props[2].value != 64 || props[3].max != 7) errors++;
+
+    // set, range checked against the cache without touching the device
+    if (!camera.setProperty(Brightness, 20)) errors++;
+    if (!camera.getProperty(Brightness, p) || p.value != 20) errors++;
+    fake->ioctls = 0;
+    if (camera.setProperty(Brightness, 65) || camera.setProperty(Saturation, -1) || fake->ioctls != 0) {
+        printf("out of range values were not rejected up front\n");
+        errors++;
+    }
+
+    // a control the camera does not have
+    {
+        FakeUVCControlEndpoint * noSharpness = new FakeUVCControlEndpoint;
+        noSharpness->removeControl(V4L2_CID_SHARPNESS);
+        noSharpness->addControl(V4L2_CID_SATURATION, 50, 0, 100, 1, true);
+        LinuxCameraDevice other(noSharpness, "/dev/fake");
+        if (other.getProperty(Sharpness, p) || !other.getProperty(Brightness, p)) errors++;
+        if (other.setProperty(Saturation, 10)) errors++;
+    }
+
+    // extension unit
+    fake->transfers = 0;
+    CommandInfo len = xuCommand(UVC_GET_LEN, 1);
+    if (!camera.sendCommand(len) || len.data.size() != 2 || len.data[0] != 4) errors++;
+    unsigned describe = fake->transfers;
+    for (unsigned k = 0; k < 10; k++) {
+        CommandInfo info = xuCommand(UVC_GET_INFO, 1);
+        CommandInfo max = xuCommand(UVC_GET_MAX, 1);
+        if (!camera.sendCommand(info) || info.data[0] != (UVC_CONTROL_CAP_GET | UVC_CONTROL_CAP_SET)) errors++;
+        if (!camera.sendCommand(max) || max.data.size() != 4 || max.data[3] != 0xff) errors++;
+    }
+    if (describe != 2 || fake->transfers != 3) {
+        printf("xu: %u transfers to describe the control, %u in total\n", describe, fake->transfers);
+        errors++;
+    }
+
+    std::vector<unsigned char> value(4);
+    value[0] = 1; value[1] = 2; value[2] = 3; value[3] = 4;
+    CommandInfo set = xuCommand(UVC_SET_CUR, 1, value);
+    CommandInfo get = xuCommand(UVC_GET_CUR, 1);
+    if (!camera.sendCommand(set) || !camera.sendCommand(get) || get.data != value || fake->xuValue(1) != value) errors++;
+
+    CommandInfo shortSet = xuCommand(UVC_SET_CUR, 1, std::vector<unsigned char>(2, 0));
+    CommandInfo readOnly = xuCommand(UVC_SET_CUR, 2, std::vector<unsigned char>(2, 0));
+    fake->transfers = 0;
+    if (camera.sendCommand(shortSet) || camera.sendCommand(readOnly)) errors++;
+    if (fake->transfers != 2) errors++; // only describing selector 2, no SET_CUR went out
+
+    CommandInfo missing = xuCommand(UVC_GET_CUR, 9);
+    if (camera.sendCommand(missing)) errors++;
+
+    if (errors) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,282 @@
+//
+//  testMotionGate.cpp
+//
+//  The SAD kernels of every instruction set must give the scalar sums and
+//  leave a copy of the row behind. A gate must call a repeated frame still,
+//  find a changed block in its own tile at the right level for YUYV, UYVY,
+//  NV12, YV12 and I420 alike, ignore chroma, honour the threshold and
+//  keepAlive and refuse settings and formats it cannot gate. Streams must
+//  carry the motion map to their consumers, through conversion and MJPEG
+//  decoding, and count suppressed frames as still without converting them.
+//  Then a 4K frame is timed.
+//
+//  usage: testMotionGate [iterations]
+//
+
+#include "CameraDevice.h"
+#include "FrameConvertKernels.h"
+#include "MotionGate.h"
+#include "testUtil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+
+static bool matchesScalar(ConvertIsa isa, unsigned n, unsigned mask, unsigned seed)
+{
+    std::vector<uint8_t> src = randomFrame(n + 1, seed), ref = randomFrame(n + 1, seed + 1), scalarRef(ref);
+    uint32_t sum = 7, expected = 7;
+    const ConvertKernels& k = convertKernels(isa);
+    unsigned done = k.difference(&src[0], &ref[0], n, mask, &sum);
+    if (done < n) convertKernels(CONVERT_ISA_SCALAR).difference(&src[done], &ref[done], n - done, mask, &sum);
+    convertKernels(CONVERT_ISA_SCALAR).difference(&src[0], &scalarRef[0], n, mask, &expected);
+    // the byte after the row is left alone
+    return sum == expected && memcmp(&ref[0], &src[0], n) == 0 && ref == scalarRef;
+}
+
+static uint8_t * luma(std::vector<uint8_t>& frame, RawFrameFormat format, unsigned width, unsigned x, unsigned y)
+{
+    if (is420(format)) return &frame[(size_t)y * width + x];
+    return &frame[(size_t)y * width * 2 + x * 2 + (format == PANACAST_FRAME_FORMAT_UYVY)];
+}
+
+// add delta to the luma of the w x h block at x, y; 0 halves its range instead
+static void brighten(std::vector<uint8_t>& frame, RawFrameFormat format, unsigned width, unsigned x, unsigned y,
+                     unsigned w, unsigned h, int delta)
+{
+    for (unsigned j = y; j < y + h; j++) {
+        for (unsigned i = x; i < x + w; i++) {
+            uint8_t * p = luma(frame, format, width, i, j);
+            *p = delta ? (uint8_t)(*p + delta) : *p & 0x7F;
+        }
+    }
+}
+
+// every chroma sample of the frame
+static void tint(std::vector<uint8_t>& frame, RawFrameFormat format, unsigned width, unsigned height)
+{
+    if (is420(format)) {
+        for (size_t k = (size_t)width * height; k < frame.size(); k++) frame[k] += 50;
+        return;
+    }
+    unsigned first = format == PANACAST_FRAME_FORMAT_YUYV;
+    for (size_t k = first; k < frame.size(); k += 2) frame[k] += 50;
+}
+
+static bool onlyTile(const FrameMotion& motion, unsigned tile, unsigned level)
+{
+    for (unsigned t = 0; t < (unsigned)motion.tilesX * motion.tilesY; t++) {
+        if (motion.tiles[t] != (t == tile ? level : 0)) return false;
+    }
+    return motion.level == level;
+}
+
+static double msec(uint64_t nsec)
+{
+    return nsec / 1e6;
+}
+
+int main(int argc, char * argv[])
+{
+    unsigned iterations = argc > 1 ? atoi(argv[1]) : 20;
+    ConvertIsa cpu = convertCpuIsa();
+
+    {
+        static const unsigned masks[3] = { 0x00FF, 0xFF00, 0xFFFF };
+        static const unsigned lengths[6] = { 0, 2, 30, 64, 480, 7682 };
+        for (unsigned isa = CONVERT_ISA_SSE41; isa <= (unsigned)cpu; isa++) {
+            bool ok = true;
+            for (unsigned m = 0; m < 3; m++) {
+                for (unsigned l = 0; l < 6; l++) ok = matchesScalar((ConvertIsa)isa, lengths[l], masks[m], m * 6 + l) && ok;
+            }
+            printf("%s difference matches scalar: %s\n", convertIsaName((ConvertIsa)isa), ok ? "yes" : "no");
+            check(ok, "difference kernels");
+        }
+    }
+
+    static const RawFrameFormat formats[5] = { PANACAST_FRAME_FORMAT_YUYV, PANACAST_FRAME_FORMAT_UYVY,
+                                               PANACAST_FRAME_FORMAT_NV12, PANACAST_FRAME_FORMAT_YV12,
+                                               PANACAST_FRAME_FORMAT_I420 };
+    for (unsigned f = 0; f < 5; f++) {
+        RawFrameFormat format = formats[f];
+        // 16 x 9 tiles of 40 x 40 pixels
+        unsigned width = 640, height = 360;
+        MotionGateSettings settings;
+        settings.enabled = true;
+        MotionGate gate;
+        FrameMotion motion;
+        check(gate.configure(format, width, height, settings), "gate configures");
+        std::vector<uint8_t> frame = randomFrame(rawFrameSize(format, width, height), f);
+        // luma below 128, so brightening never wraps
+        brighten(frame, format, width, 0, 0, width, height, 0);
+
+        gate.measure(&frame[0], 0, motion);
+        check(motion.measured && motion.moving && motion.level == 255 && motion.tilesX == 16 && motion.tilesY == 9,
+              "first frame moves");
+        check(!gate.suppress(motion), "first frame let through");
+        gate.measure(&frame[0], 0, motion);
+        check(motion.measured && !motion.moving && onlyTile(motion, MOTION_MAX_TILES, 0), "repeated frame is still");
+        check(gate.suppress(motion), "still frame suppressed");
+
+        tint(frame, format, width, height);
+        gate.measure(&frame[0], 0, motion);
+        check(!motion.moving && motion.level == 0, "chroma is not motion");
+
+        // the tile at column 5, row 2
+        brighten(frame, format, width, 200, 80, 40, 40, 100);
+        gate.measure(&frame[0], 0, motion);
+        check(motion.moving && onlyTile(motion, 2 * 16 + 5, 100), "changed block found in its tile");
+        check(!gate.suppress(motion), "moving frame let through");
+        gate.measure(&frame[0], 0, motion);
+        check(!motion.moving && motion.level == 0, "compared with the frame before, not the first");
+
+        // a quarter of the tile changes by 8: level 2, right at the default threshold
+        brighten(frame, format, width, 600, 320, 20, 20, 8);
+        gate.measure(&frame[0], 0, motion);
+        check(motion.moving && onlyTile(motion, 8 * 16 + 15, 2), "threshold reached");
+        settings.threshold = 2.5;
+        gate.configure(format, width, height, settings);
+        gate.measure(&frame[0], 0, motion);
+        brighten(frame, format, width, 600, 320, 20, 20, 8);
+        gate.measure(&frame[0], 0, motion);
+        check(!motion.moving && motion.level == 2, "below threshold");
+    }
+
+    {
+        MotionGateSettings settings;
+        settings.enabled = true;
+        settings.keepAlive = 3;
+        MotionGate gate;
+        FrameMotion motion;
+        gate.configure(PANACAST_FRAME_FORMAT_NV12, 320, 180, settings);
+        std::vector<uint8_t> frame = randomFrame(rawFrameSize(PANACAST_FRAME_FORMAT_NV12, 320, 180), 9);
+        std::string kept;
+        for (unsigned k = 0; k < 8; k++) {
+            gate.measure(&frame[0], 0, motion);
+            kept += gate.suppress(motion) ? '-' : 'x';
+        }
+        check(kept == "x--x--x-", "keepAlive lets every third still frame through");
+
+        settings.suppress = false;
+        gate.configure(PANACAST_FRAME_FORMAT_NV12, 320, 180, settings);
+        gate.measure(&frame[0], 0, motion);
+        gate.measure(&frame[0], 0, motion);
+        check(!motion.moving && !gate.suppress(motion), "flagged rather than suppressed");
+
+        MotionGateSettings bad = settings;
+        bad.tilesX = 17;
+        bad.tilesY = 16;
+        check(!MotionGate::valid(bad) && !gate.configure(PANACAST_FRAME_FORMAT_NV12, 320, 180, bad), "too many tiles refused");
+        bad = settings;
+        bad.rowStep = 0;
+        check(!MotionGate::valid(bad), "row step 0 refused");
+        bad = settings;
+        bad.threshold = -1;
+        check(!MotionGate::valid(bad), "negative threshold refused");
+        bad = settings;
+        bad.tilesX = 4;
+        bad.tilesY = 50;
+        check(!gate.configure(PANACAST_FRAME_FORMAT_NV12, 320, 180, bad), "tiles with no sampled row refused");
+        check(!gate.configure(PANACAST_FRAME_FORMAT_MJPEG, 320, 180, settings) &&
+              !gate.configure(PANACAST_FRAME_FORMAT_BGR24, 320, 180, settings), "MJPEG and RGB refused");
+        check(!gate.configure(PANACAST_FRAME_FORMAT_YUYV, 321, 180, settings), "odd width refused");
+        gate.measure(&frame[0], 0, motion);
+        check(!motion.measured, "nothing measured once unconfigured");
+    }
+
+    {
+        // only the stamp at the top of a synthetic frame changes, and it changes a lot
+        CameraStreamInterface stream("synthetic", 640, 360, "YUYV", 0);
+        stream.setOutputFormat("BGR");
+        MotionGateSettings settings;
+        settings.enabled = true;
+        settings.suppress = false;
+        check(stream.setMotionGate(settings) && stream.openStream(), "flagging stream opens");
+        FrameRef frame;
+        bool mapped = true;
+        for (unsigned k = 0; k < 5 && stream.getFrame(frame); k++) {
+            const FrameMotion& m = frame->motion;
+            mapped = mapped && frame->format == PANACAST_FRAME_FORMAT_BGR24 && m.measured && m.moving;
+            // the first frame measured had nothing to compare with
+            if (m.tiles[16] == 255) continue;
+            for (unsigned t = 16; t < MOTION_MAX_TILES; t++) mapped = mapped && m.tiles[t] == 0;
+        }
+        check(mapped, "motion map carried through conversion");
+        frame.reset();
+
+        // settings changed on an open stream: nothing reaches the threshold past the first frame
+        settings.threshold = 256;
+        settings.suppress = true;
+        settings.keepAlive = 4;
+        StreamStats before, stats;
+        LatencySummary convertedBefore, converted;
+        stream.getConversionTime(convertedBefore);
+        stream.getStats(before);
+        check(stream.setMotionGate(settings), "gate changed while open");
+        uint64_t start = now_nsec();
+        unsigned still = 0;
+        for (unsigned k = 0; k < 8 && stream.getFrame(frame); k++) {
+            still += !frame->motion.moving;
+        }
+        frame.reset();
+        // a frame may be between conversion and publishing when the first counts are read
+        check(stream.getConversionTime(converted) && stream.getStats(stats), "stats of a gated stream");
+        uint64_t delivered = stats.delivered - before.delivered, suppressed = stats.still - before.still;
+        uint64_t conversions = converted.count - convertedBefore.count;
+        printf("gated stream in %.0f ms: delivered %llu, still %llu, converted %llu\n", msec(now_nsec() - start),
+               (unsigned long long)delivered, (unsigned long long)suppressed, (unsigned long long)conversions);
+        check(still > 0 && before.still == 0 && suppressed > delivered, "still frames suppressed");
+        check(conversions <= delivered + 1, "suppressed frames never converted");
+    }
+
+#ifdef PANACAST_MJPEG_DECODE
+    {
+        CameraStreamInterface stream("synthetic", 640, 360, "MJPG", 0);
+        stream.setOutputFormat("NV12");
+        stream.setDecodeThreads(1);
+        MotionGateSettings settings;
+        settings.enabled = true;
+        settings.suppress = false;
+        FrameRef frame;
+        check(stream.openStream() && stream.setMotionGate(settings), "decoded stream gated");
+        // frames published before the gate was set are not measured; getFrame hands out the
+        // newest, so every frame after the first was published with the gate in place
+        bool measured = stream.getFrame(frame);
+        for (unsigned k = 0; k < 3 && stream.getFrame(frame); k++) measured = measured && frame->motion.measured;
+        check(measured && frame && frame->format == PANACAST_FRAME_FORMAT_NV12, "MJPEG measured once decoded");
+    }
+#endif
+
+    {
+        unsigned width = 3840, height = 2160;
+        std::vector<uint8_t> a = randomFrame(rawFrameSize(PANACAST_FRAME_FORMAT_YUYV, width, height), 1);
+        std::vector<uint8_t> b = randomFrame(a.size(), 2);
+        MotionGateSettings settings;
+        settings.enabled = true;
+        FrameMotion motion;
+        for (unsigned isa = CONVERT_ISA_SCALAR; isa <= (unsigned)cpu; isa++) {
+            MotionGate gate;
+            gate.configure(PANACAST_FRAME_FORMAT_YUYV, width, height, settings);
+            std::vector<uint64_t> times;
+            for (unsigned k = 0; k < iterations; k++) {
+                uint64_t t0 = now_nsec();
+                gate.measure(k & 1 ? &a[0] : &b[0], 0, motion, (ConvertIsa)isa);
+                times.push_back(now_nsec() - t0);
+            }
+            std::sort(times.begin(), times.end());
+            printf("%ux%u YUYV, every %u rows, 16x9 tiles, %s: median %.3f ms\n", width, height, settings.rowStep,
+                   convertIsaName((ConvertIsa)isa), msec(times[iterations / 2]));
+            if (isa == (unsigned)cpu) check(times[iterations / 2] < 1000000, "4K gate under 1 ms");
+        }
+        check(motion.moving, "random frames move");
+    }
+
+    if (errors) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+    return 0;
+}
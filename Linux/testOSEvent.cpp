@@ -0,0 +1,140 @@
+//
+//  testOSEvent.cpp
+//
+//  Checks OSEvent semantics (auto and manual reset, timeouts, several
+//  waiters) and measures what a frame notification costs: Signal with no
+//  one waiting, and the wake-up latency from Signal in one thread to the
+//  return of TimedWait in another, ping-ponged between two threads. The
+//  Makefile builds it twice, on the futex OSEvent (testOSEvent) and on the
+//  pthread one (testOSEventPthread), so the numbers can be compared.
+//
+//  usage: testOSEvent [round trips]
+//
+
+#include "utils.h"
+#include "testUtil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#ifdef OSEVENT_FUTEX
+static const char * kind = "futex";
+#else
+static const char * kind = "pthread";
+#endif
+
+static void semantics()
+{
+    int sts;
+    OSEvent autoEvent(sts, false, false);
+    check(autoEvent.TimedWait(0) == OSEvent_Error_TimedOut, "auto reset starts unsignalled");
+    autoEvent.Signal();
+    autoEvent.Signal();
+    check(autoEvent.TimedWait(0) == OSEvent_Error_None, "auto reset signalled");
+    check(autoEvent.TimedWait(0) == OSEvent_Error_TimedOut, "auto reset consumed by one wait");
+    autoEvent.Signal();
+    autoEvent.Reset();
+    check(autoEvent.TimedWait(0) == OSEvent_Error_TimedOut, "auto reset cleared by Reset");
+
+    OSEvent manualEvent(sts, true, true);
+    check(manualEvent.TimedWait(0) == OSEvent_Error_None, "manual reset starts signalled");
+    check(manualEvent.TimedWait(0) == OSEvent_Error_None, "manual reset stays signalled");
+    manualEvent.Reset();
+    check(manualEvent.TimedWait(0) == OSEvent_Error_TimedOut, "manual reset cleared by Reset");
+
+    uint64_t start = now_nsec();
+    OSEventError err = autoEvent.TimedWait(50);
+    uint64_t waited = (now_nsec() - start) / 1000000;
+    printf("%s: TimedWait(50) returned after %llu ms\n", kind, (unsigned long long)waited);
+    check(err == OSEvent_Error_TimedOut && waited >= 50 && waited < 150, "timeout");
+
+    // a manual reset event releases every waiter
+    std::atomic<int> woken(0);
+    std::vector<std::thread> waiters;
+    for (unsigned k = 0; k < 4; k++) {
+        waiters.push_back(std::thread([&] { if (manualEvent.TimedWait(2000) == OSEvent_Error_None) woken++; }));
+    }
+    usleep(20000);
+    manualEvent.Signal();
+    for (size_t k = 0; k < waiters.size(); k++) waiters[k].join();
+    check(woken == 4, "manual reset wakes all waiters");
+
+    // an auto reset event releases one waiter per Signal, and none is lost
+    woken = 0;
+    waiters.clear();
+    for (unsigned k = 0; k < 4; k++) {
+        waiters.push_back(std::thread([&] { if (autoEvent.TimedWait(2000) == OSEvent_Error_None) woken++; }));
+    }
+    usleep(20000);
+    for (unsigned k = 0; k < 4; k++) {
+        autoEvent.Signal();
+        usleep(5000);
+    }
+    for (size_t k = 0; k < waiters.size(); k++) waiters[k].join();
+    check(woken == 4, "auto reset wakes one waiter per Signal");
+}
+
+static void signalCost(unsigned count)
+{
+    int sts;
+    OSEvent event(sts, false, false);
+    uint64_t start = now_nsec();
+    for (unsigned k = 0; k < count; k++) {
+        event.Signal();
+        event.TimedWait(0);
+    }
+    double perPair = (double)(now_nsec() - start) / count;
+    printf("%s: Signal + TimedWait(0) with no one waiting: %.1f ns\n", kind, perPair);
+}
+
+static void wakeLatency(unsigned rounds)
+{
+    int sts;
+    OSEvent ping(sts, false, false), pong(sts, false, false);
+    std::atomic<uint64_t> signalledAt(0);
+    std::vector<double> latency;
+    latency.reserve(rounds);
+
+    std::thread responder([&] {
+        for (unsigned k = 0; k < rounds; k++) {
+            if (ping.TimedWait(1000) != OSEvent_Error_None) break;
+            latency.push_back((now_nsec() - signalledAt.load()) / 1000.0);
+            pong.Signal();
+        }
+    });
+    for (unsigned k = 0; k < rounds; k++) {
+        // let the responder get back to sleep, so every round measures a real wake-up
+        usleep(100);
+        signalledAt = now_nsec();
+        ping.Signal();
+        if (pong.TimedWait(1000) != OSEvent_Error_None) break;
+    }
+    responder.join();
+
+    check(latency.size() == rounds, "every ping answered");
+    if (latency.empty()) return;
+    std::sort(latency.begin(), latency.end());
+    printf("%s: wake-up latency usec over %u round trips: p50 %.1f p99 %.1f max %.1f\n", kind,
+           (unsigned)latency.size(), latency[latency.size() / 2], latency[latency.size() * 99 / 100], latency.back());
+}
+
+int main(int argc, char * argv[])
+{
+    unsigned rounds = argc > 1 ? atoi(argv[1]) : 2000;
+
+    semantics();
+    signalCost(1000000);
+    wakeLatency(rounds);
+
+    if (errors) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,278 @@
+//
+//  testReplayCapture.cpp
+//
+//  Writes a stream file of MJPEG-sized frames (a real JPEG header, then
+//  filler, so they pass the check at publish) with jittery timestamps,
+//  then replays it in both modes: REPLAY_FAST must deliver every frame in
+//  order straight from the mapping, REPLAY_PACED must reproduce the recorded
+//  frame timing. An I420 recording made by FrameRecorder must replay as
+//  recorded. With no consumer REPLAY_FAST must block rather than spin.
+//  A replayfast: stream of a raw recording must keep handing out frames
+//  when a conversion stage takes them through its frame handler.
+//
+//  usage: testReplayCapture [file] [frames]
+//
+
+#include "CameraDevice.h"
+#include "FrameRecorder.h"
+#include "testUtil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+// SOI, a 1920x1080 4:2:2 frame header and the start of a scan; the frame number follows
+static const unsigned char jpegShell[] = {
+    0xFF, 0xD8,
+    0xFF, 0xC0, 0x00, 0x11, 0x08, 0x04, 0x38, 0x07, 0x80, 0x03, 0x01, 0x21, 0x00, 0x02, 0x11, 0x01, 0x03, 0x11, 0x01,
+    0xFF, 0xDA, 0x00, 0x0C, 0x03, 0x01, 0x00, 0x02, 0x11, 0x03, 0x11, 0x00, 0x3F, 0x00,
+};
+
+static unsigned stampOf(const RawFrame * frame)
+{
+    unsigned stamp;
+    memcpy(&stamp, frame->buf + sizeof(jpegShell), sizeof(stamp));
+    return stamp;
+}
+
+static bool writeStreamFile(const char * path, unsigned count, std::vector<StreamFileFrame>& frames)
+{
+    FILE * f = fopen(path, "wb");
+    if (f == NULL) return false;
+
+    StreamFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, STREAM_FILE_MAGIC, sizeof(header.magic));
+    header.version = STREAM_FILE_VERSION;
+    header.headerSize = sizeof(header);
+    header.indexOffset = sizeof(header);
+    header.indexCapacity = count;
+    header.frameCount = count;
+    header.dataOffset = streamFileAlign(header.indexOffset + count * sizeof(StreamFileFrame));
+
+    srand(1234);
+    uint64_t offset = header.dataOffset;
+    uint64_t timestamp = 1000000000ULL;
+    for (unsigned k = 0; k < count; k++) {
+        StreamFileFrame fr;
+        fr.offset = offset;
+        fr.size = 20000 + rand() % 180000;
+        fr.format = PANACAST_FRAME_FORMAT_MJPEG;
+        fr.width = 1920;
+        fr.height = 1080;
+        fr.timestampNsec = timestamp;
+        // 30 fps with jitter, and the odd stall like a PanaCast renegotiating
+        timestamp += 33333333ULL + (rand() % 8000000) - 4000000;
+        if (k % 50 == 49) timestamp += 100000000ULL;
+        offset = streamFileAlign(offset + fr.size);
+        frames.push_back(fr);
+    }
+    header.dataEnd = offset;
+
+    fwrite(&header, sizeof(header), 1, f);
+    fwrite(&frames[0], sizeof(StreamFileFrame), count, f);
+    std::vector<unsigned char> data;
+    for (unsigned k = 0; k < count; k++) {
+        data.assign(frames[k].size, (unsigned char)k);
+        memcpy(&data[0], jpegShell, sizeof(jpegShell));
+        memcpy(&data[sizeof(jpegShell)], &k, sizeof(k));
+        data[data.size() - 2] = 0xFF;
+        data[data.size() - 1] = 0xD9; // EOI
+        fseek(f, frames[k].offset, SEEK_SET);
+        fwrite(&data[0], 1, data.size(), f);
+    }
+    fclose(f);
+    return true;
+}
+
+// count frames of format with every byte of frame k set to k, through FrameRecorder
+static bool recordRaw(const char * path, RawFrameFormat format, unsigned width, unsigned height, unsigned count)
+{
+    FrameRecorder recorder;
+    if (!recorder.open(path, 64ULL << 20, count)) return false;
+    std::vector<unsigned char> data(rawFrameSize(format, width, height));
+    RawFrame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.format = format;
+    frame.width = width;
+    frame.height = height;
+    frame.size = (int)data.size();
+    frame.buf = &data[0];
+    bool ok = true;
+    for (unsigned k = 0; k < count; k++) {
+        memset(&data[0], (int)k, data.size());
+        ok = recorder.append(&frame, 1000000000ULL + k * 33333333ULL) && ok;
+    }
+    recorder.close();
+    return ok;
+}
+
+static bool checkFrame(const RawFrame * frame, const StreamFileFrame& expected, unsigned k)
+{
+    return stampOf(frame) == k && (unsigned)frame->size == expected.size && frame->buf[frame->size - 3] == (unsigned char)k &&
+           frame->jpeg.valid;
+}
+
+int main(int argc, char * argv[])
+{
+    const char * path = argc > 1 ? argv[1] : "testReplayCapture.pcs";
+    unsigned count = argc > 2 ? atoi(argv[2]) : 180;
+
+    std::vector<StreamFileFrame> frames;
+    if (!writeStreamFile(path, count, frames)) {
+        printf("cannot write %s\n", path);
+        return -1;
+    }
+
+    // as fast as possible, every frame, zero copy
+    {
+        ReplayCapture replay(path, REPLAY_FAST, false);
+        if (!replay.init(1920, 1080, PANACAST_FRAME_FORMAT_MJPEG, NULL)) return -1;
+
+        uint64_t start = now_nsec(), bytes = 0;
+        unsigned received = 0;
+        const unsigned char * base = NULL;
+        while (received < count) {
+            FrameRef frame = replay.nextFrame();
+            if (!frame) {
+                if (replay.finished()) break;
+                continue;
+            }
+            if (base == NULL) base = frame->buf - frames[0].offset;
+            if (!checkFrame(frame.get(), frames[received], received) || frame->buf != base + frames[received].offset) {
+                printf("fast: frame %u is wrong\n", received);
+                errors++;
+            }
+            bytes += frame->size;
+            received++;
+        }
+        double elapsed = (now_nsec() - start) / 1e9;
+        printf("fast: %u of %u frames in %.3f s (%.0f fps, %.1f MB/s)\n", received, count, elapsed,
+               received / elapsed, bytes / elapsed / 1e6);
+        if (received != count) errors++;
+    }
+
+    // with nobody taking frames fast replay must sleep on its consumers, and still stop at once
+    {
+        ReplayCapture replay(path, REPLAY_FAST, false);
+        if (!replay.init(1920, 1080, PANACAST_FRAME_FORMAT_MJPEG, NULL)) return -1;
+        uint64_t cpu = now_nsec(CLOCK_PROCESS_CPUTIME_ID);
+        struct timespec idle = {0, 500000000};
+        nanosleep(&idle, NULL);
+        double busy = (now_nsec(CLOCK_PROCESS_CPUTIME_ID) - cpu) / 1e6;
+        uint64_t stopping = now_nsec();
+        replay.stopCapture();
+        double stop = (now_nsec() - stopping) / 1e6;
+        printf("fast with no consumer: %.1f ms of cpu in 500 ms, stopped in %.1f ms\n", busy, stop);
+        if (busy > 50 || stop > 100) errors++;
+    }
+
+    // original timing
+    {
+        ReplayCapture replay(path, REPLAY_PACED, false);
+        if (!replay.init(0, 0, PANACAST_FRAME_FORMAT_MJPEG, NULL)) return -1;
+
+        std::vector<uint64_t> arrival(count, 0);
+        unsigned received = 0;
+        while (true) {
+            FrameRef frame = replay.nextFrame();
+            if (!frame) {
+                if (replay.finished()) break;
+                continue;
+            }
+            unsigned k = stampOf(frame.get());
+            if (k < count) arrival[k] = now_nsec();
+            received++;
+        }
+
+        double maxError = 0, sumError = 0, maxDrift = 0;
+        unsigned pairs = 0;
+        for (unsigned k = 1; k < count; k++) {
+            if (!arrival[k] || !arrival[k - 1]) continue;
+            double recorded = (double)(frames[k].timestampNsec - frames[k - 1].timestampNsec);
+            double replayed = (double)(arrival[k] - arrival[k - 1]);
+            double error = (replayed > recorded ? replayed - recorded : recorded - replayed) / 1000.0;
+            if (error > maxError) maxError = error;
+            sumError += error;
+            pairs++;
+            // against the start of playback: scheduling hiccups must not accumulate
+            if (arrival[0]) {
+                double drift = ((double)(arrival[k] - arrival[0]) - (double)(frames[k].timestampNsec - frames[0].timestampNsec)) / 1000.0;
+                if (drift < 0) drift = -drift;
+                if (drift > maxDrift) maxDrift = drift;
+            }
+        }
+        printf("paced: %u of %u frames, inter-frame timing error usec: mean %.1f max %.1f, max drift %.1f\n",
+               received, count, pairs ? sumError / pairs : 0.0, maxError, maxDrift);
+        // a loaded or virtualised host oversleeps now and then, pacing must hold on average and not drift
+        if (received < count * 9 / 10 || !pairs || sumError / pairs > 2000 || maxDrift > 30000) errors++;
+    }
+
+    // through CameraStreamInterface
+    {
+        CameraStreamInterface stream(std::string(REPLAY_FAST_DEVICE_PREFIX) + path, 1920, 1080, "MJPG", 30);
+        if (!stream.openStream()) errors++;
+        for (unsigned k = 0; k < 10 && k < count; k++) {
+            FrameRef frame;
+            while (!stream.getFrame(frame)) ;
+            if (!checkFrame(frame.get(), frames[k], k)) errors++;
+        }
+    }
+
+    // I420, the last format in the enum, as V4L2 YUV420 cameras and the I420 output record it
+    {
+        std::string raw = std::string(path) + ".i420";
+        if (!recordRaw(raw.c_str(), PANACAST_FRAME_FORMAT_I420, 64, 32, 10)) errors++;
+        ReplayCapture replay(raw, REPLAY_FAST, false);
+        bool opened = replay.init(64, 32, PANACAST_FRAME_FORMAT_I420, NULL);
+        unsigned received = 0;
+        bool same = true;
+        while (opened) {
+            FrameRef frame = replay.nextFrame();
+            if (!frame) {
+                if (replay.finished()) break;
+                continue;
+            }
+            unsigned size = rawFrameSize(PANACAST_FRAME_FORMAT_I420, 64, 32);
+            same = same && frame->format == PANACAST_FRAME_FORMAT_I420 && (unsigned)frame->size == size &&
+                   frame->buf[0] == received && frame->buf[size - 1] == received;
+            received++;
+        }
+        printf("I420 round trip: %u of 10 frames\n", received);
+        if (!opened || received != 10 || !same) errors++;
+        remove(raw.c_str());
+    }
+
+    // the conversion stage takes each frame through the replay's frame handler, which must
+    // count as delivered or the lockstep never moves past the first frame
+    {
+        std::string raw = std::string(path) + ".yuyv";
+        if (!recordRaw(raw.c_str(), PANACAST_FRAME_FORMAT_YUYV, 64, 32, 20)) errors++;
+        CameraStreamInterface stream(std::string(REPLAY_FAST_DEVICE_PREFIX) + raw, 64, 32, "YUYV", 30);
+        stream.setOutputFormat("BGR");
+        if (!stream.openStream()) errors++;
+        unsigned received = 0;
+        uint64_t last = 0;
+        bool ordered = true;
+        uint64_t deadline = now_nsec() + 5000000000ULL;
+        while (received < 15 && now_nsec() < deadline) {
+            FrameRef frame;
+            if (!stream.getFrame(frame)) continue;
+            ordered = ordered && frame->format == PANACAST_FRAME_FORMAT_BGR24 && frame->sequence > last;
+            last = frame->sequence;
+            received++;
+        }
+        printf("fast through a conversion stage: %u of 15 frames\n", received);
+        if (received != 15 || !ordered) errors++;
+        remove(raw.c_str());
+    }
+
+    remove(path);
+    if (errors) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+    return 0;
+}
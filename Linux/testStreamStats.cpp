@@ -0,0 +1,101 @@
+//
+//  testStreamStats.cpp
+//
+//  A synthetic stream read at full rate must report its rate, no drops and
+//  little jitter. A consumer that hoards frames must show up as queue depth,
+//  lag and ring drops. A fake V4L2 device that corrupts every n-th frame
+//  must have those counted as dropped, and the hole each leaves as a late
+//  frame.
+//
+//  usage: testStreamStats [fps] [seconds]
+//
+
+#include "CameraDevice.h"
+#include "FakeV4L2Device.h"
+#include "testUtil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+static void print(const char * name, const StreamStats& s)
+{
+    printf("%s: delivered %llu consumed %llu dropped %llu late %llu decimated %llu, %.1f fps (%.1f average), "
+           "jitter %.2f ms, queue %u, lag %llu\n", name,
+           (unsigned long long)s.delivered, (unsigned long long)s.consumed, (unsigned long long)s.dropped,
+           (unsigned long long)s.late, (unsigned long long)s.decimated, s.fps, s.averageFps, s.jitterMsec,
+           s.queueDepth, (unsigned long long)s.consumerLag);
+}
+
+int main(int argc, char * argv[])
+{
+    unsigned fps = argc > 1 ? atoi(argv[1]) : 60;
+    unsigned seconds = argc > 2 ? atoi(argv[2]) : 2;
+
+    {
+        CameraStreamInterface stream("synthetic", 1280, 720, "YUYV", fps);
+        StreamStats s;
+        check(!stream.getStats(s), "no stats before openStream");
+        if (!stream.openStream()) return -1;
+
+        unsigned taken = 0;
+        for (unsigned k = 0; k < fps * seconds; k++) {
+            FrameRef frame;
+            if (stream.getFrame(frame)) taken++;
+        }
+        stream.getStats(s);
+        print("synthetic", s);
+        check(s.delivered >= fps * seconds && s.consumed == taken && s.dropped == 0, "counters");
+        check(s.fps > fps * 0.85 && s.fps < fps * 1.15 && s.averageFps > fps * 0.9 && s.averageFps < fps * 1.1, "rate");
+        // generated on an even grid, only scheduling noise is left
+        check(s.jitterMsec < 1000.0 / fps / 2, "jitter");
+        check(s.queueDepth == 0 && s.consumerLag <= 1, "nothing held");
+    }
+
+    {
+        SyntheticCapture capture(fps, 4);
+        if (!capture.init(640, 480, PANACAST_FRAME_FORMAT_YUYV, NULL)) return -1;
+        // hold on to frames until the producer has nowhere left to write
+        std::vector<FrameRef> hoard;
+        StreamStats s;
+        for (unsigned k = 0; k < fps && capture.getStats(s) && s.dropped == 0; k++) {
+            FrameRef frame = capture.nextFrame();
+            if (frame && hoard.size() < 3) hoard.push_back(frame);
+        }
+        usleep(100000);
+        capture.getStats(s);
+        print("hoarded", s);
+        check(s.queueDepth == hoard.size() && s.dropped > 0, "held slots and ring drops");
+        hoard.clear();
+        usleep(200000);
+        capture.getStats(s);
+        check(s.queueDepth == 0 && s.consumerLag > 0, "released, and lagging behind");
+        capture.stopCapture();
+    }
+
+    {
+        FakeV4L2Device * fake = new FakeV4L2Device(fps);
+        fake->injectErrors(10);
+        V4L2Capture capture(fake, "/dev/fake");
+        if (!capture.init(640, 480, PANACAST_FRAME_FORMAT_YUYV, NULL)) return -1;
+        for (unsigned k = 0; k < fps * seconds; k++) {
+            FrameRef frame = capture.nextFrame();
+        }
+        capture.stopCapture();
+
+        StreamStats s;
+        capture.getStats(s);
+        print("v4l2", s);
+        uint64_t corrupt = capture.corruptFrames();
+        check(corrupt > 0 && s.dropped >= corrupt, "corrupt frames are dropped frames");
+        check(s.late >= corrupt * 8 / 10 && s.late <= corrupt + s.delivered / 10, "the holes are late frames");
+    }
+
+    if (errors) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+    return 0;
+}
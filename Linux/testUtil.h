@@ -0,0 +1,44 @@
+//
+//  testUtil.h
+//
+//  What the Linux tests share: the error count check adds to (main
+//  prints FAILED and returns -1 if it is not zero), a CLOCK_MONOTONIC
+//  nanosecond clock for timing, and frames of seeded random bytes for the
+//  kernels. Every test is a program of its own, so all of it is static.
+//
+
+#ifndef TESTUTIL_H
+#define TESTUTIL_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <random>
+#include <vector>
+
+static int errors = 0;
+
+static inline void check(bool ok, const char * what)
+{
+    if (!ok) {
+        printf("%s: FAILED\n", what);
+        errors++;
+    }
+}
+
+static inline uint64_t now_nsec(clockid_t clock = CLOCK_MONOTONIC)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline std::vector<uint8_t> randomFrame(size_t size, unsigned seed)
+{
+    std::vector<uint8_t> frame(size);
+    std::mt19937 rng(seed);
+    for (size_t k = 0; k < size; k++) frame[k] = (uint8_t)rng();
+    return frame;
+}
+
+#endif
@@ -0,0 +1,189 @@
+//
+//  testV4L2Capture.cpp
+//
+//  Runs V4L2Capture against FakeV4L2Device: frames must arrive in driver
+//  order straight from the mmap'd buffers, every buffer must cycle back to
+//  the driver, frames must be dropped (and the driver never starved) while
+//  consumers pin every ring slot, and flagged buffers must be discarded.
+//  A restart must be refused while a consumer holds a frame of the last run.
+//  Finishes with an unthrottled run to measure the per-frame overhead.
+//
+//  usage: testV4L2Capture [width] [height] [fps] [seconds]
+//
+
+#include "V4L2Capture.h"
+#include "FakeV4L2Device.h"
+#include "testUtil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <set>
+#include <vector>
+
+static uint32_t driverSequence(const RawFrame * frame)
+{
+    uint32_t seq;
+    memcpy(&seq, frame->buf, sizeof(seq));
+    return seq;
+}
+
+int main(int argc, char * argv[])
+{
+    unsigned width = argc > 1 ? atoi(argv[1]) : 1920;
+    unsigned height = argc > 2 ? atoi(argv[2]) : 1080;
+    unsigned fps = argc > 3 ? atoi(argv[3]) : 60;
+    unsigned seconds = argc > 4 ? atoi(argv[4]) : 2;
+
+    // steady state: every frame, zero copy, buffers cycling
+    {
+        FakeV4L2Device * fake = new FakeV4L2Device(fps);
+        V4L2Capture capture(fake, "/dev/fake");
+        capture.enableDmabufExport(true);
+        if (!capture.init(width, height, PANACAST_FRAME_FORMAT_YUYV, NULL)) return -1;
+
+        unsigned expectedBuffers = FRAME_RING_DEFAULT_DEPTH + V4L2_EXTRA_BUFFERS;
+        if (capture.bufferCount() != expectedBuffers) {
+            printf("expected %u buffers, got %u\n", expectedBuffers, capture.bufferCount());
+            errors++;
+        }
+
+        std::set<const unsigned char *> seen;
+        unsigned received = 0, outOfOrder = 0, notZeroCopy = 0, noDmabuf = 0;
+        uint32_t last = 0;
+        uint64_t end = now_nsec() + seconds * 1000000000ULL;
+        while (now_nsec() < end) {
+            FrameRef frame = capture.nextFrame();
+            if (!frame) continue;
+            if (!fake->ownsAddress(frame->buf)) notZeroCopy++;
+            if (capture.dmabufFd(frame.get()) < 0) noDmabuf++;
+            if ((unsigned)frame->size != width * height * 2) errors++;
+            uint32_t seq = driverSequence(frame.get());
+            if (received && seq <= last) outOfOrder++;
+            last = seq;
+            seen.insert(frame->buf);
+            received++;
+        }
+        capture.stopCapture();
+
+        printf("steady: %u frames, %u buffers used, driver drops %llu, ring drops %llu, lowest driver queue %u\n",
+               received, (unsigned)seen.size(), (unsigned long long)capture.driverDrops(),
+               (unsigned long long)capture.framesDropped(), fake->lowestQueueDepth());
+        if (received < fps * seconds * 9 / 10) errors++;
+        if (outOfOrder || notZeroCopy || noDmabuf) {
+            printf("out of order %u, not zero copy %u, without dmabuf %u\n", outOfOrder, notZeroCopy, noDmabuf);
+            errors++;
+        }
+        if (seen.size() < 2 || fake->framesWithoutBuffer() != 0) errors++;
+
+        // a restart must not unmap a buffer a consumer still reads, so it waits for the frame
+        {
+            FrameRef held;
+            capture.init(width, height, PANACAST_FRAME_FORMAT_YUYV, NULL);
+            for (unsigned k = 0; k < 10 && !held; k++) held = capture.nextFrame();
+            capture.stopCapture();
+            uint32_t seq = held ? driverSequence(held.get()) : 0;
+            if (!held || capture.init(width, height, PANACAST_FRAME_FORMAT_YUYV, NULL)) {
+                printf("restart with a frame held was not refused\n");
+                errors++;
+            } else if (!fake->ownsAddress(held->buf) || driverSequence(held.get()) != seq) {
+                printf("held frame lost its buffer\n");
+                errors++;
+            }
+        }
+
+        // restart on the same capture object
+        if (!capture.init(width, height, PANACAST_FRAME_FORMAT_YUYV, NULL)) errors++;
+        FrameRef frame;
+        for (unsigned k = 0; k < 10 && !frame; k++) frame = capture.nextFrame();
+        if (!frame || !fake->ownsAddress(frame->buf)) {
+            printf("restart failed\n");
+            errors++;
+        }
+    }
+
+    // consumers pin every slot: the backend drops, the driver keeps its buffers
+    {
+        FakeV4L2Device * fake = new FakeV4L2Device(fps);
+        V4L2Capture capture(fake, "/dev/fake", 3);
+        if (!capture.init(width, height, PANACAST_FRAME_FORMAT_UYVY, NULL)) return -1;
+
+        std::vector<FrameRef> held;
+        uint32_t last = 0;
+        while (held.size() < 3) {
+            FrameRef frame = capture.nextFrame();
+            if (!frame) continue;
+            uint32_t seq = driverSequence(frame.get());
+            if (held.empty() || seq != last) held.push_back(frame);
+            last = seq;
+        }
+        uint64_t heldSince = capture.framesCaptured();
+        usleep(500000);
+        if (capture.framesCaptured() != heldSince || capture.framesDropped() == 0) {
+            printf("pinned: expected drops and no publishes, got %llu published %llu dropped\n",
+                   (unsigned long long)(capture.framesCaptured() - heldSince), (unsigned long long)capture.framesDropped());
+            errors++;
+        }
+        if (fake->framesWithoutBuffer() != 0) {
+            printf("pinned: driver ran out of buffers %llu times\n", (unsigned long long)fake->framesWithoutBuffer());
+            errors++;
+        }
+        // pinned frames are untouched
+        for (size_t k = 1; k < held.size(); k++) {
+            if (driverSequence(held[k].get()) <= driverSequence(held[k - 1].get())) errors++;
+        }
+
+        held.clear();
+        FrameRef frame;
+        for (unsigned k = 0; k < 10 && !frame; k++) frame = capture.nextFrame();
+        if (!frame || driverSequence(frame.get()) <= last) {
+            printf("pinned: capture did not resume\n");
+            errors++;
+        }
+        printf("pinned: %llu frames dropped while every slot was held\n", (unsigned long long)capture.framesDropped());
+    }
+
+    // corrupt buffers never reach the consumer
+    {
+        FakeV4L2Device * fake = new FakeV4L2Device(fps);
+        fake->injectErrors(5);
+        V4L2Capture capture(fake, "/dev/fake");
+        if (!capture.init(width, height, PANACAST_FRAME_FORMAT_NV12, NULL)) return -1;
+
+        unsigned received = 0, flagged = 0;
+        while (received < 40) {
+            FrameRef frame = capture.nextFrame();
+            if (!frame) continue;
+            if (driverSequence(frame.get()) % 5 == 4) flagged++;
+            received++;
+        }
+        printf("corrupt: %llu discarded, %u delivered\n", (unsigned long long)capture.corruptFrames(), flagged);
+        if (flagged || capture.corruptFrames() == 0) errors++;
+    }
+
+    // overhead: the fake produces as fast as the backend recycles buffers
+    {
+        FakeV4L2Device * fake = new FakeV4L2Device(0);
+        V4L2Capture capture(fake, "/dev/fake");
+        if (!capture.init(3840, 2160, PANACAST_FRAME_FORMAT_YUYV, NULL)) return -1;
+
+        unsigned received = 0;
+        uint64_t start = now_nsec();
+        while (now_nsec() - start < 1000000000ULL) {
+            FrameRef frame = capture.nextFrame();
+            if (frame) received++;
+        }
+        double elapsed = (now_nsec() - start) / 1e9;
+        printf("throughput: %llu frames captured, %u consumed, %.0f fps at 4K, %.2f usec per frame\n",
+               (unsigned long long)capture.framesCaptured(), received, capture.framesCaptured() / elapsed,
+               elapsed * 1e6 / capture.framesCaptured());
+        if (capture.framesCaptured() < 1000) errors++;
+    }
+
+    if (errors) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+    return 0;
+}
@@ -26,11 +26,13 @@
                     andWidth:(unsigned)width
                    andHeight:(unsigned)height
                    andFormat:(RawFrameFormat)format
+                andFrameRate:(unsigned)fps
           andCaptureCallback:(AVCaptureCallback*)cb;
 
 - (void) dealloc;
 - (void) startCapture;
 - (void) stopCapture;
 - (int) isRunning;
+- (double) activeFrameRate;
 @end
 
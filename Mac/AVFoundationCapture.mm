@@ -7,6 +7,7 @@
 //
 
 #import "AVFoundationCapture.h"
+#include "FrameLatency.h"
 #include <pthread.h>
 #include <os/log.h>
 
@@ -32,20 +33,35 @@ volatile CMSampleBufferRef spBufSrc = Nil;
 unsigned captureWidth;
 unsigned captureHeight;
 RawFrameFormat captureFormat;
+unsigned captureFrameRate; // 0: as fast as the format allows
+double activeRate;
 
 AVCaptureCallback * callback = NULL;
 
+// what AVFoundation calls the formats MacCameraCapture::init accepts
+static OSType pixelFormatFor(RawFrameFormat format)
+{
+    switch (format) {
+        case PANACAST_FRAME_FORMAT_YUYV: return kCVPixelFormatType_422YpCbCr8_yuvs;
+        case PANACAST_FRAME_FORMAT_UYVY: return kCVPixelFormatType_422YpCbCr8;
+        default: return 'dmb1';
+    }
+}
+
 
 - (id) initWithCaptureDevice:(AVCaptureDevice *) device
                     andWidth:(unsigned)width
                    andHeight:(unsigned)height
                    andFormat:(RawFrameFormat)format
+                andFrameRate:(unsigned)fps
           andCaptureCallback:(AVCaptureCallback*)cb;
 {
     if (self = [super init]){
         captureWidth = width;
         captureHeight = height;
         captureFormat = format;
+        captureFrameRate = fps;
+        activeRate = 0;
         [self initSession];
         if (device == Nil) {
             device = [self getFirstPanaCastDevice];
@@ -91,8 +107,7 @@ AVCaptureCallback * callback = NULL;
 
     
     NSDictionary* setcapSettings = [NSDictionary dictionaryWithObjectsAndKeys:
-                                    captureFormat == PANACAST_FRAME_FORMAT_YUYV ?
-                                    [NSNumber numberWithInt: kCVPixelFormatType_422YpCbCr8_yuvs] : [NSNumber numberWithInt: 'dmb1']
+                                    [NSNumber numberWithInt: pixelFormatFor(captureFormat)]
                                     , kCVPixelBufferPixelFormatTypeKey,
                                     [NSNumber numberWithInteger:captureWidth], (id)kCVPixelBufferWidthKey,
                                     [NSNumber numberWithInteger:captureHeight], (id)kCVPixelBufferHeightKey,
@@ -117,6 +132,16 @@ AVCaptureCallback * callback = NULL;
  didOutputSampleBuffer: (CMSampleBufferRef) buffer
         fromConnection: (AVCaptureConnection*) connection
 {
+    uint64_t driverNsec = frameClockNsec();
+    // the presentation time is when the device captured the frame, on the session clock
+    uint64_t deviceNsec = 0;
+    CMTime pts = CMSampleBufferGetPresentationTimeStamp(buffer);
+    if (CMTIME_IS_NUMERIC(pts)) {
+        CMClockRef host = CMClockGetHostTimeClock();
+        if (session.masterClock) pts = CMSyncConvertTime(pts, session.masterClock, host);
+        double age = CMTimeGetSeconds(CMTimeSubtract(CMClockGetTime(host), pts));
+        if (age >= 0 && age < 1) deviceNsec = driverNsec - (uint64_t)(age * 1e9);
+    }
 
     unsigned char *theData = NULL;
     int size = 0;
@@ -136,9 +161,9 @@ AVCaptureCallback * callback = NULL;
         CVImageBufferRef cameraFrame = CMSampleBufferGetImageBuffer(buffer);
         if (cameraFrame != Nil) {
             BOOL isPlanar = CVPixelBufferIsPlanar(cameraFrame);
-            BOOL isYUYV = CVPixelBufferGetPixelFormatType(cameraFrame) == kCVPixelFormatType_422YpCbCr8_yuvs;
-            if (isPlanar || !isYUYV) {
-                DBG("captureOutput: We just got a planar sample buffer.  Was expecting interleaved YUYV!");
+            BOOL isExpected = CVPixelBufferGetPixelFormatType(cameraFrame) == pixelFormatFor(captureFormat);
+            if (isPlanar || !isExpected) {
+                DBG("captureOutput: We just got a planar sample buffer.  Was expecting interleaved YUYV or UYVY!");
                 return;
             }
             //Pixel buffer size is actual frame size.
@@ -158,13 +183,14 @@ AVCaptureCallback * callback = NULL;
     
     if (theData == NULL) return;
     
-    spBufSrc = (CMSampleBufferRef)callback->handleCapturedFrame(theData, captureWidth, captureHeight, captureFormat, size, buffer);
+    spBufSrc = (CMSampleBufferRef)callback->handleCapturedFrame(theData, captureWidth, captureHeight, captureFormat, size, buffer,
+                                                               deviceNsec, driverNsec);
     
     CFRetain(buffer); // retain the current
 
     if (spBufSrc!=nil) {
         // free the older one
-        if (captureFormat == PANACAST_FRAME_FORMAT_YUYV) {
+        if (captureFormat != PANACAST_FRAME_FORMAT_MJPEG) {
             CVImageBufferRef cameraFrame = CMSampleBufferGetImageBuffer(spBufSrc);
             CVPixelBufferUnlockBaseAddress(cameraFrame, 0);
         }
@@ -174,6 +200,14 @@ AVCaptureCallback * callback = NULL;
 
 }
 
+// alwaysDiscardsLateVideoFrames drops silently otherwise
+- (void) captureOutput: (AVCaptureOutput*) output
+   didDropSampleBuffer: (CMSampleBufferRef) buffer
+        fromConnection: (AVCaptureConnection*) connection
+{
+    callback->handleDroppedFrame();
+}
+
 - (void) startCapture
 {
     if (_captureDevice && session)
@@ -186,8 +220,8 @@ AVCaptureCallback * callback = NULL;
             AVCaptureDevice *device = _captureDevice;
             AVCaptureDeviceFormat *bestFormat = nil;
             AVFrameRateRange *bestFrameRateRange = nil;
-            OSType reqdType = captureFormat == PANACAST_FRAME_FORMAT_YUYV ?
-                kCVPixelFormatType_422YpCbCr8_yuvs : 'dmb1';
+            BOOL bestCovers = NO;
+            OSType reqdType = pixelFormatFor(captureFormat);
             
             for ( AVCaptureDeviceFormat *format in [device formats] ) {
                 CMFormatDescriptionRef desc = format.formatDescription;
@@ -199,17 +233,30 @@ AVCaptureCallback * callback = NULL;
                 
                 //NSLog(@"%@, %@", format.mediaType, format.formatDescription);
                 for ( AVFrameRateRange *range in format.videoSupportedFrameRateRanges ) {
-                    if ( range.maxFrameRate > bestFrameRateRange.maxFrameRate ) {
+                    // a range that covers the requested rate wins, otherwise the fastest one
+                    // and MacCameraCapture decimates down to the requested rate
+                    BOOL covers = captureFrameRate != 0 && range.minFrameRate <= captureFrameRate &&
+                                  captureFrameRate <= range.maxFrameRate;
+                    if ( (covers && !bestCovers) ||
+                         (covers == bestCovers && range.maxFrameRate > bestFrameRateRange.maxFrameRate) ) {
                         bestFormat = format;
                         bestFrameRateRange = range;
+                        bestCovers = covers;
                     }
                 }
             }
             if ( bestFormat ) {
                 if ( [device lockForConfiguration:NULL] == YES ) {
                     device.activeFormat = bestFormat;
-                    device.activeVideoMinFrameDuration = bestFrameRateRange.maxFrameDuration;
-                    device.activeVideoMaxFrameDuration = bestFrameRateRange.minFrameDuration;
+                    if (bestCovers) {
+                        device.activeVideoMinFrameDuration = CMTimeMake(1, captureFrameRate);
+                        device.activeVideoMaxFrameDuration = CMTimeMake(1, captureFrameRate);
+                        activeRate = captureFrameRate;
+                    } else {
+                        device.activeVideoMinFrameDuration = bestFrameRateRange.maxFrameDuration;
+                        device.activeVideoMaxFrameDuration = bestFrameRateRange.minFrameDuration;
+                        activeRate = bestFrameRateRange.maxFrameRate;
+                    }
                     [device unlockForConfiguration]; // do not release lock until stopCapture
                 }
             }
@@ -229,6 +276,11 @@ AVCaptureCallback * callback = NULL;
     
 }
 
+- (double) activeFrameRate
+{
+    return activeRate;
+}
+
 - (int) isRunning
 {
     if (!session)
@@ -8,25 +8,28 @@
 #define MACFRAMECAPTURE_H
 #include "PCCameraInterface.h"
 #include "utils.h"
+#include "FrameRing.h"
+#include <atomic>
 #include <memory>
 
-class MacCameraCapture : public CaptureInterface, public AVCaptureCallback {
+class MacCameraCapture : public FrameRingCapture, public AVCaptureCallback {
 public:
-    MacCameraCapture();
+    MacCameraCapture(unsigned ringDepth = FRAME_RING_DEFAULT_DEPTH);
     virtual ~MacCameraCapture();
     bool init(unsigned width, unsigned height, RawFrameFormat format, void * captureDevice);
-    struct RawFrame * getNextFrame();
-    void freeFrame();
     void stopCapture();
     void * handleCapturedFrame(unsigned char * theData, unsigned width,
                                unsigned height, RawFrameFormat format,
-                               int length, void * buffer);
+                               int length, void * buffer,
+                               uint64_t deviceNsec, uint64_t driverNsec);
+    // alwaysDiscardsLateVideoFrames drops frames the callback was too slow for
+    void handleDroppedFrame() { osDropped.fetch_add(1, std::memory_order_relaxed); }
+
+protected:
+    uint64_t sourceDrops() const { return osDropped.load(std::memory_order_relaxed); }
 
 private:
     void *avfoundationCam; // objective-C instance
-    pthread_mutex_t bufferLock;
-    struct RawFrame frames[2];
-    volatile int currFrameIdx;
-    std::unique_ptr<OSEvent> frameAvail;
+    std::atomic<uint64_t> osDropped;
 };
 #endif
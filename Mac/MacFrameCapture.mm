@@ -8,14 +8,10 @@
 #include <string>
 
 
-MacCameraCapture::MacCameraCapture()
+MacCameraCapture::MacCameraCapture(unsigned ringDepth) : FrameRingCapture(ringDepth)
 {
-    pthread_mutex_init(&bufferLock, NULL);
-    memset(&frames[0], 0, sizeof(frames));
-    currFrameIdx = -1;
     avfoundationCam = NULL;
-    int s;
-    frameAvail.reset(new OSEvent(s, false, false));
+    osDropped = 0;
 }
 
 MacCameraCapture::~MacCameraCapture()
@@ -27,50 +23,24 @@ MacCameraCapture::~MacCameraCapture()
 
 bool MacCameraCapture::init(unsigned int width, unsigned int height, RawFrameFormat format, void * captureDevice)
 {
-    if (format != PANACAST_FRAME_FORMAT_MJPEG && format != PANACAST_FRAME_FORMAT_YUYV) return false;
+    // anything else is converted from one of these by ConvertCapture
+    if (format != PANACAST_FRAME_FORMAT_MJPEG && format != PANACAST_FRAME_FORMAT_YUYV &&
+        format != PANACAST_FRAME_FORMAT_UYVY) return false;
     
     if(!avfoundationCam) {
+        pacer.reset();
         AVFoundationCapture * avfoundationCamOC = [[AVFoundationCapture alloc] initWithCaptureDevice: (AVCaptureDevice*) captureDevice
            andWidth:width andHeight:height
-           andFormat:format andCaptureCallback:(AVCaptureCallback *)this];
+           andFormat:format andFrameRate:requestedFrameRate()
+           andCaptureCallback:(AVCaptureCallback *)this];
         [avfoundationCamOC startCapture];
         avfoundationCam = (void *)avfoundationCamOC;
-        pthread_mutex_unlock(&bufferLock);
         return true;
     }
 
     return false;
 }
 
-#define FRAME_AVAILABLE_TIMEOUT_MSEC 100
-
-struct RawFrame * MacCameraCapture::getNextFrame()
-{
-    OSEventError err = frameAvail->TimedWait(FRAME_AVAILABLE_TIMEOUT_MSEC);
-    if (err != OSEvent_Error_None) return NULL;
-
-    pthread_mutex_lock(&bufferLock);
-    if (currFrameIdx < 0) {
-        //printf("get_next_frame: currFrameIdx = %d\n", currFrameIdx);
-        pthread_mutex_unlock(&bufferLock);
-        return NULL;
-    }
-    
-    if (!frames[currFrameIdx].buf) {
-        //printf("get_next_frame: frames[%d].buf = %p\n", currFrameIdx, frames[currFrameIdx].buf);
-        pthread_mutex_unlock(&bufferLock);
-        return NULL;
-    }
-
-    // we keep the mutex locked here until freeFrame is called by the calling code
-    return &frames[currFrameIdx];
-}
-
-void MacCameraCapture::freeFrame()
-{
-    pthread_mutex_unlock(&bufferLock);
-}
-
 void MacCameraCapture::stopCapture()
 {
     if (avfoundationCam != Nil) {
@@ -84,26 +54,37 @@ void * MacCameraCapture::handleCapturedFrame(unsigned char * theData,
                                           unsigned height,
                                           RawFrameFormat format,
                                           int length,
-                                          void * buffer)
+                                          void * buffer,
+                                          uint64_t deviceNsec,
+                                          uint64_t driverNsec)
 {
-    pthread_mutex_lock(&bufferLock);
-    int nextFrameIdx = (currFrameIdx + 1) % 2;
-    void * spBufSrc = frames[nextFrameIdx].private_data;
+    // the presentation time puts the frame on the device's own cadence; both are on the frame clock
+    uint64_t timestamp = deviceNsec ? deviceNsec : frameClockNsec();
+    if (!paceFrame(timestamp)) {
+        // the device runs faster than requested, skip this one
+        return buffer;
+    }
 
-    frames[nextFrameIdx].buf = theData;
-    frames[nextFrameIdx].size = length;
-    frames[nextFrameIdx].private_data = buffer;
-    frames[nextFrameIdx].format = format;
-    frames[nextFrameIdx].width = width;
-    frames[nextFrameIdx].height = height;
+    RawFrame * frame = ring.claim();
+    if (frame == NULL) {
+        // every slot is held by a consumer, drop this frame rather than stall the capture queue
+        return buffer;
+    }
 
-    
-    currFrameIdx = nextFrameIdx;
-    pthread_mutex_unlock(&bufferLock);
+    // hand the sample buffer previously stored in this slot back to AVFoundation
+    void * spBufSrc = frame->private_data;
+
+    frame->buf = theData;
+    frame->size = length;
+    frame->private_data = buffer;
+    frame->format = format;
+    frame->width = width;
+    frame->height = height;
+    frame->timestamp = timestamp;
+    frame->stageTime[FRAME_STAGE_DEVICE] = deviceNsec;
+    frame->stageTime[FRAME_STAGE_DRIVER] = driverNsec;
+    frame->stageTime[FRAME_STAGE_CALLBACK] = frameClockNsec();
+    publishFrame(frame);
 
-    frameAvail->Signal(); // tell any waiting threads that we have a frame
     return spBufSrc;
 }
-
-
-
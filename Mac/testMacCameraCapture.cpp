@@ -1,4 +1,5 @@
 #include "MacFrameCapture.h"
+#include "FrameRecorder.h"
 #include <stdio.h>
 #include <unistd.h>
 #include <iostream>
@@ -11,29 +12,6 @@ double time_stamp ()
    return t.tv_sec + t.tv_usec*1e-6;
 }
 
-bool saveFrame(RawFrame * frame){
-   const char * name = frame->format == PANACAST_FRAME_FORMAT_YUYV ?"shutup.yuyv" : "shutup.jpg";
-   FILE * panafile = fopen(name, "wb");
-   
-
-   unsigned int frameSize = frame->format == PANACAST_FRAME_FORMAT_YUYV ? frame->width * frame->height * 2 : frame->size;  
-   if (panafile != NULL){
-      if ( fwrite(frame->buf, sizeof(char), frameSize, panafile) != frameSize ){
-         printf("what the heck cannot write to file %s\n", name);
-         return false;
-      } else {
-         fclose(panafile);
-         printf("wrote to file %s\n", name);
-         return true;
-      }
-   } else {
-      printf("unable to write to file %s\n", name);
-      return false;
-   } 
-}
-
-
-
 int main(int argc, char * argv[])
 {
    MacCameraCapture m;   
@@ -44,33 +22,38 @@ int main(int argc, char * argv[])
 
    double startTime = time_stamp();
    double secondsToCount = 5;
-   int counter = 0;
    unsigned int microseconds = 1e6/40;
    printf("sleep between frames = %u\n", microseconds);
 
-   bool saveFrameFlag = false;
+   // testCap <file> records every frame for offline analysis (replay it with ReplayCapture)
+   FrameRecorder recorder;
+   if (argc > 1 && !recorder.open(argv[1])) {
+      printf("unable to record to %s\n", argv[1]);
+      return -1;
+   }
+
    while (true) {
 
       //printf("main: calling getNextFrame\n");
       RawFrame * frame = m.getNextFrame();
 
       if (frame != NULL) {
-         if (saveFrameFlag) {
-            saveFrame(frame);
-            saveFrameFlag = false;
+         if (recorder.isOpen() && !recorder.append(frame)) {
+            printf("could not record frame %llu\n", (unsigned long long)frame->sequence);
          }
-         m.freeFrame(); // tell MacCameraCapture that we are done with this frame
+         m.freeFrame(frame); // tell MacCameraCapture that we are done with this frame
 
-         counter ++;
          double secondsPassed = (double)(time_stamp() - startTime);
          //printf("secondsPassed = %f\n", secondsPassed);
 
          if (secondsPassed >= secondsToCount) {
 
-            double fps = counter / secondsPassed;
-            std::cout << fps << " fps" << std::endl;
+            StreamStats stats;
+            m.getStats(stats);
+            printf("%.1f fps (%.1f average), %llu delivered, %llu dropped, %llu late, jitter %.2f ms\n",
+                   stats.fps, stats.averageFps, (unsigned long long)stats.delivered,
+                   (unsigned long long)stats.dropped, (unsigned long long)stats.late, stats.jitterMsec);
             startTime = time_stamp();
-            counter = 0;
 
          }
       }
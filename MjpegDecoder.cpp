@@ -0,0 +1,126 @@
+#include "MjpegDecoder.h"
+#include <setjmp.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <jpeglib.h>
+
+// scanlines per jpeg_read_scanlines call, libjpeg never hands out more than a few
+#define MJPEG_MAX_ROWS 16
+
+// libjpeg reports errors through error_exit, which must not return
+struct MjpegError {
+    jpeg_error_mgr mgr;
+    jmp_buf jump;
+};
+
+struct MjpegDecoder::State {
+    jpeg_decompress_struct cinfo;
+    MjpegError error;
+    std::vector<uint8_t> ycc; // YCbCr scanlines on their way to YUYV
+};
+
+static void errorExit(j_common_ptr cinfo)
+{
+    longjmp(((MjpegError *)cinfo->err)->jump, 1);
+}
+
+// warnings mean corrupt data libjpeg decoded around; counted, not printed
+static void emitMessage(j_common_ptr cinfo, int level)
+{
+    if (level < 0) cinfo->err->num_warnings++;
+}
+
+MjpegDecoder::MjpegDecoder() : state(new State)
+{
+    jpeg_decompress_struct& cinfo = state->cinfo;
+    cinfo.err = jpeg_std_error(&state->error.mgr);
+    state->error.mgr.error_exit = errorExit;
+    state->error.mgr.emit_message = emitMessage;
+    jpeg_create_decompress(&cinfo);
+}
+
+MjpegDecoder::~MjpegDecoder()
+{
+    jpeg_destroy_decompress(&state->cinfo);
+}
+
+bool MjpegDecoder::decodeSupported(RawFrameFormat format)
+{
+    return format == PANACAST_FRAME_FORMAT_BGR24 || format == PANACAST_FRAME_FORMAT_RGB24 ||
+           format == PANACAST_FRAME_FORMAT_BGRA32 || format == PANACAST_FRAME_FORMAT_YUYV ||
+           format == PANACAST_FRAME_FORMAT_UYVY;
+}
+
+// YCbCr 4:4:4 pixels to a row of YUYV or UYVY, averaging the chroma of each pair
+static void packRow(const uint8_t * ycc, uint8_t * dst, unsigned width, bool uyvy)
+{
+    unsigned y = uyvy ? 1 : 0, c = uyvy ? 0 : 1;
+    for (unsigned x = 0; x < width; x += 2, ycc += 6, dst += 4) {
+        dst[y] = ycc[0];
+        dst[y + 2] = ycc[3];
+        dst[c] = (uint8_t)((ycc[1] + ycc[4] + 1) >> 1);
+        dst[c + 2] = (uint8_t)((ycc[2] + ycc[5] + 1) >> 1);
+    }
+}
+
+bool MjpegDecoder::decode(const uint8_t * jpeg, size_t size, unsigned scale, uint8_t * dst, unsigned stride,
+                          RawFrameFormat format, unsigned width, unsigned height)
+{
+    if (!decodeSupported(format) || (scale != 1 && scale != 2 && scale != 4 && scale != 8)) return false;
+    bool packed422 = format == PANACAST_FRAME_FORMAT_YUYV || format == PANACAST_FRAME_FORMAT_UYVY;
+    if (packed422 && (width & 1)) return false;
+    if (stride == 0) stride = rawFrameSize(format, width, 1);
+    if (size < 4) return false;
+
+    jpeg_decompress_struct& cinfo = state->cinfo;
+    if (setjmp(state->error.jump)) {
+        jpeg_abort_decompress(&cinfo);
+        return false;
+    }
+    jpeg_mem_src(&cinfo, (unsigned char *)jpeg, (unsigned long)size);
+    cinfo.err->num_warnings = 0;
+    if (jpeg_read_header(&cinfo, TRUE) != JPEG_HEADER_OK) {
+        jpeg_abort_decompress(&cinfo);
+        return false;
+    }
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = scale;
+    switch (format) {
+        case PANACAST_FRAME_FORMAT_BGR24: cinfo.out_color_space = JCS_EXT_BGR; break;
+        case PANACAST_FRAME_FORMAT_RGB24: cinfo.out_color_space = JCS_EXT_RGB; break;
+        case PANACAST_FRAME_FORMAT_BGRA32: cinfo.out_color_space = JCS_EXT_BGRA; break;
+        default:
+            // chroma as it was sent: repeated across a pair, which packing averages back
+            cinfo.out_color_space = JCS_YCbCr;
+            cinfo.do_fancy_upsampling = FALSE;
+            break;
+    }
+    jpeg_calc_output_dimensions(&cinfo);
+    unsigned columns = packed422 ? cinfo.output_width & ~1u : cinfo.output_width;
+    if (columns != width || cinfo.output_height != height) {
+        jpeg_abort_decompress(&cinfo);
+        return false;
+    }
+
+    jpeg_start_decompress(&cinfo);
+    JSAMPROW rows[MJPEG_MAX_ROWS];
+    unsigned batch = cinfo.rec_outbuf_height < MJPEG_MAX_ROWS ? cinfo.rec_outbuf_height : MJPEG_MAX_ROWS;
+    size_t yccRow = (size_t)cinfo.output_width * 3;
+    if (packed422 && state->ycc.size() < yccRow * batch) state->ycc.resize(yccRow * batch);
+    while (cinfo.output_scanline < cinfo.output_height) {
+        unsigned first = cinfo.output_scanline, n = cinfo.output_height - first < batch ? cinfo.output_height - first : batch;
+        for (unsigned r = 0; r < n; r++) {
+            rows[r] = packed422 ? &state->ycc[r * yccRow] : dst + (size_t)(first + r) * stride;
+        }
+        unsigned got = jpeg_read_scanlines(&cinfo, rows, n);
+        for (unsigned r = 0; packed422 && r < got; r++) {
+            packRow(rows[r], dst + (size_t)(first + r) * stride, width, format == PANACAST_FRAME_FORMAT_UYVY);
+        }
+        if (got == 0) break;
+    }
+    bool ok = cinfo.output_scanline == cinfo.output_height && cinfo.err->num_warnings == 0;
+    // finishing reads on to EOI, which a truncated frame does not have
+    jpeg_abort_decompress(&cinfo);
+    return ok;
+}
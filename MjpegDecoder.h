@@ -0,0 +1,46 @@
+//
+//  MjpegDecoder.h
+//
+//  libjpeg(-turbo) decompressor for the frames of an MJPEG stream, set up
+//  once and reused for every frame, so a decoder thread only pays for the
+//  entropy decoding and IDCT. Packed RGB comes straight out of libjpeg's
+//  colour conversion; YUYV and UYVY are packed from its YCbCr output with
+//  chroma upsampling turned off, which for the 4:2:2 streams cameras send
+//  hands the chroma over untouched. Frames can be decoded at 1/2, 1/4 or
+//  1/8 size with the scaled IDCT, for a fraction of the full decode.
+//
+
+#ifndef MJPEGDECODER_H
+#define MJPEGDECODER_H
+
+#include "PCCameraInterface.h"
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+
+class MjpegDecoder {
+public:
+    MjpegDecoder();
+    ~MjpegDecoder();
+
+    // formats decode writes: BGR24, RGB24, BGRA32, YUYV and UYVY
+    static bool decodeSupported(RawFrameFormat format);
+    // rows or columns of size decoded at 1/scale
+    static unsigned scaledSize(unsigned size, unsigned scale) { return (size + scale - 1) / scale; }
+
+    // Decode jpeg at 1/scale (1, 2, 4 or 8) into width x height pixels of format at dst,
+    // stride bytes per row (0 for packed rows). false if the data is corrupt, or the image
+    // is not width x height at that scale; YUYV and UYVY drop the odd last column.
+    bool decode(const uint8_t * jpeg, size_t size, unsigned scale, uint8_t * dst, unsigned stride,
+                RawFrameFormat format, unsigned width, unsigned height);
+
+private:
+    struct State;
+    std::unique_ptr<State> state;
+
+    //disable copy constructor and assignment operator
+    MjpegDecoder(const MjpegDecoder&);
+    void operator=(const MjpegDecoder&);
+};
+
+#endif
@@ -0,0 +1,128 @@
+#include "MotionGate.h"
+#include "FrameConvertKernels.h"
+#include <string.h>
+
+static bool sameSettings(const MotionGateSettings& a, const MotionGateSettings& b)
+{
+    return a.enabled == b.enabled && a.threshold == b.threshold && a.suppress == b.suppress && a.tilesX == b.tilesX &&
+           a.tilesY == b.tilesY && a.rowStep == b.rowStep && a.keepAlive == b.keepAlive;
+}
+
+MotionGate::MotionGate()
+    : fmt(PANACAST_FRAME_FORMAT_MJPEG), width(0), height(0), configured(false), primed(false), mask(0), tileCount(0),
+      stillRun(0)
+{
+}
+
+bool MotionGate::supported(RawFrameFormat format)
+{
+    return isPacked422(format) || is420(format);
+}
+
+bool MotionGate::valid(const MotionGateSettings& settings)
+{
+    return settings.tilesX && settings.tilesY && settings.tilesX * settings.tilesY <= MOTION_MAX_TILES &&
+           settings.rowStep && settings.threshold >= 0;
+}
+
+bool MotionGate::configure(RawFrameFormat format, unsigned _width, unsigned _height, const MotionGateSettings& settings)
+{
+    configured = false;
+    primed = false;
+    stillRun = 0;
+    unsigned tilesX = settings.tilesX, tilesY = settings.tilesY, step = settings.rowStep;
+    if (!supported(format) || !valid(settings) || _width == 0 || (_width & 1) || _height == 0) return false;
+    if (tilesX > _width / 2 || tilesY > _height / step) return false;
+
+    // YUYV has luma in the even bytes, UYVY in the odd ones, a 4:2:0 luma plane in all
+    mask = format == PANACAST_FRAME_FORMAT_YUYV ? 0x00FF : format == PANACAST_FRAME_FORMAT_UYVY ? 0xFF00 : 0xFFFF;
+    unsigned pixelBytes = isPacked422(format) ? 2 : 1;
+
+    // tile edges on even pixels, so every segment starts where mask does
+    columns.resize(tilesX + 1);
+    for (unsigned tx = 0; tx <= tilesX; tx++) columns[tx] = (unsigned)((uint64_t)_width * tx / tilesX & ~1ULL) * pixelBytes;
+
+    // the middle row of every step, so a tile row never starts with one taken from the tile above
+    rows.clear();
+    rowTile.clear();
+    samples.assign(tilesX * tilesY, 0);
+    for (unsigned y = step / 2; y < _height; y += step) {
+        unsigned ty = (unsigned)((uint64_t)y * tilesY / _height);
+        rows.push_back(y);
+        rowTile.push_back(ty * tilesX);
+        for (unsigned tx = 0; tx < tilesX; tx++) samples[ty * tilesX + tx] += (columns[tx + 1] - columns[tx]) / pixelBytes;
+    }
+    for (unsigned t = 0; t < tilesX * tilesY; t++) {
+        if (samples[t] == 0) return false;
+    }
+    reference.resize((size_t)rows.size() * rowBytes(format, _width));
+
+    fmt = format;
+    width = _width;
+    height = _height;
+    config = settings;
+    tileCount = tilesX * tilesY;
+    configured = true;
+    return true;
+}
+
+bool MotionGate::configuredFor(RawFrameFormat format, unsigned _width, unsigned _height,
+                               const MotionGateSettings& settings) const
+{
+    return configured && fmt == format && width == _width && height == _height && sameSettings(config, settings);
+}
+
+void MotionGate::measure(const uint8_t * frame, unsigned stride, FrameMotion& motion, ConvertIsa isa)
+{
+    memset(&motion, 0, sizeof(motion));
+    if (!configured) return;
+    motion.measured = true;
+    motion.tilesX = (uint8_t)config.tilesX;
+    motion.tilesY = (uint8_t)config.tilesY;
+
+    const ConvertKernels& k = convertKernels(isa);
+    const ConvertKernels& scalar = convertKernels(CONVERT_ISA_SCALAR);
+    unsigned bytes = rowBytes(fmt, width);
+    if (stride == 0) stride = bytes;
+    uint32_t sums[MOTION_MAX_TILES];
+    memset(sums, 0, sizeof(uint32_t) * tileCount);
+    for (size_t r = 0; r < rows.size(); r++) {
+        const uint8_t * src = frame + (size_t)rows[r] * stride;
+        uint8_t * ref = &reference[r * bytes];
+        uint32_t * tileSums = sums + rowTile[r];
+        for (unsigned tx = 0; tx < config.tilesX; tx++) {
+            unsigned x = columns[tx], n = columns[tx + 1] - x;
+            unsigned done = k.difference(src + x, ref + x, n, mask, &tileSums[tx]);
+            if (done < n) scalar.difference(src + x + done, ref + x + done, n - done, mask, &tileSums[tx]);
+        }
+    }
+
+    if (!primed) {
+        primed = true;
+        motion.moving = true;
+        motion.level = 255;
+        memset(motion.tiles, 255, tileCount);
+        return;
+    }
+    double most = 0;
+    for (unsigned t = 0; t < tileCount; t++) {
+        double level = (double)sums[t] / samples[t];
+        if (level > most) most = level;
+        motion.tiles[t] = (uint8_t)(level + 0.5);
+    }
+    motion.level = (uint8_t)(most + 0.5);
+    motion.moving = most >= config.threshold;
+}
+
+bool MotionGate::suppress(const FrameMotion& motion)
+{
+    if (!motion.measured || motion.moving || !config.suppress) {
+        stillRun = 0;
+        return false;
+    }
+    if (config.keepAlive && ++stillRun >= config.keepAlive) {
+        stillRun = 0;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,64 @@
+//
+//  MotionGate.h
+//
+//  Motion detection cheap enough to run on every frame of a 4K stream before
+//  anything else does: a static conference room should not go through
+//  conversion and inference thirty times a second. Every rowStep-th luma row
+//  of a YUYV, UYVY, NV12, YV12 or I420 frame is compared with the same row of
+//  the frame before, with the SAD instructions of the FrameConvert kernels,
+//  and the sums are kept per tile of a tilesX x tilesY grid. The rows compared
+//  are copied in the same pass and become the reference for the next frame,
+//  so a gate reads each sampled row once and keeps nothing else.
+//
+
+#ifndef MOTIONGATE_H
+#define MOTIONGATE_H
+
+#include "FrameConvert.h"
+#include "PCCameraInterface.h"
+#include <stdint.h>
+#include <vector>
+
+class MotionGate {
+public:
+    MotionGate();
+
+    // formats whose luma the gate can read: the packed 4:2:2 and 4:2:0 ones
+    static bool supported(RawFrameFormat format);
+    // settings that make a gate for some frame size: tiles within MOTION_MAX_TILES, a row
+    // step and a threshold that is not negative
+    static bool valid(const MotionGateSettings& settings);
+
+    // Set up for frames of format at width x height. false if the format is not supported,
+    // the width is odd, or the tiles do not fit MOTION_MAX_TILES or the frame (a tile is at
+    // least two pixels wide and one sampled row high). Forgets the reference frame.
+    bool configure(RawFrameFormat format, unsigned width, unsigned height, const MotionGateSettings& settings);
+    // true if configured for exactly this
+    bool configuredFor(RawFrameFormat format, unsigned width, unsigned height, const MotionGateSettings& settings) const;
+
+    // Compare frame with the previous one measured and make it the reference for the next.
+    // stride as in convertFrame, 0 for rows packed back to back. The first frame after
+    // configure has nothing to compare with and counts as moving, every tile at 255.
+    void measure(const uint8_t * frame, unsigned stride, FrameMotion& motion, ConvertIsa isa = CONVERT_ISA_AUTO);
+    // Whether a frame measure found still is left out, given the settings; counts the still
+    // frames in a row for keepAlive. Call once per measured frame.
+    bool suppress(const FrameMotion& motion);
+
+private:
+    RawFrameFormat fmt;
+    unsigned width;
+    unsigned height;
+    MotionGateSettings config;
+    bool configured;
+    bool primed;            // the reference holds a frame
+    unsigned mask;          // DifferenceRow's, the luma bytes of a row
+    unsigned tileCount;
+    std::vector<unsigned> rows;        // luma rows compared, top to bottom
+    std::vector<unsigned> rowTile;     // first tile of each of them
+    std::vector<unsigned> columns;     // tilesX + 1 byte offsets of the tile edges in a row
+    std::vector<uint32_t> samples;     // luma samples compared per tile
+    std::vector<uint8_t> reference;    // the compared rows of the previous frame
+    unsigned stillRun;                 // still frames since the last one let through
+};
+
+#endif
@@ -6,13 +6,80 @@
 #ifndef PCCAMERAINTERFACE_H
 #define PCCAMERAINTERFACE_H 
 
+#include <functional>
 #include <string>
+#include <utility>
+#include <ctype.h>
+#include <stdint.h>
+
 enum RawFrameFormat {
    PANACAST_FRAME_FORMAT_YUYV,
    PANACAST_FRAME_FORMAT_UYVY,
    PANACAST_FRAME_FORMAT_MJPEG,
    PANACAST_FRAME_FORMAT_YV12,
    PANACAST_FRAME_FORMAT_NV12,
+   // packed RGB, produced by FrameConvert.h rather than by cameras
+   PANACAST_FRAME_FORMAT_BGR24,
+   PANACAST_FRAME_FORMAT_RGB24,
+   PANACAST_FRAME_FORMAT_BGRA32,
+   PANACAST_FRAME_FORMAT_I420, // YV12 with the U plane first
+};
+
+// Points a frame passes between the sensor and its consumers. RawFrame::stageTime has the
+// producer stages; a frame has many consumers, so their stages only go into the stream's
+// latency histograms (FrameLatency.h).
+enum FrameStage {
+   FRAME_STAGE_DEVICE,   // exposure time reported by the device, if it reports one
+   FRAME_STAGE_DRIVER,   // the OS handed the buffer over (DQBUF returned, sample callback entered)
+   FRAME_STAGE_CALLBACK, // the backend has the frame in a ring slot
+   FRAME_STAGE_PUBLISH,  // visible to consumers
+   FRAME_STAGE_ACQUIRE,  // a consumer took it, through getNextFrame or the frame handler
+   FRAME_STAGE_RELEASE,  // a consumer let go of it
+   FRAME_STAGES,
+};
+
+#define FRAME_PRODUCER_STAGES FRAME_STAGE_ACQUIRE
+
+// Header of an MJPEG frame, found by parseJpegHeader (JpegHeader.h) without decoding.
+// FrameRingCapture fills it in for every MJPEG frame it publishes.
+struct JpegHeader {
+   bool valid;               // SOI, a frame header, a scan and EOI were all there
+   uint8_t frameType;        // the SOFn marker, 0xC0 for baseline
+   uint8_t components;
+   uint8_t sampling[4];      // per component: horizontal factor << 4 | vertical factor
+   uint16_t width;
+   uint16_t height;
+   uint16_t restartInterval; // MCUs between restart markers, 0 for none
+   uint32_t scanOffset;      // first byte of the entropy-coded data
+   uint32_t size;            // bytes up to and including EOI, without any padding after it
+};
+
+#define MOTION_MAX_TILES 256
+
+// How much a frame differs from the one before it, measured on a subsample of the luma
+// by the stream's motion gate (MotionGate.h). Levels are the mean absolute difference of
+// the luma samples, 0..255.
+struct FrameMotion {
+   bool measured;            // false if the stream has no gate, or not for this format
+   bool moving;              // level reached the gate's threshold
+   uint8_t level;            // of the tile that changed most
+   uint8_t tilesX;
+   uint8_t tilesY;
+   uint8_t tiles[MOTION_MAX_TILES]; // tilesY rows of tilesX levels, the top left tile first
+};
+
+// Motion gate of a stream: frames whose luma barely changed from the frame before are
+// left out (suppress) or only marked so (not suppress).
+struct MotionGateSettings {
+   bool enabled;
+   double threshold;   // a frame moves if the mean absolute difference of some tile reaches this
+   bool suppress;      // drop still frames before anyone sees them, rather than flag them
+   unsigned tilesX;    // the motion map, tilesX * tilesY at most MOTION_MAX_TILES
+   unsigned tilesY;
+   unsigned rowStep;   // compare every rowStep-th luma row
+   unsigned keepAlive; // while suppressing, still let every keepAlive-th still frame through; 0 never
+
+   MotionGateSettings() : enabled(false), threshold(2), suppress(true), tilesX(16), tilesY(9), rowStep(4), keepAlive(0) {}
 };
 
 struct RawFrame {
@@ -23,24 +90,189 @@ struct RawFrame {
    enum RawFrameFormat  format;
    unsigned width;
    unsigned height;
+   uint64_t sequence; // set by FrameRing::publish, increases by one per published frame
+   uint64_t timestamp; // frameClockNsec at capture, on an even 1/fps grid while frames are decimated
+   uint64_t stageTime[FRAME_PRODUCER_STAGES]; // frameClockNsec per FrameStage, 0 where the backend has no such stage
+   struct JpegHeader jpeg; // MJPEG frames only, valid is false for every other format
+   struct FrameMotion motion;
 };
 
+// Health of a capture stream, see CaptureInterface::getStats. Counters run from when the backend was made.
+struct StreamStats {
+   uint64_t delivered;   // frames published to consumers
+   uint64_t dropped;     // frames the device sent that never reached consumers: driver or OS drops,
+                         // corrupt buffers, every ring slot held by a consumer
+   uint64_t corrupt;     // of those, frames that arrived damaged: flagged by the driver, truncated
+                         // or malformed MJPEG, undecodable
+   uint64_t late;        // delivered more than 1.5 average intervals after the frame before
+   uint64_t decimated;   // skipped on purpose to hold the requested frame rate, not a loss
+   uint64_t still;       // suppressed by the motion gate because nothing moved, not a loss either
+   uint64_t consumed;    // taken by getNextFrame or pushed to the frame handler
+   double fps;           // delivery rate over the last few frames
+   double averageFps;    // delivery rate since the first frame
+   double jitterMsec;    // smoothed deviation of the delivery interval from its average (RFC 3550 style)
+   unsigned queueDepth;  // frames consumers hold or have queued (pinned ring slots)
+   uint64_t consumerLag; // frames published since the newest one getNextFrame handed out
+};
+
+// bytes in an uncompressed frame, 0 for MJPEG whose size varies per frame
+inline unsigned rawFrameSize(RawFrameFormat format, unsigned width, unsigned height)
+{
+   switch (format) {
+      case PANACAST_FRAME_FORMAT_YUYV:
+      case PANACAST_FRAME_FORMAT_UYVY:
+         return width * height * 2;
+      case PANACAST_FRAME_FORMAT_YV12:
+      case PANACAST_FRAME_FORMAT_NV12:
+      case PANACAST_FRAME_FORMAT_I420:
+         return width * height * 3 / 2;
+      case PANACAST_FRAME_FORMAT_BGR24:
+      case PANACAST_FRAME_FORMAT_RGB24:
+         return width * height * 3;
+      case PANACAST_FRAME_FORMAT_BGRA32:
+         return width * height * 4;
+      default:
+         return 0;
+   }
+}
+
+// formats a camera delivers, as opposed to the ones FrameConvert.h turns them into
+inline bool rawFrameFormatFromCamera(RawFrameFormat format)
+{
+   return format <= PANACAST_FRAME_FORMAT_NV12 || format == PANACAST_FRAME_FORMAT_I420;
+}
+
+// accepts the fourcc style names used by setStreamParams ("YUYV", "mjpg", "nv12", ...)
+inline bool rawFrameFormatFromString(std::string name, RawFrameFormat& format)
+{
+   for (size_t k = 0; k < name.size(); k++) name[k] = toupper(name[k]);
+
+   if (name == "YUYV" || name == "YUY2") format = PANACAST_FRAME_FORMAT_YUYV;
+   else if (name == "UYVY") format = PANACAST_FRAME_FORMAT_UYVY;
+   else if (name == "MJPG" || name == "MJPEG") format = PANACAST_FRAME_FORMAT_MJPEG;
+   else if (name == "YV12") format = PANACAST_FRAME_FORMAT_YV12;
+   else if (name == "NV12") format = PANACAST_FRAME_FORMAT_NV12;
+   else if (name == "I420" || name == "YU12") format = PANACAST_FRAME_FORMAT_I420;
+   else if (name == "BGR" || name == "BGR24") format = PANACAST_FRAME_FORMAT_BGR24;
+   else if (name == "RGB" || name == "RGB24") format = PANACAST_FRAME_FORMAT_RGB24;
+   else if (name == "BGRA" || name == "BGRA32") format = PANACAST_FRAME_FORMAT_BGRA32;
+   else return false;
+   return true;
+}
+
+class FrameRef;
+class FrameLatencyTrace;
+
+// Push-mode consumer, called on the capture thread for every published frame before
+// pull consumers are woken. Contract:
+//  - it runs on the thread that delivers frames: keep it short and never block,
+//    time spent here is latency for everyone and frames are dropped if it falls behind;
+//  - the frame is the capture buffer itself, read it but do not write to it;
+//  - the reference is only valid during the call, copy the FrameRef to keep the frame
+//    (that pins a ring slot until the copy is dropped, so keep few and let go soon);
+//  - do not call back into the stream (getFrame, setFrameHandler, stopCapture, ...)
+//    and do not destroy it from inside the handler.
+typedef std::function<void(const FrameRef& frame)> FrameHandler;
 
 class CaptureInterface {
    public:
       virtual bool init(unsigned width, unsigned height, RawFrameFormat format, void * captureDevice) = 0;
       virtual struct RawFrame * getNextFrame() = 0;
+      virtual void retainFrame(struct RawFrame * frame) = 0;
+      virtual void freeFrame(struct RawFrame * frame) = 0;
       virtual void stopCapture() = 0;
+      virtual ~CaptureInterface() {}
+
+      // Ask for a frame rate before init. Backends negotiate it with the device and
+      // decimate whatever the device cannot do; 0 delivers every frame the device sends.
+      virtual void setFrameRate(unsigned fps) {}
+      // rate frames have been delivered at recently, 0 if the backend does not know
+      virtual double achievedFrameRate() { return 0; }
+
+      // Readable while a frame newer than the last one taken is waiting, for consumers
+      // that poll many cameras from one thread; -1 if the backend has none. Taking the
+      // frame clears it. Owned by the backend, do not close or read it.
+      virtual int frameReadyFd() { return -1; }
+      // like getNextFrame, but NULL straight away when no new frame is waiting
+      virtual struct RawFrame * tryGetNextFrame() { return NULL; }
+      // Any thread. Frames keep going to getNextFrame as well. An empty handler removes it;
+      // once this returns the old handler is not running and will not be called again.
+      // false if the backend cannot push frames.
+      virtual bool setFrameHandler(FrameHandler handler) { return false; }
+      // per-stage latency histograms of this stream, NULL if the backend does not trace frames
+      virtual FrameLatencyTrace * latencyTrace() { return NULL; }
+      // Any thread, cheap enough to poll every frame. false if the backend keeps no counters.
+      virtual bool getStats(StreamStats& stats) { return false; }
+      // Any thread. Measure motion on the frames this backend publishes, see FrameMotion;
+      // settings.enabled false removes the gate. false if the backend cannot gate frames.
+      virtual bool setMotionGate(const MotionGateSettings& settings) { return false; }
+
+      FrameRef nextFrame();
+      FrameRef tryNextFrame();
 };
 
+// Reference-counted handle to a captured frame. Copies share the frame and the
+// buffer goes back to the backend when the last handle is dropped, so several
+// stages can each hold a different frame without pairing getNextFrame/freeFrame.
+class FrameRef {
+   public:
+      FrameRef() : owner(NULL), frame(NULL) {}
+      // adopts the reference returned by getNextFrame
+      FrameRef(CaptureInterface * _owner, struct RawFrame * _frame) : owner(_owner), frame(_frame) {
+         if (frame == NULL) owner = NULL;
+      }
+      FrameRef(const FrameRef& other) : owner(other.owner), frame(other.frame) {
+         if (frame) owner->retainFrame(frame);
+      }
+      FrameRef(FrameRef&& other) : owner(other.owner), frame(other.frame) {
+         other.owner = NULL;
+         other.frame = NULL;
+      }
+      FrameRef& operator=(FrameRef other) {
+         std::swap(owner, other.owner);
+         std::swap(frame, other.frame);
+         return *this;
+      }
+      ~FrameRef() { reset(); }
+
+      void reset() {
+         if (frame) owner->freeFrame(frame);
+         owner = NULL;
+         frame = NULL;
+      }
+
+      struct RawFrame * get() const { return frame; }
+      struct RawFrame * operator->() const { return frame; }
+      explicit operator bool() const { return frame != NULL; }
+
+   private:
+      CaptureInterface * owner;
+      struct RawFrame * frame;
+};
+
+inline FrameRef CaptureInterface::nextFrame()
+{
+   return FrameRef(this, getNextFrame());
+}
+
+inline FrameRef CaptureInterface::tryNextFrame()
+{
+   return FrameRef(this, tryGetNextFrame());
+}
+
 class AVCaptureCallback {
 public:
+    // deviceNsec and driverNsec are on the frameClockNsec clock, see FRAME_STAGE_DEVICE and FRAME_STAGE_DRIVER
     virtual void * handleCapturedFrame(unsigned char * theData,
                                        unsigned width,
                                        unsigned height,
                                        RawFrameFormat format,
                                        int length,
-                                       void * buffer) = 0;
+                                       void * buffer,
+                                       uint64_t deviceNsec,
+                                       uint64_t driverNsec) = 0;
+    // the OS dropped a frame before handing it over
+    virtual void handleDroppedFrame() {}
 };
 
 
@@ -0,0 +1,211 @@
+#include "ReplayCapture.h"
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <chrono>
+
+// used between the last and first frame when looping a single-frame file
+#define REPLAY_DEFAULT_INTERVAL_NSEC 33333333ULL
+// fast replay waits on consumers this long at a time, so a missed wakeup only costs a short stall
+#define REPLAY_CONSUMER_WAIT_MSEC 10
+
+ReplayCapture::ReplayCapture(const std::string& _path, ReplayMode _mode, bool _loop, unsigned ringDepth)
+    : FrameRingCapture(ringDepth), path(_path), mode(_mode), loop(_loop)
+{
+    fd = -1;
+    map = NULL;
+    mapSize = 0;
+    index = NULL;
+    numFrames = 0;
+    running = false;
+    done = false;
+    replayed = 0;
+}
+
+ReplayCapture::~ReplayCapture()
+{
+    stopCapture();
+    unmapFile();
+}
+
+bool ReplayCapture::isReplayDevice(const std::string& deviceName)
+{
+    return deviceName.compare(0, strlen(REPLAY_DEVICE_PREFIX), REPLAY_DEVICE_PREFIX) == 0 ||
+           deviceName.compare(0, strlen(REPLAY_FAST_DEVICE_PREFIX), REPLAY_FAST_DEVICE_PREFIX) == 0;
+}
+
+ReplayCapture * ReplayCapture::fromDeviceName(const std::string& deviceName, unsigned ringDepth)
+{
+    if (deviceName.compare(0, strlen(REPLAY_FAST_DEVICE_PREFIX), REPLAY_FAST_DEVICE_PREFIX) == 0) {
+        return new ReplayCapture(deviceName.substr(strlen(REPLAY_FAST_DEVICE_PREFIX)), REPLAY_FAST, true, ringDepth);
+    }
+    if (deviceName.compare(0, strlen(REPLAY_DEVICE_PREFIX), REPLAY_DEVICE_PREFIX) == 0) {
+        return new ReplayCapture(deviceName.substr(strlen(REPLAY_DEVICE_PREFIX)), REPLAY_PACED, true, ringDepth);
+    }
+    return NULL;
+}
+
+bool ReplayCapture::mapFile()
+{
+    fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        printf("ReplayCapture: cannot open %s\n", path.c_str());
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(StreamFileHeader)) {
+        printf("ReplayCapture: %s is not a stream file\n", path.c_str());
+        unmapFile();
+        return false;
+    }
+
+    mapSize = st.st_size;
+    void * p = mmap(NULL, mapSize, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        printf("ReplayCapture: mmap of %s failed\n", path.c_str());
+        mapSize = 0;
+        unmapFile();
+        return false;
+    }
+    map = (unsigned char *)p;
+    madvise(map, mapSize, MADV_SEQUENTIAL);
+
+    const StreamFileHeader * header = (const StreamFileHeader *)map;
+    if (!isStreamFileHeader(header) ||
+        header->indexOffset + header->indexCapacity * sizeof(StreamFileFrame) > mapSize) {
+        printf("ReplayCapture: %s is not a stream file\n", path.c_str());
+        unmapFile();
+        return false;
+    }
+
+    // stop at the first entry that points outside the file, e.g. a recording cut short
+    index = (const StreamFileFrame *)(map + header->indexOffset);
+    uint64_t count = header->frameCount < header->indexCapacity ? header->frameCount : header->indexCapacity;
+    for (numFrames = 0; numFrames < count; numFrames++) {
+        const StreamFileFrame& f = index[numFrames];
+        // I420 is the last RawFrameFormat
+        if (f.offset + f.size > mapSize || f.format > PANACAST_FRAME_FORMAT_I420) break;
+    }
+
+    if (numFrames == 0) {
+        printf("ReplayCapture: %s has no frames\n", path.c_str());
+        unmapFile();
+        return false;
+    }
+    return true;
+}
+
+void ReplayCapture::unmapFile()
+{
+    if (map != NULL) munmap(map, mapSize);
+    if (fd >= 0) close(fd);
+    map = NULL;
+    mapSize = 0;
+    fd = -1;
+    index = NULL;
+    numFrames = 0;
+}
+
+bool ReplayCapture::init(unsigned width, unsigned height, RawFrameFormat format, void * captureDevice)
+{
+    if (replayThread.joinable()) return false;
+    if (map == NULL && !mapFile()) return false;
+
+    const StreamFileFrame& first = index[0];
+    if (width && height && (first.width != width || first.height != height || first.format != (uint32_t)format)) {
+        printf("ReplayCapture: %s holds %ux%u format %u, requested %ux%u format %d\n", path.c_str(),
+               first.width, first.height, first.format, width, height, format);
+        return false;
+    }
+
+    pacer.reset();
+    done = false;
+    running = true;
+    replayThread = std::thread(&ReplayCapture::replayLoop, this);
+    return true;
+}
+
+void ReplayCapture::stopCapture()
+{
+    running = false;
+    consumerActivity->Signal(); // let fast replay out of waiting on a consumer
+    if (replayThread.joinable()) {
+        replayThread.join();
+        frameAvail->Reset();
+    }
+}
+
+void ReplayCapture::prefetch(uint64_t idx)
+{
+    const StreamFileFrame& f = index[idx % numFrames];
+    long pageSize = sysconf(_SC_PAGESIZE);
+    uint64_t start = f.offset & ~(uint64_t)(pageSize - 1);
+    madvise(map + start, f.offset + f.size - start, MADV_WILLNEED);
+}
+
+void ReplayCapture::replayLoop()
+{
+    uint64_t first = index[0].timestampNsec;
+    uint64_t last = index[numFrames - 1].timestampNsec;
+    uint64_t passLength = last - first;
+    passLength += numFrames > 1 ? passLength / (numFrames - 1) : REPLAY_DEFAULT_INTERVAL_NSEC;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64_t pass = 0;
+    uint64_t idx = 0;
+
+    while (running) {
+        const StreamFileFrame& f = index[idx];
+        prefetch(idx + 1);
+
+        if (mode == REPLAY_PACED) {
+            uint64_t due = pass * passLength + (f.timestampNsec > first ? f.timestampNsec - first : 0);
+            std::this_thread::sleep_until(start + std::chrono::nanoseconds(due));
+        }
+
+        // recorded time, kept increasing across passes so a requested frame rate holds when looping;
+        // fast replay hands out every frame, only paced replay is brought down to the requested rate
+        uint64_t timestamp = pass * passLength + f.timestampNsec;
+        RawFrame * frame = NULL;
+        if (mode == REPLAY_FAST || paceFrame(timestamp)) {
+            frame = ring.claim();
+            while (frame == NULL && mode == REPLAY_FAST && running) {
+                // every slot is pinned, one comes free when a consumer releases its frame
+                waitForConsumer(REPLAY_CONSUMER_WAIT_MSEC);
+                frame = ring.claim();
+            }
+        }
+
+        if (frame != NULL) {
+            frame->buf = map + f.offset;
+            frame->size = f.size;
+            frame->format = (RawFrameFormat)f.format;
+            frame->width = f.width;
+            frame->height = f.height;
+            frame->timestamp = timestamp;
+            frame->private_data = NULL;
+            // recorded stamps are from another run, only our own stages mean anything
+            frame->stageTime[FRAME_STAGE_CALLBACK] = frameClockNsec();
+            bool published = publishFrame(frame);
+            replayed++;
+
+            // lockstep: wait for a consumer to take this frame before moving on
+            uint64_t seq = frame->sequence;
+            while (published && mode == REPLAY_FAST && running && deliveredSequence() < seq) {
+                waitForConsumer(REPLAY_CONSUMER_WAIT_MSEC);
+            }
+        }
+
+        if (++idx == numFrames) {
+            if (!loop) {
+                done = true;
+                break;
+            }
+            idx = 0;
+            pass++;
+        }
+    }
+}
@@ -0,0 +1,76 @@
+//
+//  ReplayCapture.h
+//
+//  Capture backend that replays a recorded stream file (see StreamFile.h).
+//  The file is mmap'd and every RawFrame points straight into the mapping,
+//  so nothing is copied between the disk cache and the consumer. The
+//  buffers are read-only.
+//
+//  REPLAY_PACED reproduces the recorded timestamps, dropping frames the same
+//  way a camera would when every ring slot is busy. REPLAY_FAST hands frames
+//  out in lockstep with getNextFrame, as fast as the consumer takes them and
+//  without ever skipping one, to measure the throughput downstream.
+//
+//  CameraStreamInterface opens it for device names "replay:<path>" and
+//  "replayfast:<path>".
+//
+
+#ifndef REPLAYCAPTURE_H
+#define REPLAYCAPTURE_H
+
+#include "FrameRing.h"
+#include "StreamFile.h"
+#include <atomic>
+#include <string>
+#include <thread>
+
+#define REPLAY_DEVICE_PREFIX "replay:"
+#define REPLAY_FAST_DEVICE_PREFIX "replayfast:"
+
+enum ReplayMode {
+    REPLAY_PACED,
+    REPLAY_FAST,
+};
+
+class ReplayCapture : public FrameRingCapture {
+public:
+    ReplayCapture(const std::string& path, ReplayMode mode = REPLAY_PACED, bool loop = true,
+                  unsigned ringDepth = FRAME_RING_DEFAULT_DEPTH);
+    virtual ~ReplayCapture();
+
+    // width, height of 0 accept whatever the file holds; otherwise they and the
+    // format have to match the recording
+    bool init(unsigned width, unsigned height, RawFrameFormat format, void * captureDevice);
+    void stopCapture();
+
+    static bool isReplayDevice(const std::string& deviceName);
+    static ReplayCapture * fromDeviceName(const std::string& deviceName, unsigned ringDepth = FRAME_RING_DEFAULT_DEPTH);
+
+    uint64_t frameCount() const { return numFrames; }
+    uint64_t framesReplayed() const { return replayed.load(std::memory_order_relaxed); }
+    // only for loop == false: every frame in the file has been published
+    bool finished() const { return done.load(std::memory_order_acquire); }
+
+private:
+    bool mapFile();
+    void unmapFile();
+    void replayLoop();
+    void prefetch(uint64_t idx);
+
+    std::string path;
+    ReplayMode mode;
+    bool loop;
+
+    int fd;
+    unsigned char * map;
+    size_t mapSize;
+    const StreamFileFrame * index;
+    uint64_t numFrames;
+
+    std::thread replayThread;
+    std::atomic<bool> running;
+    std::atomic<bool> done;
+    std::atomic<uint64_t> replayed;
+};
+
+#endif
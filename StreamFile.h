@@ -0,0 +1,57 @@
+//
+//  StreamFile.h
+//
+//  On-disk layout of a recorded raw stream, read by ReplayCapture.
+//
+//  [StreamFileHeader][StreamFileFrame x indexCapacity][frame data ...]
+//
+//  The index is reserved up front so frames can be appended in place. Each
+//  frame's data starts on a STREAM_FILE_FRAME_ALIGN boundary, and frameCount
+//  is only bumped once both the data and its index entry are written, so a
+//  file cut short by a crash is still readable up to the last whole frame.
+//  All fields are little-endian.
+//
+
+#ifndef STREAMFILE_H
+#define STREAMFILE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define STREAM_FILE_MAGIC "PCSTRM01"
+#define STREAM_FILE_VERSION 1
+#define STREAM_FILE_FRAME_ALIGN 64
+
+struct StreamFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t indexOffset;
+    uint64_t indexCapacity;
+    uint64_t frameCount;
+    uint64_t dataOffset;
+    uint64_t dataEnd;
+    uint64_t reserved[2];
+};
+
+struct StreamFileFrame {
+    uint64_t offset;
+    uint64_t timestampNsec; // CLOCK_MONOTONIC at capture
+    uint32_t size;
+    uint32_t format;        // RawFrameFormat
+    uint32_t width;
+    uint32_t height;
+};
+
+inline bool isStreamFileHeader(const StreamFileHeader * h)
+{
+    return memcmp(h->magic, STREAM_FILE_MAGIC, sizeof(h->magic)) == 0 &&
+           h->version == STREAM_FILE_VERSION && h->headerSize == sizeof(StreamFileHeader);
+}
+
+inline uint64_t streamFileAlign(uint64_t offset)
+{
+    return (offset + STREAM_FILE_FRAME_ALIGN - 1) & ~(uint64_t)(STREAM_FILE_FRAME_ALIGN - 1);
+}
+
+#endif
@@ -0,0 +1,476 @@
+#include "SyntheticCapture.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+// BT.601 limited range colour bars: white, yellow, cyan, green, magenta, red, blue, black
+static const uint8_t barColors[8][3] = {
+    {235, 128, 128}, {210, 16, 146}, {170, 166, 16}, {145, 54, 34},
+    {106, 202, 222}, {81, 90, 240}, {41, 240, 110}, {16, 128, 128},
+};
+
+#define STAMP_ONE  235
+#define STAMP_ZERO 16
+
+SyntheticCapture::SyntheticCapture(unsigned _fps, unsigned ringDepth) : FrameRingCapture(ringDepth)
+{
+    fps = _fps;
+    width = 0;
+    height = 0;
+    format = PANACAST_FRAME_FORMAT_YUYV;
+    stampRows = 0;
+    bufferSize = 0;
+    running = false;
+    counter = 0;
+}
+
+SyntheticCapture::~SyntheticCapture()
+{
+    stopCapture();
+    releaseBuffers();
+}
+
+void SyntheticCapture::releaseBuffers()
+{
+    for (unsigned k = 0; k < ring.depth(); k++) {
+        RawFrame * slot = ring.slot(k);
+        if (pool) pool->release(slot->buf);
+        slot->buf = NULL;
+    }
+}
+
+bool SyntheticCapture::init(unsigned _width, unsigned _height, RawFrameFormat _format, void * captureDevice)
+{
+    if (captureThread.joinable()) return false;
+
+    if (!rawFrameFormatFromCamera(_format)) {
+        printf("SyntheticCapture: format %d is not a camera format\n", _format);
+        return false;
+    }
+
+    unsigned cols = _width / STAMP_CELL_WIDTH;
+    if (cols == 0 || (_width & 1) || (_height & 1)) {
+        printf("SyntheticCapture: unsupported resolution %ux%u\n", _width, _height);
+        return false;
+    }
+    stampRows = (STAMP_BITS + cols - 1) / cols;
+    if (stampRows * STAMP_CELL_HEIGHT > _height) {
+        printf("SyntheticCapture: %ux%u is too small for the frame stamp\n", _width, _height);
+        return false;
+    }
+
+    width = _width;
+    height = _height;
+    format = _format;
+    bufferSize = rawFrameSize(format, width, height);
+    if (format == PANACAST_FRAME_FORMAT_MJPEG) {
+        // a flat-block JPEG never comes close to one byte per pixel
+        bufferSize = width * height + 4096;
+        buildJpegTemplate();
+    }
+
+    // slots are set up again for the new format as they are first filled
+    releaseBuffers();
+    if (!pool || pool->bufferSize() < bufferSize) {
+        // frames of 2 MB and up are worth a huge page mapping
+        unsigned flags = bufferSize >= FRAME_POOL_HUGE_PAGE_SIZE ? FRAME_POOL_HUGE_PAGES : 0;
+        pool.reset(new FrameBufferPool(bufferSize, ring.depth(), flags));
+        if (!pool->valid()) {
+            pool.reset();
+            return false;
+        }
+    }
+
+    pacer.reset();
+    running = true;
+    captureThread = std::thread(&SyntheticCapture::captureLoop, this);
+    return true;
+}
+
+void SyntheticCapture::setFrameRate(unsigned _fps)
+{
+    if (captureThread.joinable()) return;
+    if (_fps) fps = _fps;
+    FrameRingCapture::setFrameRate(_fps);
+    // generated at exactly that rate on its own grid, the pacer only measures
+    pacer.setTarget(0);
+}
+
+void SyntheticCapture::stopCapture()
+{
+    running = false;
+    if (captureThread.joinable()) {
+        captureThread.join();
+        frameAvail->Reset();
+    }
+}
+
+void SyntheticCapture::captureLoop()
+{
+    std::chrono::nanoseconds interval(fps ? 1000000000ULL / fps : 0);
+    std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+
+    while (running) {
+        if (fps) {
+            next += interval;
+            std::this_thread::sleep_until(next);
+            // fell more than a frame behind, do not try to catch up with a burst
+            std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+            if (t - next > interval) next = t;
+        }
+
+        // the counter advances for dropped frames too, so drops show up as gaps in the stamp
+        uint64_t count = counter++;
+        uint64_t timestamp = frameClockNsec();
+        // frameClockNsec is steady_clock, so the schedule is the jitter-free timestamp
+        uint64_t paced = fps ? std::chrono::duration_cast<std::chrono::nanoseconds>(next.time_since_epoch()).count() : timestamp;
+        if (!paceFrame(paced)) continue;
+
+        RawFrame * frame = ring.claim();
+        if (frame == NULL) {
+            if (!fps) std::this_thread::yield();
+            continue;
+        }
+
+        if (frame->buf == NULL) {
+            frame->buf = pool->acquire();
+            if (frame->buf == NULL) {
+                printf("SyntheticCapture: frame buffer pool is empty\n");
+                ring.abandon(frame);
+                running = false;
+                break;
+            }
+            frame->format = format;
+            frame->width = width;
+            frame->height = height;
+            frame->size = bufferSize;
+            renderBackground(frame);
+        }
+
+        if (!renderFrame(frame, count, timestamp)) {
+            ring.abandon(frame);
+            continue;
+        }
+        // the stamped time stands in for the exposure, rendering for the driver's work
+        frame->stageTime[FRAME_STAGE_DEVICE] = timestamp;
+        frame->stageTime[FRAME_STAGE_CALLBACK] = frameClockNsec();
+        frame->timestamp = paced;
+        publishFrame(frame);
+    }
+}
+
+bool SyntheticCapture::renderFrame(struct RawFrame * frame, uint64_t count, uint64_t timestampNsec)
+{
+    uint8_t bits[STAMP_BITS];
+    for (unsigned k = 0; k < 64; k++) {
+        bits[k] = (count >> (63 - k)) & 1;
+        bits[64 + k] = (timestampNsec >> (63 - k)) & 1;
+    }
+
+    if (format != PANACAST_FRAME_FORMAT_MJPEG) {
+        renderStamp(frame, bits);
+        return true;
+    }
+
+    // only the stamp rows change, everything below them is pre-encoded
+    jpegScratch.assign(jpegHeader.begin(), jpegHeader.end());
+    for (unsigned row = 0; row < stampRows; row++) {
+        encodeJpegRow(jpegScratch, row, bits);
+    }
+    if (jpegScratch.size() + jpegTail.size() > bufferSize) return false;
+
+    memcpy(frame->buf, &jpegScratch[0], jpegScratch.size());
+    memcpy(frame->buf + jpegScratch.size(), &jpegTail[0], jpegTail.size());
+    frame->size = (int)(jpegScratch.size() + jpegTail.size());
+    return true;
+}
+
+void SyntheticCapture::renderBackground(struct RawFrame * frame)
+{
+    unsigned char * buf = frame->buf;
+    unsigned chromaWidth = width / 2;
+
+    switch (format) {
+        case PANACAST_FRAME_FORMAT_YUYV:
+        case PANACAST_FRAME_FORMAT_UYVY: {
+            bool yuyv = format == PANACAST_FRAME_FORMAT_YUYV;
+            for (unsigned x = 0; x < width; x += 2) {
+                const uint8_t * c = barColors[x * 8 / width];
+                unsigned char * p = buf + x * 2;
+                p[0] = yuyv ? c[0] : c[1];
+                p[1] = yuyv ? c[1] : c[0];
+                p[2] = yuyv ? c[0] : c[2];
+                p[3] = yuyv ? c[2] : c[0];
+            }
+            for (unsigned y = 1; y < height; y++) memcpy(buf + y * width * 2, buf, width * 2);
+            break;
+        }
+        case PANACAST_FRAME_FORMAT_NV12: {
+            unsigned char * uv = buf + width * height;
+            for (unsigned x = 0; x < width; x += 2) {
+                const uint8_t * c = barColors[x * 8 / width];
+                buf[x] = buf[x + 1] = c[0];
+                uv[x] = c[1];
+                uv[x + 1] = c[2];
+            }
+            for (unsigned y = 1; y < height; y++) memcpy(buf + y * width, buf, width);
+            for (unsigned y = 1; y < height / 2; y++) memcpy(uv + y * width, uv, width);
+            break;
+        }
+        case PANACAST_FRAME_FORMAT_YV12:
+        case PANACAST_FRAME_FORMAT_I420: {
+            unsigned char * v = buf + width * height;
+            unsigned char * u = v + chromaWidth * (height / 2);
+            if (format == PANACAST_FRAME_FORMAT_I420) std::swap(u, v);
+            for (unsigned x = 0; x < width; x += 2) {
+                const uint8_t * c = barColors[x * 8 / width];
+                buf[x] = buf[x + 1] = c[0];
+                u[x / 2] = c[1];
+                v[x / 2] = c[2];
+            }
+            for (unsigned y = 1; y < height; y++) memcpy(buf + y * width, buf, width);
+            for (unsigned y = 1; y < height / 2; y++) {
+                memcpy(u + y * chromaWidth, u, chromaWidth);
+                memcpy(v + y * chromaWidth, v, chromaWidth);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void SyntheticCapture::fillLuma(struct RawFrame * frame, unsigned x0, unsigned y0, unsigned w, unsigned h, uint8_t luma)
+{
+    unsigned char * buf = frame->buf;
+
+    switch (format) {
+        case PANACAST_FRAME_FORMAT_YUYV:
+        case PANACAST_FRAME_FORMAT_UYVY: {
+            unsigned lumaOffset = format == PANACAST_FRAME_FORMAT_YUYV ? 0 : 1;
+            for (unsigned y = y0; y < y0 + h; y++) {
+                unsigned char * p = buf + (y * width + x0) * 2;
+                for (unsigned x = 0; x < w * 2; x += 2) {
+                    p[x + lumaOffset] = luma;
+                    p[x + 1 - lumaOffset] = 128;
+                }
+            }
+            break;
+        }
+        case PANACAST_FRAME_FORMAT_NV12:
+        case PANACAST_FRAME_FORMAT_YV12:
+        case PANACAST_FRAME_FORMAT_I420: {
+            for (unsigned y = y0; y < y0 + h; y++) memset(buf + y * width + x0, luma, w);
+            unsigned char * chroma = buf + width * height;
+            if (format == PANACAST_FRAME_FORMAT_NV12) {
+                for (unsigned y = y0 / 2; y < (y0 + h) / 2; y++) memset(chroma + y * width + x0, 128, w);
+            } else {
+                unsigned chromaWidth = width / 2;
+                unsigned planeSize = chromaWidth * (height / 2);
+                for (unsigned y = y0 / 2; y < (y0 + h) / 2; y++) {
+                    memset(chroma + y * chromaWidth + x0 / 2, 128, w / 2);
+                    memset(chroma + planeSize + y * chromaWidth + x0 / 2, 128, w / 2);
+                }
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void SyntheticCapture::renderStamp(struct RawFrame * frame, const uint8_t * bits)
+{
+    unsigned cols = width / STAMP_CELL_WIDTH;
+    for (unsigned k = 0; k < STAMP_BITS; k++) {
+        fillLuma(frame, (k % cols) * STAMP_CELL_WIDTH, (k / cols) * STAMP_CELL_HEIGHT,
+                 STAMP_CELL_WIDTH, STAMP_CELL_HEIGHT, bits[k] ? STAMP_ONE : STAMP_ZERO);
+    }
+}
+
+bool SyntheticCapture::readStamp(const struct RawFrame * frame, uint64_t& count, uint64_t& timestampNsec)
+{
+    unsigned cols = frame->width / STAMP_CELL_WIDTH;
+    if (cols == 0 || frame->buf == NULL) return false;
+
+    count = 0;
+    timestampNsec = 0;
+    for (unsigned k = 0; k < STAMP_BITS; k++) {
+        // sample the middle of the cell
+        unsigned x = (k % cols) * STAMP_CELL_WIDTH + STAMP_CELL_WIDTH / 2;
+        unsigned y = (k / cols) * STAMP_CELL_HEIGHT + STAMP_CELL_HEIGHT / 2;
+        uint8_t luma;
+        switch (frame->format) {
+            case PANACAST_FRAME_FORMAT_YUYV: luma = frame->buf[(y * frame->width + x) * 2]; break;
+            case PANACAST_FRAME_FORMAT_UYVY: luma = frame->buf[(y * frame->width + x) * 2 + 1]; break;
+            case PANACAST_FRAME_FORMAT_NV12:
+            case PANACAST_FRAME_FORMAT_YV12:
+            case PANACAST_FRAME_FORMAT_I420: luma = frame->buf[y * frame->width + x]; break;
+            default: return false;
+        }
+        uint64_t bit = luma >= 128 ? 1 : 0;
+        if (k < 64) count = (count << 1) | bit;
+        else timestampNsec = (timestampNsec << 1) | bit;
+    }
+    return true;
+}
+
+//
+// Minimal baseline JPEG writer. Every 8x8 block is flat, so a block is just its
+// DC difference followed by an end-of-block code. 4:2:2 sampling like the
+// PanaCast MJPEG stream, one restart interval per MCU row so rows can be
+// encoded independently.
+//
+
+static const uint8_t dcBits[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+static const uint8_t dcVals[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+#define JPEG_QUANT 8
+
+struct JpegBitWriter {
+    JpegBitWriter(std::vector<uint8_t>& _out) : out(_out), acc(0), n(0) {}
+
+    void put(uint32_t code, int len) {
+        acc = (acc << len) | (code & ((1u << len) - 1));
+        n += len;
+        while (n >= 8) {
+            uint8_t byte = (uint8_t)(acc >> (n - 8));
+            out.push_back(byte);
+            if (byte == 0xFF) out.push_back(0x00); // byte stuffing
+            n -= 8;
+        }
+        acc &= (1u << n) - 1;
+    }
+
+    void flush() {
+        if (n > 0) put(0x7F, 8 - n); // pad with one bits
+    }
+
+    std::vector<uint8_t>& out;
+    uint32_t acc;
+    int n;
+};
+
+struct JpegDcTable {
+    JpegDcTable() {
+        uint32_t code = 0;
+        unsigned k = 0;
+        for (int len = 1; len <= 16; len++) {
+            for (int i = 0; i < dcBits[len - 1]; i++, k++) {
+                codes[dcVals[k]] = code++;
+                lengths[dcVals[k]] = len;
+            }
+            code <<= 1;
+        }
+    }
+    uint32_t codes[12];
+    int lengths[12];
+};
+
+static const JpegDcTable dcTable;
+
+static void encodeBlock(JpegBitWriter& w, int value, int& pred)
+{
+    int dc = value - 128; // flat block: DCT DC is 8 * (value - 128), quantised by JPEG_QUANT
+    int diff = dc - pred;
+    pred = dc;
+
+    int mag = diff < 0 ? -diff : diff;
+    int category = 0;
+    while (mag) { category++; mag >>= 1; }
+
+    w.put(dcTable.codes[category], dcTable.lengths[category]);
+    if (category) w.put(diff < 0 ? diff + (1 << category) - 1 : diff, category);
+    w.put(0, 1); // EOB, the only AC symbol
+}
+
+static void putMarker(std::vector<uint8_t>& out, uint8_t marker, unsigned length)
+{
+    out.push_back(0xFF);
+    out.push_back(marker);
+    if (length) {
+        out.push_back(length >> 8);
+        out.push_back(length & 0xFF);
+    }
+}
+
+void SyntheticCapture::buildJpegTemplate()
+{
+    unsigned mcusPerRow = (width + 15) / 16;
+    unsigned mcuRows = (height + 7) / 8;
+
+    std::vector<uint8_t>& h = jpegHeader;
+    h.clear();
+    putMarker(h, 0xD8, 0); // SOI
+
+    putMarker(h, 0xDB, 67); // DQT, table 0, all entries equal
+    h.push_back(0x00);
+    h.insert(h.end(), 64, JPEG_QUANT);
+
+    putMarker(h, 0xC0, 17); // SOF0
+    h.push_back(8);
+    h.push_back(height >> 8); h.push_back(height & 0xFF);
+    h.push_back(width >> 8); h.push_back(width & 0xFF);
+    h.push_back(3);
+    h.push_back(1); h.push_back(0x21); h.push_back(0); // Y 2x1
+    h.push_back(2); h.push_back(0x11); h.push_back(0); // Cb
+    h.push_back(3); h.push_back(0x11); h.push_back(0); // Cr
+
+    putMarker(h, 0xC4, 2 + 1 + 16 + 12 + 1 + 16 + 1); // DHT
+    h.push_back(0x00); // DC table 0
+    h.insert(h.end(), dcBits, dcBits + 16);
+    h.insert(h.end(), dcVals, dcVals + 12);
+    h.push_back(0x10); // AC table 0, holds nothing but EOB
+    h.push_back(1);
+    h.insert(h.end(), 15, 0);
+    h.push_back(0x00);
+
+    putMarker(h, 0xDD, 4); // DRI
+    h.push_back(mcusPerRow >> 8);
+    h.push_back(mcusPerRow & 0xFF);
+
+    putMarker(h, 0xDA, 12); // SOS
+    h.push_back(3);
+    h.push_back(1); h.push_back(0x00);
+    h.push_back(2); h.push_back(0x00);
+    h.push_back(3); h.push_back(0x00);
+    h.push_back(0); h.push_back(63); h.push_back(0);
+
+    jpegTail.clear();
+    for (unsigned row = stampRows; row < mcuRows; row++) {
+        encodeJpegRow(jpegTail, row, NULL);
+    }
+    putMarker(jpegTail, 0xD9, 0); // EOI
+}
+
+void SyntheticCapture::encodeJpegRow(std::vector<uint8_t>& out, unsigned mcuRow, const uint8_t * bits)
+{
+    unsigned mcusPerRow = (width + 15) / 16;
+    unsigned mcuRows = (height + 7) / 8;
+    unsigned cols = width / STAMP_CELL_WIDTH;
+    int pred[3] = {0, 0, 0};
+
+    JpegBitWriter w(out);
+    for (unsigned mx = 0; mx < mcusPerRow; mx++) {
+        unsigned cell = mcuRow * cols + mx;
+        if (mcuRow < stampRows && mx < cols && cell < STAMP_BITS) {
+            int luma = bits && bits[cell] ? STAMP_ONE : STAMP_ZERO;
+            encodeBlock(w, luma, pred[0]);
+            encodeBlock(w, luma, pred[0]);
+            encodeBlock(w, 128, pred[1]);
+            encodeBlock(w, 128, pred[2]);
+            continue;
+        }
+
+        unsigned x0 = mx * 16;
+        unsigned x1 = x0 + 8 < width ? x0 + 8 : width - 1;
+        encodeBlock(w, barColors[x0 * 8 / width][0], pred[0]);
+        encodeBlock(w, barColors[x1 * 8 / width][0], pred[0]);
+        encodeBlock(w, barColors[x0 * 8 / width][1], pred[1]);
+        encodeBlock(w, barColors[x0 * 8 / width][2], pred[2]);
+    }
+    w.flush();
+
+    if (mcuRow + 1 < mcuRows) putMarker(out, 0xD0 + (mcuRow & 7), 0); // RSTn
+}
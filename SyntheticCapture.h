@@ -0,0 +1,80 @@
+//
+//  SyntheticCapture.h
+//
+//  Test-pattern capture backend. Produces colour bars in any RawFrameFormat at
+//  a configurable rate, with the frame counter and capture time stamped into
+//  the top of the picture so the whole get/convert/consume path can be
+//  measured without a camera. Opened by CameraStreamInterface for device
+//  names starting with "synthetic".
+//
+
+#ifndef SYNTHETICCAPTURE_H
+#define SYNTHETICCAPTURE_H
+
+#include "FrameBufferPool.h"
+#include "FrameRing.h"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#define SYNTHETIC_DEVICE_PREFIX "synthetic"
+
+// the stamp is 128 cells of STAMP_CELL_WIDTH x STAMP_CELL_HEIGHT pixels:
+// 64 bits of frame counter followed by 64 bits of frameClockNsec nanoseconds
+#define STAMP_CELL_WIDTH  16
+#define STAMP_CELL_HEIGHT 8
+#define STAMP_BITS        128
+
+class SyntheticCapture : public FrameRingCapture {
+public:
+    // fps 0 produces frames as fast as the consumers release slots
+    SyntheticCapture(unsigned fps = 30, unsigned ringDepth = FRAME_RING_DEFAULT_DEPTH);
+    virtual ~SyntheticCapture();
+    bool init(unsigned width, unsigned height, RawFrameFormat format, void * captureDevice);
+    void stopCapture();
+    // the generator runs at whatever rate is asked for
+    void setFrameRate(unsigned fps);
+
+    static bool isSyntheticDevice(const std::string& deviceName) {
+        return deviceName.compare(0, strlen(SYNTHETIC_DEVICE_PREFIX), SYNTHETIC_DEVICE_PREFIX) == 0;
+    }
+
+    // recover the stamp from an uncompressed frame, false for MJPEG
+    static bool readStamp(const struct RawFrame * frame, uint64_t& counter, uint64_t& timestampNsec);
+
+    uint64_t framesGenerated() const { return counter.load(std::memory_order_relaxed); }
+
+private:
+    void captureLoop();
+    void releaseBuffers();
+    bool renderFrame(struct RawFrame * frame, uint64_t count, uint64_t timestampNsec);
+    void renderBackground(struct RawFrame * frame);
+    void renderStamp(struct RawFrame * frame, const uint8_t * bits);
+    void fillLuma(struct RawFrame * frame, unsigned x, unsigned y, unsigned w, unsigned h, uint8_t luma);
+
+    // baseline JPEG made of flat 8x8 blocks, see encodeJpegRow
+    void buildJpegTemplate();
+    void encodeJpegRow(std::vector<uint8_t>& out, unsigned mcuRow, const uint8_t * bits);
+
+    unsigned width;
+    unsigned height;
+    RawFrameFormat format;
+    unsigned fps;
+    unsigned stampRows; // rows of stamp cells
+    unsigned bufferSize;
+    // one buffer per ring slot, taken when a slot is first filled
+    std::unique_ptr<FrameBufferPool> pool;
+
+    std::vector<uint8_t> jpegHeader;
+    std::vector<uint8_t> jpegTail; // pre-encoded rows below the stamp, then EOI
+    std::vector<uint8_t> jpegScratch;
+
+    std::thread captureThread;
+    std::atomic<bool> running;
+    std::atomic<uint64_t> counter;
+};
+
+#endif
@@ -11,6 +11,18 @@
 #include "DeviceInfo.h"
 
 bool WebcamSource::m_Initialized = false;
+
+// Capture sample times are in 100 ns units of the clock MFGetSystemTime reads, whose origin
+// need not be the one of frameClockNsec, so only the age of the sample is carried over:
+// systemTime and frameTime are the two clocks read at the same moment of delivery.
+// 0 (the stage left unset) when the sample time is not on that clock after all.
+static uint64_t deviceStageTime(LONGLONG sampleTime, MFTIME systemTime, uint64_t frameTime)
+{
+	LONGLONG age = systemTime - sampleTime;
+	if (sampleTime <= 0 || age < 0 || age > WEBCAM_MAX_SAMPLE_AGE_MSEC * 10000LL) return 0;
+	if ((uint64_t)age * 100 > frameTime) return 0;
+	return frameTime - (uint64_t)age * 100;
+}
 //bool WebcamSource::platformSupportsMediaFoundation() {
 //	// Even though the DLLs might be available on Vista, we get crashes
 //	// when running our tests on the build bots.
@@ -245,7 +257,7 @@ public:
 					if (data && length > 0)
 					{
 						if (observerAvailable_)
-							observer_->OnIncomingCapturedData(data, length, format_, now, status);
+							observer_->OnIncomingCapturedData(data, length, format_, now, status, time_stamp);
 					}
 
 					buffer->Unlock();
@@ -281,6 +293,29 @@ private:
 	volatile bool observerAvailable_;
 };
 
+// largest sample of a format, 0 if unknown
+static size_t maxSampleSize(VideoCaptureFormat& format)
+{
+	unsigned w = format.frame_size_.width(), h = format.frame_size_.height();
+	switch (format.pixel_format_) {
+	case PIXEL_FORMAT_I420:
+	case PIXEL_FORMAT_NV12:
+	case PIXEL_FORMAT_YV12:
+		return FrameBufferPool::bufferSizeFor(PANACAST_FRAME_FORMAT_NV12, w, h);
+	case PIXEL_FORMAT_YUY2:
+	case PIXEL_FORMAT_UYVY:
+		return FrameBufferPool::bufferSizeFor(PANACAST_FRAME_FORMAT_YUYV, w, h);
+	case PIXEL_FORMAT_MJPEG:
+		return FrameBufferPool::bufferSizeFor(PANACAST_FRAME_FORMAT_MJPEG, w, h);
+	case PIXEL_FORMAT_RGB24:
+		return (size_t)w * h * 3;
+	case PIXEL_FORMAT_ARGB:
+		return (size_t)w * h * 4;
+	default:
+		return 0;
+	}
+}
+
 bool WebcamSource::getSample(WebcamFrame& frame)
 {
 	if (!synchronousCapture_) {
@@ -305,6 +340,8 @@ bool WebcamSource::getSample(WebcamFrame& frame)
 	HRESULT hr;
 	LONGLONG  llTimestamp;
 	hr = pReader_->ReadSample(MF_SOURCE_READER_FIRST_VIDEO_STREAM, 0, NULL, &streamFlags, &llTimestamp, &pSample);
+	uint64_t delivered = frameClockNsec();
+	MFTIME deliveredSystem = MFGetSystemTime();
 	if (SUCCEEDED(hr)) {
 		DBG(D_VERBOSE, "WebcamSource::getSample: ReadSample successful\n");
 		if ((streamFlags & (MF_SOURCE_READERF_ERROR | MF_SOURCE_READERF_ALLEFFECTSREMOVED | MF_SOURCE_READERF_ENDOFSTREAM)) || pSample == NULL) {
@@ -345,11 +382,22 @@ bool WebcamSource::getSample(WebcamFrame& frame)
 				break;
 			}
 
-			frame.allocate(cursize);
+			size_t poolSize = maxSampleSize(matchedFormat_);
+			if (poolSize != 0 && (!framePool_ || framePool_->bufferSize() != poolSize)) {
+				// frames still holding buffers of the old pool keep it alive until they let go
+				unsigned flags = poolSize >= FRAME_POOL_HUGE_PAGE_SIZE ? FRAME_POOL_HUGE_PAGES : 0;
+				framePool_ = std::make_shared<FrameBufferPool>(poolSize, WEBCAM_FRAME_POOL_DEPTH, flags);
+				if (!framePool_->valid()) framePool_.reset();
+			}
+			if (frame.pool && frame.pool != framePool_) frame.releaseData();
+			frame.allocate(cursize, framePool_);
 			memcpy(frame.data, ptr, cursize); 
 			frame.length = cursize;
 			frame.format = matchedFormat_;
 			frame.timestamp = llTimestamp;
+			frame.stageTime[FRAME_STAGE_DEVICE] = deviceStageTime(llTimestamp, deliveredSystem, delivered);
+			frame.stageTime[FRAME_STAGE_DRIVER] = delivered;
+			frame.stageTime[FRAME_STAGE_CALLBACK] = frameClockNsec();
 			pBuffer->Unlock();
 		} while (0);
 
@@ -380,7 +428,8 @@ void WebcamSource::OnIncomingCapturedData(const unsigned char* data,
 	int length,
 	VideoCaptureFormat format,
 	unsigned __int64 timestamp,
-	HRESULT onReadSampleResult) {
+	HRESULT onReadSampleResult,
+	LONGLONG sampleTime) {
 	bool errorEncountered = false;
 	
 	if (!TryEnterCriticalSection(&lock_)) {
@@ -400,6 +449,12 @@ void WebcamSource::OnIncomingCapturedData(const unsigned char* data,
 			frame.length = length;
 			frame.format = format;
 			frame.timestamp = timestamp;
+			// timestamp is the QPC count when OnReadSample was entered
+			LARGE_INTEGER freq;
+			QueryPerformanceFrequency(&freq);
+			frame.stageTime[FRAME_STAGE_DEVICE] = deviceStageTime(sampleTime, MFGetSystemTime(), frameClockNsec());
+			frame.stageTime[FRAME_STAGE_DRIVER] = timestamp / freq.QuadPart * 1000000000ULL + timestamp % freq.QuadPart * 1000000000ULL / freq.QuadPart;
+			frame.stageTime[FRAME_STAGE_CALLBACK] = frameClockNsec();
 			//LeaveCriticalSection(&lock_);
 			if (frame_callback_)
 				frame_callback_((void*)&frame);
@@ -5,33 +5,58 @@
 #include <mfreadwrite.h>
 #include <vector>
 #include <functional>
+#include <memory>
 
 #include "VideoCaptureFormat.h"
 #include "captureDevice.h"
 #include "msdk_utils.h"
 #include "ColorControlDefines.h"
+#include "FrameBufferPool.h"
+#include "FrameLatency.h"
+
+// frames getSample callers can hold at once before WebcamFrame falls back to malloc
+#define WEBCAM_FRAME_POOL_DEPTH 4
+// a sample time further behind MFGetSystemTime than this at delivery is not on that clock
+#define WEBCAM_MAX_SAMPLE_AGE_MSEC 2000
 
 struct WebcamFrame{
 
-	WebcamFrame(): data(NULL), allocatedLength(0) {}
-	void allocate(unsigned cursize) {
-		if (data == NULL || allocatedLength < cursize) {
-			data = (unsigned char *)realloc(data, cursize);
-			allocatedLength = cursize;
+	WebcamFrame(): data(NULL), allocatedLength(0) {
+		memset(stageTime, 0, sizeof(stageTime));
+	}
+	// A buffer from pool when the frame fits, so a WebcamFrame passed to getSample
+	// again and again keeps the same buffer and never goes back to the heap.
+	void allocate(unsigned cursize, const std::shared_ptr<FrameBufferPool>& from = std::shared_ptr<FrameBufferPool>()) {
+		if (data != NULL && allocatedLength >= cursize) return;
+		releaseData();
+		if (from && cursize <= from->bufferSize() && (data = from->acquire()) != NULL) {
+			pool = from;
+			allocatedLength = (unsigned)from->bufferSize();
+			return;
 		}
-
+		data = (unsigned char *)malloc(cursize);
+		allocatedLength = cursize;
 	}
-	~WebcamFrame() {
+	void releaseData() {
 		if (data != NULL && allocatedLength != 0) {
-			free(data);
+			if (pool) pool->release(data);
+			else free(data);
 		}
+		data = NULL;
+		allocatedLength = 0;
+		pool.reset();
+	}
+	~WebcamFrame() {
+		releaseData();
 	}
 
 	unsigned char * data;
 	unsigned length;
 	VideoCaptureFormat format;
 	unsigned __int64 timestamp;
+	uint64_t stageTime[FRAME_PRODUCER_STAGES]; // frameClockNsec per FrameStage, 0 where there is none
 	unsigned allocatedLength;
+	std::shared_ptr<FrameBufferPool> pool; // owner of data, if it came from one
 };
 
 
@@ -59,7 +84,8 @@ public:
 		int length,
 		VideoCaptureFormat format,
 		unsigned __int64 timestamp,
-		HRESULT onReadSampleResult);
+		HRESULT onReadSampleResult,
+		LONGLONG sampleTime = 0);
 
 	std::vector<captureDevice> enumerateDevices() {
 		return devices_;
@@ -104,6 +130,7 @@ private:
 	IMFMediaSource * pSource_;
 	captureDevice *activeDevice_;
 	VideoCaptureFormat matchedFormat_;
+	std::shared_ptr<FrameBufferPool> framePool_; // getSample buffers sized for matchedFormat_
 	MFReaderCallback * mReaderCallback_;
 	CRITICAL_SECTION lock_;
 	std::function<void(long)> error_callback_;
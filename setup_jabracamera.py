@@ -10,6 +10,10 @@ import os
 
 compile_extra_args = []
 link_extra_args = []
+sources = ["JabraCameraPyWrapper.cpp", "utils.cpp", "FrameRing.cpp", "JpegHeader.cpp", "FrameLatency.cpp", "FramePacer.cpp", "FrameBroadcaster.cpp", "FrameBufferPool.cpp", "FrameWorkers.cpp", "FrameConvert.cpp", "FrameConvertScalar.cpp", "FrameScale.cpp", "FrameTensor.cpp", "MotionGate.cpp", "FrameView.cpp", "ConvertCapture.cpp", "SyntheticCapture.cpp"]
+# the SSE4.1, AVX2 and AVX-512 kernels only on x86, arm64 (Apple Silicon) runs the scalar ones
+if platform.machine().lower() in ("x86_64", "amd64", "i386", "i686", "x86"):
+    sources += ["FrameConvertSSE41.cpp", "FrameConvertAVX2.cpp", "FrameConvertAVX512.cpp"]
 
 if platform.system() == "Windows":
     compile_extra_args = ["/std:c++latest", "/EHsc"]
@@ -21,6 +25,14 @@ elif platform.system() == "Darwin":
     #link_extra_args = ["-stdlib=libc++", "-mmacosx-version-min=10.9",  "-lpthread",  "-framework CoreFoundation",  "-framework IOKit"]
     link_extra_args = ["-stdlib=libc++", "-mmacosx-version-min=10.9",  "-lpthread" ]
     os.environ['LDFLAGS'] = '-framework CoreFoundation -framework IOKit -framework AVFoundation -framework CoreMedia -framework CoreVideo -framework Foundation'
+    sources += ["Mac/MacCameraDevice.cpp", "ReplayCapture.cpp", "Mac/AVFoundationCapture.mm", "Mac/MacFrameCapture.mm"]
+elif platform.system() == "Linux":
+    compile_extra_args = ["-O3", "-std=c++11", "-I%s" % os.getcwd(), "-I%s/Linux" % os.getcwd()]
+    link_extra_args = ["-lpthread"]
+    sources += ["ReplayCapture.cpp", "Linux/V4L2Capture.cpp", "Linux/LinuxCameraDevice.cpp", "MjpegDecoder.cpp", "DecodeCapture.cpp"]
+    # native MJPEG decoding, libjpeg-turbo
+    compile_extra_args.append("-DPANACAST_MJPEG_DECODE")
+    link_extra_args.append("-ljpeg")
 
 compile_extra_args.append("-I"+np.get_include())
 
@@ -36,6 +48,6 @@ setup(
         "License :: Public Domain",
         "Programming Language :: C++"],
     ext_modules = [
-        Extension("jabracamera", ["Mac/MacCameraDevice.cpp", "JabraCameraPyWrapper.cpp", "utils.cpp", "Mac/AVFoundationCapture.mm", "Mac/MacFrameCapture.mm"], 
+        Extension("jabracamera", sources,
             extra_compile_args = compile_extra_args,
             extra_link_args = link_extra_args)])
@@ -2,6 +2,7 @@ import jabracamera
 import numpy as np
 import cv2
 import sys
+import select
 
 r = jabracamera.JabraCamera()
 
@@ -12,15 +13,17 @@ if dn is None:
 
 print('Cameras found: ', dn)
 
-def convertYUYV2BGR(yuyv):
-    return cv2.cvtColor(yuyv, cv2.COLOR_YUV2BGR_YUYV)
-
 width = 1920    
 height = 1080
 #format_ = 'mjpg'
 format_ = 'nv12'
 #format_ = 'yuyv'
-if not r.setStreamParams(deviceName=dn[0], width=width, height=height, format=format_, fps=30):
+# the library converts yuyv, uyvy, nv12 and the planar formats to BGR itself, with SIMD
+# kernels, before handing frames out; a camera without the format is opened in one it has.
+# mjpg is decoded to BGR natively, on a pool of decoder threads
+output = 'BGR'
+if not r.setStreamParams(deviceName=dn[0], width=width, height=height, format=format_, fps=30, output=output,
+                         decodeThreads=2 if format_ == 'mjpg' else 0):
     print('Unable to set stream params')
     sys.exit(1)
 
@@ -42,16 +45,19 @@ if f is not None:
 else:
     print('getProperty failed')
 
+# readable when a frame is ready, so we sleep instead of spinning on getFrameView
+fd = r.getFrameFd(dn[0])
+
 while True:
-    raw = r.getFrame(dn[0])
+    if fd is not None:
+        select.select([fd], [], [], 0.1)
+    # getFrameView pins the capture buffer instead of copying it into bytes
+    raw = r.getFrameView(dn[0])
     if raw is None: continue
-    if format_ == 'mjpg':
-        frame1 = cv2.imdecode(np.fromstring(raw, dtype=np.uint8), cv2.IMREAD_UNCHANGED)
-    else:
-        yuv = np.frombuffer(raw, dtype=np.uint8)
-        shape=(height, width, 2)
-        yuv = yuv.reshape(shape)
-        frame1 = convertYUYV2BGR(yuv)
+    frame1 = np.frombuffer(raw, dtype=np.uint8).reshape((height, width, 3))
+    # the left half of the room, a strided view into the same buffer
+    (left,) = raw.crop(0, 0, width // 2, height)
+    cv2.imshow("left", np.asarray(left))
     cv2.imshow("hurr", frame1)
     k = cv2.waitKey(1)
     if (k == ord("q")):
@@ -59,3 +65,16 @@ while True:
 
         
 
+
+# what an ImageNet model takes: 3 x 224 x 224 float32, normalized, straight from the camera
+tensor = np.asarray(r.getTensor(dn[0], 224, 224, mean=(123.675, 116.28, 103.53), std=(58.395, 57.12, 57.375)))
+print('tensor', tensor.shape, tensor.dtype)
+
+# only frames where something moved from now on, each with its 16 x 9 motion map
+r.setMotionGate(dn[0], threshold=2.0)
+raw = r.getFrameView(dn[0])
+if raw is not None:
+    print('motion', raw.motion['level'], np.frombuffer(raw.motion['tiles'], dtype=np.uint8).reshape((9, 16)))
+
+# delivered/dropped/late/still counts, rate, jitter and capture-to-consumer latency
+print(r.getStats(dn[0]))
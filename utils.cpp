@@ -2,12 +2,67 @@
 #include <sys/time.h>
 #include <errno.h>
 
+#ifdef OSEVENT_FUTEX
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+static_assert(sizeof(std::atomic<int>) == sizeof(int), "futex needs a plain int");
+
+// waits while *word == value; an absolute FUTEX_WAIT_BITSET timeout is on CLOCK_MONOTONIC
+static int futexWait(std::atomic<int>& word, int value, const struct timespec * deadline)
+{
+	return syscall(SYS_futex, (int *)&word, FUTEX_WAIT_BITSET | FUTEX_PRIVATE_FLAG, value, deadline, NULL,
+		FUTEX_BITSET_MATCH_ANY);
+}
+
+static void futexWake(std::atomic<int>& word, int count)
+{
+	syscall(SYS_futex, (int *)&word, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, count, NULL, NULL, 0);
+}
+
+// consume the signal of an auto-reset event, or just look at a manual one
+static bool takeSignal(std::atomic<int>& state, bool manual)
+{
+	if (manual) return state.load(std::memory_order_acquire) != 0;
+	int expected = 1;
+	return state.compare_exchange_strong(expected, 0, std::memory_order_acquire);
+}
+
+// deadline == NULL waits forever
+static OSEventError futexTimedWait(std::atomic<int>& state, std::atomic<int>& waiters, bool manual,
+	const struct timespec * deadline)
+{
+	while (!takeSignal(state, manual))
+	{
+		// announce ourselves before the last look at the state, Signal looks at waiters after setting it
+		waiters.fetch_add(1, std::memory_order_seq_cst);
+		int r = 0;
+		if (state.load(std::memory_order_seq_cst) == 0) r = futexWait(state, 0, deadline);
+		int err = r < 0 ? errno : 0;
+		waiters.fetch_sub(1, std::memory_order_relaxed);
+		// EAGAIN: signalled before we slept, EINTR: try again
+		if (err == ETIMEDOUT) return takeSignal(state, manual) ? OSEvent_Error_None : OSEvent_Error_TimedOut;
+		if (err && err != EAGAIN && err != EINTR) return OSEvent_Error_Unknown;
+	}
+	return OSEvent_Error_None;
+}
+#endif
+
 OSEvent::OSEvent(int &sts, bool manual, bool state)
 {
 #ifdef _WIN32
 	sts = 0;
 	m_event = CreateEvent(NULL, manual, state, NULL);
 	if (!m_event) sts = -1;
+#elif defined(OSEVENT_FUTEX)
+	sts = 0;
+
+	m_manual = manual;
+	m_state = state ? 1 : 0;
+	m_waiters = 0;
 #else
 	sts = 0;
 
@@ -22,7 +77,7 @@ OSEvent::~OSEvent(void)
 {
 #ifdef _WIN32
 	if (m_event) CloseHandle(m_event);
-#else
+#elif !defined(OSEVENT_FUTEX)
 	pthread_cond_destroy(&m_event);
 	pthread_mutex_destroy(&m_mutex);
 #endif
@@ -32,6 +87,11 @@ void OSEvent::Signal(void)
 {
 #ifdef _WIN32
 	if (m_event) SetEvent(m_event);
+#elif defined(OSEVENT_FUTEX)
+	if (m_state.exchange(1, std::memory_order_seq_cst) == 0 && m_waiters.load(std::memory_order_seq_cst) > 0)
+	{
+		futexWake(m_state, m_manual ? INT_MAX : 1);
+	}
 #else
 	int res = pthread_mutex_lock(&m_mutex);
 	if (!res)
@@ -51,6 +111,8 @@ void OSEvent::Reset(void)
 {
 #ifdef _WIN32
 	if (m_event) ResetEvent(m_event);
+#elif defined(OSEVENT_FUTEX)
+	m_state.store(0, std::memory_order_relaxed);
 #else
 	int res = pthread_mutex_lock(&m_mutex);
 	if (!res)
@@ -65,6 +127,8 @@ void OSEvent::Wait(void)
 {
 #ifdef _WIN32
 	if (m_event) WaitForSingleObject(m_event, INFINITE);
+#elif defined(OSEVENT_FUTEX)
+	futexTimedWait(m_state, m_waiters, m_manual, NULL);
 #else
 	int res = pthread_mutex_lock(&m_mutex);
 	if (!res)
@@ -97,6 +161,20 @@ OSEventError OSEvent::TimedWait(unsigned msec)
 	}
 
 	return res;
+#elif defined(OSEVENT_FUTEX)
+	if (0xFFFFFFFF == msec) return OSEvent_Error_Unsupported;
+	if (takeSignal(m_state, m_manual)) return OSEvent_Error_None;
+
+	// monotonic, so setting the wall clock cannot cut a wait short or stretch it
+	struct timespec deadline;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += msec / 1000;
+	deadline.tv_nsec += (long)(msec % 1000) * 1000000;
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+	return futexTimedWait(m_state, m_waiters, m_manual, &deadline);
 #else
 	if (0xFFFFFFFF == msec) return OSEvent_Error_Unsupported;
 	OSEventError res = OSEvent_Error_NotInitialized;
@@ -133,3 +211,85 @@ OSEventError OSEvent::TimedWait(unsigned msec)
 #endif
 }
 
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+OSPollableEvent::OSPollableEvent(void)
+{
+	m_fd = -1;
+	m_writeFd = -1;
+}
+
+OSPollableEvent::~OSPollableEvent(void)
+{
+	int fd = m_fd.load();
+	int writeFd = m_writeFd.load();
+	if (fd >= 0) close(fd);
+	if (writeFd >= 0 && writeFd != fd) close(writeFd);
+}
+
+int OSPollableEvent::GetFd(void)
+{
+	int fd = m_fd.load(std::memory_order_acquire);
+	if (fd >= 0) return fd;
+
+	int fds[2];
+#ifdef __linux__
+	fds[0] = fds[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (fds[0] < 0) return -1;
+#else
+	if (pipe(fds) < 0) return -1;
+	for (int k = 0; k < 2; k++)
+	{
+		fcntl(fds[k], F_SETFL, fcntl(fds[k], F_GETFL) | O_NONBLOCK);
+		fcntl(fds[k], F_SETFD, FD_CLOEXEC);
+	}
+#endif
+
+	// someone else may be creating it at the same time, first one wins
+	int expected = -1;
+	if (!m_writeFd.compare_exchange_strong(expected, fds[1]))
+	{
+		close(fds[0]);
+		if (fds[1] != fds[0]) close(fds[1]);
+		while ((fd = m_fd.load(std::memory_order_acquire)) < 0) ;
+		return fd;
+	}
+	m_fd.store(fds[0], std::memory_order_release);
+	return fds[0];
+}
+
+void OSPollableEvent::Signal(void)
+{
+	int writeFd = m_writeFd.load(std::memory_order_acquire);
+	if (writeFd < 0) return;
+#ifdef __linux__
+	uint64_t one = 1;
+	ssize_t r = write(writeFd, &one, sizeof(one));
+#else
+	// a full pipe is still readable, nothing is lost by dropping the byte
+	char one = 1;
+	ssize_t r = write(writeFd, &one, sizeof(one));
+#endif
+	(void)r;
+}
+
+void OSPollableEvent::Reset(void)
+{
+	int fd = m_fd.load(std::memory_order_acquire);
+	if (fd < 0) return;
+#ifdef __linux__
+	uint64_t count;
+	ssize_t r = read(fd, &count, sizeof(count));
+	(void)r;
+#else
+	char buf[64];
+	while (read(fd, buf, sizeof(buf)) > 0) ;
+#endif
+}
+#endif
@@ -3,9 +3,15 @@
 
 #ifdef _WIN32
 # include <windows.h>
+#elif defined(__linux__) && !defined(OSEVENT_PTHREAD)
+// a futex on the state word: Signal is one atomic exchange unless a thread is waiting
+# define OSEVENT_FUTEX
 #else
 # include <pthread.h>
 #endif
+#ifndef _WIN32
+# include <atomic>
+#endif
 
 enum OSEventError {
 	OSEvent_Error_Unsupported = -1,
@@ -29,6 +35,10 @@ public:
 private:
 #ifdef _WIN32
 	void* m_event;
+#elif defined(OSEVENT_FUTEX)
+	bool m_manual;
+	std::atomic<int> m_state;
+	std::atomic<int> m_waiters;
 #else
 	bool m_manual;
 	bool m_state;
@@ -37,4 +47,29 @@ private:
 #endif
 };
 
+#ifndef _WIN32
+// A file descriptor that is readable while the event is signalled, for poll/epoll/kqueue
+// loops that watch many sources at once: an eventfd on Linux, a pipe elsewhere. The fd is
+// created by the first GetFd, so Signal costs nothing until someone polls.
+class OSPollableEvent
+{
+public:
+	OSPollableEvent(void);
+	~OSPollableEvent(void);
+
+	int GetFd(void);
+	void Signal(void);
+	// drains the fd; reset before looking for the work the fd announces, or a signal can be lost
+	void Reset(void);
+
+private:
+	std::atomic<int> m_fd;
+	std::atomic<int> m_writeFd;
+
+	//disable copy constructor and assignment operator
+	OSPollableEvent(const OSPollableEvent&);
+	void operator=(const OSPollableEvent&);
+};
+#endif
+
 #endif